@@ -1,10 +1,38 @@
 #include <SFML/Graphics.hpp>
 #include <SFML/Audio.hpp>
+#include <SFML/Network.hpp>
 #include <iostream>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <cmath>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <iomanip>
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 // ==================== BUTTON CLASS ==================== //
 
 // This class makes a clickable button with text, which changes color when hovered or clicked.
@@ -93,41 +121,49 @@ public:
     sf::Text &getText() { return text; }
 };
 
-// ==================== PET CLASS ==================== //
-
-// This class defines a game pet that has stats like HP, speed, and level, and can level up with training points.
-// It uses encapsulation to manage pet data and behavior, and polymorphism so different pets can customize setup and texture.
-class Pet
+// Base stats and per-level growth of one species, the balance sweep reads and swaps these without touching the species table.
+struct SpeciesStats
 {
-protected:
-    sf::Texture texture;
-    sf::Sprite sprite;
-    sf::Text nameText;
-    sf::Text infoText;
-    sf::RectangleShape background;
-    sf::RectangleShape highlight;
-    std::string name;
-    std::string type;
-    std::string ability;
-    int level;
-    int hp;
-    int attack;
-    int speed;
-    int trainingPoints;
-    sf::Vector2f position;
-    bool isSelected;
-    static constexpr float IMAGE_SIZE = 180.f;
-
-    const int MAX_LEVEL = 3;
-
     int baseHP;
     int baseAttack;
     int baseSpeed;
     float hpGrowth;
     float attackGrowth;
     float speedGrowth;
+};
+
+// Progress of one pet, the only part that differs between two pets of the same species.
+// Version 1 of the pet store writes these 4 bytes, later versions append new fields.
+struct PetRecord
+{
+    uint8_t speciesId;
+    uint8_t level;
+    uint16_t trainingPoints;
+};
+
+// Everything that is the same for every pet of a species, the strings are built once so getters can hand out references.
+struct SpeciesInfo
+{
+    std::string name;
+    std::string type;
+    std::string ability;
+    std::string texturePath;
+    SpeciesStats stats;
+    std::string projectilePath;
+    sf::Color projectileColor; // placeholder when the projectile picture is missing
+    sf::Vector2f bodySize;     // the shipped pictures at the scale the battles draw them, the rules use these so a missing file changes nothing
+    sf::Vector2f shotSize;
+};
+
+// ==================== SPECIES CLASS ==================== //
 
-    void removeWhiteBackground(sf::Image &image)
+// Shared read-only table of the four species, their names, textures and stat curves exist once however many pets there are.
+// It uses the Flyweight pattern, a pet is just a PetRecord and every species question is answered from the table.
+class Species
+{
+private:
+    // near-white pixels become transparent, a picture with none of them falls back to masking pure white
+    static void keyWhiteBackground(sf::Image &image)
     {
         bool hasTransparency = false;
         for (unsigned int y = 0; y < image.getSize().y; ++y)
@@ -149,330 +185,442 @@ protected:
         }
     }
 
-    void updateStatsText()
+public:
+    enum Id
     {
-        std::string stats =
-            "Type:      " + type + "\n" +
-            "Ability:   " + ability + "\n" +
-            "Level:     " + std::to_string(level) +
-            " (TP: " + std::to_string(trainingPoints) +
-            "/" + std::to_string(calculateRequiredTP()) + ")\n" +
-            "HP:        " + std::to_string(hp) + " (+" +
-            std::to_string(static_cast<int>(baseHP * pow(hpGrowth, level - 1) - baseHP)) + ")\n" +
-            "Attack:    " + std::to_string(attack) + " (+" +
-            std::to_string(static_cast<int>(baseAttack * pow(attackGrowth, level - 1) - baseAttack)) + ")\n" +
-            "Speed:     " + std::to_string(speed) + " (+" +
-            std::to_string(static_cast<int>(baseSpeed * pow(speedGrowth, level - 1) - baseSpeed)) + ")";
+        DRAGON,
+        PHOENIX,
+        GRIFFIN,
+        UNICORN,
+        COUNT
+    };
 
-        infoText.setString(stats);
-    }
+    static const int MAX_LEVEL = 3;
 
-public:
-    Pet() : level(1), trainingPoints(0), // constructor
-            baseHP(100), baseAttack(10), baseSpeed(5),
-            hpGrowth(1.2f), attackGrowth(1.1f), speedGrowth(1.05f)
+    // an unknown id reads as a Dragon, like an unknown name did in the old text saves
+    static const SpeciesInfo &info(int id)
     {
-        updateStats();
+        static const SpeciesInfo table[COUNT] = {
+            {"Dragon", "Fire", "Fireball", "dragon1.png", {120, 15, 4, 1.25f, 1.15f, 1.03f}, "fire1.png", sf::Color(255, 150, 0), {78, 47}, {27, 21}},
+            {"Phoenix", "Ice", "Freeze", "phoneix1.png", {90, 12, 7, 1.15f, 1.1f, 1.08f}, "ice1.png", sf::Color(100, 200, 255), {78, 47}, {16, 20}},
+            {"Griffin", "Electric", "Lightning", "griffin1.png", {100, 10, 6, 1.15f, 1.1f, 1.00f}, "lightning.png", sf::Color(255, 255, 100), {65, 71}, {44, 40}},
+            {"Unicorn", "Magic", "Healing", "unicorn1.png", {110, 8, 5, 1.15f, 1.1f, 1.1f}, "magic.png", sf::Color(200, 100, 255), {141, 77}, {19, 21}}};
+        return table[(id >= 0 && id < COUNT) ? id : DRAGON];
     }
 
-    virtual ~Pet() {} // polymorphism used
-
-    virtual void setup(const sf::Font &font) = 0;
-
-    virtual std::string getTexturePath() const = 0;
-
-    void updateStats()
+    // case does not matter, -1 when no species has that name
+    static int find(const std::string &name)
     {
-        hp = static_cast<int>(baseHP * pow(hpGrowth, level - 1));
-        attack = static_cast<int>(baseAttack * pow(attackGrowth, level - 1));
-        speed = static_cast<int>(baseSpeed * pow(speedGrowth, level - 1));
+        for (int id = 0; id < COUNT; id++)
+        {
+            const std::string &species = info(id).name;
+            if (species.size() == name.size() && std::equal(species.begin(), species.end(), name.begin(), [](char a, char b)
+                                                            { return tolower(static_cast<unsigned char>(a)) == tolower(static_cast<unsigned char>(b)); }))
+                return id;
+        }
+        return -1;
     }
 
-    void setPosition(float posX, float posY)
+    // a level of 0 from an old record counts as 1, TP stops at what the save format holds
+    static PetRecord record(int id, int level = 1, int trainingPoints = 0)
     {
-        position.x = posX;
-        position.y = posY;
-        background.setPosition(position);
-        highlight.setPosition(position.x - 5, position.y - 5);
-
-        float imageX = position.x + 20.f;
-        float imageY = position.y + (background.getSize().y - sprite.getGlobalBounds().height) / 2;
-        sprite.setPosition(imageX, imageY);
-
-        float textX = position.x + 180.f + 30.f;
-        nameText.setPosition(textX, position.y + 20);
-        infoText.setPosition(textX, position.y + 60);
+        PetRecord pet;
+        pet.speciesId = static_cast<uint8_t>((id >= 0 && id < COUNT) ? id : DRAGON);
+        pet.level = static_cast<uint8_t>(std::max(1, std::min(level, static_cast<int>(MAX_LEVEL))));
+        pet.trainingPoints = static_cast<uint16_t>(std::max(0, std::min(trainingPoints, 65535)));
+        return pet;
     }
 
-    void gainExperience(int amount)
+    // loaded and keyed the first time a pet of the species is drawn, every sprite of that species then points at it
+    static const sf::Texture &texture(int id)
     {
-        int requiredTP = calculateRequiredTP();
-        trainingPoints += amount;
+        static sf::Texture textures[COUNT];
+        static bool loaded[COUNT] = {false, false, false, false};
+        const SpeciesInfo &species = info(id);
+        int key = record(id).speciesId;
+        if (!loaded[key])
+        {
+            sf::Image image;
+            if (image.loadFromFile(species.texturePath))
+            {
+                keyWhiteBackground(image);
+            }
+            else
+            {
+                std::cerr << "Error loading pet texture: " << species.texturePath << std::endl;
+                image.create(64, 64, sf::Color::Magenta);
+            }
+            textures[key].loadFromImage(image);
+            textures[key].setSmooth(true);
+            loaded[key] = true;
+        }
+        return textures[key];
+    }
 
-        while (trainingPoints >= requiredTP && level < MAX_LEVEL)
+    // the species' shot, shared the same way, a coloured bar stands in for a missing picture
+    static const sf::Texture &projectileTexture(int id)
+    {
+        static sf::Texture textures[COUNT];
+        static bool loaded[COUNT] = {false, false, false, false};
+        const SpeciesInfo &species = info(id);
+        int key = record(id).speciesId;
+        if (!loaded[key])
         {
-            levelUp();
-            trainingPoints -= requiredTP;
-            requiredTP = calculateRequiredTP();
+            if (!textures[key].loadFromFile(species.projectilePath))
+            {
+                sf::Image placeholder;
+                placeholder.create(50, 20, species.projectileColor);
+                textures[key].loadFromImage(placeholder);
+            }
+            loaded[key] = true;
         }
+        return textures[key];
     }
 
-    void levelUp()
+    static int hp(const SpeciesStats &stats, int level) { return static_cast<int>(stats.baseHP * pow(stats.hpGrowth, level - 1)); }
+    static int attack(const SpeciesStats &stats, int level) { return static_cast<int>(stats.baseAttack * pow(stats.attackGrowth, level - 1)); }
+    static int speed(const SpeciesStats &stats, int level) { return static_cast<int>(stats.baseSpeed * pow(stats.speedGrowth, level - 1)); }
+
+    // "Griffin:2" or just "Griffin", how a pet is given on the command line, false for an unknown species
+    static bool parse(const std::string &text, PetRecord &pet)
     {
-        level++;
-        updateStats();
+        size_t colon = text.find(':');
+        int id = find(text.substr(0, colon));
+        if (id < 0)
+            return false;
+        pet = record(id, colon == std::string::npos ? 1 : atoi(text.c_str() + colon + 1));
+        return true;
     }
 
-    int calculateRequiredTP() const
+    static int requiredTP(int level)
     {
         return static_cast<int>(100 * pow(1.2, level - 1));
     }
-                                                                    // getter
-    sf::Vector2f getPosition() const { return position; }
-    void setSelected(bool selected) { isSelected = selected; }
-    sf::FloatRect getBounds() const { return background.getGlobalBounds(); }
-    std::string getName() const { return name; }
-    std::string getType() const { return type; }
-    std::string getAbility() const { return ability; }
-    int getLevel() const { return level; }
-    int getHP() const { return hp; }
-    int getAttack() const { return attack; }
-    int getSpeed() const { return speed; }
-    int getTrainingPoints() const { return trainingPoints; }
-    sf::Sprite &getSprite() { return sprite; }
 
-    virtual void draw(sf::RenderWindow &window)
+    // levels up as long as the points cover the next level, the rest carries over
+    static void gainExperience(PetRecord &pet, int amount)
     {
-        window.draw(background);
-        window.draw(sprite);
-        window.draw(nameText);
-        window.draw(infoText);
-
-        if (isSelected)
+        int level = pet.level;
+        int points = pet.trainingPoints + amount;
+        int required = requiredTP(level);
+        while (points >= required && level < MAX_LEVEL)
         {
-            window.draw(highlight);
+            level++;
+            points -= required;
+            required = requiredTP(level);
         }
+        pet = record(pet.speciesId, level, points);
     }
+};
 
+// ==================== PET CLASS ==================== //
+
+// This class defines a game pet that has stats like HP, speed, and level, and can level up with training points.
+// It uses encapsulation to manage pet data and behavior, and polymorphism so different pets can customize their texture.
+// Species data and textures are shared through the Species table, a Pet only owns its progress, the windows draw it with a PetCard.
+class Pet
+{
 protected:
-    void setupCommon(const sf::Font &font, const std::string &textureFile)
-    {
-        if (!texture.loadFromFile(textureFile))
-        {
-            std::cerr << "Error loading pet texture: " << textureFile << std::endl;
-            sf::Image placeholder;
-            placeholder.create(64, 64, sf::Color::Magenta);
-            texture.loadFromImage(placeholder);
-        }
-        else
-        {
-            sf::Image img = texture.copyToImage();
-            removeWhiteBackground(img);
-            texture.loadFromImage(img);
-        }
+    const SpeciesInfo *species;
+    PetRecord progress;
 
-        texture.setSmooth(true);
-        sprite.setTexture(texture, true);
+public:
+    explicit Pet(int speciesId) : species(&Species::info(speciesId)), progress(Species::record(speciesId)) // constructor
+    {
+    }
 
-        const float BOX_WIDTH = 450.f;
-        const float BOX_HEIGHT = 250.f;
-        const float IMAGE_AREA_WIDTH = 180.f;
-        const float PADDING = 20.f;
+    virtual ~Pet() {} // polymorphism used
 
-        sf::FloatRect spriteBounds = sprite.getLocalBounds();
-        float scale = std::min(
-            (IMAGE_AREA_WIDTH - 2 * PADDING) / spriteBounds.width,
-            (BOX_HEIGHT - 2 * PADDING) / spriteBounds.height);
-        sprite.setScale(scale, scale);
+    virtual std::string getTexturePath() const = 0;
 
-        background.setSize(sf::Vector2f(BOX_WIDTH, BOX_HEIGHT));
-        background.setFillColor(sf::Color(30, 30, 50, 240));
-        background.setOutlineThickness(3.f);
-        background.setOutlineColor(sf::Color(255, 200, 100));
+    void gainExperience(int amount)
+    {
+        Species::gainExperience(progress, amount);
+    }
 
-        highlight.setSize(sf::Vector2f(BOX_WIDTH + 10, BOX_HEIGHT + 10));
-        highlight.setFillColor(sf::Color::Transparent);
-        highlight.setOutlineThickness(3.f);
-        highlight.setOutlineColor(sf::Color(255, 100, 100, 200));
+    void levelUp()
+    {
+        progress = Species::record(progress.speciesId, progress.level + 1, progress.trainingPoints);
+    }
 
-        nameText.setFont(font);
-        nameText.setString(name);
-        nameText.setStyle(sf::Text::Bold | sf::Text::Underlined);
-        nameText.setCharacterSize(34);
-        nameText.setFillColor(sf::Color(255, 225, 150));
-        nameText.setOutlineThickness(2.f);
-        nameText.setOutlineColor(sf::Color::Black);
+    // restores saved progress, a level of 0 from an old record counts as 1
+    void setProgress(int savedLevel, int savedTP)
+    {
+        progress = Species::record(progress.speciesId, savedLevel, savedTP);
+    }
 
-        infoText.setFont(font);
-        infoText.setCharacterSize(20);
-        infoText.setFillColor(sf::Color(220, 240, 255));
-        infoText.setOutlineThickness(1.f);
-        infoText.setOutlineColor(sf::Color::Black);
-        infoText.setLineSpacing(1.2f);
-        updateStatsText();
+    int calculateRequiredTP() const
+    {
+        return Species::requiredTP(progress.level);
     }
+                                                                    // getter
+    const std::string &getName() const { return species->name; }
+    const std::string &getType() const { return species->type; }
+    const std::string &getAbility() const { return species->ability; }
+    const PetRecord &getProgress() const { return progress; }
+    int getSpeciesId() const { return progress.speciesId; }
+    int getLevel() const { return progress.level; }
+    int getHP() const { return Species::hp(species->stats, progress.level); }
+    int getAttack() const { return Species::attack(species->stats, progress.level); }
+    int getSpeed() const { return Species::speed(species->stats, progress.level); }
+    int getTrainingPoints() const { return progress.trainingPoints; }
 };
 
 // --------------- Dragon Class ----------------//
 
 // This class creates a specific pet called Dragon with fire type and special fireball ability.
-// It uses inheritance to extend the Pet class and override setup details like texture and stats.
+// It uses inheritance to extend the Pet class and override its texture.
 class Dragon : public Pet
 {
 public:
-    Dragon()                // constructor
-    {
-        name = "Dragon";
-        type = "Fire";
-        ability = "Fireball";
-        baseHP = 120;
-        baseAttack = 15;
-        baseSpeed = 4;
-        hpGrowth = 1.25f;
-        attackGrowth = 1.15f;
-        speedGrowth = 1.03f;
-        updateStats();
-    }
-
-    void setup(const sf::Font &font) override
+    Dragon() : Pet(Species::DRAGON)                // constructor
     {
-        setupCommon(font, "dragon1.png");
     }
 
-    std::string getTexturePath() const override { return "dragon1.png"; }               // getter
+    std::string getTexturePath() const override { return species->texturePath; }               // getter
 };
 
 //-------- Phoneix Class --------------------//
 
 // This class creates a specific pet Phoneix with ice type and special freeze ability.
-// It uses inheritance to extend the Pet class and override setup details like texture and stats.
+// It uses inheritance to extend the Pet class and override its texture.
 class Phoenix : public Pet
 {
 public:
-    Phoenix()                                           // constructor
-    {
-        name = "Phoenix";
-        type = "Ice";
-        ability = "Freeze";
-        baseHP = 90;
-        baseAttack = 12;
-        baseSpeed = 7;
-        hpGrowth = 1.15f;
-        attackGrowth = 1.1f;
-        speedGrowth = 1.08f;
-        updateStats();
-    }
-    void setup(const sf::Font &font) override
+    Phoenix() : Pet(Species::PHOENIX)                                           // constructor
     {
-        setupCommon(font, "phoneix1.png");
     }
     // getter
-    std::string getTexturePath() const override { return "phoneix1.png"; }
+    std::string getTexturePath() const override { return species->texturePath; }
 };
 
 //---------- Griffin Class --------------//
 
 // This class creates a specific pet cGriffin with electric type and special flightning ability.
-// It uses inheritance to extend the Pet class and override setup details like texture and stats.
+// It uses inheritance to extend the Pet class and override its texture.
 class Griffin : public Pet
 {
 public:
-    Griffin() // constructor
+    Griffin() : Pet(Species::GRIFFIN) // constructor
     {
-        name = "Griffin";
-        type = "Electric";
-        ability = "Lightning";
-        baseHP = 100;
-        baseAttack = 10;
-        baseSpeed = 6;
-        hpGrowth = 1.15f;
-        attackGrowth = 1.1f;
-        speedGrowth = 1.00f;
-        updateStats();
     }
-    void setup(const sf::Font &font) override
-    {
-        setupCommon(font, "griffin1.png");
-    }
-
-    std::string getTexturePath() const override { return "griffin1.png"; } // getter
+    std::string getTexturePath() const override { return species->texturePath; } // getter
 };
 
 //------------ Unicorn Class ---------------//
 
 // This class creates a specific pet Unicorn with magic type and special healing ability.
-// It uses inheritance to extend the Pet class and override setup details like texture and stats.
+// It uses inheritance to extend the Pet class and override its texture.
 class Unicorn : public Pet
 {
 public:
-    Unicorn()                               // constructor
+    Unicorn() : Pet(Species::UNICORN)                               // constructor
+    {
+    }
+    std::string getTexturePath() const override { return species->texturePath; } // getter
+};
+
+// ==================== ENEMY POOL CLASS ==================== //
+
+// Hands out enemy pets for battles, each species and slot is built once and the same instance comes back every battle.
+// It uses the Factory pattern to turn a species id into the right subclass, and composition to own what it built.
+class EnemyPool
+{
+private:
+    static const int SLOTS = 2; // a 2v2 can draw the same species twice
+    Pet *pets[Species::COUNT][SLOTS];
+
+public:
+    EnemyPool() // constructor
+    {
+        for (int id = 0; id < Species::COUNT; id++)
+        {
+            for (int slot = 0; slot < SLOTS; slot++)
+                pets[id][slot] = nullptr;
+        }
+    }
+
+    ~EnemyPool() // destructor
+    {
+        for (int id = 0; id < Species::COUNT; id++)
+        {
+            for (int slot = 0; slot < SLOTS; slot++)
+                delete pets[id][slot];
+        }
+    }
+
+    EnemyPool(const EnemyPool &) = delete;
+    EnemyPool &operator=(const EnemyPool &) = delete;
+
+    static Pet *create(int speciesId)
+    {
+        switch (speciesId)
+        {
+        case Species::PHOENIX:
+            return new Phoenix();
+        case Species::GRIFFIN:
+            return new Griffin();
+        case Species::UNICORN:
+            return new Unicorn();
+        default:
+            return new Dragon();
+        }
+    }
+
+    // battles only read species data and progress from an enemy, so a pooled pet comes back at level 1
+    Pet *acquire(int speciesId, int slot)
+    {
+        int id = Species::record(speciesId).speciesId;
+        slot = std::max(0, std::min(slot, SLOTS - 1));
+        if (!pets[id][slot])
+            pets[id][slot] = create(id);
+        pets[id][slot]->setProgress(1, 0);
+        return pets[id][slot];
+    }
+};
+
+// ==================== PET CARD CLASS ==================== //
+
+// This class draws one pet's box, its picture, name and stats, from a PetRecord at draw time.
+// It uses composition, a window owns one card and draws it once per pet, so the pets themselves stay plain records.
+class PetCard
+{
+public:
+    static constexpr float WIDTH = 450.f;
+    static constexpr float HEIGHT = 250.f;
+
+private:
+    static constexpr float IMAGE_AREA_WIDTH = 180.f;
+    static constexpr float PADDING = 20.f;
+
+    sf::Sprite sprite;
+    sf::Text nameText;
+    sf::Text infoText;
+    sf::RectangleShape background;
+    sf::RectangleShape highlight;
+
+    // what a stat gained over level 1
+    static int growth(int base, float rate, int level)
+    {
+        return static_cast<int>(base * pow(rate, level - 1) - base);
+    }
+
+    static std::string statsText(const PetRecord &pet)
+    {
+        const SpeciesInfo &species = Species::info(pet.speciesId);
+        const SpeciesStats &base = species.stats;
+        int level = pet.level;
+        return "Type:      " + species.type + "\n" +
+               "Ability:   " + species.ability + "\n" +
+               "Level:     " + std::to_string(level) +
+               " (TP: " + std::to_string(pet.trainingPoints) +
+               "/" + std::to_string(Species::requiredTP(level)) + ")\n" +
+               "HP:        " + std::to_string(Species::hp(base, level)) + " (+" +
+               std::to_string(growth(base.baseHP, base.hpGrowth, level)) + ")\n" +
+               "Attack:    " + std::to_string(Species::attack(base, level)) + " (+" +
+               std::to_string(growth(base.baseAttack, base.attackGrowth, level)) + ")\n" +
+               "Speed:     " + std::to_string(Species::speed(base, level)) + " (+" +
+               std::to_string(growth(base.baseSpeed, base.speedGrowth, level)) + ")";
+    }
+
+public:
+    void setup(const sf::Font &font)
     {
-        name = "Unicorn";
-        type = "Magic";
-        ability = "Healing";
-        baseHP = 110;
-        baseAttack = 8;
-        baseSpeed = 5;
-        hpGrowth = 1.15f;
-        attackGrowth = 1.1f;
-        speedGrowth = 1.1f;
-        updateStats();
+        background.setSize(sf::Vector2f(WIDTH, HEIGHT));
+        background.setFillColor(sf::Color(30, 30, 50, 240));
+        background.setOutlineThickness(3.f);
+        background.setOutlineColor(sf::Color(255, 200, 100));
+
+        highlight.setSize(sf::Vector2f(WIDTH + 10, HEIGHT + 10));
+        highlight.setFillColor(sf::Color::Transparent);
+        highlight.setOutlineThickness(3.f);
+        highlight.setOutlineColor(sf::Color(255, 100, 100, 200));
+
+        nameText.setFont(font);
+        nameText.setStyle(sf::Text::Bold | sf::Text::Underlined);
+        nameText.setCharacterSize(34);
+        nameText.setFillColor(sf::Color(255, 225, 150));
+        nameText.setOutlineThickness(2.f);
+        nameText.setOutlineColor(sf::Color::Black);
+
+        infoText.setFont(font);
+        infoText.setCharacterSize(20);
+        infoText.setFillColor(sf::Color(220, 240, 255));
+        infoText.setOutlineThickness(1.f);
+        infoText.setOutlineColor(sf::Color::Black);
+        infoText.setLineSpacing(1.2f);
     }
-    void setup(const sf::Font &font) override
+
+    // the box a card drawn at `position` covers, windows hit-test their pets with it
+    static sf::FloatRect bounds(const sf::Vector2f &position)
     {
-        setupCommon(font, "unicorn1.png");
+        return sf::FloatRect(position.x, position.y, WIDTH, HEIGHT);
     }
 
-    std::string getTexturePath() const override { return "unicorn1.png"; } // getter
+    void draw(sf::RenderWindow &window, const PetRecord &pet, const sf::Vector2f &position, bool selected)
+    {
+        sprite.setTexture(Species::texture(pet.speciesId), true);
+        sf::FloatRect spriteBounds = sprite.getLocalBounds();
+        float scale = std::min(
+            (IMAGE_AREA_WIDTH - 2 * PADDING) / spriteBounds.width,
+            (HEIGHT - 2 * PADDING) / spriteBounds.height);
+        sprite.setScale(scale, scale);
+        nameText.setString(Species::info(pet.speciesId).name);
+        infoText.setString(statsText(pet));
+
+        background.setPosition(position);
+        highlight.setPosition(position.x - 5, position.y - 5);
+        sprite.setPosition(position.x + PADDING, position.y + (HEIGHT - sprite.getGlobalBounds().height) / 2);
+        float textX = position.x + IMAGE_AREA_WIDTH + 30.f;
+        nameText.setPosition(textX, position.y + 20);
+        infoText.setPosition(textX, position.y + 60);
+
+        window.draw(background);
+        window.draw(sprite);
+        window.draw(nameText);
+        window.draw(infoText);
+        if (selected)
+            window.draw(highlight);
+    }
 };
 
 // ==================== PET SELECTION WINDOW CLASS==================== //
 
 // This class shows a window where players can pick one pet from a list of options.
-// It uses composition and dynamic memory, managing buttons, pets, and user interaction.
+// It uses composition, holding each pet's record and one PetCard that draws them all, plus the buttons and user interaction.
 class PetSelectionWindow
 {
 private:
-    static const int MAX_PETS = 4;
+    static const int MAX_PETS = Species::COUNT;
     sf::RectangleShape window;
     sf::RectangleShape backgroundDim;
     sf::Text title;
     Button closeButton;
     Button selectButton;
-    Pet *pets[MAX_PETS];
+    PetRecord pets[MAX_PETS]; // indexed by species id
+    sf::Vector2f slots[MAX_PETS]; // relative to the window
+    PetCard card;
     bool isActive;
     sf::Font font;
     int selectedPet;
-    int petCount;
-
-    void initializePets()
-    {
-        pets[0] = new Dragon();
-        pets[1] = new Phoenix();
-        pets[2] = new Griffin();
-        pets[3] = new Unicorn();
-        petCount = MAX_PETS;
-    }
+    int hoveredPet;
 
-    void cleanupPets()
+    // the pet whose card is under the mouse, or -1
+    int petAt(const sf::Vector2f &mousePos) const
     {
-        for (int i = 0; i < petCount; i++)
+        for (int i = 0; i < MAX_PETS; i++)
         {
-            delete pets[i];
-            pets[i] = nullptr;
+            if (PetCard::bounds(slots[i]).contains(mousePos))
+                return i;
         }
-        petCount = 0;
+        return -1;
     }
 
 public:
-    PetSelectionWindow() : isActive(false), selectedPet(-1), petCount(0) // constructor
-    {
-        initializePets();
-    }
-
-    ~PetSelectionWindow()                           // destructor
+    PetSelectionWindow() : isActive(false), selectedPet(-1), hoveredPet(-1) // constructor
     {
-        cleanupPets();
+        for (int i = 0; i < MAX_PETS; i++)
+            pets[i] = Species::record(i);
     }
 
     void setup(const sf::Font &gameFont)
@@ -512,19 +660,16 @@ public:
                               sf::Color(150, 250, 150),
                               sf::Color(50, 150, 50));
 
-        for (int i = 0; i < petCount; i++)
-        {
-            pets[i]->setup(font);
-        }
+        card.setup(font);
 
         float startX = HORIZONTAL_SPACING;
         float startY = VERTICAL_SPACING + 50;
 
-        pets[0]->setPosition(startX, startY);
-        pets[1]->setPosition(startX + BOX_WIDTH + HORIZONTAL_SPACING, startY);
-        pets[2]->setPosition(startX, startY + BOX_HEIGHT + VERTICAL_SPACING);
-        pets[3]->setPosition(startX + BOX_WIDTH + HORIZONTAL_SPACING,
-                             startY + BOX_HEIGHT + VERTICAL_SPACING);
+        slots[0] = sf::Vector2f(startX, startY);
+        slots[1] = sf::Vector2f(startX + BOX_WIDTH + HORIZONTAL_SPACING, startY);
+        slots[2] = sf::Vector2f(startX, startY + BOX_HEIGHT + VERTICAL_SPACING);
+        slots[3] = sf::Vector2f(startX + BOX_WIDTH + HORIZONTAL_SPACING,
+                                startY + BOX_HEIGHT + VERTICAL_SPACING);
 
         float closeButtonX = (window.getSize().x - closeButton.getBounds().width) / 2 - 120;
         float selectButtonX = (window.getSize().x - selectButton.getBounds().width) / 2 + 120;
@@ -538,10 +683,7 @@ public:
     {
         isActive = true;
         selectedPet = -1;
-        for (int i = 0; i < petCount; i++)
-        {
-            pets[i]->setSelected(false);
-        }
+        hoveredPet = -1;
     }
 
     void close() { isActive = false; }
@@ -553,31 +695,14 @@ public:
         closeButton.update(mousePos);
         selectButton.update(mousePos);
 
-        if (sf::Mouse::isButtonPressed(sf::Mouse::Left))
+        hoveredPet = petAt(mousePos);
+        if (hoveredPet != -1)
         {
-            bool clickedOnPet = false;
-            for (int i = 0; i < petCount; i++)
-            {
-                if (pets[i]->getBounds().contains(mousePos))
-                {
-                    clickedOnPet = true;
-                    break;
-                }
-            }
-            if (!clickedOnPet)
-            {
-                selectedPet = -1;
-            }
+            selectedPet = hoveredPet;
         }
-
-        for (int i = 0; i < petCount; i++)
+        else if (sf::Mouse::isButtonPressed(sf::Mouse::Left))
         {
-            pets[i]->setSelected(false);
-            if (pets[i]->getBounds().contains(mousePos))
-            {
-                selectedPet = i;
-                pets[i]->setSelected(true);
-            }
+            selectedPet = -1;
         }
 
         selectButton.setActive(selectedPet != -1);
@@ -595,15 +720,11 @@ public:
             }
             else
             {
-
-                for (int i = 0; i < petCount; i++)
+                int pet = petAt(mousePos);
+                if (pet != -1)
                 {
-                    if (pets[i]->getBounds().contains(mousePos))
-                    {
-                        selectedPet = i;
-                        close();
-                        return;
-                    }
+                    selectedPet = pet;
+                    close();
                 }
             }
         }
@@ -627,77 +748,63 @@ public:
         targetWindow.draw(window);
         targetWindow.draw(title);
 
-        for (int i = 0; i < petCount; i++)
+        for (int i = 0; i < MAX_PETS; i++)
         {
-            sf::Vector2f originalPos = pets[i]->getPosition();
-            pets[i]->setPosition(window.getPosition().x + originalPos.x,
-                                 window.getPosition().y + originalPos.y);
-            pets[i]->draw(targetWindow);
-            pets[i]->setPosition(originalPos.x, originalPos.y);
+            card.draw(targetWindow, pets[i], window.getPosition() + slots[i], i == hoveredPet);
         }
 
         closeButton.draw(targetWindow);
         selectButton.draw(targetWindow);
     }
 
-    Pet *getSelectedPet()
+    // shows a pet's saved progress, `pet.speciesId` picks the card
+    void setPet(const PetRecord &pet)
     {
-        if (selectedPet >= 0 && selectedPet < petCount)
-        {
-            return pets[selectedPet];
-        }
-        return nullptr;
+        pets[Species::record(pet.speciesId).speciesId] = pet;
     }
+
+    // the species id of the picked pet, or -1
+    int getSelectedPet() const { return selectedPet; } // getter
 };
 
 // ==================== PET DISPLAY CLASS ==================== //
 
 // This class manages a display for showing a collection of pets, allowing you to view details or close the window.
-// It uses polymorphism to handle different pet types (like Dragon, Phoenix, etc.) that inherit from a common Pet base class.
+// It uses composition, every species is a PetRecord drawn by the one PetCard, so showing the collection builds no pets.
 class PetDisplay
 {
 private:
-    static const int MAX_PETS = 4;
+    static const int MAX_PETS = Species::COUNT;
 
     sf::RectangleShape window;
     sf::RectangleShape backgroundDim;
     sf::Text title;
     Button closeButton;
     Button viewButton;
-    Pet *pets[MAX_PETS];
+    PetRecord pets[MAX_PETS]; // indexed by species id
+    sf::Vector2f slots[MAX_PETS]; // relative to the window
+    PetCard card;
     bool isActive;
     sf::Font font;
     int selectedPet;
-    int petCount;
-
-    void initializePets()
-    {
-        pets[0] = new Dragon();
-        pets[1] = new Phoenix();
-        pets[2] = new Griffin();
-        pets[3] = new Unicorn();
-        petCount = MAX_PETS;
-    }
+    int hoveredPet;
 
-    void cleanupPets()
+    // the pet whose card is under the mouse, or -1
+    int petAt(const sf::Vector2f &mousePos) const
     {
-        for (int i = 0; i < petCount; i++)
+        for (int i = 0; i < MAX_PETS; i++)
         {
-            delete pets[i];
-            pets[i] = nullptr;
+            if (PetCard::bounds(slots[i]).contains(mousePos))
+                return i;
         }
-        petCount = 0;
+        return -1;
     }
 
 public:
-    PetDisplay() : isActive(false), selectedPet(-1), petCount(0) // constructor
-    {
-        initializePets();
-    }
-
-    ~PetDisplay() // destructor
+    PetDisplay() : isActive(false), selectedPet(-1), hoveredPet(-1) // constructor
     {
-        cleanupPets();
+        for (int i = 0; i < MAX_PETS; i++)
+            pets[i] = Species::record(i);
     }
 
     void setup(const sf::Font &gameFont)
@@ -732,19 +839,16 @@ public:
                              sf::Color(255, 150, 150),
                              sf::Color(200, 50, 50));
 
-        for (int i = 0; i < petCount; i++)
-        {
-            pets[i]->setup(font);
-        }
+        card.setup(font);
 
         float startX = HORIZONTAL_SPACING;
         float startY = VERTICAL_SPACING + 50;
 
-        pets[0]->setPosition(startX, startY);
-        pets[1]->setPosition(startX + BOX_WIDTH + HORIZONTAL_SPACING, startY);
-        pets[2]->setPosition(startX, startY + BOX_HEIGHT + VERTICAL_SPACING);
-        pets[3]->setPosition(startX + BOX_WIDTH + HORIZONTAL_SPACING,
-                             startY + BOX_HEIGHT + VERTICAL_SPACING);
+        slots[0] = sf::Vector2f(startX, startY);
+        slots[1] = sf::Vector2f(startX + BOX_WIDTH + HORIZONTAL_SPACING, startY);
+        slots[2] = sf::Vector2f(startX, startY + BOX_HEIGHT + VERTICAL_SPACING);
+        slots[3] = sf::Vector2f(startX + BOX_WIDTH + HORIZONTAL_SPACING,
+                                startY + BOX_HEIGHT + VERTICAL_SPACING);
 
         float closeButtonX = (window.getSize().x - closeButton.getBounds().width) / 2 - 120;
         float viewButtonX = (window.getSize().x - viewButton.getBounds().width) / 2 + 120;
@@ -763,10 +867,7 @@ public:
     {
         isActive = true;
         selectedPet = -1;
-        for (int i = 0; i < petCount; i++)
-        {
-            pets[i]->setSelected(false);
-        }
+        hoveredPet = -1;
     }
 
     void close() { isActive = false; }
@@ -777,19 +878,10 @@ public:
     {
         closeButton.update(mousePos);
 
-        for (int i = 0; i < petCount; i++)
+        hoveredPet = petAt(mousePos);
+        if (hoveredPet != -1)
         {
-            pets[i]->setSelected(pets[i]->getBounds().contains(mousePos));
-        }
-
-        for (int i = 0; i < petCount; i++)
-        {
-            pets[i]->setSelected(false);
-            if (pets[i]->getBounds().contains(mousePos))
-            {
-                selectedPet = i;
-                pets[i]->setSelected(true);
-            }
+            selectedPet = hoveredPet;
         }
 
         viewButton.setActive(selectedPet != -1);
@@ -807,7 +899,7 @@ public:
             }
             else if (viewButton.contains(mousePos) && selectedPet != -1)
             {
-                std::cout << "Viewing: " << pets[selectedPet]->getName() << std::endl;
+                std::cout << "Viewing: " << Species::info(pets[selectedPet].speciesId).name << std::endl;
             }
         }
     }
@@ -830,1125 +922,7904 @@ public:
         targetWindow.draw(window);
         targetWindow.draw(title);
 
-        for (int i = 0; i < petCount; i++)
+        for (int i = 0; i < MAX_PETS; i++)
         {
-            sf::Vector2f originalPos = pets[i]->getPosition();
-            pets[i]->setPosition(window.getPosition().x + originalPos.x,
-                                 window.getPosition().y + originalPos.y);
-            pets[i]->draw(targetWindow);
-            pets[i]->setPosition(originalPos.x, originalPos.y);
+            card.draw(targetWindow, pets[i], window.getPosition() + slots[i], i == hoveredPet);
         }
 
         closeButton.draw(targetWindow);
         viewButton.draw(targetWindow);
     }
 
-    Pet *getSelectedPet()
+    // shows a pet's saved progress, `pet.speciesId` picks the card
+    void setPet(const PetRecord &pet)
     {
-        if (selectedPet >= 0 && selectedPet < petCount)
-        {
-            return pets[selectedPet];
-        }
-        return nullptr;
+        pets[Species::record(pet.speciesId).speciesId] = pet;
     }
+
+    // the species id of the pet under the mouse last, or -1
+    int getSelectedPet() const { return selectedPet; } // getter
 };
 
-// ==================== USER DATA CLASS ==================== //
+// ==================== LEADERBOARD CLASS ==================== //
 
-// This class handles user data like username, diamonds, pets, and items, loading and saving it to a file.
-// It uses concepts like encapsulation (keeping data private) and file I/O to save and load user information.
-class UserData
+// This class keeps every player's diamonds in memory as a treap where each node also stores its subtree size.
+// It uses encapsulation to hide the tree, so rank lookups and diamond updates both cost O(log n) without touching the file.
+class Leaderboard
 {
 private:
-    std::string filename;
-    std::string username;
-    int diamonds;
-    std::string pets[4];
-    int itemQuantities[5];
-    std::string itemNames[5] = {
-        "Healing Potion",
-        "Mana Potion",
-        "Attack Buff",
-        "Speed Buff",
-        "Shield"};
+    struct Node
+    {
+        std::string username;
+        int diamonds;
+        unsigned int priority;
+        int size;
+        int left;
+        int right;
+    };
 
-public:
-    UserData() : username(""), diamonds(0) // constructor
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    std::map<std::string, int> nodeOf; // username -> node index
+    int root;
+    unsigned int seed;
+    int version; // bumped on every change so views know when to re-read
+
+    unsigned int nextPriority()
     {
-        filename = "user_data.txt";
-        for (int i = 0; i < 4; i++)
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+    int sizeOf(int t) const { return t < 0 ? 0 : nodes[t].size; }
+
+    void pull(int t)
+    {
+        nodes[t].size = 1 + sizeOf(nodes[t].left) + sizeOf(nodes[t].right);
+    }
+
+    // more diamonds rank first, equal diamonds fall back to name order
+    bool comesBefore(const Node &node, int diamonds, const std::string &username) const
+    {
+        if (node.diamonds != diamonds)
+            return node.diamonds > diamonds;
+        return node.username < username;
+    }
+
+    void split(int t, int diamonds, const std::string &username, int &l, int &r)
+    {
+        if (t < 0)
         {
-            pets[i] = "";
+            l = r = -1;
+            return;
         }
-        for (int i = 0; i < 5; i++)
+        if (comesBefore(nodes[t], diamonds, username))
         {
-            itemQuantities[i] = 0;
+            split(nodes[t].right, diamonds, username, nodes[t].right, r);
+            l = t;
+        }
+        else
+        {
+            split(nodes[t].left, diamonds, username, l, nodes[t].left);
+            r = t;
         }
+        pull(t);
     }
 
-    void initializeNewUser()
+    int merge(int l, int r)
     {
-        diamonds = 500;
-        pets[0] = "Dragon";
-        pets[1] = "Phoenix";
-        pets[2] = "Griffin";
-        pets[3] = "Unicorn";
-
-        itemQuantities[0] = 3;
-        itemQuantities[1] = 2;
+        if (l < 0)
+            return r;
+        if (r < 0)
+            return l;
+        if (nodes[l].priority > nodes[r].priority)
+        {
+            nodes[l].right = merge(nodes[l].right, r);
+            pull(l);
+            return l;
+        }
+        nodes[r].left = merge(l, nodes[r].left);
+        pull(r);
+        return r;
     }
 
-    bool userExists(const std::string &name)
+    int erase(int t, int diamonds, const std::string &username)
     {
-        std::ifstream file(filename);
-        std::string line;
+        if (t < 0)
+            return t;
+        if (nodes[t].diamonds == diamonds && nodes[t].username == username)
+        {
+            int merged = merge(nodes[t].left, nodes[t].right);
+            freeNodes.push_back(t);
+            return merged;
+        }
+        if (comesBefore(nodes[t], diamonds, username))
+            nodes[t].right = erase(nodes[t].right, diamonds, username);
+        else
+            nodes[t].left = erase(nodes[t].left, diamonds, username);
+        pull(t);
+        return t;
+    }
 
-        while (std::getline(file, line))
+    void insert(const std::string &username, int diamonds)
+    {
+        int index;
+        if (!freeNodes.empty())
         {
-            if (line.find("Username: " + name) != std::string::npos)
-            {
-                return true;
-            }
+            index = freeNodes.back();
+            freeNodes.pop_back();
         }
-        return false;
+        else
+        {
+            index = static_cast<int>(nodes.size());
+            nodes.push_back(Node());
+        }
+        nodes[index] = {username, diamonds, nextPriority(), 1, -1, -1};
+        nodeOf[username] = index;
+
+        int l, r;
+        split(root, diamonds, username, l, r);
+        root = merge(merge(l, index), r);
     }
 
-    void loadUserData(const std::string &name)
+public:
+    Leaderboard() : root(-1), seed(2463534242u), version(0) {} // constructor
+
+    // reads the user file once at startup, after that every change comes through update()
+    void load(const std::string &filename)
     {
         std::ifstream file(filename);
         std::string line;
-        bool found = false;
 
         while (std::getline(file, line))
         {
-            if (line.find("Username: " + name) != std::string::npos)
+            if (line.find("Username: ") == 0)
             {
-                found = true;
-                username = name;
+                std::string username = line.substr(10);
 
                 std::getline(file, line);
-                std::stringstream ss(line.substr(10));
-                ss >> diamonds;
-
-                for (int i = 0; i < 4; i++)
-                {
-                    std::getline(file, line);
-                    pets[i] = line.substr(6);
-                }
-
-                for (int i = 0; i < 5; i++)
+                int diamonds = 0;
+                if (line.find("Diamonds: ") == 0)
                 {
-                    std::getline(file, line);
-                    std::stringstream ss(line.substr(8));
-                    ss >> itemQuantities[i];
+                    std::stringstream ss(line.substr(10));
+                    ss >> diamonds;
                 }
-                break;
+                update(username, diamonds);
             }
         }
+    }
 
-        if (!found)
+    void update(const std::string &username, int diamonds)
+    {
+        std::map<std::string, int>::iterator it = nodeOf.find(username);
+        if (it != nodeOf.end())
         {
-            username = name;
-            initializeNewUser();
-            saveUserData();
+            if (nodes[it->second].diamonds == diamonds)
+                return;
+            root = erase(root, nodes[it->second].diamonds, username);
+            nodeOf.erase(it);
         }
+        insert(username, diamonds);
+        version++;
     }
 
-    void saveUserData()
+    // 1-based rank, 0 when the player is not on the board
+    int getRank(const std::string &username) const
     {
-        if (userExists(username))
-        {
-            updateUserData();
-            return;
-        }
+        std::map<std::string, int>::const_iterator it = nodeOf.find(username);
+        if (it == nodeOf.end())
+            return 0;
 
-        std::ofstream file(filename, std::ios::app);
-        file << "Username: " << username << "\n";
-        file << "Diamonds: " << diamonds << "\n";
-        for (int i = 0; i < 4; i++)
-        {
-            file << "Pet " << i << ": " << pets[i] << "\n";
-        }
-        for (int i = 0; i < 5; i++)
+        const Node &target = nodes[it->second];
+        int rank = 1;
+        int t = root;
+        while (t >= 0)
         {
-            file << "Item " << i << ": " << itemQuantities[i] << "\n";
+            if (t == it->second)
+                return rank + sizeOf(nodes[t].left);
+            if (comesBefore(nodes[t], target.diamonds, target.username))
+            {
+                rank += sizeOf(nodes[t].left) + 1;
+                t = nodes[t].right;
+            }
+            else
+            {
+                t = nodes[t].left;
+            }
         }
-        file << "----------------\n";
+        return 0;
     }
 
-    void updateUserData()
+    bool getEntry(int rank, std::string &username, int &diamonds) const
     {
-        std::ifstream inFile(filename);
-        std::ofstream outFile("temp.txt");
-        std::string line;
-        bool found = false;
+        if (rank < 1 || rank > size())
+            return false;
 
-        while (std::getline(inFile, line))
+        int t = root;
+        int k = rank - 1;
+        while (t >= 0)
         {
-            if (line.find("Username: " + username) != std::string::npos)
+            int leftSize = sizeOf(nodes[t].left);
+            if (k < leftSize)
             {
-                found = true;
-                outFile << "Username: " << username << "\n";
-                outFile << "Diamonds: " << diamonds << "\n";
-                for (int i = 0; i < 4; i++)
-                {
-                    std::getline(inFile, line);
-                    outFile << "Pet " << i << ": " << pets[i] << "\n";
-                }
-                for (int i = 0; i < 5; i++)
-                {
-                    std::getline(inFile, line);
-                    outFile << "Item " << i << ": " << itemQuantities[i] << "\n";
-                }
-                std::getline(inFile, line);
+                t = nodes[t].left;
+            }
+            else if (k == leftSize)
+            {
+                username = nodes[t].username;
+                diamonds = nodes[t].diamonds;
+                return true;
             }
             else
             {
-                outFile << line << "\n";
+                k -= leftSize + 1;
+                t = nodes[t].right;
             }
         }
+        return false;
+    }
 
-        inFile.close();
-        outFile.close();
+    int size() const { return sizeOf(root); } // getter
+    int getVersion() const { return version; } // getter
+};
 
-        remove(filename.c_str());
-        rename("temp.txt", filename.c_str());
-    }
+// ==================== DURABLE FILE CLASS ==================== //
 
-    void addDiamonds(int amount)
+// This class replaces a whole file so that after a crash either the old or the new contents are on disk, never neither.
+// It uses abstraction to hide the platform calls for fsync and atomic rename behind one static function.
+class DurableFile
+{
+private:
+    static bool syncFile(FILE *file)
     {
-        diamonds += amount;
-        if (diamonds < 0)
-            diamonds = 0;
+        if (fflush(file) != 0)
+            return false;
+#ifdef _WIN32
+        return _commit(_fileno(file)) == 0;
+#else
+        return fsync(fileno(file)) == 0;
+#endif
     }
-    void setItemQuantity(int index, int quantity)
+
+    static bool atomicRename(const std::string &from, const std::string &to)
     {
-        if (index >= 0 && index < 5)
+#ifdef _WIN32
+        return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        if (rename(from.c_str(), to.c_str()) != 0)
+            return false;
+
+        // the rename itself lives in the directory, so sync that too
+        std::string dir = ".";
+        size_t slash = to.find_last_of('/');
+        if (slash != std::string::npos)
+            dir = slash == 0 ? "/" : to.substr(0, slash);
+        int dirFd = open(dir.c_str(), O_RDONLY);
+        if (dirFd >= 0)
         {
-            itemQuantities[index] = quantity;
-            if (itemQuantities[index] < 0)
-                itemQuantities[index] = 0;
+            fsync(dirFd);
+            close(dirFd);
         }
+        return true;
+#endif
     }
-    void addItemQuantity(int index, int amount)
+
+public:
+    // writes to path.tmp, syncs it, then renames it over path
+    static bool replace(const std::string &path, const std::string &contents)
     {
-        if (index >= 0 && index < 5)
+        std::string tempPath = path + ".tmp";
+        FILE *file = fopen(tempPath.c_str(), "wb");
+        if (!file)
         {
-            itemQuantities[index] += amount;
-            if (itemQuantities[index] < 0)
-                itemQuantities[index] = 0;
+            std::cerr << "Error opening " << tempPath << " for writing" << std::endl;
+            return false;
         }
+
+        bool ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+        ok = syncFile(file) && ok;
+        ok = fclose(file) == 0 && ok;
+
+        if (!ok || !atomicRename(tempPath, path))
+        {
+            std::cerr << "Error saving " << path << ", previous file kept" << std::endl;
+            remove(tempPath.c_str());
+            return false;
+        }
+        return true;
     }
-                                             // getter
-    int getItemQuantity(int index) const
+};
+
+// ==================== BYTE CODEC CLASS ==================== //
+
+// Little-endian helpers shared by the binary save files, so the files read the same on every machine.
+class ByteCodec
+{
+public:
+    static void put16(std::string &out, unsigned int value)
     {
-        if (index >= 0 && index < 5)
-            return itemQuantities[index];
-        return 0;
+        out += static_cast<char>(value & 0xFF);
+        out += static_cast<char>((value >> 8) & 0xFF);
     }
-    std::string getItemName(int index) const
+
+    static void put32(std::string &out, uint32_t value)
     {
-        if (index >= 0 && index < 5)
-            return itemNames[index];
-        return "";
+        put16(out, value & 0xFFFF);
+        put16(out, value >> 16);
     }
 
-    int getDiamonds() const { return diamonds; }
-    std::string getUsername() const { return username; }
+    static void put64(std::string &out, uint64_t value)
+    {
+        put32(out, static_cast<uint32_t>(value));
+        put32(out, static_cast<uint32_t>(value >> 32));
+    }
+
+    static unsigned int get16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+    static uint32_t get32(const unsigned char *p) { return get16(p) | (static_cast<uint32_t>(get16(p + 2)) << 16); }
+    static uint64_t get64(const unsigned char *p) { return get32(p) | (static_cast<uint64_t>(get32(p + 4)) << 32); }
+
+    // FNV-1a, start from FNV_BASIS and fold in every field two runs have to agree on
+    static const uint32_t FNV_BASIS = 2166136261u;
+
+    static uint32_t fnv(uint32_t hash, const void *data, size_t size)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ bytes[i]) * 16777619u;
+        return hash;
+    }
 };
 
-// ------------ 2V2 BATTLE GAME CLASS ---------------- //
+// ==================== PET STORE CLASS ==================== //
 
-// This is a 2v2 pet battle game where players and enemies control pets that move, shoot abilities (fire/ice/lightning/magic), and have health bars.
-// It tracks game time, collisions, and win/lose conditions. It uses Encapsulation keeping  data  private and aggregation
-class Battle2v2Game
+// This class keeps every player's pet progress in one small binary file next to user_data.txt, sorted by username.
+// The header records how big each record is, so older files still load into newer layouts and missing fields read as zero.
+class PetStore
 {
 private:
-    bool isActive;
-    bool gameOver;
-    bool playerWon;
+    static const int VERSION = 1;
+    static const int HEADER_SIZE = 16; // magic, version, user record size, pet record size, reserved, count
+    static const int NAME_SIZE = 16;
+    static const int PETS_PER_USER = 4;
+    static const int PET_SIZE = 4;
 
-    sf::RectangleShape window;
-    sf::RectangleShape backgroundDim;
-    sf::Text title;
-    Button closeButton;
-    sf::Font font;
+    static void encodePet(std::string &out, const PetRecord &pet)
+    {
+        out += static_cast<char>(pet.speciesId);
+        out += static_cast<char>(pet.level);
+        ByteCodec::put16(out, pet.trainingPoints);
+    }
 
-    Pet *playerPets[2];
-    Pet *enemyPets[2];
-    sf::Texture playerTextures[2];
-    sf::Sprite playerSprites[2];
-    sf::Texture enemyTextures[2];
-    sf::Sprite enemySprites[2];
+    // copies only the bytes the file has, so fields added after it was written stay zero
+    static PetRecord decodePet(const unsigned char *p, unsigned int size)
+    {
+        unsigned char raw[PET_SIZE] = {0};
+        memcpy(raw, p, std::min<unsigned int>(size, PET_SIZE));
 
-    float playerSpeed;
-    float enemySpeed;
-    sf::Vector2f playerVelocities[2];
-    sf::Vector2f enemyVelocities[2];
-    bool keys[8];
+        PetRecord pet;
+        pet.speciesId = raw[0];
+        pet.level = raw[1];
+        pet.trainingPoints = static_cast<uint16_t>(ByteCodec::get16(raw + 2));
+        return pet;
+    }
 
-    struct Ability
+    // the whole file in one read, with the header checked
+    static bool readAll(const std::string &file, std::string &bytes, unsigned int &userSize,
+                        unsigned int &petSize, unsigned int &count)
     {
-        sf::Sprite projectile;
-        sf::Vector2f velocity;
-        float cooldown;
-        float currentCooldown;
-        int petIndex;
-        int damage;
+        std::ifstream in(file, std::ios::binary | std::ios::ate);
+        if (!in.is_open())
+            return false;
+
+        std::streamsize length = in.tellg();
+        if (length < HEADER_SIZE)
+            return false;
+        bytes.resize(static_cast<size_t>(length));
+        in.seekg(0);
+        if (!in.read(&bytes[0], length))
+            return false;
 
-                                                     // Overload == operator for ability comparison
-        bool operator==(const Ability &other) const
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(bytes.data());
+        if (memcmp(p, "MPKP", 4) != 0)
+            return false;
+        if (isNewerVersion(bytes))
         {
-            return projectile.getPosition() == other.projectile.getPosition() &&
-                   velocity == other.velocity &&
-                   damage == other.damage;
+            std::cerr << "Error: " << file << " has pet file version " << ByteCodec::get16(p + 4)
+                      << ", this build reads up to version " << VERSION << std::endl;
+            return false;
         }
-    };
-
-    static const int MAX_ABILITIES = 100;
-    Ability playerAbilities[MAX_ABILITIES];
-    Ability enemyAbilities[MAX_ABILITIES];
-    int playerAbilityCount;
-    int enemyAbilityCount;
-    sf::Clock abilityClock;
-
-    int playerHealth[2];
-    int enemyHealth[2];
-    int playerMaxHealth[2];
-    int enemyMaxHealth[2];
-    sf::Text playerHealthText[2];
-    sf::Text enemyHealthText[2];
-    sf::RectangleShape playerHealthBar[2];
-    sf::RectangleShape playerHealthBarBackground[2];
-    sf::RectangleShape enemyHealthBar[2];
-    sf::RectangleShape enemyHealthBarBackground[2];
-
-    sf::Clock gameClock;
-    sf::Clock powerDecreaseClock;
-    sf::Text timerText;
-    int gameDuration;
 
-    sf::Texture fireTexture;
-    sf::Texture iceTexture;
-    sf::Texture lightningTexture;
-    sf::Texture magicTexture;
-
-    sf::FloatRect arenaBounds;
-    sf::Vector2f arenaCenter;
+        userSize = ByteCodec::get16(p + 6);
+        petSize = ByteCodec::get16(p + 8);
+        count = ByteCodec::get32(p + 12);
+        if (petSize == 0 || userSize < NAME_SIZE + petSize * PETS_PER_USER ||
+            HEADER_SIZE + static_cast<std::streamsize>(userSize) * count > length)
+            return false;
+        return true;
+    }
 
-    void setupAbilities()
+    // older versions load through the record sizes in the header, only a newer layout is unknown
+    static bool isNewerVersion(const std::string &bytes)
     {
-        playerAbilityCount = 0;
-        enemyAbilityCount = 0;
-
-        if (!fireTexture.loadFromFile("fire1.png"))
-        {
-            sf::Image placeholder;
-            placeholder.create(50, 20, sf::Color(255, 150, 0));
-            fireTexture.loadFromImage(placeholder);
-        }
-        if (!iceTexture.loadFromFile("ice1.png"))
-        {
-            sf::Image placeholder;
-            placeholder.create(50, 20, sf::Color(100, 200, 255));
-            iceTexture.loadFromImage(placeholder);
-        }
-        if (!lightningTexture.loadFromFile("lightning.png"))
-        {
-            sf::Image placeholder;
-            placeholder.create(50, 20, sf::Color(255, 255, 100));
-            lightningTexture.loadFromImage(placeholder);
-        }
-        if (!magicTexture.loadFromFile("magic.png"))
-        {
-            sf::Image placeholder;
-            placeholder.create(50, 20, sf::Color(200, 100, 255));
-            magicTexture.loadFromImage(placeholder);
-        }
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(bytes.data());
+        return bytes.size() >= static_cast<size_t>(HEADER_SIZE) && memcmp(p, "MPKP", 4) == 0 &&
+               ByteCodec::get16(p + 4) > VERSION;
     }
 
-    void resetPositions()
+    static std::string paddedName(const std::string &username)
     {
-        playerSprites[0].setPosition(arenaCenter.x - 400, arenaCenter.y - 100);
-        playerSprites[1].setPosition(arenaCenter.x - 400, arenaCenter.y + 100);
-
-        enemySprites[0].setPosition(arenaCenter.x + 400, arenaCenter.y - 100);
-        enemySprites[1].setPosition(arenaCenter.x + 400, arenaCenter.y + 100);
-
-        for (int i = 0; i < 2; i++)
-        {
-            playerVelocities[i] = sf::Vector2f(0, 0);
-            enemyVelocities[i] = sf::Vector2f(0, 0);
-        }
+        std::string key = username.substr(0, NAME_SIZE);
+        key.resize(NAME_SIZE, '\0');
+        return key;
+    }
 
-        playerAbilityCount = 0;
-        enemyAbilityCount = 0;
+public:
+    // a pet name from the users file, spaces or a line ending around it are ignored, an unknown name is a Dragon
+    static int speciesId(const std::string &petName)
+    {
+        size_t first = petName.find_first_not_of(" \t\r\n");
+        size_t last = petName.find_last_not_of(" \t\r\n");
+        int id = first == std::string::npos ? -1 : Species::find(petName.substr(first, last - first + 1));
+        return id >= 0 ? id : Species::DRAGON;
     }
 
-    bool checkCollision(const sf::Sprite &sprite1, const sf::Sprite &sprite2)
+    static PetRecord defaultRecord(const std::string &petName)
     {
-        return sprite1.getGlobalBounds().intersects(sprite2.getGlobalBounds());
+        return Species::record(speciesId(petName));
     }
 
-    void decreasePowerOverTime()
+    // binary search over the sorted records, false when the player has no saved pets yet
+    static bool load(const std::string &file, const std::string &username, PetRecord pets[PETS_PER_USER])
     {
-        if (powerDecreaseClock.getElapsedTime().asSeconds() > 5.0f) 
+        std::string bytes;
+        unsigned int userSize, petSize, count;
+        if (!readAll(file, bytes, userSize, petSize, count))
+            return false;
+
+        const unsigned char *records = reinterpret_cast<const unsigned char *>(bytes.data()) + HEADER_SIZE;
+        std::string key = paddedName(username);
+        int low = 0;
+        int high = static_cast<int>(count) - 1;
+        while (low <= high)
         {
-            for (int i = 0; i < 2; i++)
+            int mid = (low + high) / 2;
+            const unsigned char *record = records + static_cast<size_t>(mid) * userSize;
+            int cmp = memcmp(record, key.data(), NAME_SIZE);
+            if (cmp == 0)
             {
-                if (playerHealth[i] > 0)
-                {
-                    int decreaseAmount = getPowerDecreaseRate(playerPets[i]->getType());
-                    updateHealthBars();
-                }
-
-                if (enemyHealth[i] > 0)
+                for (int i = 0; i < PETS_PER_USER; i++)
                 {
-                    int decreaseAmount = getPowerDecreaseRate(enemyPets[i]->getType());
-                    updateHealthBars();
+                    pets[i] = decodePet(record + NAME_SIZE + i * petSize, petSize);
                 }
+                return true;
             }
-            powerDecreaseClock.restart();
+            if (cmp < 0)
+                low = mid + 1;
+            else
+                high = mid - 1;
         }
+        return false;
     }
 
-    int getPowerDecreaseRate(const std::string &petType) const
+    struct UserPets
     {
-        if (petType == "Dragon")
-            return 8;
-        if (petType == "Griffin")
-            return 7;
-        if (petType == "Phoenix")
-            return 6;
-        if (petType == "Unicorn")
-            return 5;
-        return 4; 
-    }
+        PetRecord pets[PETS_PER_USER];
+    };
 
-    void updateHealthBars()
+    // one read for the whole file, for tools that need every player's pets instead of one
+    static bool loadAll(const std::string &file, std::unordered_map<std::string, UserPets> &players)
     {
-        for (int i = 0; i < 2; i++)
+        std::string bytes;
+        unsigned int userSize, petSize, count;
+        if (!readAll(file, bytes, userSize, petSize, count))
+            return false;
+
+        const unsigned char *records = reinterpret_cast<const unsigned char *>(bytes.data()) + HEADER_SIZE;
+        players.reserve(count);
+        for (unsigned int r = 0; r < count; r++)
         {
-            if (playerHealth[i] > 0)
+            const unsigned char *record = records + static_cast<size_t>(r) * userSize;
+            const char *name = reinterpret_cast<const char *>(record);
+            UserPets &entry = players[std::string(name, strnlen(name, NAME_SIZE))];
+            for (int i = 0; i < PETS_PER_USER; i++)
             {
-                playerHealthText[i].setString(playerPets[i]->getName() + ": " +
-                                              std::to_string(playerHealth[i]) + "/" + std::to_string(playerMaxHealth[i]));
-
-                float healthPercentage = playerHealth[i] / static_cast<float>(playerMaxHealth[i]);
-                playerHealthBar[i].setSize(sf::Vector2f(200 * healthPercentage, 20));
-            }
-
-            if (enemyHealth[i] > 0)
-            {
-                enemyHealthText[i].setString(enemyPets[i]->getName() + ": " +
-                                             std::to_string(enemyHealth[i]) + "/" + std::to_string(enemyMaxHealth[i]));
-
-                float healthPercentage = enemyHealth[i] / static_cast<float>(enemyMaxHealth[i]);
-                enemyHealthBar[i].setSize(sf::Vector2f(200 * healthPercentage, 20));
+                entry.pets[i] = decodePet(record + NAME_SIZE + i * petSize, petSize);
             }
         }
+        return true;
     }
 
-    void handleCollisions()
+    // merges the updated players into the file and writes it back in the current layout
+    static bool writeRecords(const std::string &file, const std::map<std::string, const PetRecord *> &updates)
     {
-        for (int i = 0; i < playerAbilityCount;)
-        {
-            bool hit = false;
-            for (int j = 0; j < 2; j++)
-            {
-                if (enemyHealth[j] > 0 && checkCollision(playerAbilities[i].projectile, enemySprites[j]))
-                {
-                    enemyHealth[j] -= playerAbilities[i].damage;
-                    enemyHealthText[j].setString(enemyPets[j]->getName() + ": " +
-                                                 std::to_string(enemyHealth[j]) + "/" + std::to_string(enemyMaxHealth[j]));
-
-                    enemyHealthBar[j].setSize(sf::Vector2f(
-                        200 * (enemyHealth[j] / static_cast<float>(enemyMaxHealth[j])),
-                        20));
-
-                    if (enemyHealth[j] <= 0)
-                    {
-                        enemyHealth[j] = 0;
-                        enemySprites[j].setColor(sf::Color(100, 100, 100));
-                    }
-
-                    hit = true;
-                    break;
-                }
-            }
-
-            if (hit)
-            {
-                playerAbilities[i] = playerAbilities[playerAbilityCount - 1];
-                playerAbilityCount--;
-            }
-            else
-            {
-                i++;
-            }
-        }
+        std::map<std::string, std::string> encoded; // padded name -> pet bytes
 
-        for (int i = 0; i < enemyAbilityCount;)
+        std::string bytes;
+        unsigned int userSize, petSize, count;
+        if (readAll(file, bytes, userSize, petSize, count))
         {
-            bool hit = false;
-            for (int j = 0; j < 2; j++)
+            const unsigned char *records = reinterpret_cast<const unsigned char *>(bytes.data()) + HEADER_SIZE;
+            for (unsigned int r = 0; r < count; r++)
             {
-                if (playerHealth[j] > 0 && checkCollision(enemyAbilities[i].projectile, playerSprites[j]))
+                const unsigned char *record = records + static_cast<size_t>(r) * userSize;
+                std::string pets;
+                for (int i = 0; i < PETS_PER_USER; i++)
                 {
-                    playerHealth[j] -= enemyAbilities[i].damage;
-                    playerHealthText[j].setString(playerPets[j]->getName() + ": " +
-                                                  std::to_string(playerHealth[j]) + "/" + std::to_string(playerMaxHealth[j]));
-
-                    playerHealthBar[j].setSize(sf::Vector2f(
-                        200 * (playerHealth[j] / static_cast<float>(playerMaxHealth[j])),
-                        20));
-
-                    if (playerHealth[j] <= 0)
-                    {
-                        playerHealth[j] = 0;
-                        playerSprites[j].setColor(sf::Color(100, 100, 100));
-                    }
-
-                    hit = true;
-                    break;
+                    encodePet(pets, decodePet(record + NAME_SIZE + i * petSize, petSize));
                 }
-            }
-
-            if (hit)
-            {
-                enemyAbilities[i] = enemyAbilities[enemyAbilityCount - 1];
-                enemyAbilityCount--;
-            }
-            else
-            {
-                i++;
+                encoded[std::string(reinterpret_cast<const char *>(record), NAME_SIZE)] = pets;
             }
         }
-
-        bool allPlayerPetsDefeated = true;
-        bool allEnemyPetsDefeated = true;
-
-        for (int i = 0; i < 2; i++)
+        else if (std::ifstream(file, std::ios::binary).is_open())
         {
-            if (playerHealth[i] > 0)
-                allPlayerPetsDefeated = false;
-            if (enemyHealth[i] > 0)
-                allEnemyPetsDefeated = false;
+            // a file that is there but does not parse, truncated, damaged or newer, may hold every other player,
+            // so it is left alone and the save worker retries, only a missing file starts an empty store
+            if (!isNewerVersion(bytes))
+                std::cerr << "Error: " << file << " could not be read, not replacing it" << std::endl;
+            return false;
         }
 
-        if (allPlayerPetsDefeated || allEnemyPetsDefeated)
+        for (std::map<std::string, const PetRecord *>::const_iterator it = updates.begin(); it != updates.end(); ++it)
         {
-            gameOver = true;
-            playerWon = allEnemyPetsDefeated;
-            if (playerWon)
+            std::string pets;
+            for (int i = 0; i < PETS_PER_USER; i++)
             {
-                for (int i = 0; i < 2; i++)
-                {
-                    if (playerHealth[i] > 0)
-                    {
-                        int xp = 50 + (rand() % 50) + (enemyMaxHealth[0] + enemyMaxHealth[1]) / 20;
-                        playerPets[i]->gainExperience(xp);
-                    }
-                }
+                encodePet(pets, it->second[i]);
             }
+            encoded[paddedName(it->first)] = pets;
         }
-    }
 
-    void removeWhiteBackground(sf::Image &image)
-    {
-        for (unsigned int y = 0; y < image.getSize().y; ++y)
+        std::string out = "MPKP";
+        ByteCodec::put16(out, VERSION);
+        ByteCodec::put16(out, NAME_SIZE + PET_SIZE * PETS_PER_USER);
+        ByteCodec::put16(out, PET_SIZE);
+        ByteCodec::put16(out, 0);
+        ByteCodec::put32(out, static_cast<unsigned int>(encoded.size()));
+        for (std::map<std::string, std::string>::const_iterator it = encoded.begin(); it != encoded.end(); ++it)
         {
-            for (unsigned int x = 0; x < image.getSize().x; ++x)
-            {
-                sf::Color pixel = image.getPixel(x, y);
-                if (pixel.r > 200 && pixel.g > 200 && pixel.b > 200)
-                {
-                    pixel.a = 0;
-                    image.setPixel(x, y, pixel);
-                }
-            }
+            out += it->first;
+            out += it->second;
         }
+        return DurableFile::replace(file, out);
     }
+};
+
+// ==================== SAVE WORKER CLASS ==================== //
+
+// Plain copy of one player's saved fields, so the save thread never touches the live UserData.
+struct UserRecord
+{
+    std::string username;
+    int diamonds;
+    std::string pets[4];
+    int itemQuantities[5];
+    PetRecord petStates[4];
+};
 
-    void addPlayerProjectile(int petIndex)
+// This class writes user records to disk on its own thread, so event handlers only pay for queueing a snapshot.
+// Saves that arrive within the durability window are group-committed: one synced atomic replace covers all of them.
+class SaveWorker
+{
+private:
+    std::string filename;
+    std::string petFilename;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::vector<UserRecord> queue;
+    bool running;
+    bool stopping;
+    bool busy;
+    bool flushRequested;
+    bool failing; // the last commit could not be written, its batch is waiting for a retry
+    float durabilityWindow; // seconds a commit waits to collect more saves
+    int submittedCount;
+    int writtenCount;
+    int commitCount;
+    int attemptCount; // commits tried, written or not
+
+    void run()
     {
-        if (playerAbilityCount < MAX_ABILITIES && abilityClock.getElapsedTime().asSeconds() > 0.5f)
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
         {
-            playerAbilities[playerAbilityCount].petIndex = petIndex;
+            wake.wait(lock, [this]
+                      { return stopping || !queue.empty(); });
+            if (queue.empty() && stopping)
+                break;
 
-            if (playerPets[petIndex]->getType() == "Fire")
-            {
-                playerAbilities[playerAbilityCount].projectile.setTexture(fireTexture);
-                playerAbilities[playerAbilityCount].damage = playerPets[petIndex]->getAttack() / 2;
-            }
-            else if (playerPets[petIndex]->getType() == "Ice")
-            {
-                playerAbilities[playerAbilityCount].projectile.setTexture(iceTexture);
-                playerAbilities[playerAbilityCount].damage = playerPets[petIndex]->getAttack() / 3;
-            }
-            else if (playerPets[petIndex]->getType() == "Electric")
-            {
-                playerAbilities[playerAbilityCount].projectile.setTexture(lightningTexture);
-                playerAbilities[playerAbilityCount].damage = playerPets[petIndex]->getAttack() / 2;
-            }
-            else
-            {
-                playerAbilities[playerAbilityCount].projectile.setTexture(magicTexture);
-                playerAbilities[playerAbilityCount].damage = playerPets[petIndex]->getAttack() / 3;
-            }
+            // hold the commit open for a moment so a burst of clicks shares one fsync,
+            // after a failed commit the full window also spaces out the retries
+            wake.wait_for(lock, std::chrono::duration<float>(durabilityWindow), [this]
+                          { return stopping || (flushRequested && !failing); });
 
-            playerAbilities[playerAbilityCount].projectile.setScale(0.4f, 0.4f);
+            std::vector<UserRecord> batch;
+            batch.swap(queue);
+            busy = true;
+            lock.unlock();
 
-            sf::Vector2f targetPos;
-            float minDistance = 9999;
-            for (int i = 0; i < 2; i++)
+            // later snapshots replace earlier ones, so each user is written once per batch
+            std::map<std::string, UserRecord> latest;
+            for (size_t i = 0; i < batch.size(); i++)
             {
-                if (enemyHealth[i] > 0)
-                {
-                    float dist = sqrt(pow(enemySprites[i].getPosition().x - playerSprites[petIndex].getPosition().x, 2) +
-                                      pow(enemySprites[i].getPosition().y - playerSprites[petIndex].getPosition().y, 2));
-                    if (dist < minDistance)
-                    {
-                        minDistance = dist;
-                        targetPos = enemySprites[i].getPosition();
-                    }
-                }
+                latest[batch[i].username] = batch[i];
             }
+            bool committed = writeRecords(filename, latest);
+            committed = writePetRecords(petFilename, latest) && committed;
 
-            if (minDistance == 9999)
+            lock.lock();
+            attemptCount++;
+            if (committed)
             {
-                playerAbilities[playerAbilityCount].velocity = sf::Vector2f(15.0f, 0);
+                writtenCount += static_cast<int>(latest.size());
+                commitCount++;
+                failing = false;
             }
             else
             {
-                sf::Vector2f direction = targetPos - playerSprites[petIndex].getPosition();
-                float length = sqrt(direction.x * direction.x + direction.y * direction.y);
-                if (length > 0)
+                // only the newest snapshot per user goes back, in front of anything submitted meanwhile,
+                // so the retry still ends on the latest state and a disk that keeps failing cannot grow the queue without bound
+                std::vector<UserRecord> retry;
+                retry.reserve(latest.size());
+                for (std::map<std::string, UserRecord>::const_iterator it = latest.begin(); it != latest.end(); ++it)
                 {
-                    direction /= length;
-                    playerAbilities[playerAbilityCount].velocity = direction * 15.0f;
+                    retry.push_back(it->second);
                 }
-                else
+                queue.insert(queue.begin(), retry.begin(), retry.end());
+                if (!failing)
+                    std::cerr << "Error: could not commit " << latest.size() << " user records, keeping them for a retry" << std::endl;
+                failing = true;
+                if (stopping)
                 {
-                    playerAbilities[playerAbilityCount].velocity = sf::Vector2f(15.0f, 0);
+                    std::cerr << "Error: " << queue.size() << " unsaved updates were lost on exit" << std::endl;
+                    queue.clear();
                 }
             }
+            busy = false;
+            idle.notify_all();
+        }
+    }
+
+public:
+    SaveWorker() : running(false), stopping(false), busy(false), flushRequested(false), failing(false), durabilityWindow(0.5f), // constructor
+                   submittedCount(0), writtenCount(0), commitCount(0), attemptCount(0) {}
+
+    ~SaveWorker() // destructor
+    {
+        stop();
+    }
+
+    void start(const std::string &file, const std::string &petFile)
+    {
+        if (running)
+            return;
+        filename = file;
+        petFilename = petFile;
+        stopping = false;
+        running = true;
+        worker = std::thread(&SaveWorker::run, this);
+    }
 
-            playerAbilities[playerAbilityCount].cooldown = 0.5f;
+    void submit(const UserRecord &record)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(record);
+            submittedCount++;
+        }
+        wake.notify_one();
+    }
 
-            playerAbilities[playerAbilityCount].projectile.setPosition(
-                playerSprites[petIndex].getPosition().x + playerSprites[petIndex].getGlobalBounds().width / 2,
-                playerSprites[petIndex].getPosition().y + playerSprites[petIndex].getGlobalBounds().height / 2);
+    // commits right away instead of waiting out the window, and blocks until every snapshot is on disk
+    // or the commit failed, in which case the batch stays queued for the next try
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        int attemptsBefore = attemptCount;
+        flushRequested = true;
+        wake.notify_one();
+        idle.wait(lock, [this, attemptsBefore]
+                  { return !busy && (queue.empty() || (failing && attemptCount > attemptsBefore)); });
+        flushRequested = false;
+    }
 
-            playerAbilityCount++;
-            abilityClock.restart();
+    void stop()
+    {
+        if (!running)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
         }
+        wake.notify_one();
+        worker.join();
+        running = false;
     }
 
-    void addEnemyProjectile(int petIndex)
+    void setDurabilityWindow(float seconds) { durabilityWindow = std::max(0.0f, seconds); }
+                                                // getter
+    bool isRunning() const { return running; }
+    float getDurabilityWindow() const { return durabilityWindow; }
+    int getSubmittedCount() const { return submittedCount; }
+    int getWrittenCount() const { return writtenCount; }
+    int getCommitCount() const { return commitCount; }
+
+    static void writeRecord(std::ostream &out, const UserRecord &record)
     {
-        if (enemyAbilityCount < MAX_ABILITIES && rand() % 100 < 3)
+        out << "Username: " << record.username << "\n";
+        out << "Diamonds: " << record.diamonds << "\n";
+        for (int i = 0; i < 4; i++)
+        {
+            out << "Pet " << i << ": " << record.pets[i] << "\n";
+        }
+        for (int i = 0; i < 5; i++)
         {
-            enemyAbilities[enemyAbilityCount].petIndex = petIndex;
+            out << "Item " << i << ": " << record.itemQuantities[i] << "\n";
+        }
+    }
 
-            if (enemyPets[petIndex]->getType() == "Fire")
-            {
-                enemyAbilities[enemyAbilityCount].projectile.setTexture(fireTexture);
-                enemyAbilities[enemyAbilityCount].damage = enemyPets[petIndex]->getAttack() / 2;
-            }
-            else if (enemyPets[petIndex]->getType() == "Ice")
-            {
-                enemyAbilities[enemyAbilityCount].projectile.setTexture(iceTexture);
-                enemyAbilities[enemyAbilityCount].damage = enemyPets[petIndex]->getAttack() / 3;
-            }
-            else if (enemyPets[petIndex]->getType() == "Electric")
-            {
-                enemyAbilities[enemyAbilityCount].projectile.setTexture(lightningTexture);
-                enemyAbilities[enemyAbilityCount].damage = enemyPets[petIndex]->getAttack() / 2;
-            }
-            else
+    // rewrites the user file once for a whole batch, users not found in the file are appended
+    static bool writeRecords(const std::string &file, const std::map<std::string, UserRecord> &records)
+    {
+        std::ifstream inFile(file);
+        std::ostringstream outFile;
+        std::string line;
+        std::map<std::string, bool> written;
+
+        while (std::getline(inFile, line))
+        {
+            std::map<std::string, UserRecord>::const_iterator it = records.end();
+            if (line.find("Username: ") == 0)
             {
-                enemyAbilities[enemyAbilityCount].projectile.setTexture(magicTexture);
-                enemyAbilities[enemyAbilityCount].damage = enemyPets[petIndex]->getAttack() / 3;
+                it = records.find(line.substr(10));
             }
 
-            enemyAbilities[enemyAbilityCount].projectile.setScale(0.4f, 0.4f);
-
-            sf::Vector2f targetPos;
-            float minDistance = 9999;
-            for (int i = 0; i < 2; i++)
+            if (it != records.end())
             {
-                if (playerHealth[i] > 0)
+                writeRecord(outFile, it->second);
+                written[it->first] = true;
+                for (int i = 0; i < 10; i++)
                 {
-                    float dist = sqrt(pow(playerSprites[i].getPosition().x - enemySprites[petIndex].getPosition().x, 2) +
-                                      pow(playerSprites[i].getPosition().y - enemySprites[petIndex].getPosition().y, 2));
-                    if (dist < minDistance)
-                    {
-                        minDistance = dist;
-                        targetPos = playerSprites[i].getPosition();
-                    }
+                    std::getline(inFile, line);
                 }
             }
-
-            if (minDistance == 9999)
+            else
             {
-                enemyAbilities[enemyAbilityCount].velocity = sf::Vector2f(-12.0f, 0);
+                outFile << line << "\n";
             }
-            else
+        }
+
+        for (std::map<std::string, UserRecord>::const_iterator it = records.begin(); it != records.end(); ++it)
+        {
+            if (!written.count(it->first))
             {
-                sf::Vector2f direction = targetPos - enemySprites[petIndex].getPosition();
-                float length = sqrt(direction.x * direction.x + direction.y * direction.y);
-                if (length > 0)
-                {
-                    direction /= length;
-                    enemyAbilities[enemyAbilityCount].velocity = direction * 12.0f;
-                }
-                else
-                {
-                    enemyAbilities[enemyAbilityCount].velocity = sf::Vector2f(-12.0f, 0);
-                }
+                writeRecord(outFile, it->second);
+                outFile << "----------------\n";
             }
+        }
 
-            enemyAbilities[enemyAbilityCount].cooldown = 1.0f;
+        inFile.close();
 
-            enemyAbilities[enemyAbilityCount].projectile.setPosition(
-                enemySprites[petIndex].getPosition().x,
-                enemySprites[petIndex].getPosition().y + enemySprites[petIndex].getGlobalBounds().height / 2);
+        return DurableFile::replace(file, outFile.str());
+    }
 
-            enemyAbilityCount++;
+    static bool writePetRecords(const std::string &file, const std::map<std::string, UserRecord> &records)
+    {
+        std::map<std::string, const PetRecord *> pets;
+        for (std::map<std::string, UserRecord>::const_iterator it = records.begin(); it != records.end(); ++it)
+        {
+            pets[it->first] = it->second.petStates;
         }
+        return PetStore::writeRecords(file, pets);
     }
+};
 
-public:
-    Battle2v2Game() : isActive(false), gameOver(false), playerWon(false),
-                      gameDuration(180), playerSpeed(5.0f), enemySpeed(3.0f),
-                      playerAbilityCount(0), enemyAbilityCount(0)
+// ==================== USER STORE CLASS ==================== //
+
+// This class converts between the text user file and a compact binary store with fixed 64-byte records and a sorted name index.
+// It is used by the --import/--export/--lookup commands and cleans up legacy records (stray spaces, negative counts, duplicates) on the way.
+class UserStore
+{
+private:
+    static const int VERSION = 1;
+    static const int HEADER_SIZE = 24; // magic, version, record size, count, reserved, index offset
+    static const int NAME_SIZE = 24;
+    static const int RECORD_SIZE = 64; // name, diamonds, 5 items, 4 pet records
+    static const int INDEX_ENTRY_SIZE = 12; // name hash, record number
+
+    struct Stats
     {
-        for (int i = 0; i < 8; i++)
+        long long records;
+        long long duplicates;
+        long long rejected;
+    };
+
+    static uint64_t hashName(const std::string &name)
+    {
+        uint64_t hash = 1469598103934665603ULL; // FNV-1a
+        for (size_t i = 0; i < name.size(); i++)
         {
-            keys[i] = false;
+            hash ^= static_cast<unsigned char>(name[i]);
+            hash *= 1099511628211ULL;
         }
-        for (int i = 0; i < 2; i++)
+        return hash;
+    }
+
+    // reads digits straight from the line, negative counts from old saves are clamped to 0
+    static int parseInt(const std::string &text, size_t pos)
+    {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t'))
+            pos++;
+        bool negative = pos < text.size() && text[pos] == '-';
+        if (negative)
+            pos++;
+        long long value = 0;
+        while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9' && value < 2000000000)
         {
-            playerVelocities[i] = sf::Vector2f(0, 0);
-            enemyVelocities[i] = sf::Vector2f(0, 0);
-            playerHealth[i] = 0;
-            enemyHealth[i] = 0;
-            playerMaxHealth[i] = 0;
-            enemyMaxHealth[i] = 0;
+            value = value * 10 + (text[pos] - '0');
+            pos++;
         }
+        return negative ? 0 : static_cast<int>(value);
     }
 
-    void setup(const sf::Font &gameFont, Pet *player1, Pet *player2, Pet *enemy1, Pet *enemy2)
+    static bool hasKey(const std::string &line, size_t pos, const char *key)
     {
-        font = gameFont;
-        playerPets[0] = player1;
-        playerPets[1] = player2;
-        enemyPets[0] = enemy1;
-        enemyPets[1] = enemy2;
+        return line.compare(pos, strlen(key), key) == 0;
+    }
 
-        for (int i = 0; i < 8; i++)
+    static void encodeRecord(std::string &out, const UserRecord &record)
+    {
+        std::string name = record.username;
+        name.resize(NAME_SIZE, '\0');
+        out += name;
+        ByteCodec::put32(out, static_cast<uint32_t>(record.diamonds));
+        for (int i = 0; i < 5; i++)
         {
-            keys[i] = false;
+            ByteCodec::put32(out, static_cast<uint32_t>(record.itemQuantities[i]));
         }
-
-        for (int i = 0; i < 2; i++)
+        for (int i = 0; i < 4; i++)
         {
-            playerVelocities[i] = sf::Vector2f(0, 0);
-            enemyVelocities[i] = sf::Vector2f(0, 0);
+            out += static_cast<char>(record.petStates[i].speciesId);
+            out += static_cast<char>(record.petStates[i].level);
+            ByteCodec::put16(out, record.petStates[i].trainingPoints);
         }
+    }
 
-        backgroundDim.setFillColor(sf::Color(0, 0, 0, 180));
-        window.setSize(sf::Vector2f(1200, 700));
-        window.setFillColor(sf::Color(40, 40, 50, 240));
-        window.setOutlineThickness(4.f);
-        window.setOutlineColor(sf::Color(255, 215, 0));
-
-        arenaBounds = sf::FloatRect(100, 150, window.getSize().x - 200, window.getSize().y - 250); // Adjusted for better spacing
-        arenaCenter = sf::Vector2f(window.getSize().x / 2, window.getSize().y / 2);
+    static UserRecord decodeRecord(const unsigned char *p)
+    {
+        UserRecord record;
+        record.username = std::string(reinterpret_cast<const char *>(p), strnlen(reinterpret_cast<const char *>(p), NAME_SIZE));
+        p += NAME_SIZE;
+        record.diamonds = static_cast<int>(ByteCodec::get32(p));
+        p += 4;
+        for (int i = 0; i < 5; i++, p += 4)
+        {
+            record.itemQuantities[i] = static_cast<int>(ByteCodec::get32(p));
+        }
+        for (int i = 0; i < 4; i++, p += 4)
+        {
+            record.petStates[i].speciesId = p[0];
+            record.petStates[i].level = p[1];
+            record.petStates[i].trainingPoints = static_cast<uint16_t>(ByteCodec::get16(p + 2));
+            record.pets[i] = speciesName(record.petStates[i].speciesId);
+        }
+        return record;
+    }
 
-        title.setFont(font);
-        title.setString("2 vs 2 BATTLE ARENA");
-        title.setCharacterSize(42);
-        title.setFillColor(sf::Color(255, 215, 0));
-        title.setStyle(sf::Text::Bold);
-        title.setOutlineThickness(2.f);
-        title.setOutlineColor(sf::Color::Black);
+    // reads the next "Username:" block, fields are matched by key so extra spaces and blank lines do not matter
+    static bool readTextRecord(std::istream &in, UserRecord &record, std::string &line, bool &havePending)
+    {
+        size_t pos = 0;
+        while (true)
+        {
+            if (!havePending && !std::getline(in, line))
+                return false;
+            havePending = false;
+            pos = line.find_first_not_of(" \t");
+            if (pos != std::string::npos && hasKey(line, pos, "Username:"))
+                break;
+        }
 
-        closeButton = Button(font, "CLOSE", 28,
-                             sf::Color(255, 100, 100),
-                             sf::Color(255, 150, 150),
-                             sf::Color(200, 50, 50));
+        record.username = trim(line.substr(pos + 9));
+        record.diamonds = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            record.pets[i] = speciesName(i);
+        }
+        for (int i = 0; i < 5; i++)
+        {
+            record.itemQuantities[i] = 0;
+        }
 
-        for (int i = 0; i < 2; i++)
+        while (std::getline(in, line))
         {
-            sf::Image playerImg;
-            if (playerImg.loadFromFile(playerPets[i]->getTexturePath()))
+            pos = line.find_first_not_of(" \t");
+            if (pos == std::string::npos)
+                continue;
+            if (hasKey(line, pos, "Username:"))
             {
-                removeWhiteBackground(playerImg);
-                playerTextures[i].loadFromImage(playerImg);
-                playerSprites[i].setTexture(playerTextures[i]);
+                havePending = true;
+                break;
             }
-            else
+            if (hasKey(line, pos, "---"))
+                break;
+
+            size_t colon = line.find(':', pos);
+            if (colon == std::string::npos)
+                continue;
+
+            if (hasKey(line, pos, "Diamonds"))
             {
-                sf::Image placeholder;
-                placeholder.create(100, 100, sf::Color::Magenta);
-                playerTextures[i].loadFromImage(placeholder);
-                playerSprites[i].setTexture(playerTextures[i]);
+                record.diamonds = parseInt(line, colon + 1);
             }
-            playerSprites[i].setScale(0.8f, 0.8f);
-            playerMaxHealth[i] = playerPets[i]->getHP();
-            playerHealth[i] = playerMaxHealth[i];
-        }
-
-        for (int i = 0; i < 2; i++)
-        {
-            sf::Image enemyImg;
-            if (enemyImg.loadFromFile(enemyPets[i]->getTexturePath()))
+            else if (hasKey(line, pos, "Pet "))
             {
-                removeWhiteBackground(enemyImg);
-                enemyTextures[i].loadFromImage(enemyImg);
-                enemySprites[i].setTexture(enemyTextures[i]);
+                int index = parseInt(line, pos + 4);
+                if (index < 4)
+                    record.pets[index] = normalizePetName(line.substr(colon + 1));
             }
-            else
+            else if (hasKey(line, pos, "Item "))
             {
-                sf::Image placeholder;
-                placeholder.create(100, 100, sf::Color::Cyan);
-                enemyTextures[i].loadFromImage(placeholder);
-                enemySprites[i].setTexture(enemyTextures[i]);
+                int index = parseInt(line, pos + 5);
+                if (index < 5)
+                    record.itemQuantities[index] = parseInt(line, colon + 1);
             }
-            enemySprites[i].setScale(0.8f, 0.8f);
-            enemyMaxHealth[i] = enemyPets[i]->getHP();
-            enemyHealth[i] = enemyMaxHealth[i];
         }
 
-        for (int i = 0; i < 2; i++)
+        for (int i = 0; i < 4; i++)
         {
-            playerHealthText[i].setFont(font);
-            playerHealthText[i].setString(playerPets[i]->getName() + ": " + std::to_string(playerHealth[i]) + "/" + std::to_string(playerMaxHealth[i]));
-            playerHealthText[i].setCharacterSize(24);
-            playerHealthText[i].setFillColor(sf::Color(255, 150, 100));
-            playerHealthText[i].setOutlineThickness(1.f);
-            playerHealthText[i].setOutlineColor(sf::Color::Black);
-
-            enemyHealthText[i].setFont(font);
-            enemyHealthText[i].setString(enemyPets[i]->getName() + ": " + std::to_string(enemyHealth[i]) + "/" + std::to_string(enemyMaxHealth[i]));
-            enemyHealthText[i].setCharacterSize(24);
-            enemyHealthText[i].setFillColor(sf::Color(100, 150, 255));
-            enemyHealthText[i].setOutlineThickness(1.f);
-            enemyHealthText[i].setOutlineColor(sf::Color::Black);
-
-            playerHealthBarBackground[i].setSize(sf::Vector2f(200, 20));
-            playerHealthBarBackground[i].setFillColor(sf::Color(50, 50, 50));
-            playerHealthBarBackground[i].setOutlineThickness(2.f);
-            playerHealthBarBackground[i].setOutlineColor(sf::Color::Black);
-
-            playerHealthBar[i].setSize(sf::Vector2f(200, 20));
-            playerHealthBar[i].setFillColor(sf::Color(255, 50, 50));
+            record.petStates[i] = PetStore::defaultRecord(record.pets[i]);
+        }
+        return true;
+    }
 
-            enemyHealthBarBackground[i].setSize(sf::Vector2f(200, 20));
-            enemyHealthBarBackground[i].setFillColor(sf::Color(50, 50, 50));
-            enemyHealthBarBackground[i].setOutlineThickness(2.f);
-            enemyHealthBarBackground[i].setOutlineColor(sf::Color::Black);
+    static void printRate(const std::string &action, long long count, double seconds)
+    {
+        std::cout << action << " " << count << " records in " << seconds << " s ("
+                  << static_cast<long long>(count / std::max(seconds, 1e-9)) << " records/s)" << std::endl;
+    }
 
-            enemyHealthBar[i].setSize(sf::Vector2f(200, 20));
-            enemyHealthBar[i].setFillColor(sf::Color(50, 50, 255));
-        }
+public:
+    static std::string trim(const std::string &text)
+    {
+        size_t first = text.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos)
+            return "";
+        size_t last = text.find_last_not_of(" \t\r\n");
+        return text.substr(first, last - first + 1);
+    }
 
-        timerText.setFont(font);
-        timerText.setString("TIME: 180");
-        timerText.setCharacterSize(28);
-        timerText.setFillColor(sf::Color(255, 215, 0));
-        timerText.setOutlineThickness(1.f);
-        timerText.setOutlineColor(sf::Color::Black);
+    static std::string speciesName(int id)
+    {
+        return Species::info(id).name;
+    }
 
-        setupAbilities();
-        resetPositions();
+    // "          Dragon" and "dragon " both become "Dragon"
+    static std::string normalizePetName(const std::string &name)
+    {
+        std::string clean = trim(name);
+        int id = Species::find(clean);
+        return id >= 0 ? speciesName(id) : clean;
     }
 
-    void open()
+    // text -> binary, optionally folding in levels from a pet_data.dat file
+    static bool importText(const std::string &textFile, const std::string &storeFile, const std::string &petFile)
     {
-        isActive = true;
-        gameOver = false;
-        playerWon = false;
+        std::ifstream in(textFile);
+        if (!in.is_open())
+        {
+            std::cerr << "Error opening " << textFile << std::endl;
+            return false;
+        }
 
-        for (int i = 0; i < 2; i++)
+        sf::Clock timer;
+        std::unordered_map<std::string, PetStore::UserPets> savedPets;
+        if (!petFile.empty())
         {
-            playerMaxHealth[i] = playerPets[i]->getHP();
-            playerHealth[i] = playerMaxHealth[i];
-            enemyMaxHealth[i] = enemyPets[i]->getHP();
-            enemyHealth[i] = enemyMaxHealth[i];
-            playerHealthText[i].setString(playerPets[i]->getName() + ": " + std::to_string(playerHealth[i]) + "/" + std::to_string(playerMaxHealth[i]));
-            enemyHealthText[i].setString(enemyPets[i]->getName() + ": " + std::to_string(enemyHealth[i]) + "/" + std::to_string(enemyMaxHealth[i]));
-            playerHealthBar[i].setSize(sf::Vector2f(200, 20));
-            enemyHealthBar[i].setSize(sf::Vector2f(200, 20));
-            playerSprites[i].setColor(sf::Color::White);
-            enemySprites[i].setColor(sf::Color::White);
+            PetStore::loadAll(petFile, savedPets);
         }
 
-        gameClock.restart();
-        powerDecreaseClock.restart();
-        resetPositions();
-    }
+        Stats stats = {0, 0, 0};
+        std::vector<UserRecord> records;
+        std::unordered_map<std::string, size_t> slotOf;
+        UserRecord record;
+        std::string line;
+        bool havePending = false;
 
-    void handleInput(const sf::Event &event, const sf::Vector2f &mousePos)
-    {
-        if (event.type == sf::Event::KeyPressed)
+        while (readTextRecord(in, record, line, havePending))
         {
-            switch (event.key.code)
+            if (record.username.empty() || record.username.size() > static_cast<size_t>(NAME_SIZE))
             {
-            case sf::Keyboard::W:
-                keys[0] = true;
-                break;
-            case sf::Keyboard::A:
-                keys[1] = true;
-                break;
-            case sf::Keyboard::S:
-                keys[2] = true;
-                break;
-            case sf::Keyboard::D:
-                keys[3] = true;
-                break;
-            case sf::Keyboard::Space:
-                if (playerHealth[0] > 0)
-                {
-                    addPlayerProjectile(0);
-                }
-                break;
+                std::cerr << "Skipping record with bad username \"" << record.username << "\"" << std::endl;
+                stats.rejected++;
+                continue;
             }
-
-            switch (event.key.code)
+            std::unordered_map<std::string, PetStore::UserPets>::const_iterator saved = savedPets.find(record.username);
+            if (saved != savedPets.end())
             {
-            case sf::Keyboard::I:
-                keys[4] = true;
-                break;
-            case sf::Keyboard::J:
-                keys[5] = true;
-                break;
-            case sf::Keyboard::K:
-                keys[6] = true;
-                break;
-            case sf::Keyboard::L:
-                keys[7] = true;
-                break;
-            case sf::Keyboard::M:
-                if (playerHealth[1] > 0)
-                {
-                    addPlayerProjectile(1);
-                }
-                break;
+                std::copy(saved->second.pets, saved->second.pets + 4, record.petStates);
             }
-        }
-        else if (event.type == sf::Event::KeyReleased)
-        {
-            switch (event.key.code)
+
+            std::unordered_map<std::string, size_t>::iterator it = slotOf.find(record.username);
+            if (it != slotOf.end())
             {
-            case sf::Keyboard::W:
-                keys[0] = false;
-                break;
-            case sf::Keyboard::A:
-                keys[1] = false;
-                break;
-            case sf::Keyboard::S:
-                keys[2] = false;
-                break;
-            case sf::Keyboard::D:
-                keys[3] = false;
-                break;
+                records[it->second] = record; // the later record wins, like the game's own loader
+                stats.duplicates++;
             }
-
-            switch (event.key.code)
+            else
             {
-            case sf::Keyboard::I:
-                keys[4] = false;
-                break;
-            case sf::Keyboard::J:
-                keys[5] = false;
-                break;
-            case sf::Keyboard::K:
-                keys[6] = false;
-                break;
-            case sf::Keyboard::L:
-                keys[7] = false;
-                break;
+                slotOf[record.username] = records.size();
+                records.push_back(record);
             }
+            stats.records++;
         }
-        else if (event.type == sf::Event::MouseButtonPressed &&
-                 event.mouseButton.button == sf::Mouse::Left)
+
+        std::vector<std::pair<uint64_t, uint32_t>> index(records.size());
+        std::string out = "MPKU";
+        ByteCodec::put16(out, VERSION);
+        ByteCodec::put16(out, RECORD_SIZE);
+        ByteCodec::put32(out, static_cast<uint32_t>(records.size()));
+        ByteCodec::put32(out, 0);
+        ByteCodec::put64(out, HEADER_SIZE + static_cast<uint64_t>(records.size()) * RECORD_SIZE);
+        out.reserve(out.size() + records.size() * (RECORD_SIZE + INDEX_ENTRY_SIZE));
+        for (size_t i = 0; i < records.size(); i++)
         {
-            if (closeButton.contains(mousePos))
-            {
-                close();
-            }
+            encodeRecord(out, records[i]);
+            index[i] = std::make_pair(hashName(records[i].username), static_cast<uint32_t>(i));
+        }
+        std::sort(index.begin(), index.end());
+        for (size_t i = 0; i < index.size(); i++)
+        {
+            ByteCodec::put64(out, index[i].first);
+            ByteCodec::put32(out, index[i].second);
         }
+
+        if (!DurableFile::replace(storeFile, out))
+            return false;
+
+        printRate("Imported", stats.records, timer.getElapsedTime().asSeconds());
+        std::cout << "Unique users: " << records.size() << ", duplicates merged: " << stats.duplicates
+                  << ", rejected: " << stats.rejected << std::endl;
+        return true;
     }
 
-    void update()
+    // checks the header against the file length, so offsets read from it stay inside the file
+    static bool readHeader(const unsigned char *p, uint64_t length, uint32_t &count, uint64_t &indexOffset)
     {
-        if (gameOver)
-            return;
+        if (memcmp(p, "MPKU", 4) != 0 || ByteCodec::get16(p + 4) != VERSION || ByteCodec::get16(p + 6) != RECORD_SIZE)
+            return false;
+        count = ByteCodec::get32(p + 8);
+        indexOffset = ByteCodec::get64(p + 16);
+        return HEADER_SIZE + static_cast<uint64_t>(count) * RECORD_SIZE <= indexOffset &&
+               indexOffset + static_cast<uint64_t>(count) * INDEX_ENTRY_SIZE <= length;
+    }
+
+    static bool readAt(std::ifstream &in, uint64_t offset, unsigned char *buffer, size_t size)
+    {
+        in.seekg(static_cast<std::streamoff>(offset));
+        return static_cast<bool>(in.read(reinterpret_cast<char *>(buffer), static_cast<std::streamsize>(size)));
+    }
 
-        decreasePowerOverTime();
+    static bool readStore(const std::string &storeFile, std::string &bytes, uint32_t &count, uint64_t &indexOffset)
+    {
+        std::ifstream in(storeFile, std::ios::binary | std::ios::ate);
+        if (!in.is_open())
+            return false;
+        std::streamsize length = in.tellg();
+        if (length < HEADER_SIZE)
+            return false;
+        bytes.resize(static_cast<size_t>(length));
+        in.seekg(0);
+        if (!in.read(&bytes[0], length))
+            return false;
 
-        playerVelocities[0].x = (keys[3] - keys[1]) * playerSpeed; // D - A
-        playerVelocities[0].y = (keys[2] - keys[0]) * playerSpeed; // S - W
+        return readHeader(reinterpret_cast<const unsigned char *>(bytes.data()), static_cast<uint64_t>(length), count, indexOffset);
+    }
 
-        playerVelocities[1].x = (keys[7] - keys[5]) * playerSpeed; // L - J
-        playerVelocities[1].y = (keys[6] - keys[4]) * playerSpeed; // K - I
+    // binary -> text in the game's layout, every field written in its normalized form
+    static bool exportText(const std::string &storeFile, const std::string &textFile)
+    {
+        sf::Clock timer;
+        std::string bytes;
+        uint32_t count = 0;
+        uint64_t indexOffset = 0;
+        if (!readStore(storeFile, bytes, count, indexOffset))
+        {
+            std::cerr << "Error reading store " << storeFile << std::endl;
+            return false;
+        }
 
-        for (int i = 0; i < 2; i++)
+        std::ostringstream out;
+        const unsigned char *records = reinterpret_cast<const unsigned char *>(bytes.data()) + HEADER_SIZE;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            SaveWorker::writeRecord(out, decodeRecord(records + static_cast<size_t>(i) * RECORD_SIZE));
+            out << "----------------\n";
+        }
+
+        if (!DurableFile::replace(textFile, out.str()))
+            return false;
+
+        printRate("Exported", count, timer.getElapsedTime().asSeconds());
+        return true;
+    }
+
+    // finds one user through the hash index, reading only the header, the index entries the binary search
+    // probes and the matching 64-byte record instead of loading the store
+    static bool lookup(const std::string &storeFile, const std::string &username, UserRecord &record)
+    {
+        std::ifstream in(storeFile, std::ios::binary | std::ios::ate);
+        if (!in.is_open())
+            return false;
+        uint64_t length = static_cast<uint64_t>(in.tellg());
+
+        unsigned char header[HEADER_SIZE];
+        uint32_t count = 0;
+        uint64_t indexOffset = 0;
+        if (length < HEADER_SIZE || !readAt(in, 0, header, HEADER_SIZE) || !readHeader(header, length, count, indexOffset))
+            return false;
+
+        uint64_t hash = hashName(username);
+        unsigned char entry[INDEX_ENTRY_SIZE];
+        uint32_t low = 0, high = count;
+        while (low < high)
+        {
+            uint32_t mid = low + (high - low) / 2;
+            if (!readAt(in, indexOffset + static_cast<uint64_t>(mid) * INDEX_ENTRY_SIZE, entry, INDEX_ENTRY_SIZE))
+                return false;
+            if (ByteCodec::get64(entry) < hash)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+
+        unsigned char bytes[RECORD_SIZE];
+        for (uint32_t i = low; i < count; i++)
+        {
+            if (!readAt(in, indexOffset + static_cast<uint64_t>(i) * INDEX_ENTRY_SIZE, entry, INDEX_ENTRY_SIZE) ||
+                ByteCodec::get64(entry) != hash)
+                return false;
+
+            uint32_t slot = ByteCodec::get32(entry + 8);
+            if (slot >= count || !readAt(in, HEADER_SIZE + static_cast<uint64_t>(slot) * RECORD_SIZE, bytes, RECORD_SIZE))
+                return false;
+            record = decodeRecord(bytes);
+            if (record.username == username)
+                return true;
+        }
+        return false;
+    }
+
+    static int runCommand(int argc, char *argv[])
+    {
+        std::string command = argv[1];
+        if (command == "--import" && argc >= 4)
+        {
+            return importText(argv[2], argv[3], argc >= 5 ? argv[4] : "") ? 0 : 1;
+        }
+        if (command == "--export" && argc >= 4)
+        {
+            return exportText(argv[2], argv[3]) ? 0 : 1;
+        }
+        if (command == "--lookup" && argc >= 4)
         {
-            if (playerVelocities[i].x != 0 && playerVelocities[i].y != 0)
+            UserRecord record;
+            if (!lookup(argv[2], argv[3], record))
+            {
+                std::cerr << "User " << argv[3] << " not found" << std::endl;
+                return 1;
+            }
+            SaveWorker::writeRecord(std::cout, record);
+            for (int i = 0; i < 4; i++)
             {
-                playerVelocities[i] *= 0.7071f;
+                std::cout << "Pet " << i << " level: " << static_cast<int>(record.petStates[i].level)
+                          << " (TP: " << record.petStates[i].trainingPoints << ")\n";
             }
+            return 0;
         }
 
-        for (int i = 0; i < 2; i++)
+        std::cerr << "Usage: " << argv[0] << " --import <user_data.txt> <users.bin> [pet_data.dat]\n"
+                  << "       " << argv[0] << " --export <users.bin> <user_data.txt>\n"
+                  << "       " << argv[0] << " --lookup <users.bin> <username>\n"
+                  << "       " << argv[0] << " --selfplay [matches per setting] [seed]\n"
+                  << "       " << argv[0] << " --tournament <Species:level,...> [roundrobin|bracket] [1v1|2v2] [games per pairing] [seed]\n"
+                  << "       " << argv[0] << " --sweep <species> [games per opponent] [seed] [results.tsv]\n"
+                  << "       " << argv[0] << " --server [port] [seed] [players] [simulated loss %] [replay file]\n"
+                  << "       " << argv[0] << " --client [host] [port] [play|bot|watch|watch-headless] [Species:level]\n"
+                  << "       " << argv[0] << " --rollback <local port> <remote host> <remote port> <seat 1|2> <seed> [play|bot] [input delay] [Species:level]\n"
+                  << "       " << argv[0] << " --rollback loopback [latency ticks] [seed] [input delay]\n"
+                  << "       " << argv[0] << " --replay <file> [seek to second]\n"
+                  << "       " << argv[0] << " --arenas [count] [matches per arena] [seed]" << std::endl;
+        return 1;
+    }
+};
+
+// ==================== USER DATA CLASS ==================== //
+
+// This class handles user data like username, diamonds, pets, and items, loading and saving it to a file.
+// It uses concepts like encapsulation (keeping data private) and file I/O to save and load user information.
+class UserData
+{
+private:
+    std::string filename;
+    std::string petFilename;
+    std::string username;
+    int diamonds;
+    std::string pets[4];
+    int itemQuantities[5];
+    PetRecord petStates[4];
+    std::string itemNames[5] = {
+        "Healing Potion",
+        "Mana Potion",
+        "Attack Buff",
+        "Speed Buff",
+        "Shield"};
+    Leaderboard *leaderboard;
+    SaveWorker *saveWorker;
+
+public:
+    UserData() : username(""), diamonds(0), leaderboard(nullptr), saveWorker(nullptr) // constructor
+    {
+        filename = "user_data.txt";
+        petFilename = "pet_data.dat";
+        for (int i = 0; i < 4; i++)
         {
-            if (playerHealth[i] > 0)
-            {
-                playerSprites[i].move(playerVelocities[i]);
+            pets[i] = "";
+            petStates[i] = PetStore::defaultRecord(pets[i]);
+        }
+        for (int i = 0; i < 5; i++)
+        {
+            itemQuantities[i] = 0;
+        }
+    }
+
+    void initializeNewUser()
+    {
+        diamonds = 500;
+        pets[0] = "Dragon";
+        pets[1] = "Phoenix";
+        pets[2] = "Griffin";
+        pets[3] = "Unicorn";
+        for (int i = 0; i < 4; i++)
+        {
+            petStates[i] = PetStore::defaultRecord(pets[i]);
+        }
 
-                sf::FloatRect spriteBounds = playerSprites[i].getGlobalBounds();
+        itemQuantities[0] = 3;
+        itemQuantities[1] = 2;
+    }
+
+    bool userExists(const std::string &name)
+    {
+        if (saveWorker)
+            saveWorker->flush();
+
+        std::ifstream file(filename);
+        std::string line;
 
-                if (spriteBounds.left < arenaBounds.left)
-                    playerSprites[i].setPosition(arenaBounds.left, spriteBounds.top);
-                if (spriteBounds.left + spriteBounds.width > arenaBounds.left + arenaBounds.width)
-                    playerSprites[i].setPosition(arenaBounds.left + arenaBounds.width - spriteBounds.width, spriteBounds.top);
-                if (spriteBounds.top < arenaBounds.top)
-                    playerSprites[i].setPosition(spriteBounds.left, arenaBounds.top);
-                if (spriteBounds.top + spriteBounds.height > arenaBounds.top + arenaBounds.height)
-                    playerSprites[i].setPosition(spriteBounds.left, arenaBounds.top + arenaBounds.height - spriteBounds.height);
+        while (std::getline(file, line))
+        {
+            if (line.find("Username: " + name) != std::string::npos)
+            {
+                return true;
             }
         }
+        return false;
+    }
 
-        // Enemy AI movement
-        for (int i = 0; i < 2; i++)
+    void loadUserData(const std::string &name)
+    {
+        if (saveWorker)
+            saveWorker->flush();
+
+        std::ifstream file(filename);
+        std::string line;
+        bool found = false;
+
+        while (std::getline(file, line))
         {
-            if (enemyHealth[i] > 0)
+            if (line.find("Username: " + name) != std::string::npos)
             {
-                float minDistance = 9999;
-                int targetIndex = -1;
+                found = true;
+                username = name;
+
+                std::getline(file, line);
+                std::stringstream ss(line.substr(10));
+                ss >> diamonds;
 
-                for (int j = 0; j < 2; j++)
+                for (int i = 0; i < 4; i++)
                 {
-                    if (playerHealth[j] > 0)
-                    {
-                        float dx = playerSprites[j].getPosition().x - enemySprites[i].getPosition().x;
-                        float dy = playerSprites[j].getPosition().y - enemySprites[i].getPosition().y;
-                        float distance = sqrt(dx * dx + dy * dy);
+                    std::getline(file, line);
+                    pets[i] = UserStore::normalizePetName(line.substr(line.find(':') + 1));
+                }
 
-                        if (distance < minDistance)
-                        {
-                            minDistance = distance;
-                            targetIndex = j;
-                        }
-                    }
+                for (int i = 0; i < 5; i++)
+                {
+                    std::getline(file, line);
+                    std::stringstream ss(line.substr(8));
+                    ss >> itemQuantities[i];
                 }
 
-                if (targetIndex >= 0)
+                // players saved before pet progress existed start every pet at level 1
+                if (!PetStore::load(petFilename, username, petStates))
                 {
-                    sf::Vector2f direction = playerSprites[targetIndex].getPosition() - enemySprites[i].getPosition();
-                    float length = sqrt(direction.x * direction.x + direction.y * direction.y);
-                    if (length > 0)
+                    for (int i = 0; i < 4; i++)
                     {
-                        direction /= length;
+                        petStates[i] = PetStore::defaultRecord(pets[i]);
+                    }
+                }
+                break;
+            }
+        }
 
-                        direction.x += ((rand() % 100) - 50) * 0.01f;
-                        direction.y += ((rand() % 100) - 50) * 0.01f;
+        if (!found)
+        {
+            username = name;
+            initializeNewUser();
+            saveUserData();
+        }
 
-                        length = sqrt(direction.x * direction.x + direction.y * direction.y);
-                        if (length > 0)
-                        {
-                            direction /= length;
-                        }
+        if (leaderboard)
+            leaderboard->update(username, diamonds);
+    }
 
-                        enemyVelocities[i] = direction * enemySpeed;
-                    }
-                }
-                else
-                {
-                    enemyVelocities[i].x = ((rand() % 100) - 50) * 0.02f;
-                    enemyVelocities[i].y = ((rand() % 100) - 50) * 0.02f;
-                }
+    UserRecord snapshot() const
+    {
+        UserRecord record;
+        record.username = username;
+        record.diamonds = diamonds;
+        for (int i = 0; i < 4; i++)
+        {
+            record.pets[i] = pets[i];
+        }
+        for (int i = 0; i < 5; i++)
+        {
+            record.itemQuantities[i] = itemQuantities[i];
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            record.petStates[i] = petStates[i];
+        }
+        return record;
+    }
+
+    void saveUserData()
+    {
+        updateUserData();
+    }
 
-                enemySprites[i].move(enemyVelocities[i]);
+    // hands a snapshot to the save thread when one is attached, otherwise writes right away
+    void updateUserData()
+    {
+        if (saveWorker)
+        {
+            saveWorker->submit(snapshot());
+            return;
+        }
 
-                sf::FloatRect spriteBounds = enemySprites[i].getGlobalBounds();
+        std::map<std::string, UserRecord> records;
+        records[username] = snapshot();
+        SaveWorker::writeRecords(filename, records);
+        SaveWorker::writePetRecords(petFilename, records);
+    }
 
-                if (spriteBounds.left < arenaBounds.left)
-                    enemySprites[i].setPosition(arenaBounds.left, spriteBounds.top);
-                if (spriteBounds.left + spriteBounds.width > arenaBounds.left + arenaBounds.width)
-                    enemySprites[i].setPosition(arenaBounds.left + arenaBounds.width - spriteBounds.width, spriteBounds.top);
-                if (spriteBounds.top < arenaBounds.top)
-                    enemySprites[i].setPosition(spriteBounds.left, arenaBounds.top);
-                if (spriteBounds.top + spriteBounds.height > arenaBounds.top + arenaBounds.height)
-                    enemySprites[i].setPosition(spriteBounds.left, arenaBounds.top + arenaBounds.height - spriteBounds.height);
+    void addDiamonds(int amount)
+    {
+        diamonds += amount;
+        if (diamonds < 0)
+            diamonds = 0;
+        if (leaderboard)
+            leaderboard->update(username, diamonds);
+    }
+
+    void setLeaderboard(Leaderboard *board) { leaderboard = board; }
+    void setSaveWorker(SaveWorker *worker) { saveWorker = worker; }
+    void setItemQuantity(int index, int quantity)
+    {
+        if (index >= 0 && index < 5)
+        {
+            itemQuantities[index] = quantity;
+            if (itemQuantities[index] < 0)
+                itemQuantities[index] = 0;
+        }
+    }
+    void addItemQuantity(int index, int amount)
+    {
+        if (index >= 0 && index < 5)
+        {
+            itemQuantities[index] += amount;
+            if (itemQuantities[index] < 0)
+                itemQuantities[index] = 0;
+        }
+    }
+                                             // getter
+    int getItemQuantity(int index) const
+    {
+        if (index >= 0 && index < 5)
+            return itemQuantities[index];
+        return 0;
+    }
+    std::string getItemName(int index) const
+    {
+        if (index >= 0 && index < 5)
+            return itemNames[index];
+        return "";
+    }
+
+    PetRecord getPetState(int index) const
+    {
+        if (index >= 0 && index < 4)
+            return petStates[index];
+        return PetStore::defaultRecord("");
+    }
+
+    void setPetState(int index, int level, int trainingPoints)
+    {
+        if (index >= 0 && index < 4)
+        {
+            petStates[index].level = static_cast<uint8_t>(std::max(1, std::min(level, 255)));
+            petStates[index].trainingPoints = static_cast<uint16_t>(std::max(0, std::min(trainingPoints, 65535)));
+        }
+    }
+
+    int getDiamonds() const { return diamonds; }
+    std::string getUsername() const { return username; }
+};
+
+// ==================== JOB SYSTEM CLASS ==================== //
+
+// Work-stealing thread pool, each worker owns a deque of range tasks and raids the others when its own runs dry.
+// It uses Encapsulation, callers only see parallelFor and gather, and the submitting thread helps until its batch is done so nested calls never deadlock.
+class JobSystem
+{
+private:
+    struct Batch
+    {
+        const std::function<void(int, int)> *body;
+        std::atomic<int> remaining;
+    };
+
+    struct Task
+    {
+        Batch *batch;
+        int begin;
+        int end;
+    };
+
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    // queues[0 .. workers) belong to the workers, the last one takes work submitted from outside the pool
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    std::atomic<int> queued;
+    bool stopping;
+
+    static int &workerIndex()
+    {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    int homeQueue() const
+    {
+        int index = workerIndex();
+        return index >= 0 ? index : static_cast<int>(queues.size()) - 1;
+    }
+
+    // own queue from the back (most recently split, still warm), everyone else's from the front
+    bool takeTask(int home, Task &task)
+    {
+        {
+            Queue &own = *queues[home];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty())
+            {
+                task = own.tasks.back();
+                own.tasks.pop_back();
+                queued--;
+                return true;
+            }
+        }
+        int count = static_cast<int>(queues.size());
+        for (int offset = 1; offset < count; offset++)
+        {
+            Queue &victim = *queues[(home + offset) % count];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void runTask(const Task &task)
+    {
+        (*task.batch->body)(task.begin, task.end);
+        task.batch->remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    void workerLoop(int index)
+    {
+        workerIndex() = index;
+        Task task;
+        while (true)
+        {
+            if (takeTask(index, task))
+            {
+                runTask(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepLock);
+            wake.wait(lock, [this]
+                      { return stopping || queued.load() > 0; });
+            if (stopping && queued.load() == 0)
+                break;
+        }
+    }
+
+public:
+    explicit JobSystem(int threadCount = -1) : queued(0), stopping(false) // constructor
+    {
+        if (threadCount < 0)
+            threadCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency())) - 1;
+        for (int i = 0; i <= threadCount; i++)
+        {
+            queues.push_back(std::unique_ptr<Queue>(new Queue()));
+        }
+        for (int i = 0; i < threadCount; i++)
+        {
+            workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+        }
+    }
+
+    ~JobSystem() // destructor
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+        {
+            workers[i].join();
+        }
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // one pool for the whole process, sized to the machine
+    static JobSystem &shared()
+    {
+        static JobSystem pool;
+        return pool;
+    }
+
+    // body(begin, end) over [0, count) in chunks of `grain`, returns once every chunk has run
+    void parallelFor(int count, int grain, const std::function<void(int, int)> &body)
+    {
+        if (count <= 0)
+            return;
+        grain = std::max(1, grain);
+        int chunks = (count + grain - 1) / grain;
+        if (chunks == 1 || workers.empty())
+        {
+            body(0, count);
+            return;
+        }
+
+        Batch batch;
+        batch.body = &body;
+        batch.remaining.store(chunks);
+
+        // deal the chunks out round robin so every worker starts with local work
+        int queueCount = static_cast<int>(queues.size());
+        int home = homeQueue();
+        for (int c = 0; c < chunks; c++)
+        {
+            Task task;
+            task.batch = &batch;
+            task.begin = c * grain;
+            task.end = std::min(count, task.begin + grain);
+            Queue &target = *queues[(home + c) % queueCount];
+            std::lock_guard<std::mutex> guard(target.lock);
+            target.tasks.push_back(task);
+            queued++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepLock);
+        }
+        wake.notify_all();
+
+        // help out, possibly with other batches, until ours is finished
+        Task task;
+        while (batch.remaining.load(std::memory_order_acquire) > 0)
+        {
+            if (takeTask(home, task))
+                runTask(task);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    // produce(begin, end, out) fills one vector per chunk, the chunks are appended in index order
+    // so the merged result is the same whatever thread ran what
+    template <typename T, typename Produce>
+    void gather(int count, int grain, std::vector<T> &merged, Produce produce)
+    {
+        grain = std::max(1, grain);
+        int chunks = std::max(0, (count + grain - 1) / grain);
+        std::vector<std::vector<T>> parts(chunks);
+        parallelFor(count, grain, [&](int begin, int end)
+                    { produce(begin, end, parts[begin / grain]); });
+        for (int c = 0; c < chunks; c++)
+        {
+            merged.insert(merged.end(), parts[c].begin(), parts[c].end());
+        }
+    }
+
+    int getThreadCount() const { return static_cast<int>(workers.size()) + 1; } // getter
+};
+
+// ==================== TIMER WHEEL CLASS ==================== //
+
+// Hierarchical timing wheel driven by simulation ticks, every cooldown, spawn and periodic effect of a battle is one entry here.
+// It uses Encapsulation, scheduling, cancelling and firing are O(1) and the timers live in one pool that a battle resets when it starts.
+class TimerWheel
+{
+public:
+    static const int TICKS_PER_SECOND = 60;
+
+private:
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const int LEVELS = 3;
+    static const int FAR_LIST = LEVELS * SLOTS; // past the last level, re-sorted once per full turn
+    static const int FIRING_LIST = FAR_LIST + 1;
+    static const int LIST_COUNT = FIRING_LIST + 1;
+
+    struct Timer
+    {
+        int event;
+        uint32_t period; // 0 for one-shot timers
+        uint64_t due;
+        int list;        // -1 while the entry is free
+        int prev;
+        int next;
+        uint16_t generation;
+    };
+
+    std::vector<Timer> timers;
+    std::vector<int> freeTimers;
+    int heads[LIST_COUNT];
+    uint64_t current;
+
+    void link(int index, int list)
+    {
+        Timer &timer = timers[index];
+        timer.list = list;
+        timer.prev = -1;
+        timer.next = heads[list];
+        if (heads[list] >= 0)
+            timers[heads[list]].prev = index;
+        heads[list] = index;
+    }
+
+    void unlink(int index)
+    {
+        Timer &timer = timers[index];
+        if (timer.prev >= 0)
+            timers[timer.prev].next = timer.next;
+        else
+            heads[timer.list] = timer.next;
+        if (timer.next >= 0)
+            timers[timer.next].prev = timer.prev;
+        timer.list = -1;
+    }
+
+    void place(int index)
+    {
+        uint64_t due = timers[index].due;
+        uint64_t delta = due - current;
+        if (delta < (1u << SLOT_BITS))
+            link(index, static_cast<int>(due & (SLOTS - 1)));
+        else if (delta < (1u << (2 * SLOT_BITS)))
+            link(index, SLOTS + static_cast<int>((due >> SLOT_BITS) & (SLOTS - 1)));
+        else if (delta < (1u << (3 * SLOT_BITS)))
+            link(index, 2 * SLOTS + static_cast<int>((due >> (2 * SLOT_BITS)) & (SLOTS - 1)));
+        else
+            link(index, FAR_LIST);
+    }
+
+    // moves every timer of a coarse slot down to the level that now fits it
+    void cascade(int list)
+    {
+        int index = heads[list];
+        heads[list] = -1;
+        while (index >= 0)
+        {
+            int next = timers[index].next;
+            timers[index].list = -1;
+            place(index);
+            index = next;
+        }
+    }
+
+    int handleOf(int index) const { return (timers[index].generation << 16) | index; }
+
+    int indexOf(int handle) const
+    {
+        if (handle < 0)
+            return -1;
+        int index = handle & 0xFFFF;
+        if (index >= static_cast<int>(timers.size()) || timers[index].list < 0 ||
+            timers[index].generation != static_cast<uint16_t>(handle >> 16))
+            return -1;
+        return index;
+    }
+
+    void release(int index)
+    {
+        timers[index].generation = (timers[index].generation + 1) & 0x7FFF;
+        freeTimers.push_back(index);
+    }
+
+public:
+    TimerWheel() { reset(); } // constructor
+
+    // forgets every timer and starts counting from tick 0 again
+    void reset()
+    {
+        for (int i = 0; i < LIST_COUNT; i++)
+        {
+            heads[i] = -1;
+        }
+        for (size_t i = 0; i < timers.size(); i++)
+        {
+            if (timers[i].list >= 0)
+            {
+                timers[i].list = -1;
+                release(static_cast<int>(i));
+            }
+        }
+        current = 0;
+    }
+
+    static uint32_t ticks(float seconds)
+    {
+        return static_cast<uint32_t>(std::max(1.0f, seconds * TICKS_PER_SECOND + 0.5f));
+    }
+
+    // fires `event` after delayTicks (at least 1), then every periodTicks if that is not 0
+    int schedule(uint32_t delayTicks, int event, uint32_t periodTicks = 0)
+    {
+        int index;
+        if (!freeTimers.empty())
+        {
+            index = freeTimers.back();
+            freeTimers.pop_back();
+        }
+        else
+        {
+            if (timers.size() >= 0xFFFF)
+                return -1;
+            Timer timer;
+            timer.generation = 0;
+            timer.list = -1;
+            timers.push_back(timer);
+            index = static_cast<int>(timers.size()) - 1;
+        }
+
+        Timer &timer = timers[index];
+        timer.event = event;
+        timer.period = periodTicks;
+        timer.due = current + std::max<uint32_t>(1, delayTicks);
+        place(index);
+        return handleOf(index);
+    }
+
+    bool cancel(int handle)
+    {
+        int index = indexOf(handle);
+        if (index < 0)
+            return false;
+        unlink(index);
+        release(index);
+        return true;
+    }
+
+    bool isPending(int handle) const { return indexOf(handle) >= 0; }
+
+    uint32_t remaining(int handle) const
+    {
+        int index = indexOf(handle);
+        return index < 0 ? 0 : static_cast<uint32_t>(timers[index].due - current);
+    }
+
+    // one simulation tick, onFire(event) runs for each timer that comes due and may schedule or cancel others
+    template <typename Handler>
+    void advance(Handler onFire)
+    {
+        current++;
+        if ((current & (SLOTS - 1)) == 0)
+        {
+            if ((current & ((1u << (2 * SLOT_BITS)) - 1)) == 0)
+            {
+                if ((current & ((1u << (3 * SLOT_BITS)) - 1)) == 0)
+                    cascade(FAR_LIST);
+                cascade(2 * SLOTS + static_cast<int>((current >> (2 * SLOT_BITS)) & (SLOTS - 1)));
+            }
+            cascade(SLOTS + static_cast<int>((current >> SLOT_BITS) & (SLOTS - 1)));
+        }
+
+        // move the due slot to a list of its own so handlers can touch the wheel safely
+        int slot = static_cast<int>(current & (SLOTS - 1));
+        while (heads[slot] >= 0)
+        {
+            int index = heads[slot];
+            unlink(index);
+            link(index, FIRING_LIST);
+        }
+
+        while (heads[FIRING_LIST] >= 0)
+        {
+            int index = heads[FIRING_LIST];
+            unlink(index);
+            int event = timers[index].event;
+            if (timers[index].period > 0)
+            {
+                timers[index].due = current + timers[index].period;
+                place(index);
+            }
+            else
+            {
+                release(index);
+            }
+            onFire(event);
+        }
+    }
+
+    uint64_t now() const { return current; }
+    float seconds() const { return static_cast<float>(current) / TICKS_PER_SECOND; }
+};
+
+// ==================== TARGETING PASS CLASS ==================== //
+
+// Finds the nearest living target for every seeker in one sweep over packed x/y arrays, so the cost stays flat as unit counts grow.
+// It uses Encapsulation, battles only load positions and read back the chosen target and its squared distance.
+class TargetingPass
+{
+private:
+    static constexpr float NO_TARGET = 1e30f;
+
+    std::vector<float> seekerX;
+    std::vector<float> seekerY;
+    std::vector<float> targetX;
+    std::vector<float> targetY;
+    std::vector<unsigned char> targetAlive;
+
+    std::vector<float> bestDistanceSquared;
+    std::vector<int> bestTarget;
+
+public:
+    // keeps the capacity so refilling every frame does not allocate
+    void clear()
+    {
+        seekerX.clear();
+        seekerY.clear();
+        targetX.clear();
+        targetY.clear();
+        targetAlive.clear();
+    }
+
+    void addSeeker(const sf::Vector2f &position)
+    {
+        seekerX.push_back(position.x);
+        seekerY.push_back(position.y);
+    }
+
+    void addTarget(const sf::Vector2f &position, bool alive)
+    {
+        targetX.push_back(position.x);
+        targetY.push_back(position.y);
+        targetAlive.push_back(alive ? 1 : 0);
+    }
+
+    void run()
+    {
+        size_t seekerCount = seekerX.size();
+        bestDistanceSquared.assign(seekerCount, NO_TARGET);
+        bestTarget.assign(seekerCount, -1);
+
+        const float *sx = seekerX.data();
+        const float *sy = seekerY.data();
+        float *best = bestDistanceSquared.data();
+        int *chosen = bestTarget.data();
+
+        for (size_t j = 0; j < targetX.size(); j++)
+        {
+            if (!targetAlive[j])
+                continue;
+
+            const float tx = targetX[j];
+            const float ty = targetY[j];
+            const int index = static_cast<int>(j);
+
+            // no branches and no sqrt in here, the compiler turns it into SIMD over the seekers
+            // (the index update is arithmetic on purpose, a select on ints stops gcc from vectorizing)
+            for (size_t i = 0; i < seekerCount; i++)
+            {
+                float dx = tx - sx[i];
+                float dy = ty - sy[i];
+                float distanceSquared = dx * dx + dy * dy;
+                int closer = distanceSquared < best[i];
+                best[i] = closer ? distanceSquared : best[i];
+                chosen[i] += (index - chosen[i]) * closer;
+            }
+        }
+    }
+
+    // -1 when every target is down
+    int getTarget(int seeker) const
+    {
+        if (seeker < 0 || seeker >= static_cast<int>(bestTarget.size()))
+            return -1;
+        return bestTarget[seeker];
+    }
+
+    float getDistanceSquared(int seeker) const
+    {
+        if (seeker < 0 || seeker >= static_cast<int>(bestDistanceSquared.size()))
+            return NO_TARGET;
+        return bestDistanceSquared[seeker];
+    }
+};
+
+// ==================== BATTLE RANDOM CLASS ==================== //
+
+// Small xoshiro128** generator that each battle owns, so runs are repeatable from a seed and battles never share state.
+// It uses Encapsulation, the four state words are private and only the seed and the draw functions are exposed.
+class BattleRandom
+{
+private:
+    uint32_t state[4];
+    uint64_t seed;
+
+    static uint32_t rotl(uint32_t value, int shift)
+    {
+        return (value << shift) | (value >> (32 - shift));
+    }
+
+    // splitmix64 spreads any seed (even 0 or 1) over the whole state
+    static uint64_t splitMix(uint64_t &x)
+    {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+public:
+    BattleRandom() { setSeed(freshSeed()); }                    // constructor
+    explicit BattleRandom(uint64_t newSeed) { setSeed(newSeed); } // constructor
+
+    void setSeed(uint64_t newSeed)
+    {
+        seed = newSeed;
+        uint64_t x = newSeed;
+        uint64_t a = splitMix(x);
+        uint64_t b = splitMix(x);
+        state[0] = static_cast<uint32_t>(a);
+        state[1] = static_cast<uint32_t>(a >> 32);
+        state[2] = static_cast<uint32_t>(b);
+        state[3] = static_cast<uint32_t>(b >> 32);
+    }
+
+    uint64_t getSeed() const { return seed; }
+
+    // the four state words, for writing a battle to disk mid-match and picking it up again
+    void getState(uint32_t out[4]) const { memcpy(out, state, sizeof(state)); }
+    void setState(const uint32_t in[4]) { memcpy(state, in, sizeof(state)); }
+
+    uint32_t next()
+    {
+        uint32_t result = rotl(state[1] * 5, 7) * 9;
+        uint32_t t = state[1] << 9;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 11);
+        return result;
+    }
+
+    // 0 .. bound-1, same use as rand() % bound without the modulo bias
+    int nextInt(int bound)
+    {
+        if (bound <= 0)
+            return 0;
+        return static_cast<int>((static_cast<uint64_t>(next()) * static_cast<uint32_t>(bound)) >> 32);
+    }
+
+    // 0.0 .. 1.0 (exclusive)
+    float nextFloat()
+    {
+        return (next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // different for every call, used when nobody asked for a fixed seed
+    static uint64_t freshSeed()
+    {
+        static std::atomic<uint64_t> counter(0);
+        uint64_t time = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        uint64_t x = time ^ (counter.fetch_add(1) * 0x9E3779B97F4A7C15ULL);
+        return splitMix(x);
+    }
+};
+
+// ==================== THREAT FIELD CLASS ==================== //
+
+// Buckets the projectiles aimed at one side into a coarse grid every tick, and tells an enemy which shot will hit it first.
+// It uses Encapsulation, positions and velocities sit in packed arrays and a query only touches the cells around the asker.
+struct Threat
+{
+    bool active;
+    float timeToImpact;  // frames until the closest approach
+    sf::Vector2f escape; // unit direction that leaves the shot's path fastest
+};
+
+class ThreatField
+{
+private:
+    static constexpr float CELL_SIZE = 128.0f;
+
+    sf::FloatRect area;
+    int columns;
+    int rows;
+
+    std::vector<float> posX, posY, velX, velY;
+    std::vector<int> cellStart; // shots of cell c are order[cellStart[c] .. cellStart[c + 1])
+    std::vector<int> order;
+    std::vector<int> cellOf;
+    std::vector<int> writeCursor;
+
+    // scratch for one assess() call, kept between calls so it never allocates after warm-up
+    mutable std::vector<float> nearX, nearY, nearVX, nearVY, nearT, nearD2;
+
+    int cellIndex(float x, float y) const
+    {
+        int cx = std::clamp(static_cast<int>((x - area.left) / CELL_SIZE), 0, columns - 1);
+        int cy = std::clamp(static_cast<int>((y - area.top) / CELL_SIZE), 0, rows - 1);
+        return cy * columns + cx;
+    }
+
+public:
+    ThreatField() : columns(1), rows(1) {} // constructor
+
+    void clear(const sf::FloatRect &bounds)
+    {
+        area = bounds;
+        columns = std::max(1, static_cast<int>(ceil(bounds.width / CELL_SIZE)));
+        rows = std::max(1, static_cast<int>(ceil(bounds.height / CELL_SIZE)));
+        posX.clear();
+        posY.clear();
+        velX.clear();
+        velY.clear();
+    }
+
+    void addProjectile(const sf::Vector2f &center, const sf::Vector2f &velocity)
+    {
+        posX.push_back(center.x);
+        posY.push_back(center.y);
+        velX.push_back(velocity.x);
+        velY.push_back(velocity.y);
+    }
+
+    // counting sort of the shots by cell
+    void build()
+    {
+        int cellCount = columns * rows;
+        int count = static_cast<int>(posX.size());
+        cellStart.assign(cellCount + 1, 0);
+        cellOf.resize(count);
+        order.resize(count);
+
+        for (int i = 0; i < count; i++)
+        {
+            cellOf[i] = cellIndex(posX[i], posY[i]);
+            cellStart[cellOf[i] + 1]++;
+        }
+        for (int c = 0; c < cellCount; c++)
+        {
+            cellStart[c + 1] += cellStart[c];
+        }
+        writeCursor.assign(cellStart.begin(), cellStart.end() - 1);
+        for (int i = 0; i < count; i++)
+        {
+            order[writeCursor[cellOf[i]]++] = i;
+        }
+    }
+
+    int size() const { return static_cast<int>(posX.size()); }
+
+    // first shot that comes within hitRadius of the agent in the next `horizon` frames,
+    // only shots that could cover the distance in time (maxShotSpeed) are looked at
+    Threat assess(const sf::Vector2f &center, const sf::Vector2f &velocity, float hitRadius,
+                  float horizon, float maxShotSpeed) const
+    {
+        Threat threat;
+        threat.active = false;
+        threat.timeToImpact = horizon;
+        threat.escape = sf::Vector2f(0, 0);
+        if (horizon <= 0 || posX.empty())
+            return threat;
+
+        float reach = maxShotSpeed * horizon + hitRadius;
+        int minCell = cellIndex(center.x - reach, center.y - reach);
+        int maxCell = cellIndex(center.x + reach, center.y + reach);
+        int minX = minCell % columns, minY = minCell / columns;
+        int maxX = maxCell % columns, maxY = maxCell / columns;
+
+        nearX.clear();
+        nearY.clear();
+        nearVX.clear();
+        nearVY.clear();
+        for (int cy = minY; cy <= maxY; cy++)
+        {
+            for (int cx = minX; cx <= maxX; cx++)
+            {
+                int c = cy * columns + cx;
+                for (int k = cellStart[c]; k < cellStart[c + 1]; k++)
+                {
+                    int i = order[k];
+                    nearX.push_back(posX[i] - center.x);
+                    nearY.push_back(posY[i] - center.y);
+                    nearVX.push_back(velX[i] - velocity.x);
+                    nearVY.push_back(velY[i] - velocity.y);
+                }
+            }
+        }
+
+        size_t n = nearX.size();
+        if (n == 0)
+            return threat;
+        nearT.resize(n);
+        nearD2.resize(n);
+
+        // closest approach of every nearby shot in one branch-free sweep
+        const float *rx = nearX.data();
+        const float *ry = nearY.data();
+        const float *vx = nearVX.data();
+        const float *vy = nearVY.data();
+        float *outT = nearT.data();
+        float *outD2 = nearD2.data();
+        for (size_t i = 0; i < n; i++)
+        {
+            float vv = vx[i] * vx[i] + vy[i] * vy[i] + 1e-6f;
+            float t = std::min(std::max(-(rx[i] * vx[i] + ry[i] * vy[i]) / vv, 0.0f), horizon);
+            float cx = rx[i] + vx[i] * t;
+            float cy = ry[i] + vy[i] * t;
+            outT[i] = t;
+            outD2[i] = cx * cx + cy * cy;
+        }
+
+        float radiusSquared = hitRadius * hitRadius;
+        int first = -1;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (outD2[i] < radiusSquared && (first < 0 || outT[i] < outT[first]))
+                first = static_cast<int>(i);
+        }
+        if (first < 0)
+            return threat;
+
+        // move away from where the shot will pass, sideways if it is dead on
+        sf::Vector2f miss(rx[first] + vx[first] * outT[first], ry[first] + vy[first] * outT[first]);
+        float missLength = sqrt(outD2[first]);
+        if (missLength > 1.0f)
+        {
+            threat.escape = -miss / missLength;
+        }
+        else
+        {
+            float speed = sqrt(vx[first] * vx[first] + vy[first] * vy[first]);
+            threat.escape = speed > 0 ? sf::Vector2f(-vy[first], vx[first]) / speed : sf::Vector2f(0, 1);
+        }
+        threat.active = true;
+        threat.timeToImpact = outT[first];
+        return threat;
+    }
+};
+
+// ==================== SPATIAL GRID CLASS ==================== //
+
+// Uniform grid over an arena rebuilt every tick with a counting sort, so "who is near me" only looks at a few cells instead of every unit.
+// It uses Encapsulation, callers hand in packed position arrays and get back unit indices cell by cell.
+class SpatialGrid
+{
+private:
+    sf::FloatRect area;
+    float cellSize;
+    int columns;
+    int rows;
+
+    std::vector<int> cellStart; // items of cell c are order[cellStart[c] .. cellStart[c + 1])
+    std::vector<int> order;
+    std::vector<int> cellOf;
+    std::vector<int> writeCursor;
+
+    int columnOf(float x) const { return std::clamp(static_cast<int>((x - area.left) / cellSize), 0, columns - 1); }
+    int rowOf(float y) const { return std::clamp(static_cast<int>((y - area.top) / cellSize), 0, rows - 1); }
+
+public:
+    SpatialGrid() : cellSize(64.0f), columns(1), rows(1) {} // constructor
+
+    // buckets items[0 .. count) by the cell their x/y falls in, x and y are indexed by item
+    void build(const sf::FloatRect &bounds, float size, const float *x, const float *y, const int *items, int count)
+    {
+        area = bounds;
+        cellSize = size;
+        columns = std::max(1, static_cast<int>(ceil(bounds.width / size)));
+        rows = std::max(1, static_cast<int>(ceil(bounds.height / size)));
+
+        int cellCount = columns * rows;
+        cellStart.assign(cellCount + 1, 0);
+        cellOf.resize(count);
+        order.resize(count);
+
+        for (int i = 0; i < count; i++)
+        {
+            int item = items[i];
+            cellOf[i] = rowOf(y[item]) * columns + columnOf(x[item]);
+            cellStart[cellOf[i] + 1]++;
+        }
+        for (int c = 0; c < cellCount; c++)
+        {
+            cellStart[c + 1] += cellStart[c];
+        }
+        writeCursor.assign(cellStart.begin(), cellStart.end() - 1);
+        for (int i = 0; i < count; i++)
+        {
+            order[writeCursor[cellOf[i]]++] = items[i];
+        }
+    }
+
+    // visits every item in the cells the square around (x, y) touches, the caller does the exact distance test
+    template <typename Visit>
+    void forEachNear(float x, float y, float radius, Visit visit) const
+    {
+        if (cellStart.empty())
+            return;
+        int minX = columnOf(x - radius), maxX = columnOf(x + radius);
+        int minY = rowOf(y - radius), maxY = rowOf(y + radius);
+        for (int cy = minY; cy <= maxY; cy++)
+        {
+            for (int c = cy * columns + minX; c <= cy * columns + maxX; c++)
+            {
+                for (int k = cellStart[c]; k < cellStart[c + 1]; k++)
+                {
+                    visit(order[k]);
+                }
+            }
+        }
+    }
+
+    int size() const { return static_cast<int>(order.size()); }
+};
+
+// ==================== SESSION ARENA CLASS ==================== //
+
+// Memory for the transient state of one battle session, handed out from one buffer by bumping a pointer and released in one go at close().
+// It uses Encapsulation around std::pmr::monotonic_buffer_resource, owners give resource() to pmr containers and empty them before release().
+class SessionArena
+{
+private:
+    // anything the buffer cannot hold still works but is counted, so a battle that outgrew it shows up
+    class Overflow : public std::pmr::memory_resource
+    {
+    public:
+        std::size_t bytes = 0;
+        int allocations = 0;
+
+    private:
+        void *do_allocate(std::size_t size, std::size_t alignment) override
+        {
+            bytes += size;
+            allocations++;
+            return std::pmr::new_delete_resource()->allocate(size, alignment);
+        }
+
+        void do_deallocate(void *p, std::size_t size, std::size_t alignment) override
+        {
+            std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+    };
+
+    static const std::size_t BUFFER_SIZE = 128 * 1024;
+    std::unique_ptr<unsigned char[]> buffer; // on the heap once per game
+    Overflow overflow;
+    std::pmr::monotonic_buffer_resource memory;
+
+public:
+    SessionArena() : buffer(new unsigned char[BUFFER_SIZE]), memory(buffer.get(), BUFFER_SIZE, &overflow) {} // constructor
+
+    SessionArena(const SessionArena &) = delete;
+    SessionArena &operator=(const SessionArena &) = delete;
+
+    std::pmr::memory_resource *resource() { return &memory; }
+
+    // the containers that used the arena must be empty and shrunk by now, their memory is gone after this
+    void release() { memory.release(); }
+
+    std::size_t getOverflowBytes() const { return overflow.bytes; } // getter
+    int getOverflowCount() const { return overflow.allocations; } // getter
+};
+
+// ==================== BATTLE WORLD CLASS ==================== //
+
+// Component storage shared by every battle mode, pets and shots are entities whose transform, velocity, health, team, shot, weapon and sprite data sit in packed rows.
+// It uses Encapsulation, the world owns where every pet is and how much health it has, modes steer bodies and read them back for the HUD.
+class BattleWorld
+{
+public:
+    enum Component
+    {
+        TRANSFORM = 1,
+        VELOCITY = 2,
+        HEALTH = 4,
+        SHOT = 8,
+        SPRITE = 16,
+        TARGET = 32, // hit by shots but never worn down, like the training dummies
+        WEAPON = 64  // attacks the entity in its target column once it is in range and the cooldown ran out
+    };
+
+private:
+    // one row per entity, rows are swap-removed so every system walks contiguous memory
+    std::pmr::vector<float> posX, posY, width, height;
+    std::pmr::vector<float> velX, velY;
+    std::pmr::vector<int> health;
+    std::pmr::vector<int> damage;
+    std::pmr::vector<float> range;  // WEAPON rows, centre to centre
+    std::pmr::vector<int> reload;   // WEAPON rows, ticks between attacks
+    std::pmr::vector<int> cooldown; // WEAPON rows, ticks until the next attack
+    std::pmr::vector<int> target;   // handle of the entity a WEAPON row attacks, -1 for none
+    std::pmr::vector<int> tag;  // the mode's own index for the entity (pet slot, influence handle)
+    std::pmr::vector<int> look; // index into the sprites the mode hands to draw(), rows without SPRITE keep -1
+    std::pmr::vector<uint8_t> team;
+    std::pmr::vector<uint8_t> mask;
+    std::pmr::vector<int> idOfRow;
+
+    // handles are (generation << 16) | slot, a slot points at the entity's current row
+    std::pmr::vector<int> rowOfSlot;
+    std::pmr::vector<uint16_t> generation;
+    std::pmr::vector<int> freeSlots;
+
+    // swapping with an empty vector is the only way to make one give its memory back
+    template <typename T>
+    static void releaseVector(std::pmr::vector<T> &rows)
+    {
+        std::pmr::vector<T>(rows.get_allocator()).swap(rows);
+    }
+
+    int rowOf(int id) const
+    {
+        if (id < 0)
+            return -1;
+        int slot = id & 0xFFFF;
+        if (slot >= static_cast<int>(rowOfSlot.size()) || generation[slot] != static_cast<uint16_t>(id >> 16))
+            return -1;
+        return rowOfSlot[slot];
+    }
+
+    int addRow(int teamIndex, uint8_t components, const sf::FloatRect &box)
+    {
+        int slot;
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            if (rowOfSlot.size() >= 0xFFFF)
+                return -1;
+            slot = static_cast<int>(rowOfSlot.size());
+            rowOfSlot.push_back(-1);
+            generation.push_back(0);
+        }
+
+        rowOfSlot[slot] = static_cast<int>(posX.size());
+        idOfRow.push_back((generation[slot] << 16) | slot);
+        posX.push_back(box.left);
+        posY.push_back(box.top);
+        width.push_back(box.width);
+        height.push_back(box.height);
+        velX.push_back(0);
+        velY.push_back(0);
+        health.push_back(0);
+        damage.push_back(0);
+        range.push_back(0);
+        reload.push_back(0);
+        cooldown.push_back(0);
+        target.push_back(-1);
+        tag.push_back(-1);
+        look.push_back(-1);
+        team.push_back(static_cast<uint8_t>(teamIndex));
+        mask.push_back(components | TRANSFORM);
+        return idOfRow.back();
+    }
+
+    void removeRow(int row)
+    {
+        int slot = idOfRow[row] & 0xFFFF;
+        generation[slot] = (generation[slot] + 1) & 0x7FFF;
+        rowOfSlot[slot] = -1;
+        freeSlots.push_back(slot);
+
+        int last = static_cast<int>(posX.size()) - 1;
+        if (row != last)
+        {
+            posX[row] = posX[last];
+            posY[row] = posY[last];
+            width[row] = width[last];
+            height[row] = height[last];
+            velX[row] = velX[last];
+            velY[row] = velY[last];
+            health[row] = health[last];
+            damage[row] = damage[last];
+            range[row] = range[last];
+            reload[row] = reload[last];
+            cooldown[row] = cooldown[last];
+            target[row] = target[last];
+            tag[row] = tag[last];
+            look[row] = look[last];
+            team[row] = team[last];
+            mask[row] = mask[last];
+            idOfRow[row] = idOfRow[last];
+            rowOfSlot[idOfRow[row] & 0xFFFF] = row;
+        }
+        posX.pop_back();
+        posY.pop_back();
+        width.pop_back();
+        height.pop_back();
+        velX.pop_back();
+        velY.pop_back();
+        health.pop_back();
+        damage.pop_back();
+        range.pop_back();
+        reload.pop_back();
+        cooldown.pop_back();
+        target.pop_back();
+        tag.pop_back();
+        look.pop_back();
+        team.pop_back();
+        mask.pop_back();
+        idOfRow.pop_back();
+    }
+
+    bool overlaps(int a, int b) const
+    {
+        return posX[a] < posX[b] + width[b] && posX[b] < posX[a] + width[a] &&
+               posY[a] < posY[b] + height[b] && posY[b] < posY[a] + height[a];
+    }
+
+public:
+    // rows come from `memory`, a battle passes its SessionArena so the whole world goes away with it
+    explicit BattleWorld(std::pmr::memory_resource *memory = std::pmr::get_default_resource()) // constructor
+        : posX(memory), posY(memory), width(memory), height(memory), velX(memory), velY(memory), health(memory), damage(memory),
+          range(memory), reload(memory), cooldown(memory), target(memory), tag(memory), look(memory), team(memory), mask(memory), idOfRow(memory), rowOfSlot(memory), generation(memory),
+          freeSlots(memory)
+    {
+    }
+
+    // room for `rows` entities up front, so spawning during a battle never allocates
+    void reserve(int rows)
+    {
+        std::size_t count = static_cast<std::size_t>(rows);
+        posX.reserve(count);
+        posY.reserve(count);
+        width.reserve(count);
+        height.reserve(count);
+        velX.reserve(count);
+        velY.reserve(count);
+        health.reserve(count);
+        damage.reserve(count);
+        range.reserve(count);
+        reload.reserve(count);
+        cooldown.reserve(count);
+        target.reserve(count);
+        tag.reserve(count);
+        look.reserve(count);
+        team.reserve(count);
+        mask.reserve(count);
+        idOfRow.reserve(count);
+        rowOfSlot.reserve(count);
+        generation.reserve(count);
+        freeSlots.reserve(count);
+    }
+
+    // empties the world and drops its memory, call before releasing the arena it came from
+    void release()
+    {
+        releaseVector(posX);
+        releaseVector(posY);
+        releaseVector(width);
+        releaseVector(height);
+        releaseVector(velX);
+        releaseVector(velY);
+        releaseVector(health);
+        releaseVector(damage);
+        releaseVector(range);
+        releaseVector(reload);
+        releaseVector(cooldown);
+        releaseVector(target);
+        releaseVector(tag);
+        releaseVector(look);
+        releaseVector(team);
+        releaseVector(mask);
+        releaseVector(idOfRow);
+        releaseVector(rowOfSlot);
+        releaseVector(generation);
+        releaseVector(freeSlots);
+    }
+
+    void clear()
+    {
+        for (int row = static_cast<int>(posX.size()) - 1; row >= 0; row--)
+        {
+            removeRow(row);
+        }
+    }
+
+    // a pet or anything else shots can hit, from here on the world moves it and keeps its health
+    int spawnBody(int teamIndex, const sf::FloatRect &box, int hitPoints, int userTag, int sprite = -1)
+    {
+        int id = addRow(teamIndex, VELOCITY | HEALTH | (sprite >= 0 ? SPRITE : 0), box);
+        int row = rowOf(id);
+        if (row >= 0)
+        {
+            health[row] = hitPoints;
+            tag[row] = userTag;
+            look[row] = sprite;
+        }
+        return id;
+    }
+
+    // a body that counts hits without losing health
+    int spawnTarget(int teamIndex, const sf::FloatRect &box, int userTag, int sprite = -1)
+    {
+        int id = spawnBody(teamIndex, box, 1, userTag, sprite);
+        int row = rowOf(id);
+        if (row >= 0)
+            mask[row] |= TARGET;
+        return id;
+    }
+
+    // a moving box that hits the first living body of the other team it touches
+    int spawnShot(int teamIndex, const sf::FloatRect &box, const sf::Vector2f &velocity, int hitDamage, int userTag = -1, int sprite = -1)
+    {
+        int id = addRow(teamIndex, VELOCITY | SHOT | (sprite >= 0 ? SPRITE : 0), box);
+        int row = rowOf(id);
+        if (row >= 0)
+        {
+            velX[row] = velocity.x;
+            velY[row] = velocity.y;
+            damage[row] = hitDamage;
+            tag[row] = userTag;
+            look[row] = sprite;
+        }
+        return id;
+    }
+
+    // scenery that moves with the world but neither hits nor gets hit, like the obstacles falling through the 1v1
+    int spawnProp(const sf::FloatRect &box, const sf::Vector2f &velocity, int sprite = -1)
+    {
+        int id = addRow(0, VELOCITY | (sprite >= 0 ? SPRITE : 0), box);
+        int row = rowOf(id);
+        if (row >= 0)
+        {
+            velX[row] = velocity.x;
+            velY[row] = velocity.y;
+            look[row] = sprite;
+        }
+        return id;
+    }
+
+    // gives a body a weapon, it attacks its target for `hitDamage` every `reloadTicks` once within `reach`, the first time after `firstCooldown`
+    void arm(int id, int hitDamage, float reach, int reloadTicks, int firstCooldown)
+    {
+        int row = rowOf(id);
+        if (row < 0)
+            return;
+        mask[row] |= WEAPON;
+        damage[row] = hitDamage;
+        range[row] = reach;
+        reload[row] = std::max(1, reloadTicks);
+        cooldown[row] = firstCooldown;
+    }
+
+    // -1 clears it, an armed body holds its fire while the target is gone or down
+    void setTarget(int id, int targetId)
+    {
+        int row = rowOf(id);
+        if (row >= 0)
+            target[row] = targetId;
+    }
+
+    int getTarget(int id) const
+    {
+        int row = rowOf(id);
+        return row < 0 ? -1 : target[row];
+    }
+
+    float getRange(int id) const
+    {
+        int row = rowOf(id);
+        return row < 0 ? 0 : range[row];
+    }
+
+    // the velocity integrate() moves the entity by every tick until it is changed again
+    void setVelocity(int id, const sf::Vector2f &velocity)
+    {
+        int row = rowOf(id);
+        if (row < 0)
+            return;
+        velX[row] = velocity.x;
+        velY[row] = velocity.y;
+    }
+
+    // moves an entity straight to a spot, for pushes and for pets that follow the mouse
+    void place(int id, const sf::Vector2f &position)
+    {
+        int row = rowOf(id);
+        if (row < 0)
+            return;
+        posX[row] = position.x;
+        posY[row] = position.y;
+    }
+
+    // takes health off a body without a shot, never below 0, returns what is left
+    int hurt(int id, int amount)
+    {
+        int row = rowOf(id);
+        if (row < 0)
+            return 0;
+        health[row] = std::max(0, health[row] - amount);
+        return health[row];
+    }
+
+    sf::FloatRect getBox(int id) const
+    {
+        int row = rowOf(id);
+        if (row < 0)
+            return sf::FloatRect();
+        return sf::FloatRect(posX[row], posY[row], width[row], height[row]);
+    }
+
+    sf::Vector2f getPosition(int id) const
+    {
+        sf::FloatRect box = getBox(id);
+        return sf::Vector2f(box.left, box.top);
+    }
+
+    sf::Vector2f getCenter(int id) const
+    {
+        sf::FloatRect box = getBox(id);
+        return sf::Vector2f(box.left + box.width / 2, box.top + box.height / 2);
+    }
+
+    sf::Vector2f getVelocity(int id) const
+    {
+        int row = rowOf(id);
+        return row < 0 ? sf::Vector2f(0, 0) : sf::Vector2f(velX[row], velY[row]);
+    }
+
+    // 0 for a body that is down and for a handle that no longer exists
+    int getHealth(int id) const
+    {
+        int row = rowOf(id);
+        return row < 0 ? 0 : health[row];
+    }
+
+    // the tag a body or shot was spawned with, -1 for a handle that no longer exists
+    int getTag(int id) const
+    {
+        int row = rowOf(id);
+        return row < 0 ? -1 : tag[row];
+    }
+
+    bool destroy(int id)
+    {
+        int row = rowOf(id);
+        if (row < 0)
+            return false;
+        removeRow(row);
+        return true;
+    }
+
+    // velocity system, pets and shots alike, a branch-free sweep since rows without VELOCITY keep it at zero
+    void integrate()
+    {
+        size_t count = posX.size();
+        float *x = posX.data();
+        float *y = posY.data();
+        const float *vx = velX.data();
+        const float *vy = velY.data();
+        for (size_t i = 0; i < count; i++)
+        {
+            x[i] += vx[i];
+            y[i] += vy[i];
+        }
+    }
+
+    // keeps every body inside `area` after it moved, shots are left to cull()
+    void confine(const sf::FloatRect &area)
+    {
+        for (size_t row = 0; row < posX.size(); row++)
+        {
+            if (mask[row] & HEALTH)
+            {
+                posX[row] = std::max(area.left, std::min(posX[row], area.left + area.width - width[row]));
+                posY[row] = std::max(area.top, std::min(posY[row], area.top + area.height - height[row]));
+            }
+        }
+    }
+
+    // drops every shot whose box has left `area`, onRemove(tag) runs first
+    template <typename Removed>
+    void cull(const sf::FloatRect &area, Removed onRemove)
+    {
+        for (int row = 0; row < static_cast<int>(posX.size());)
+        {
+            bool outside = posX[row] + width[row] < area.left || posX[row] > area.left + area.width ||
+                           posY[row] + height[row] < area.top || posY[row] > area.top + area.height;
+            if ((mask[row] & SHOT) && outside)
+            {
+                onRemove(tag[row]);
+                removeRow(row);
+            }
+            else
+            {
+                row++;
+            }
+        }
+    }
+
+    // hit system, onHit(shotTag, bodyTag, damage) runs once per hit, the shot is spent and the body's health drops to no lower than 0
+    template <typename Hit>
+    void resolveHits(Hit onHit)
+    {
+        for (int row = 0; row < static_cast<int>(posX.size());)
+        {
+            int victim = -1;
+            if (mask[row] & SHOT)
+            {
+                for (int other = 0; other < static_cast<int>(posX.size()); other++)
+                {
+                    if ((mask[other] & HEALTH) && team[other] != team[row] && health[other] > 0 && overlaps(row, other))
+                    {
+                        victim = other;
+                        break;
+                    }
+                }
+            }
+            if (victim < 0)
+            {
+                row++;
+                continue;
+            }
+            if (!(mask[victim] & TARGET))
+                health[victim] = std::max(0, health[victim] - damage[row]);
+            onHit(tag[row], tag[victim], damage[row]);
+            removeRow(row);
+        }
+    }
+
+    // weapon system, every living armed body counts its cooldown down and attacks a living target whose centre is within range,
+    // onAttack(attacker, target, damage) gets both handles and does the damage, so a mode decides between a strike and a shot,
+    // it runs inside the sweep, so anything it spawns or hurts should wait until fireWeapons() returns
+    template <typename Attack>
+    void fireWeapons(Attack onAttack)
+    {
+        for (size_t row = 0; row < posX.size(); row++)
+        {
+            if (!(mask[row] & WEAPON) || health[row] <= 0)
+                continue;
+            if (cooldown[row] > 0)
+                cooldown[row]--;
+            int foe = rowOf(target[row]);
+            if (cooldown[row] > 0 || foe < 0 || health[foe] <= 0)
+                continue;
+
+            float dx = posX[foe] + width[foe] / 2 - posX[row] - width[row] / 2;
+            float dy = posY[foe] + height[foe] / 2 - posY[row] - height[row] / 2;
+            if (dx * dx + dy * dy > range[row] * range[row])
+                continue;
+            cooldown[row] = reload[row];
+            onAttack(idOfRow[row], target[row], damage[row]);
+        }
+    }
+
+    // visits fn(center, velocity, tag) for every shot of a team
+    template <typename Visit>
+    void forEachShot(int teamIndex, Visit fn) const
+    {
+        for (size_t row = 0; row < posX.size(); row++)
+        {
+            if ((mask[row] & SHOT) && team[row] == teamIndex)
+                fn(sf::Vector2f(posX[row] + width[row] / 2, posY[row] + height[row] / 2),
+                   sf::Vector2f(velX[row], velY[row]), tag[row]);
+        }
+    }
+
+    int countShots(int teamIndex) const
+    {
+        int count = 0;
+        for (size_t row = 0; row < posX.size(); row++)
+        {
+            count += (mask[row] & SHOT) && team[row] == teamIndex;
+        }
+        return count;
+    }
+
+    // visits fn(box, team, sprite) for every entity that has all of `components`, in row order
+    template <typename Visit>
+    void forEachBox(uint8_t components, Visit fn) const
+    {
+        for (size_t row = 0; row < posX.size(); row++)
+        {
+            if ((mask[row] & components) == components)
+                fn(sf::FloatRect(posX[row], posY[row], width[row], height[row]), static_cast<int>(team[row]), look[row]);
+        }
+    }
+
+    // sprite system, the world only stores which of the mode's `sprites` a row looks like, so it stays cheap to copy and runs headless
+    // positions are world coordinates and `offset` moves them onto the screen
+    void draw(sf::RenderTarget &target, const sf::Vector2f &offset, sf::Sprite *sprites, int spriteCount) const
+    {
+        for (size_t row = 0; row < posX.size(); row++)
+        {
+            if ((mask[row] & SPRITE) && look[row] < spriteCount)
+            {
+                sprites[look[row]].setPosition(posX[row] + offset.x, posY[row] + offset.y);
+                target.draw(sprites[look[row]]);
+            }
+        }
+    }
+
+    // folds every entity's position and team into an FNV-1a hash, in row order
+    uint32_t checksum(uint32_t hash) const
+    {
+        for (size_t row = 0; row < posX.size(); row++)
+        {
+            int side = team[row];
+            hash = ByteCodec::fnv(hash, &posX[row], sizeof(posX[row]));
+            hash = ByteCodec::fnv(hash, &posY[row], sizeof(posY[row]));
+            hash = ByteCodec::fnv(hash, &side, sizeof(side));
+        }
+        return hash;
+    }
+
+    int size() const { return static_cast<int>(posX.size()); }
+};
+
+// ==================== INFLUENCE MAP CLASS ==================== //
+
+// Coarse grid over the arena where players spread threat and opportunity and enemies spread crowding, so an enemy can pick a spot by reading a few cells.
+// It uses Encapsulation, sources are restamped only when they cross into a new cell and the layers are integers so adding and removing a stamp cancels exactly.
+class InfluenceMap
+{
+public:
+    enum Layer
+    {
+        THREAT,      // close to a player or a player shot
+        OPPORTUNITY, // good range to shoot a player from
+        CROWD,       // already covered by another enemy
+        LAYER_COUNT
+    };
+
+private:
+    // the values a source adds around its cell, worked out once per strength/radius/ring combination
+    struct Shape
+    {
+        int strength;
+        float radius; // how far the value fades out from the peak
+        float ring;   // distance of the peak from the source, 0 for a plain blob
+        int reach;    // cells covered in each direction
+        std::vector<int> weights;
+    };
+
+    struct Source
+    {
+        bool active;
+        int layer;
+        int shape;
+        int cellX;
+        int cellY;
+    };
+
+    sf::FloatRect area;
+    float cellSize;
+    int columns;
+    int rows;
+    std::vector<int> values[LAYER_COUNT];
+    std::vector<Shape> shapes;
+    std::vector<Source> sources;
+    std::vector<int> freeSources;
+
+    int findShape(int strength, float radius, float ring)
+    {
+        for (size_t i = 0; i < shapes.size(); i++)
+        {
+            if (shapes[i].strength == strength && shapes[i].radius == radius && shapes[i].ring == ring)
+                return static_cast<int>(i);
+        }
+
+        Shape shape;
+        shape.strength = strength;
+        shape.radius = radius;
+        shape.ring = ring;
+        shape.reach = static_cast<int>(ceil((ring + radius) / cellSize));
+        int side = shape.reach * 2 + 1;
+        shape.weights.resize(side * side);
+        for (int dy = -shape.reach; dy <= shape.reach; dy++)
+        {
+            for (int dx = -shape.reach; dx <= shape.reach; dx++)
+            {
+                float distance = sqrt(static_cast<float>(dx * dx + dy * dy)) * cellSize;
+                float falloff = 1.0f - fabs(distance - ring) / radius;
+                shape.weights[(dy + shape.reach) * side + dx + shape.reach] = falloff > 0 ? static_cast<int>(strength * falloff) : 0;
+            }
+        }
+        shapes.push_back(shape);
+        return static_cast<int>(shapes.size()) - 1;
+    }
+
+    int kernel(const Source &source, int dx, int dy) const
+    {
+        const Shape &shape = shapes[source.shape];
+        if (abs(dx) > shape.reach || abs(dy) > shape.reach)
+            return 0;
+        return shape.weights[(dy + shape.reach) * (shape.reach * 2 + 1) + dx + shape.reach];
+    }
+
+    void stamp(const Source &source, int sign)
+    {
+        const Shape &shape = shapes[source.shape];
+        int side = shape.reach * 2 + 1;
+        std::vector<int> &layer = values[source.layer];
+        int x0 = std::max(0, source.cellX - shape.reach);
+        int x1 = std::min(columns - 1, source.cellX + shape.reach);
+        for (int y = std::max(0, source.cellY - shape.reach); y <= std::min(rows - 1, source.cellY + shape.reach); y++)
+        {
+            int *row = layer.data() + y * columns;
+            const int *weights = shape.weights.data() + (y - source.cellY + shape.reach) * side;
+            for (int x = x0; x <= x1; x++)
+            {
+                row[x] += sign * weights[x - source.cellX + shape.reach];
+            }
+        }
+    }
+
+    void cellOf(const sf::Vector2f &position, int &x, int &y) const
+    {
+        x = std::clamp(static_cast<int>((position.x - area.left) / cellSize), 0, columns - 1);
+        y = std::clamp(static_cast<int>((position.y - area.top) / cellSize), 0, rows - 1);
+    }
+
+    int desirability(int x, int y, int selfSource) const
+    {
+        int index = y * columns + x;
+        int value = values[OPPORTUNITY][index] - values[THREAT][index] - values[CROWD][index];
+        if (selfSource >= 0 && selfSource < static_cast<int>(sources.size()) && sources[selfSource].active)
+        {
+            const Source &self = sources[selfSource];
+            if (self.layer == CROWD)
+                value += kernel(self, x - self.cellX, y - self.cellY);
+        }
+        return value;
+    }
+
+public:
+    InfluenceMap() : cellSize(50), columns(1), rows(1) {} // constructor
+
+    // drops every source, used when a battle starts over
+    void setup(const sf::FloatRect &bounds, float cell)
+    {
+        area = bounds;
+        cellSize = cell;
+        columns = std::max(1, static_cast<int>(ceil(bounds.width / cell)));
+        rows = std::max(1, static_cast<int>(ceil(bounds.height / cell)));
+        for (int i = 0; i < LAYER_COUNT; i++)
+        {
+            values[i].assign(columns * rows, 0);
+        }
+        shapes.clear();
+        sources.clear();
+        freeSources.clear();
+    }
+
+    int addSource(Layer layer, const sf::Vector2f &position, int strength, float radius, float ring = 0)
+    {
+        Source source;
+        source.active = true;
+        source.layer = layer;
+        source.shape = findShape(strength, std::max(radius, 1.0f), ring);
+        cellOf(position, source.cellX, source.cellY);
+        stamp(source, 1);
+
+        if (!freeSources.empty())
+        {
+            int id = freeSources.back();
+            freeSources.pop_back();
+            sources[id] = source;
+            return id;
+        }
+        sources.push_back(source);
+        return static_cast<int>(sources.size()) - 1;
+    }
+
+    // nothing to do until the source crosses into another cell
+    void moveSource(int id, const sf::Vector2f &position)
+    {
+        if (id < 0 || id >= static_cast<int>(sources.size()) || !sources[id].active)
+            return;
+
+        Source &source = sources[id];
+        int x, y;
+        cellOf(position, x, y);
+        if (x == source.cellX && y == source.cellY)
+            return;
+
+        stamp(source, -1);
+        source.cellX = x;
+        source.cellY = y;
+        stamp(source, 1);
+    }
+
+    void removeSource(int id)
+    {
+        if (id < 0 || id >= static_cast<int>(sources.size()) || !sources[id].active)
+            return;
+
+        stamp(sources[id], -1);
+        sources[id].active = false;
+        freeSources.push_back(id);
+    }
+
+    int sample(Layer layer, const sf::Vector2f &position) const
+    {
+        int x, y;
+        cellOf(position, x, y);
+        return values[layer][y * columns + x];
+    }
+
+    // best cell within searchCells of position, ignoring the asker's own crowd stamp;
+    // returns its centre and how much better it is than where the asker stands
+    sf::Vector2f bestSpot(const sf::Vector2f &position, int searchCells, int selfSource, int &gain) const
+    {
+        int x, y;
+        cellOf(position, x, y);
+        int current = desirability(x, y, selfSource);
+        int best = current;
+        int bestX = x;
+        int bestY = y;
+
+        for (int cy = std::max(0, y - searchCells); cy <= std::min(rows - 1, y + searchCells); cy++)
+        {
+            for (int cx = std::max(0, x - searchCells); cx <= std::min(columns - 1, x + searchCells); cx++)
+            {
+                int value = desirability(cx, cy, selfSource);
+                if (value > best)
+                {
+                    best = value;
+                    bestX = cx;
+                    bestY = cy;
+                }
+            }
+        }
+
+        gain = best - current;
+        return sf::Vector2f(area.left + (bestX + 0.5f) * cellSize, area.top + (bestY + 0.5f) * cellSize);
+    }
+};
+
+// Keeps the influence map in step with a team battle: players spread threat and a ring of opportunity,
+// enemies spread crowding, player shots spread a short-lived threat.
+class TeamInfluence
+{
+private:
+    static constexpr float CELL_SIZE = 50.0f;
+
+    InfluenceMap map;
+    float opportunityRing; // how far from a player the best shooting spots are
+    std::vector<int> playerThreat;
+    std::vector<int> playerOpportunity;
+    std::vector<int> enemyCrowd;
+
+    void track(int &source, InfluenceMap::Layer layer, const sf::Vector2f &position, bool alive,
+               int strength, float radius, float ring)
+    {
+        if (!alive)
+        {
+            map.removeSource(source);
+            source = -1;
+        }
+        else if (source < 0)
+        {
+            source = map.addSource(layer, position, strength, radius, ring);
+        }
+        else
+        {
+            map.moveSource(source, position);
+        }
+    }
+
+public:
+    TeamInfluence() : opportunityRing(300.0f) {} // constructor
+
+    // `ring` is the distance enemies like to shoot from, the 2v2 enemies stay 300 px out
+    void reset(const sf::FloatRect &arena, int playerCount, int enemyCount, float ring = 300.0f)
+    {
+        map.setup(arena, CELL_SIZE);
+        opportunityRing = ring;
+        playerThreat.assign(playerCount, -1);
+        playerOpportunity.assign(playerCount, -1);
+        enemyCrowd.assign(enemyCount, -1);
+    }
+
+    void updatePlayer(int index, const sf::Vector2f &center, bool alive)
+    {
+        track(playerThreat[index], InfluenceMap::THREAT, center, alive, 100, 150.0f, 0);
+        track(playerOpportunity[index], InfluenceMap::OPPORTUNITY, center, alive, 100, 150.0f, opportunityRing);
+    }
+
+    void updateEnemy(int index, const sf::Vector2f &center, bool alive)
+    {
+        track(enemyCrowd[index], InfluenceMap::CROWD, center, alive, 80, 150.0f, 0);
+    }
+
+    int addShot(const sf::Vector2f &center) { return map.addSource(InfluenceMap::THREAT, center, 60, 80.0f); }
+    void moveShot(int source, const sf::Vector2f &center) { map.moveSource(source, center); }
+    void removeShot(int source) { map.removeSource(source); }
+
+    sf::Vector2f toSpot(int enemy, const sf::Vector2f &center) const
+    {
+        int gain = 0;
+        sf::Vector2f spot = map.bestSpot(center, 2, enemyCrowd[enemy], gain);
+        return gain > 0 ? spot - center : sf::Vector2f(0, 0);
+    }
+};
+
+// ==================== ENEMY AI CLASS ==================== //
+
+// Holds the tunable enemy behaviour and the steering rules that both the battles and the headless simulations call.
+// It uses Encapsulation, the constants live in one struct so whatever the self-play harness tunes is exactly what the game plays.
+struct EnemyAIParams
+{
+    float approachDistance; // chase when the player is farther than this
+    float retreatDistance;  // back off when the player is closer than this
+    float retreatFactor;    // retreat speed as a fraction of chase speed
+    float fireInterval;     // seconds between shots in 1v1
+    int teamFireChance;     // percent chance per frame to shoot in 2v2
+    float dodgeHorizon;     // frames of warning an enemy reacts to, 0 turns dodging off
+    bool teamPositioning;   // 2v2 enemies pick spots from the influence map instead of running straight at a player
+
+    EnemyAIParams() : approachDistance(200), retreatDistance(150), retreatFactor(0.7f), // constructor
+                      fireInterval(1.5f), teamFireChance(3), dodgeHorizon(20), teamPositioning(true)
+    {
+    }
+};
+
+// What an enemy knows when it picks and follows an action, rebuilt every tick from the battle state.
+struct AIContext
+{
+    sf::Vector2f toTarget; // offset to the chosen target, (0, 0) when there is none
+    float distance;
+    bool hasTarget;
+    sf::Vector2f velocity; // last velocity, kept when an action has nothing better to do
+    float speed;
+    Threat threat;         // most urgent incoming shot, inactive when nothing is about to hit
+    sf::Vector2f toSpot;   // offset to the best nearby cell of the influence map, (0, 0) when already there
+    float reach;           // how close the agent needs to be to its target to attack, 0 for modes without weapon ranges
+};
+
+// Small steering helpers shared by the actions below.
+class EnemyAI
+{
+public:
+    static AIContext makeContext(const sf::Vector2f &toTarget, float distance, bool hasTarget,
+                                 const sf::Vector2f &velocity, float speed)
+    {
+        AIContext context;
+        context.toTarget = hasTarget ? toTarget : sf::Vector2f(0, 0);
+        context.distance = hasTarget ? distance : 0;
+        context.hasTarget = hasTarget;
+        context.velocity = velocity;
+        context.speed = speed;
+        context.threat.active = false;
+        context.threat.timeToImpact = 0;
+        context.threat.escape = sf::Vector2f(0, 0);
+        context.toSpot = sf::Vector2f(0, 0);
+        context.reach = 0;
+        return context;
+    }
+
+    static sf::Vector2f jitter(BattleRandom &random, float scale)
+    {
+        float x = (random.nextInt(100) - 50) * scale;
+        float y = (random.nextInt(100) - 50) * scale;
+        return sf::Vector2f(x, y);
+    }
+
+    // 2v2: head for the chosen target with some wobble, wander when nobody is left to chase
+    static sf::Vector2f teamVelocity(const sf::Vector2f &toTarget, float distance, bool hasTarget,
+                                     const sf::Vector2f &current, float speed, BattleRandom &random)
+    {
+        if (!hasTarget)
+            return jitter(random, 0.02f);
+        if (distance <= 0)
+            return current;
+
+        sf::Vector2f direction = toTarget / distance + jitter(random, 0.01f);
+        float length = sqrt(direction.x * direction.x + direction.y * direction.y);
+        if (length > 0)
+            direction /= length;
+        return direction * speed;
+    }
+};
+
+// ==================== UTILITY ACTION CLASS ==================== //
+
+// One thing an enemy can do: score() says how much it wants to right now and steer() turns it into a velocity.
+// It uses Abstraction and Polymorphism, new behaviours are new subclasses and the brain never needs to know which ones exist.
+class UtilityAction
+{
+public:
+    virtual ~UtilityAction() {}
+
+    virtual const char *getName() const = 0;
+    virtual float score(const AIContext &context, const EnemyAIParams &params) const = 0;
+    virtual sf::Vector2f steer(const AIContext &context, const EnemyAIParams &params, BattleRandom &random) const = 0;
+};
+
+// 1v1: close the gap while the player is outside the comfort band
+class ChaseAction : public UtilityAction
+{
+public:
+    const char *getName() const override { return "chase"; }
+
+    float score(const AIContext &context, const EnemyAIParams &params) const override
+    {
+        return context.hasTarget ? context.distance - params.approachDistance : -1e9f;
+    }
+
+    sf::Vector2f steer(const AIContext &context, const EnemyAIParams &, BattleRandom &random) const override
+    {
+        sf::Vector2f velocity(0, 0);
+        if (context.distance > 0)
+            velocity = context.toTarget / context.distance * context.speed;
+        return velocity + jitter(random);
+    }
+
+    static sf::Vector2f jitter(BattleRandom &random) { return EnemyAI::jitter(random, 0.01f); }
+};
+
+// 1v1: back off while the player is inside the comfort band
+class RetreatAction : public UtilityAction
+{
+public:
+    const char *getName() const override { return "retreat"; }
+
+    float score(const AIContext &context, const EnemyAIParams &params) const override
+    {
+        return context.hasTarget ? params.retreatDistance - context.distance : -1e9f;
+    }
+
+    sf::Vector2f steer(const AIContext &context, const EnemyAIParams &params, BattleRandom &random) const override
+    {
+        sf::Vector2f velocity(0, 0);
+        if (context.distance > 0)
+            velocity = -context.toTarget / context.distance * context.speed * params.retreatFactor;
+        return velocity + ChaseAction::jitter(random);
+    }
+};
+
+// 1v1: stay put (apart from the jitter) inside the band, also the fallback when nothing else scores
+class HoldAction : public UtilityAction
+{
+public:
+    const char *getName() const override { return "hold"; }
+
+    float score(const AIContext &, const EnemyAIParams &) const override { return 0; }
+
+    sf::Vector2f steer(const AIContext &, const EnemyAIParams &, BattleRandom &random) const override
+    {
+        return ChaseAction::jitter(random);
+    }
+};
+
+// 2v2: run at the nearest living player
+class PursueAction : public UtilityAction
+{
+public:
+    const char *getName() const override { return "pursue"; }
+
+    float score(const AIContext &context, const EnemyAIParams &) const override
+    {
+        return context.hasTarget ? 1.0f : -1.0f;
+    }
+
+    sf::Vector2f steer(const AIContext &context, const EnemyAIParams &, BattleRandom &random) const override
+    {
+        return EnemyAI::teamVelocity(context.toTarget, context.distance, context.hasTarget,
+                                     context.velocity, context.speed, random);
+    }
+};
+
+// 2v2: drift around when every player is down
+class WanderAction : public UtilityAction
+{
+public:
+    const char *getName() const override { return "wander"; }
+
+    float score(const AIContext &, const EnemyAIParams &) const override { return 0; }
+
+    sf::Vector2f steer(const AIContext &, const EnemyAIParams &, BattleRandom &random) const override
+    {
+        return EnemyAI::jitter(random, 0.02f);
+    }
+};
+
+// 2v2: move to the best nearby cell of the influence map, in range of a player but not on top of one or of a teammate
+class PositionAction : public UtilityAction
+{
+public:
+    const char *getName() const override { return "position"; }
+
+    float score(const AIContext &context, const EnemyAIParams &params) const override
+    {
+        return (context.hasTarget && params.teamPositioning) ? 2.0f : -1e9f;
+    }
+
+    sf::Vector2f steer(const AIContext &context, const EnemyAIParams &, BattleRandom &random) const override
+    {
+        float length = sqrt(context.toSpot.x * context.toSpot.x + context.toSpot.y * context.toSpot.y);
+        if (length < context.speed)
+            return EnemyAI::jitter(random, 0.02f);
+        return context.toSpot / length * context.speed + EnemyAI::jitter(random, 0.01f);
+    }
+};
+
+// any mode: sidestep the shot that will hit first, outranks everything else the closer the impact is
+class DodgeAction : public UtilityAction
+{
+public:
+    const char *getName() const override { return "dodge"; }
+
+    float score(const AIContext &context, const EnemyAIParams &params) const override
+    {
+        if (!context.threat.active || params.dodgeHorizon <= 0)
+            return -1e9f;
+        return 1000.0f * (1.0f - context.threat.timeToImpact / params.dodgeHorizon) + 1000.0f;
+    }
+
+    sf::Vector2f steer(const AIContext &context, const EnemyAIParams &, BattleRandom &random) const override
+    {
+        if (!context.threat.active)
+            return EnemyAI::jitter(random, 0.01f);
+        return context.threat.escape * context.speed;
+    }
+};
+
+// guild war: close in until the target is within reach and stand there
+class EngageAction : public UtilityAction
+{
+public:
+    const char *getName() const override { return "engage"; }
+
+    float score(const AIContext &context, const EnemyAIParams &) const override
+    {
+        return context.hasTarget ? 1.0f : -1e9f;
+    }
+
+    sf::Vector2f steer(const AIContext &context, const EnemyAIParams &, BattleRandom &) const override
+    {
+        if (context.distance <= context.reach || context.distance <= 0)
+            return sf::Vector2f(0, 0);
+        return context.toTarget / context.distance * context.speed;
+    }
+};
+
+// guild war: nobody in sight, head for the rally point or the rival guild
+class MarchAction : public UtilityAction
+{
+public:
+    const char *getName() const override { return "march"; }
+
+    float score(const AIContext &, const EnemyAIParams &) const override { return 0; }
+
+    sf::Vector2f steer(const AIContext &context, const EnemyAIParams &, BattleRandom &) const override
+    {
+        float length = sqrt(context.toSpot.x * context.toSpot.x + context.toSpot.y * context.toSpot.y);
+        if (length < context.speed)
+            return sf::Vector2f(0, 0);
+        return context.toSpot / length * context.speed;
+    }
+};
+
+// ==================== UTILITY BRAIN CLASS ==================== //
+
+// A fixed list of actions, choose() scores each one and returns the best.
+// It uses Aggregation, the brain points at shared stateless actions so every enemy of a kind uses the same brain.
+class UtilityBrain
+{
+private:
+    static const int MAX_ACTIONS = 8;
+    const UtilityAction *actions[MAX_ACTIONS];
+    int actionCount;
+
+public:
+    UtilityBrain() : actionCount(0) {} // constructor
+
+    void addAction(const UtilityAction *action)
+    {
+        if (actionCount < MAX_ACTIONS)
+            actions[actionCount++] = action;
+    }
+
+    // ties go to the action added first
+    int choose(const AIContext &context, const EnemyAIParams &params) const
+    {
+        int best = 0;
+        float bestScore = -1e30f;
+        for (int i = 0; i < actionCount; i++)
+        {
+            float value = actions[i]->score(context, params);
+            if (value > bestScore)
+            {
+                bestScore = value;
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    const UtilityAction *getAction(int index) const { return actions[index]; }
+    int getActionCount() const { return actionCount; }
+
+    // brains for the battle modes, built once and shared by every battle and simulation
+    static const UtilityBrain &duelBrain()
+    {
+        static ChaseAction chase;
+        static RetreatAction retreat;
+        static HoldAction hold;
+        static DodgeAction dodge;
+        static UtilityBrain brain = []()
+        {
+            UtilityBrain b;
+            b.addAction(&hold);
+            b.addAction(&chase);
+            b.addAction(&retreat);
+            b.addAction(&dodge);
+            return b;
+        }();
+        return brain;
+    }
+
+    static const UtilityBrain &teamBrain()
+    {
+        static PursueAction pursue;
+        static WanderAction wander;
+        static PositionAction position;
+        static DodgeAction dodge;
+        static UtilityBrain brain = []()
+        {
+            UtilityBrain b;
+            b.addAction(&pursue);
+            b.addAction(&wander);
+            b.addAction(&position);
+            b.addAction(&dodge);
+            return b;
+        }();
+        return brain;
+    }
+
+    static const UtilityBrain &guildBrain()
+    {
+        static MarchAction march;
+        static EngageAction engage;
+        static PositionAction position;
+        static DodgeAction dodge;
+        static UtilityBrain brain = []()
+        {
+            UtilityBrain b;
+            b.addAction(&march);
+            b.addAction(&engage);
+            b.addAction(&position);
+            b.addAction(&dodge);
+            return b;
+        }();
+        return brain;
+    }
+};
+
+// ==================== AI SCHEDULER CLASS ==================== //
+
+// Decides which agents get to re-plan this tick, everyone else keeps steering with the action they picked last time.
+// It uses Encapsulation, a round-robin cursor staggers the planning and a budget counted in action scores caps its cost,
+// so a replay or a rollback peer plans exactly the same agents on every machine.
+class AIScheduler
+{
+private:
+    std::vector<int> plans; // chosen action per agent, -1 until the first plan
+    size_t cursor;
+    int scoreBudget; // action scores per tick, one plan scores every action of the brain once
+    int plannedLastTick;
+
+public:
+    // the default plans 8 agents a tick with the four-action brains
+    explicit AIScheduler(int scoresPerTick = 32) // constructor
+        : cursor(0), scoreBudget(std::max(1, scoresPerTick)), plannedLastTick(0)
+    {
+    }
+
+    void setBudget(int scoresPerTick) { scoreBudget = std::max(1, scoresPerTick); }
+
+    // new agents start without a plan and are planned on the next update regardless of the budget
+    void resize(int agentCount)
+    {
+        plans.resize(agentCount, -1);
+        if (cursor >= plans.size())
+            cursor = 0;
+    }
+
+    void reset()
+    {
+        std::fill(plans.begin(), plans.end(), -1);
+        cursor = 0;
+    }
+
+    void invalidate(int agent)
+    {
+        if (agent >= 0 && agent < static_cast<int>(plans.size()))
+            plans[agent] = -1;
+    }
+
+    // contextOf(agent, context) fills the context and returns false for agents that are out of the fight
+    template <typename ContextFn>
+    void update(const UtilityBrain &brain, const EnemyAIParams &params, ContextFn contextOf)
+    {
+        plannedLastTick = 0;
+        size_t count = plans.size();
+        if (count == 0)
+            return;
+
+        AIContext context;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (plans[i] < 0 && contextOf(static_cast<int>(i), context))
+            {
+                plans[i] = brain.choose(context, params);
+                plannedLastTick++;
+            }
+        }
+
+        // at least one agent a tick, however small the budget or big the brain
+        int allowed = std::max(1, scoreBudget / std::max(1, brain.getActionCount()));
+        int planned = 0;
+        for (size_t visited = 0; visited < count && planned < allowed; visited++)
+        {
+            size_t agent = cursor;
+            cursor = (cursor + 1) % count;
+            if (!contextOf(static_cast<int>(agent), context))
+                continue;
+
+            plans[agent] = brain.choose(context, params);
+            planned++;
+        }
+        plannedLastTick += planned;
+    }
+
+    int getPlan(int agent) const
+    {
+        if (agent < 0 || agent >= static_cast<int>(plans.size()))
+            return 0;
+        return std::max(0, plans[agent]);
+    }
+
+    int getPlannedLastTick() const { return plannedLastTick; }
+
+    // velocity for one agent from its current plan, called every tick for every agent
+    sf::Vector2f steer(const UtilityBrain &brain, int agent, const AIContext &context,
+                       const EnemyAIParams &params, BattleRandom &random) const
+    {
+        return brain.getAction(getPlan(agent))->steer(context, params, random);
+    }
+};
+
+// ==================== TEAM BATTLE CLASS ==================== //
+
+// The 2v2 battle rules, pets and shots are bodies in a BattleWorld and one step() plays a 60 Hz tick from the players' buttons.
+// It uses Encapsulation, Battle2v2Game draws it and the server, clients, rollback peers, replays and arenas all step this same object.
+enum BattleButton
+{
+    BUTTON_UP = 1,
+    BUTTON_LEFT = 2,
+    BUTTON_DOWN = 4,
+    BUTTON_RIGHT = 8,
+    BUTTON_FIRE = 16
+};
+
+struct SimUnit
+{
+    int health;
+    int damage;
+    int speciesId; // picks the body size and the look
+};
+
+class TeamBattle
+{
+public:
+    static constexpr int MAX_PER_SIDE = 4; // constexpr, std::min takes it by reference
+    static const int MAX_PETS = 2 * MAX_PER_SIDE;
+    static const int MAX_SHOTS = 100; // in flight per side
+    static constexpr float LEFT = 100.0f;
+    static constexpr float TOP = 150.0f;
+    static constexpr float WIDTH = 1000.0f;
+    static constexpr float HEIGHT = 450.0f;
+    static const int DURATION_TICKS = 180 * TimerWheel::TICKS_PER_SECOND;
+
+    enum Team
+    {
+        PLAYER_TEAM,
+        ENEMY_TEAM
+    };
+
+private:
+    static constexpr float CENTER_X = 600.0f; // the 2v2 window's centre, the sides line up 400 px either side of it
+    static constexpr float CENTER_Y = 350.0f;
+    static constexpr float PLAYER_SPEED = 5.0f;
+    static constexpr float ENEMY_SPEED = 3.0f;
+    static constexpr float SHOT_COOLDOWN = 0.5f; // seconds, the players share one shot clock like on the keyboard
+
+    enum TimerEvent
+    {
+        EVENT_SHOT_READY
+    };
+
+    // pets are numbered players first, bodies[p] is pet p's handle in the world and its box is the species' body size
+    // the world tags a pet's body with p and a player shot with its influence source
+    // a pet looks like sprite p and its shots like sprite getPetCount() + p, so a view can tell whose shot it is
+    BattleWorld world;
+    std::pmr::vector<SimUnit> units;
+    std::pmr::vector<int> bodies;
+    std::pmr::vector<int> rewards; // experience per player pet, set when the match ends
+    int playerCount;
+    uint32_t tick;
+    bool over;
+    bool playerWon;
+    bool shotReady;
+    uint64_t seed;
+    TimerWheel timers;
+    BattleRandom random;
+    EnemyAIParams params;
+    AIScheduler scheduler; // the default budget covers more than MAX_PER_SIDE agents, so every enemy re-plans every tick
+    TeamInfluence influence;
+
+    // scratch, rebuilt from the world every step
+    TargetingPass playerTargeting;
+    TargetingPass enemyTargeting;
+    ThreatField threats;
+    AIContext contexts[MAX_PER_SIDE];
+
+    sf::FloatRect arena() const { return sf::FloatRect(LEFT, TOP, WIDTH, HEIGHT); }
+    int enemyCount() const { return getPetCount() - playerCount; }
+
+    void runTargeting()
+    {
+        playerTargeting.clear();
+        enemyTargeting.clear();
+        for (int p = 0; p < playerCount; p++)
+        {
+            playerTargeting.addSeeker(world.getPosition(bodies[p]));
+            enemyTargeting.addTarget(world.getPosition(bodies[p]), isAlive(p));
+        }
+        for (int p = playerCount; p < getPetCount(); p++)
+        {
+            enemyTargeting.addSeeker(world.getPosition(bodies[p]));
+            playerTargeting.addTarget(world.getPosition(bodies[p]), isAlive(p));
+        }
+        playerTargeting.run();
+        enemyTargeting.run();
+    }
+
+    // player shots that the enemies should watch out for this tick
+    void updateThreats()
+    {
+        threats.clear(arena());
+        world.forEachShot(PLAYER_TEAM, [this](const sf::Vector2f &center, const sf::Vector2f &velocity, int)
+                          { threats.addProjectile(center, velocity); });
+        threats.build();
+    }
+
+    // aimed at `target`, or straight at the other side when there is none
+    void fire(int pet, int target, const sf::Vector2f &origin, float speed)
+    {
+        Team team = pet < playerCount ? PLAYER_TEAM : ENEMY_TEAM;
+        if (world.countShots(team) >= MAX_SHOTS)
+            return;
+
+        sf::Vector2f velocity(team == PLAYER_TEAM ? speed : -speed, 0);
+        if (target >= 0)
+        {
+            sf::Vector2f direction = world.getPosition(bodies[target]) - world.getPosition(bodies[pet]);
+            float length = std::sqrt(direction.x * direction.x + direction.y * direction.y);
+            if (length > 0)
+                velocity = direction / length * speed;
+        }
+
+        sf::Vector2f size = Species::info(units[pet].speciesId).shotSize;
+        sf::FloatRect box(origin.x, origin.y, size.x, size.y);
+        int source = team == PLAYER_TEAM ? influence.addShot(sf::Vector2f(box.left + size.x / 2, box.top + size.y / 2)) : -1;
+        world.spawnShot(team, box, velocity, units[pet].damage, source, getPetCount() + pet);
+    }
+
+    void movePlayers(const uint8_t *buttons)
+    {
+        for (int p = 0; p < playerCount; p++)
+        {
+            uint8_t held = isAlive(p) ? buttons[p] : 0;
+            sf::Vector2f velocity(((held & BUTTON_RIGHT) ? 1.0f : 0.0f) - ((held & BUTTON_LEFT) ? 1.0f : 0.0f),
+                                  ((held & BUTTON_DOWN) ? 1.0f : 0.0f) - ((held & BUTTON_UP) ? 1.0f : 0.0f));
+            velocity *= PLAYER_SPEED;
+            if (velocity.x != 0 && velocity.y != 0)
+                velocity *= 0.7071f;
+            world.setVelocity(bodies[p], velocity);
+
+            if ((held & BUTTON_FIRE) && shotReady)
+            {
+                int target = playerTargeting.getTarget(p);
+                fire(p, target < 0 ? -1 : playerCount + target, world.getCenter(bodies[p]), 15.0f);
+                shotReady = false;
+                timers.schedule(TimerWheel::ticks(SHOT_COOLDOWN), EVENT_SHOT_READY);
+            }
+        }
+    }
+
+    // the influence map steers every living enemy to a spot the others do not crowd, the brain decides how to get there
+    void moveEnemies()
+    {
+        updateThreats();
+        for (int p = 0; p < playerCount; p++)
+            influence.updatePlayer(p, world.getCenter(bodies[p]), isAlive(p));
+        for (int i = 0; i < enemyCount(); i++)
+            influence.updateEnemy(i, world.getCenter(bodies[playerCount + i]), isAlive(playerCount + i));
+
+        for (int i = 0; i < enemyCount(); i++)
+        {
+            int body = bodies[playerCount + i];
+            int target = enemyTargeting.getTarget(i);
+            sf::Vector2f toTarget = target >= 0 ? world.getPosition(bodies[target]) - world.getPosition(body) : sf::Vector2f(0, 0);
+            contexts[i] = EnemyAI::makeContext(toTarget, std::sqrt(enemyTargeting.getDistanceSquared(i)),
+                                               target >= 0, world.getVelocity(body), ENEMY_SPEED);
+            sf::FloatRect bounds = world.getBox(body);
+            contexts[i].threat = threats.assess(world.getCenter(body), world.getVelocity(body),
+                                                std::max(bounds.width, bounds.height) / 2 + 10.0f, params.dodgeHorizon, 15.0f);
+            if (params.teamPositioning && isAlive(playerCount + i))
+                contexts[i].toSpot = influence.toSpot(i, world.getCenter(body));
+        }
+        scheduler.update(UtilityBrain::teamBrain(), params, [this](int agent, AIContext &context)
+                         {
+            context = contexts[agent];
+            return isAlive(playerCount + agent); });
+
+        for (int i = 0; i < enemyCount(); i++)
+        {
+            sf::Vector2f velocity(0, 0);
+            if (isAlive(playerCount + i))
+                velocity = scheduler.steer(UtilityBrain::teamBrain(), i, contexts[i], params, random);
+            world.setVelocity(bodies[playerCount + i], velocity);
+        }
+
+        for (int i = 0; i < enemyCount(); i++)
+        {
+            int pet = playerCount + i;
+            if (isAlive(pet) && random.nextInt(100) < params.teamFireChance)
+            {
+                sf::FloatRect box = world.getBox(bodies[pet]);
+                fire(pet, enemyTargeting.getTarget(i), sf::Vector2f(box.left, box.top + box.height / 2), 12.0f);
+            }
+        }
+    }
+
+    // every living player pet earns experience, a wipe pays on the enemies' full health and a win on time on what they had left
+    void finish(bool won, bool wipe)
+    {
+        over = true;
+        playerWon = won;
+        if (!won)
+            return;
+        int base = wipe ? 50 : 30;
+        int enemyTotal = 0;
+        for (int p = playerCount; p < getPetCount(); p++)
+            enemyTotal += wipe ? getMaxHealth(p) : getHealth(p);
+        for (int p = 0; p < playerCount; p++)
+        {
+            if (isAlive(p))
+                rewards[p] = base + random.nextInt(base) + enemyTotal / 20;
+        }
+    }
+
+public:
+    // the world and the per-pet tables come from `memory`, a copy made for a rollback uses the default resource
+    explicit TeamBattle(std::pmr::memory_resource *memory = std::pmr::get_default_resource()) // constructor
+        : world(memory), units(memory), bodies(memory), rewards(memory), playerCount(0), tick(0), over(false), playerWon(false),
+          shotReady(true), seed(0)
+    {
+    }
+
+    void setParams(const EnemyAIParams &aiParams) { params = aiParams; }
+
+    // each side stands in a column 400 px from the centre with 200 px between pets
+    void start(const SimUnit *players, int playerTotal, const SimUnit *enemies, int enemyTotal, uint64_t matchSeed)
+    {
+        playerCount = std::max(1, std::min(playerTotal, MAX_PER_SIDE));
+        enemyTotal = std::max(1, std::min(enemyTotal, MAX_PER_SIDE));
+        units.assign(players, players + playerCount);
+        units.insert(units.end(), enemies, enemies + enemyTotal);
+        bodies.assign(getPetCount(), -1);
+        rewards.assign(playerCount, 0);
+        tick = 0;
+        over = false;
+        playerWon = false;
+        shotReady = true;
+        seed = matchSeed;
+        random.setSeed(matchSeed);
+        timers.reset();
+
+        world.clear();
+        world.reserve(2 * MAX_SHOTS + getPetCount());
+        influence.reset(arena(), playerCount, enemyTotal);
+        for (int p = 0; p < getPetCount(); p++)
+        {
+            bool enemy = p >= playerCount;
+            int index = enemy ? p - playerCount : p;
+            int sideCount = enemy ? enemyTotal : playerCount;
+            sf::Vector2f size = Species::info(units[p].speciesId).bodySize;
+            sf::FloatRect box(CENTER_X + (enemy ? 400 : -400), CENTER_Y + 200 * index - 100 * (sideCount - 1), size.x, size.y);
+            bodies[p] = world.spawnBody(enemy ? ENEMY_TEAM : PLAYER_TEAM, box, units[p].health, p, p);
+        }
+        world.confine(arena());
+        scheduler.resize(enemyTotal);
+        scheduler.reset();
+    }
+
+    // health and per-shot damage of a pet in the 2v2, fire and electric pets hit harder
+    // stats can differ from the species table, the balance sweep tries other lines this way
+    static SimUnit unitFor(const PetRecord &pet, const SpeciesStats &stats)
+    {
+        SimUnit unit;
+        int attack = Species::attack(stats, pet.level);
+        unit.health = Species::hp(stats, pet.level);
+        unit.damage = (pet.speciesId == Species::DRAGON || pet.speciesId == Species::GRIFFIN) ? attack / 2 : attack / 3;
+        unit.speciesId = pet.speciesId;
+        return unit;
+    }
+
+    static SimUnit unitFor(const PetRecord &pet)
+    {
+        return unitFor(pet, Species::info(pet.speciesId).stats);
+    }
+
+    static SimUnit unitFor(const Pet &pet)
+    {
+        return unitFor(pet.getProgress());
+    }
+
+    // the enemy in `slot` of a seeded match when no EnemyPool picked one, the same on every machine
+    static SimUnit seededEnemy(uint64_t matchSeed, int slot, int level)
+    {
+        BattleRandom pick(matchSeed ^ 0xE7E7E7E7ULL);
+        int species = 0;
+        for (int i = 0; i <= slot; i++)
+            species = pick.nextInt(Species::COUNT);
+        return unitFor(Species::record(species, level));
+    }
+
+    // one 60 Hz tick, buttons[p] is the BattleButton mask held for player pet p
+    void step(const uint8_t *buttons)
+    {
+        if (over)
+            return;
+
+        timers.advance([this](int event)
+                       {
+            if (event == EVENT_SHOT_READY)
+                shotReady = true; });
+
+        runTargeting();
+        movePlayers(buttons);
+        moveEnemies();
+
+        // the world moves every pet and shot, then shots leave the arena or hit a living pet of the other team
+        world.integrate();
+        world.confine(arena());
+        world.forEachShot(PLAYER_TEAM, [this](const sf::Vector2f &center, const sf::Vector2f &, int source)
+                          { influence.moveShot(source, center); });
+        world.cull(arena(), [this](int source)
+                   {
+            if (source >= 0)
+                influence.removeShot(source); });
+        world.resolveHits([this](int source, int pet, int)
+                          {
+            if (pet >= playerCount)
+                influence.removeShot(source); });
+
+        tick++;
+        int playerHealth = getSideHealth(PLAYER_TEAM);
+        int enemyHealth = getSideHealth(ENEMY_TEAM);
+        if (playerHealth == 0 || enemyHealth == 0)
+            finish(enemyHealth == 0, true);
+        else if (tick >= static_cast<uint32_t>(DURATION_TICKS))
+            finish(playerHealth > enemyHealth, false);
+    }
+
+    // FNV-1a over everything that can differ between two runs, two peers with the same inputs must agree on it
+    uint32_t checksum() const
+    {
+        uint8_t flags = static_cast<uint8_t>(over | (playerWon << 1) | (shotReady << 2));
+        uint32_t hash = ByteCodec::fnv(ByteCodec::FNV_BASIS, &tick, sizeof(tick));
+        hash = ByteCodec::fnv(hash, &flags, sizeof(flags));
+        hash = world.checksum(hash);
+        for (int p = 0; p < getPetCount(); p++)
+        {
+            int health = getHealth(p);
+            hash = ByteCodec::fnv(hash, &health, sizeof(health));
+        }
+        uint32_t generator[4];
+        random.getState(generator);
+        return ByteCodec::fnv(hash, generator, sizeof(generator));
+    }
+
+    // the tables and the world go back to their memory resource, call before releasing it
+    void release()
+    {
+        world.release();
+        std::pmr::vector<SimUnit>(units.get_allocator()).swap(units);
+        std::pmr::vector<int>(bodies.get_allocator()).swap(bodies);
+        std::pmr::vector<int>(rewards.get_allocator()).swap(rewards);
+    }
+
+    int getPetCount() const { return static_cast<int>(units.size()); } // getter
+    int getPlayerCount() const { return playerCount; } // getter
+    const SimUnit &getUnit(int pet) const { return units[pet]; } // getter
+    int getHealth(int pet) const { return world.getHealth(bodies[pet]); } // getter
+    int getMaxHealth(int pet) const { return units[pet].health; } // getter
+    bool isAlive(int pet) const { return getHealth(pet) > 0; }
+    sf::FloatRect getBox(int pet) const { return world.getBox(bodies[pet]); } // getter
+    int getReward(int pet) const { return pet < playerCount ? rewards[pet] : 0; } // getter
+    uint32_t getTick() const { return tick; } // getter
+    bool isOver() const { return over; }
+    bool hasPlayerWon() const { return playerWon; }
+    uint64_t getSeed() const { return seed; } // getter
+    const BattleWorld &getWorld() const { return world; } // getter
+
+    int getSideHealth(Team team) const
+    {
+        int total = 0;
+        for (int p = team == PLAYER_TEAM ? 0 : playerCount; p < (team == PLAYER_TEAM ? playerCount : getPetCount()); p++)
+            total += getHealth(p);
+        return total;
+    }
+};
+
+// ==================== DUEL BATTLE CLASS ==================== //
+
+// The 1v1 battle rules, both pets, their shots and the falling obstacles are entities in a BattleWorld stepped at 60 Hz from one button mask.
+// It uses Encapsulation, BattleGame draws it and plays its sounds while self-play, tournaments and the balance sweep step the same object headless.
+class DuelBattle
+{
+public:
+    static const int MAX_HEALTH = 100;
+    static const int SHOT_DAMAGE = 8;
+    static const int DURATION_SECONDS = 80;
+    static constexpr float WIDTH = 1000.0f; // the 1v1 window, the world is in window coordinates
+    static constexpr float HEIGHT = 600.0f;
+    static constexpr float PET_SIZE = 80.0f; // BattleGame stretches every pet picture over this square
+    static constexpr float OBSTACLE_WIDTH = 42.0f; // obstacle1.png
+    static constexpr float OBSTACLE_HEIGHT = 51.0f;
+
+    // what the world draws, the pets are looks[TeamBattle::PLAYER_TEAM] and looks[TeamBattle::ENEMY_TEAM]
+    enum Look
+    {
+        LOOK_PLAYER,
+        LOOK_ENEMY,
+        LOOK_PLAYER_SHOT,
+        LOOK_ENEMY_SHOT,
+        LOOK_OBSTACLE,
+        LOOK_COUNT
+    };
+
+    // what happened during the last step(), BattleGame turns these into sounds
+    enum Cue
+    {
+        CUE_PLAYER_SHOT = 1,
+        CUE_ENEMY_SHOT = 2,
+        CUE_HIT = 4
+    };
+
+private:
+    static const int MAX_SHOTS = 50; // in flight per side
+    static const int MAX_OBSTACLES = 10;
+    static constexpr float PLAYER_SPEED = 5.0f;
+    static constexpr float ENEMY_SPEED = 3.5f;
+    static constexpr float PLAYER_SHOT_SPEED = 15.0f;
+    static constexpr float ENEMY_SHOT_SPEED = 12.0f;
+    static constexpr float SHOT_COOLDOWN = 0.5f;
+    static constexpr float OBSTACLE_INTERVAL = 2.5f;
+    static constexpr float OBSTACLE_SPEED = 3.5f;
+
+    enum TimerEvent
+    {
+        EVENT_SPAWN_OBSTACLE,
+        EVENT_PLAYER_SHOT_READY,
+        EVENT_ENEMY_SHOT_READY
+    };
+
+    BattleWorld world;
+    int species[2]; // per team, picks the shot size
+    int bodies[2];  // per team
+    int obstacles[MAX_OBSTACLES];
+    int obstacleCount;
+    uint32_t tick;
+    bool over;
+    bool playerWon;
+    bool playerShotReady;
+    bool enemyShotReady;
+    uint8_t cues;
+    uint64_t seed;
+    TimerWheel timers;
+    BattleRandom random;
+    EnemyAIParams params;
+    AIScheduler scheduler;
+    ThreatField threats;
+
+    sf::FloatRect screen() const { return sf::FloatRect(0, 0, WIDTH, HEIGHT); }
+    sf::FloatRect field() const { return sf::FloatRect(0, 50, WIDTH, HEIGHT - 100); } // below the HUD and above the bottom edge
+
+    void onTimer(int event)
+    {
+        switch (event)
+        {
+        case EVENT_SPAWN_OBSTACLE:
+            if (obstacleCount < MAX_OBSTACLES)
+            {
+                float x = static_cast<float>(random.nextInt(static_cast<int>(WIDTH) - 100) + 50);
+                obstacles[obstacleCount++] = world.spawnProp(sf::FloatRect(x, -50, OBSTACLE_WIDTH, OBSTACLE_HEIGHT),
+                                                             sf::Vector2f(0, OBSTACLE_SPEED), LOOK_OBSTACLE);
+            }
+            break;
+        case EVENT_PLAYER_SHOT_READY:
+            playerShotReady = true;
+            break;
+        case EVENT_ENEMY_SHOT_READY:
+            enemyShotReady = true;
+            break;
+        }
+    }
+
+    // a shot leaves the front of the pet at half its height, players fire right and enemies left
+    void fire(int team, float speed, int look)
+    {
+        sf::FloatRect body = world.getBox(bodies[team]);
+        sf::Vector2f size = Species::info(species[team]).shotSize;
+        float x = team == TeamBattle::PLAYER_TEAM ? body.left + body.width : body.left;
+        world.spawnShot(team, sf::FloatRect(x, body.top + body.height / 2, size.x, size.y),
+                        sf::Vector2f(team == TeamBattle::PLAYER_TEAM ? speed : -speed, 0), SHOT_DAMAGE, -1, look);
+    }
+
+    void movePlayer(uint8_t buttons)
+    {
+        sf::Vector2f velocity((buttons & BUTTON_RIGHT) ? PLAYER_SPEED : ((buttons & BUTTON_LEFT) ? -PLAYER_SPEED : 0),
+                              (buttons & BUTTON_DOWN) ? PLAYER_SPEED : ((buttons & BUTTON_UP) ? -PLAYER_SPEED : 0));
+        if (velocity.x != 0 && velocity.y != 0)
+            velocity *= 0.7071f;
+        world.setVelocity(bodies[TeamBattle::PLAYER_TEAM], velocity);
+    }
+
+    // the enemy steers around the player's shots in flight
+    void moveEnemy()
+    {
+        threats.clear(screen());
+        world.forEachShot(TeamBattle::PLAYER_TEAM, [this](const sf::Vector2f &center, const sf::Vector2f &velocity, int)
+                          { threats.addProjectile(center, velocity); });
+        threats.build();
+
+        int enemy = bodies[TeamBattle::ENEMY_TEAM];
+        sf::Vector2f toPlayer = world.getPosition(bodies[TeamBattle::PLAYER_TEAM]) - world.getPosition(enemy);
+        sf::Vector2f velocity = world.getVelocity(enemy);
+        AIContext context = EnemyAI::makeContext(toPlayer, std::sqrt(toPlayer.x * toPlayer.x + toPlayer.y * toPlayer.y),
+                                                 true, velocity, ENEMY_SPEED);
+        sf::FloatRect box = world.getBox(enemy);
+        context.threat = threats.assess(world.getCenter(enemy), velocity, std::max(box.width, box.height) / 2 + 10.0f,
+                                        params.dodgeHorizon, PLAYER_SHOT_SPEED);
+        scheduler.update(UtilityBrain::duelBrain(), params, [&context](int, AIContext &out)
+                         { out = context; return true; });
+        world.setVelocity(enemy, scheduler.steer(UtilityBrain::duelBrain(), 0, context, params, random));
+    }
+
+    // obstacles fall off the bottom of the window, one landing on a pet shoves it and wears it down every tick they overlap
+    void updateObstacles()
+    {
+        for (int i = 0; i < obstacleCount;)
+        {
+            if (world.getPosition(obstacles[i]).y > HEIGHT)
+            {
+                world.destroy(obstacles[i]);
+                obstacles[i] = obstacles[--obstacleCount];
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        for (int i = 0; i < obstacleCount; i++)
+        {
+            sf::FloatRect rock = world.getBox(obstacles[i]);
+            for (int body : bodies)
+            {
+                if (!world.getBox(body).intersects(rock))
+                    continue;
+                sf::Vector2f push = world.getPosition(body) - sf::Vector2f(rock.left, rock.top);
+                float length = std::sqrt(push.x * push.x + push.y * push.y);
+                if (length > 0)
+                    world.place(body, world.getPosition(body) + push / length * 5.0f);
+                world.hurt(body, 3);
+                cues |= CUE_HIT;
+            }
+        }
+    }
+
+    void finish(bool won)
+    {
+        over = true;
+        playerWon = won;
+    }
+
+public:
+    // the world comes from `memory`, a copy made for a replay keyframe uses the default resource
+    explicit DuelBattle(std::pmr::memory_resource *memory = std::pmr::get_default_resource()) // constructor
+        : world(memory), species{Species::DRAGON, Species::DRAGON}, bodies{-1, -1}, obstacleCount(0), tick(0), over(false),
+          playerWon(false), playerShotReady(true), enemyShotReady(false), cues(0), seed(0)
+    {
+    }
+
+    void setParams(const EnemyAIParams &aiParams) { params = aiParams; }
+
+    // both pets have 100 HP and hit for 8 whatever their level, the species only changes the size of their shots
+    void start(int playerSpecies, int enemySpecies, uint64_t matchSeed)
+    {
+        species[TeamBattle::PLAYER_TEAM] = playerSpecies;
+        species[TeamBattle::ENEMY_TEAM] = enemySpecies;
+        tick = 0;
+        over = false;
+        playerWon = false;
+        playerShotReady = true;
+        enemyShotReady = false;
+        cues = 0;
+        seed = matchSeed;
+        random.setSeed(matchSeed);
+        scheduler.resize(1);
+        scheduler.reset();
+
+        timers.reset();
+        timers.schedule(TimerWheel::ticks(OBSTACLE_INTERVAL), EVENT_SPAWN_OBSTACLE, TimerWheel::ticks(OBSTACLE_INTERVAL));
+        timers.schedule(TimerWheel::ticks(params.fireInterval), EVENT_ENEMY_SHOT_READY);
+
+        world.clear();
+        world.reserve(2 * MAX_SHOTS + 2 + MAX_OBSTACLES);
+        bodies[TeamBattle::PLAYER_TEAM] = world.spawnBody(TeamBattle::PLAYER_TEAM, sf::FloatRect(150, 300, PET_SIZE, PET_SIZE),
+                                                          MAX_HEALTH, TeamBattle::PLAYER_TEAM, LOOK_PLAYER);
+        bodies[TeamBattle::ENEMY_TEAM] = world.spawnBody(TeamBattle::ENEMY_TEAM, sf::FloatRect(800, 300, PET_SIZE, PET_SIZE),
+                                                         MAX_HEALTH, TeamBattle::ENEMY_TEAM, LOOK_ENEMY);
+        obstacleCount = 0;
+    }
+
+    // one 60 Hz tick, `buttons` is the player's BattleButton mask and BUTTON_FIRE shoots when the cooldown allows
+    void step(uint8_t buttons)
+    {
+        cues = 0;
+        if (over)
+            return;
+
+        // every step that runs is a tick, the one that finds the battle decided too, so a replay has an input for it
+        timers.advance([this](int event) { onTimer(event); });
+        tick++;
+        if (getRemainingSeconds() <= 0 || getHealth(TeamBattle::PLAYER_TEAM) <= 0 || getHealth(TeamBattle::ENEMY_TEAM) <= 0)
+        {
+            finish(getHealth(TeamBattle::PLAYER_TEAM) > getHealth(TeamBattle::ENEMY_TEAM));
+            return;
+        }
+
+        if ((buttons & BUTTON_FIRE) && playerShotReady && world.countShots(TeamBattle::PLAYER_TEAM) < MAX_SHOTS)
+        {
+            fire(TeamBattle::PLAYER_TEAM, PLAYER_SHOT_SPEED, LOOK_PLAYER_SHOT);
+            cues |= CUE_PLAYER_SHOT;
+            playerShotReady = false;
+            timers.schedule(TimerWheel::ticks(SHOT_COOLDOWN), EVENT_PLAYER_SHOT_READY);
+        }
+        movePlayer(buttons);
+        moveEnemy();
+
+        // the world moves both pets, every shot in flight and the obstacles
+        world.integrate();
+        world.confine(field());
+        updateObstacles();
+
+        if (enemyShotReady && world.countShots(TeamBattle::ENEMY_TEAM) < MAX_SHOTS)
+        {
+            fire(TeamBattle::ENEMY_TEAM, ENEMY_SHOT_SPEED, LOOK_ENEMY_SHOT);
+            cues |= CUE_ENEMY_SHOT;
+            enemyShotReady = false;
+            timers.schedule(TimerWheel::ticks(params.fireInterval), EVENT_ENEMY_SHOT_READY);
+        }
+
+        world.cull(screen(), [](int) {});
+        world.resolveHits([this](int, int, int)
+                          { cues |= CUE_HIT; });
+
+        if (getHealth(TeamBattle::ENEMY_TEAM) <= 0)
+            finish(true);
+        else if (getHealth(TeamBattle::PLAYER_TEAM) <= 0)
+            finish(false);
+    }
+
+    // FNV-1a over everything that can differ between two runs
+    uint32_t checksum() const
+    {
+        uint8_t flags = static_cast<uint8_t>(over | (playerWon << 1) | (playerShotReady << 2) | (enemyShotReady << 3));
+        uint32_t hash = ByteCodec::fnv(ByteCodec::FNV_BASIS, &tick, sizeof(tick));
+        hash = ByteCodec::fnv(hash, &flags, sizeof(flags));
+        hash = world.checksum(hash);
+        for (int body : bodies)
+        {
+            int health = world.getHealth(body);
+            hash = ByteCodec::fnv(hash, &health, sizeof(health));
+        }
+        uint32_t generator[4];
+        random.getState(generator);
+        return ByteCodec::fnv(hash, generator, sizeof(generator));
+    }
+
+    // the world goes back to its memory resource, call before releasing it
+    void release() { world.release(); }
+
+    int getHealth(int team) const { return world.getHealth(bodies[team]); } // getter
+    sf::FloatRect getBox(int team) const { return world.getBox(bodies[team]); } // getter
+    int getSpecies(int team) const { return species[team]; } // getter
+    int getRemainingSeconds() const { return std::max(0, DURATION_SECONDS - static_cast<int>(timers.seconds())); }
+    uint32_t getTick() const { return tick; } // getter
+    uint8_t getCues() const { return cues; } // getter
+    bool isOver() const { return over; }
+    bool hasPlayerWon() const { return playerWon; }
+    uint64_t getSeed() const { return seed; } // getter
+    const BattleWorld &getWorld() const { return world; } // getter
+};
+
+// ==================== TRAINING ROUND CLASS ==================== //
+
+// The training rules, the pet follows the mouse up and down and trades shots with a drifting sparring partner for a minute, hits only score.
+// It uses Encapsulation, TrainingGame draws it and hands out the experience while replays step the same object headless.
+struct Trainee
+{
+    int speciesId;
+    int level;
+    int attack; // scores more per hit
+    int speed;  // faster shots
+};
+
+class TrainingRound
+{
+public:
+    static const int DURATION_SECONDS = 60;
+    static constexpr float WIDTH = 900.0f; // the training window, the world is in window coordinates
+    static constexpr float HEIGHT = 600.0f;
+
+    // what the world draws, the pets are looks[TeamBattle::PLAYER_TEAM] and looks[TeamBattle::ENEMY_TEAM]
+    enum Look
+    {
+        LOOK_PLAYER,
+        LOOK_ENEMY,
+        LOOK_PLAYER_SHOT,
+        LOOK_ENEMY_SHOT,
+        LOOK_COUNT
+    };
+
+private:
+    static const int MAX_SHOTS = 50; // in flight per side
+    static constexpr float PET_HEIGHT = HEIGHT * 0.12f;
+    static constexpr float SHOT_COOLDOWN = 0.2f;
+    static constexpr float DECIDE_INTERVAL = 0.5f;
+
+    enum TimerEvent
+    {
+        EVENT_ENEMY_DECIDE,
+        EVENT_SHOT_READY
+    };
+
+    BattleWorld world;
+    Trainee trainee;
+    int enemySpecies;
+    int bodies[2]; // per team, both are targets that never wear down
+    int playerScore;
+    int enemyScore;
+    float enemySpeed;
+    uint32_t tick;
+    bool over;
+    bool shotReady;
+    uint64_t seed;
+    TimerWheel timers;
+    BattleRandom random;
+
+    // the pet and its partner move in the band between the title and the scores
+    sf::FloatRect lane() const { return sf::FloatRect(0, 80, WIDTH, HEIGHT - 160); }
+
+    // the sparring partner is a Dragon or a Phoenix of another element than the trainee
+    int pickEnemy()
+    {
+        int choices[2];
+        int count = 0;
+        if (trainee.speciesId != Species::DRAGON)
+            choices[count++] = Species::DRAGON;
+        if (trainee.speciesId != Species::PHOENIX)
+            choices[count++] = Species::PHOENIX;
+        return choices[random.nextInt(count)];
+    }
+
+    // chases the pet's height, drifts somewhere or stands still
+    void decideEnemyMove()
+    {
+        int aiChoice = random.nextInt(100);
+        if (aiChoice < 40)
+        {
+            enemySpeed = (world.getPosition(bodies[TeamBattle::PLAYER_TEAM]).y - world.getPosition(bodies[TeamBattle::ENEMY_TEAM]).y) * 0.05f;
+        }
+        else if (aiChoice < 70)
+        {
+            enemySpeed = (random.nextInt(100) / 50.0f) - 1.0f;
+        }
+        else
+        {
+            enemySpeed = 0;
+        }
+    }
+
+    void onTimer(int event)
+    {
+        switch (event)
+        {
+        case EVENT_ENEMY_DECIDE:
+            decideEnemyMove();
+            break;
+        case EVENT_SHOT_READY:
+            shotReady = true;
+            break;
+        }
+    }
+
+    // shots leave the front of the pet a little above its middle, the partner always throws lightning
+    void fire(int team, int species, float speed, int look)
+    {
+        if (world.countShots(team) >= MAX_SHOTS)
+            return;
+        sf::FloatRect body = world.getBox(bodies[team]);
+        sf::Vector2f size = Species::info(species).shotSize;
+        float x = team == TeamBattle::PLAYER_TEAM ? body.left + body.width : body.left;
+        world.spawnShot(team, sf::FloatRect(x, body.top + body.height / 2 - 15, size.x, size.y), sf::Vector2f(speed, 0), 1, -1, look);
+    }
+
+public:
+    // the world comes from `memory`, a copy made for a replay keyframe uses the default resource
+    explicit TrainingRound(std::pmr::memory_resource *memory = std::pmr::get_default_resource()) // constructor
+        : world(memory), trainee{Species::DRAGON, 1, 0, 0}, enemySpecies(Species::PHOENIX), bodies{-1, -1}, playerScore(0),
+          enemyScore(0), enemySpeed(1.5f), tick(0), over(false), shotReady(true), seed(0)
+    {
+    }
+
+    // a pet is as tall as 12% of the window and as wide as its picture
+    static sf::Vector2f petSize(int speciesId)
+    {
+        sf::Vector2f body = Species::info(speciesId).bodySize;
+        return sf::Vector2f(PET_HEIGHT * body.x / body.y, PET_HEIGHT);
+    }
+
+    void start(const Trainee &pet, uint64_t matchSeed)
+    {
+        trainee = pet;
+        seed = matchSeed;
+        random.setSeed(matchSeed);
+        enemySpecies = pickEnemy();
+        playerScore = 0;
+        enemyScore = 0;
+        enemySpeed = 1.5f;
+        tick = 0;
+        over = false;
+        shotReady = true;
+        timers.reset();
+        timers.schedule(TimerWheel::ticks(DECIDE_INTERVAL), EVENT_ENEMY_DECIDE, TimerWheel::ticks(DECIDE_INTERVAL));
+
+        world.clear();
+        world.reserve(2 * MAX_SHOTS + 2);
+        sf::Vector2f playerSize = petSize(trainee.speciesId);
+        sf::Vector2f enemySize = petSize(enemySpecies);
+        bodies[TeamBattle::PLAYER_TEAM] = world.spawnTarget(TeamBattle::PLAYER_TEAM,
+                                                            sf::FloatRect(WIDTH * 0.21f, (HEIGHT - playerSize.y) / 2, playerSize.x, playerSize.y),
+                                                            TeamBattle::PLAYER_TEAM, LOOK_PLAYER);
+        bodies[TeamBattle::ENEMY_TEAM] = world.spawnTarget(TeamBattle::ENEMY_TEAM,
+                                                           sf::FloatRect(WIDTH * 0.79f - enemySize.x, (HEIGHT - enemySize.y) / 2, enemySize.x, enemySize.y),
+                                                           TeamBattle::ENEMY_TEAM, LOOK_ENEMY);
+    }
+
+    // one 60 Hz tick, the pet is centred on `mouseY` in window coordinates and BUTTON_FIRE shoots when the cooldown allows
+    void step(int mouseY, uint8_t buttons)
+    {
+        if (over)
+            return;
+
+        timers.advance([this](int event) { onTimer(event); });
+        tick++;
+        if (getRemainingSeconds() <= 0)
+        {
+            over = true;
+            return;
+        }
+
+        // the pet follows the mouse, the partner drifts at the speed it last decided on
+        int player = bodies[TeamBattle::PLAYER_TEAM];
+        sf::FloatRect playerBox = world.getBox(player);
+        world.place(player, sf::Vector2f(playerBox.left, mouseY - playerBox.height / 2));
+        world.setVelocity(bodies[TeamBattle::ENEMY_TEAM], sf::Vector2f(0, enemySpeed * 3.0f));
+
+        if ((buttons & BUTTON_FIRE) && shotReady)
+        {
+            fire(TeamBattle::PLAYER_TEAM, trainee.speciesId, 15.0f + trainee.speed * 0.5f, LOOK_PLAYER_SHOT);
+            shotReady = false;
+            timers.schedule(TimerWheel::ticks(SHOT_COOLDOWN), EVENT_SHOT_READY);
+        }
+        if (random.nextInt(100) < 2 + trainee.level / 5)
+            fire(TeamBattle::ENEMY_TEAM, Species::GRIFFIN, -12.0f, LOOK_ENEMY_SHOT);
+
+        world.integrate();
+        world.confine(lane());
+        world.cull(sf::FloatRect(0, 0, WIDTH, HEIGHT), [](int) {});
+        world.resolveHits([this](int, int body, int)
+                          {
+            if (body == TeamBattle::ENEMY_TEAM)
+                playerScore += 10 + trainee.attack / 2;
+            else
+                enemyScore += 10; });
+    }
+
+    // FNV-1a over everything that can differ between two runs
+    uint32_t checksum() const
+    {
+        uint8_t flags = static_cast<uint8_t>(over | (shotReady << 1));
+        int scores[2] = {playerScore, enemyScore};
+        uint32_t hash = ByteCodec::fnv(ByteCodec::FNV_BASIS, &tick, sizeof(tick));
+        hash = ByteCodec::fnv(hash, &flags, sizeof(flags));
+        hash = ByteCodec::fnv(hash, scores, sizeof(scores));
+        hash = ByteCodec::fnv(hash, &enemySpeed, sizeof(enemySpeed));
+        hash = world.checksum(hash);
+        uint32_t generator[4];
+        random.getState(generator);
+        return ByteCodec::fnv(hash, generator, sizeof(generator));
+    }
+
+    // the world goes back to its memory resource, call before releasing it
+    void release() { world.release(); }
+
+    const Trainee &getTrainee() const { return trainee; } // getter
+    int getEnemySpecies() const { return enemySpecies; } // getter
+    int getPlayerScore() const { return playerScore; } // getter
+    int getEnemyScore() const { return enemyScore; } // getter
+    sf::FloatRect getBox(int team) const { return world.getBox(bodies[team]); } // getter
+    int getRemainingSeconds() const { return std::max(0, DURATION_SECONDS - static_cast<int>(timers.seconds())); }
+    float getElapsedSeconds() const { return timers.seconds(); }
+    uint32_t getTick() const { return tick; } // getter
+    bool isOver() const { return over; }
+    uint64_t getSeed() const { return seed; } // getter
+    const BattleWorld &getWorld() const { return world; } // getter
+};
+
+// ==================== SELF PLAY CLASS ==================== //
+
+// Plays thousands of headless matches across every core to see how the enemy AI constants hold up against scripted players.
+// It uses Abstraction and threads, a scripted player presses buttons on the real DuelBattle or TeamBattle and every match gets its own seed so runs repeat exactly.
+enum PlayerPolicy
+{
+    POLICY_IDLE,  // stands still and never shoots
+    POLICY_RUSH,  // closes in and shoots whenever ready
+    POLICY_KITE,  // keeps its distance and shoots whenever ready
+    POLICY_DODGE, // steps out of the way of incoming shots, shoots in between
+    POLICY_COUNT
+};
+
+struct MatchResult
+{
+    bool playerWon;
+    int ticks;
+    int damageToPlayer;
+    int damageToEnemy;
+};
+
+class SelfPlay
+{
+private:
+    // runs job(0..count-1) on the shared pool, one match per task so stealing evens out long and short games
+    template <typename Job>
+    static void parallelFor(int count, Job job)
+    {
+        JobSystem::shared().parallelFor(count, 1, [&](int begin, int end)
+                                        {
+            for (int i = begin; i < end; i++)
+            {
+                job(i);
+            } });
+    }
+
+    static void printSummary(const std::string &label, std::vector<MatchResult> &results)
+    {
+        if (results.empty())
+            return;
+
+        int enemyWins = 0;
+        double totalTicks = 0;
+        std::vector<int> damage;
+        damage.reserve(results.size());
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            if (!results[i].playerWon)
+                enemyWins++;
+            totalTicks += results[i].ticks;
+            damage.push_back(results[i].damageToPlayer);
+        }
+        std::sort(damage.begin(), damage.end());
+        size_t n = damage.size();
+
+        std::cout << label
+                  << " | enemy wins " << (100.0 * enemyWins / n) << "%"
+                  << ", avg length " << (totalTicks / n / TimerWheel::TICKS_PER_SECOND) << " s"
+                  << ", damage to player p10/p50/p90 " << damage[n / 10] << "/" << damage[n / 2] << "/" << damage[n * 9 / 10]
+                  << std::endl;
+    }
+
+public:
+    // the buttons a scripted player holds this tick, `self` lines up with `target` and the enemy shots in `world` are what it dodges
+    static uint8_t scriptedButtons(PlayerPolicy policy, const sf::FloatRect &self, const sf::FloatRect &target, const BattleWorld &world)
+    {
+        if (policy == POLICY_IDLE)
+            return 0;
+
+        float alignY = target.top - self.top;
+        float gap = target.left - self.left;
+        uint8_t buttons = BUTTON_FIRE | (alignY > 5 ? BUTTON_DOWN : (alignY < -5 ? BUTTON_UP : 0));
+        if (policy == POLICY_RUSH && gap > 250)
+            buttons |= BUTTON_RIGHT;
+        else if (policy == POLICY_KITE && gap < 500)
+            buttons |= BUTTON_LEFT;
+        else if (policy == POLICY_DODGE)
+        {
+            bool dodged = false;
+            world.forEachShot(TeamBattle::ENEMY_TEAM, [&](const sf::Vector2f &center, const sf::Vector2f &, int)
+                              {
+                float ahead = center.x - (self.left + self.width);
+                bool inLane = center.y > self.top - 10 && center.y < self.top + self.height + 10;
+                if (dodged || ahead <= -self.width || ahead >= 200 || !inLane)
+                    return;
+                buttons = (buttons & ~(BUTTON_UP | BUTTON_DOWN)) | (center.y > self.top + self.height / 2 ? BUTTON_UP : BUTTON_DOWN);
+                dodged = true; });
+        }
+        return buttons;
+    }
+
+    static const char *policyName(int policy)
+    {
+        static const char *names[POLICY_COUNT] = {"idle", "rush", "kite", "dodge"};
+        return (policy >= 0 && policy < POLICY_COUNT) ? names[policy] : "?";
+    }
+
+    // a whole 1v1 on the real rules with the scripted player on the keyboard
+    static MatchResult playDuel(const EnemyAIParams &params, PlayerPolicy policy, int playerSpecies, int enemySpecies, uint64_t seed)
+    {
+        DuelBattle battle;
+        battle.setParams(params);
+        battle.start(playerSpecies, enemySpecies, seed);
+        while (!battle.isOver())
+        {
+            battle.step(scriptedButtons(policy, battle.getBox(TeamBattle::PLAYER_TEAM), battle.getBox(TeamBattle::ENEMY_TEAM),
+                                        battle.getWorld()));
+        }
+
+        MatchResult result;
+        result.playerWon = battle.hasPlayerWon();
+        result.ticks = static_cast<int>(battle.getTick());
+        result.damageToPlayer = DuelBattle::MAX_HEALTH - battle.getHealth(TeamBattle::PLAYER_TEAM);
+        result.damageToEnemy = DuelBattle::MAX_HEALTH - battle.getHealth(TeamBattle::ENEMY_TEAM);
+        return result;
+    }
+
+    // a whole 2v2 on the real rules, every living player pet runs the same script against the nearest living enemy
+    static MatchResult playTeam(const EnemyAIParams &params, PlayerPolicy policy,
+                                const SimUnit *players, int playerTotal, const SimUnit *enemies, int enemyTotal, uint64_t seed)
+    {
+        TeamBattle battle;
+        battle.setParams(params);
+        battle.start(players, playerTotal, enemies, enemyTotal, seed);
+        uint8_t buttons[TeamBattle::MAX_PER_SIDE] = {};
+        while (!battle.isOver())
+        {
+            for (int p = 0; p < battle.getPlayerCount(); p++)
+            {
+                sf::FloatRect self = battle.getBox(p);
+                int target = -1;
+                float best = 0;
+                for (int e = battle.getPlayerCount(); e < battle.getPetCount(); e++)
+                {
+                    sf::FloatRect box = battle.getBox(e);
+                    float dx = box.left - self.left;
+                    float dy = box.top - self.top;
+                    if (battle.isAlive(e) && (target < 0 || dx * dx + dy * dy < best))
+                    {
+                        target = e;
+                        best = dx * dx + dy * dy;
+                    }
+                }
+                buttons[p] = target < 0 ? 0 : scriptedButtons(policy, self, battle.getBox(target), battle.getWorld());
+            }
+            battle.step(buttons);
+        }
+
+        MatchResult result;
+        result.playerWon = battle.hasPlayerWon();
+        result.ticks = static_cast<int>(battle.getTick());
+        result.damageToPlayer = 0;
+        result.damageToEnemy = 0;
+        for (int p = 0; p < battle.getPetCount(); p++)
+        {
+            int lost = battle.getMaxHealth(p) - battle.getHealth(p);
+            (p < battle.getPlayerCount() ? result.damageToPlayer : result.damageToEnemy) += lost;
+        }
+        return result;
+    }
+
+    // --selfplay [matches per setting] [seed]
+    static int runCommand(int argc, char *argv[])
+    {
+        int matches = argc >= 3 ? std::max(1, atoi(argv[2])) : 500;
+        uint64_t seed = argc >= 4 ? strtoull(argv[3], nullptr, 10) : 1;
+
+        std::cout.setf(std::ios::fixed);
+        std::cout.precision(1);
+
+        // 1v1 sweep over the distance band and the fire rate
+        const float approach[] = {150, 200, 250, 300};
+        const float retreat[] = {100, 150};
+        const float fireInterval[] = {1.0f, 1.5f, 2.0f};
+        const float dodgeHorizon[] = {0, 20};
+
+        std::vector<EnemyAIParams> settings;
+        for (float a : approach)
+            for (float r : retreat)
+                for (float f : fireInterval)
+                    for (float d : dodgeHorizon)
+                    {
+                        EnemyAIParams params;
+                        params.approachDistance = a;
+                        params.retreatDistance = r;
+                        params.fireInterval = f;
+                        params.dodgeHorizon = d;
+                        settings.push_back(params);
+                    }
+
+        int duelJobs = static_cast<int>(settings.size()) * POLICY_COUNT * matches;
+        std::vector<MatchResult> duelResults(duelJobs);
+        sf::Clock timer;
+        parallelFor(duelJobs, [&](int job)
+                    {
+            int setting = job / (POLICY_COUNT * matches);
+            int policy = (job / matches) % POLICY_COUNT;
+            duelResults[job] = playDuel(settings[setting], static_cast<PlayerPolicy>(policy), Species::DRAGON, Species::DRAGON, seed + job); });
+        float duelSeconds = timer.getElapsedTime().asSeconds();
+
+        std::cout << "=== 1v1 (" << matches << " matches per row) ===" << std::endl;
+        for (size_t s = 0; s < settings.size(); s++)
+        {
+            for (int p = 0; p < POLICY_COUNT; p++)
+            {
+                std::vector<MatchResult> rows(duelResults.begin() + (s * POLICY_COUNT + p) * matches,
+                                              duelResults.begin() + (s * POLICY_COUNT + p + 1) * matches);
+                std::ostringstream label;
+                label << "approach " << static_cast<int>(settings[s].approachDistance)
+                      << " retreat " << static_cast<int>(settings[s].retreatDistance)
+                      << " fire " << settings[s].fireInterval << "s dodge " << static_cast<int>(settings[s].dodgeHorizon)
+                      << " vs " << policyName(p);
+                printSummary(label.str(), rows);
+            }
+        }
+
+        // 2v2 sweep over the per-frame fire chance and positioning, Dragon + Phoenix against Griffin + Unicorn
+        SimUnit players[2] = {TeamBattle::unitFor(Species::record(Species::DRAGON)), TeamBattle::unitFor(Species::record(Species::PHOENIX))};
+        SimUnit enemies[2] = {TeamBattle::unitFor(Species::record(Species::GRIFFIN)), TeamBattle::unitFor(Species::record(Species::UNICORN))};
+        const int fireChance[] = {1, 2, 3, 4, 5};
+
+        std::vector<EnemyAIParams> teamSettings;
+        for (int c : fireChance)
+            for (int positioning = 0; positioning < 2; positioning++)
+            {
+                EnemyAIParams params;
+                params.teamFireChance = c;
+                params.teamPositioning = positioning == 1;
+                teamSettings.push_back(params);
+            }
+
+        int teamJobs = static_cast<int>(teamSettings.size()) * POLICY_COUNT * matches;
+        std::vector<MatchResult> teamResults(teamJobs);
+        timer.restart();
+        parallelFor(teamJobs, [&](int job)
+                    {
+            int setting = job / (POLICY_COUNT * matches);
+            int policy = (job / matches) % POLICY_COUNT;
+            teamResults[job] = playTeam(teamSettings[setting], static_cast<PlayerPolicy>(policy), players, 2, enemies, 2, seed + job); });
+        float teamSeconds = timer.getElapsedTime().asSeconds();
+
+        std::cout << "=== 2v2 (" << matches << " matches per row) ===" << std::endl;
+        for (size_t s = 0; s < teamSettings.size(); s++)
+        {
+            for (int p = 0; p < POLICY_COUNT; p++)
+            {
+                std::vector<MatchResult> rows(teamResults.begin() + (s * POLICY_COUNT + p) * matches,
+                                              teamResults.begin() + (s * POLICY_COUNT + p + 1) * matches);
+                std::ostringstream label;
+                label << "fire chance " << teamSettings[s].teamFireChance << "%"
+                      << (teamSettings[s].teamPositioning ? " positioning" : " chase") << " vs " << policyName(p);
+                printSummary(label.str(), rows);
+            }
+        }
+
+        std::cout << "Played " << duelJobs << " duels in " << duelSeconds << " s and "
+                  << teamJobs << " team battles in " << teamSeconds << " s on "
+                  << JobSystem::shared().getThreadCount() << " threads" << std::endl;
+        return 0;
+    }
+};
+
+// ==================== TOURNAMENT CLASS ==================== //
+
+// Runs round robin or knockout tournaments between a roster of pets on the headless 1v1 and 2v2 rules, spread over every core.
+// It uses Abstraction and composition, a game is two DuelBattle or TeamBattle legs on one seed with the entrants in swapped seats.
+class Tournament
+{
+private:
+    struct Entrant
+    {
+        std::string name; // "Dragon" in a 1v1, "Dragon L3 + Phoenix L1" for a 2v2 team
+        SimUnit units[2];
+    };
+
+    struct Pairing
+    {
+        int first;
+        int second;
+    };
+
+    struct GameResult
+    {
+        int outcome; // 1 when the first entrant won the game, -1 when the second did, 0 for a draw
+        int margin;  // damage dealt minus damage taken over both legs, seen from the first entrant
+        int ticks;   // both legs
+        long long micros;
+    };
+
+    std::vector<Entrant> entrants;
+    bool teams;
+    int gamesPerPairing;
+    uint64_t seed;
+    std::vector<int> wins;   // wins[a * count + b] = games a won against b
+    std::vector<int> draws;  // draws[a * count + b] = games a and b drew
+    std::vector<int> played; // played[a * count + b] = games between a and b
+    std::vector<GameResult> games;
+    float wallSeconds;
+
+    static std::string lower(std::string text)
+    {
+        for (char &c : text)
+            c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        return text;
+    }
+
+    // looks the species up by name and levels it like a saved pet would be, the name only carries the level when it plays
+    static bool makeUnit(const std::string &species, int level, bool leveled, SimUnit &unit, std::string &name)
+    {
+        int id = Species::find(species);
+        if (id < 0)
+            return false;
+        PetRecord pet = Species::record(id, level);
+        unit = TeamBattle::unitFor(pet);
+        name = Species::info(id).name + (leveled ? " L" + std::to_string(pet.level) : "");
+        return true;
+    }
+
+    // "Dragon:3,Phoenix,Griffin:2", a missing level counts as 1
+    // a duel gives every pet the same health and shot damage whatever its level, so a 1v1 roster that names a level is refused rather than ignored
+    bool parseRoster(const std::string &roster)
+    {
+        std::vector<Entrant> pets;
+        std::istringstream list(roster);
+        std::string entry;
+        while (std::getline(list, entry, ','))
+        {
+            if (entry.empty())
+                continue;
+            size_t colon = entry.find(':');
+            if (!teams && colon != std::string::npos)
+            {
+                std::cerr << "Levels do not change a 1v1 duel, drop the level from " << entry << std::endl;
+                return false;
+            }
+            int level = colon == std::string::npos ? 1 : atoi(entry.c_str() + colon + 1);
+            Entrant pet;
+            if (!makeUnit(entry.substr(0, colon), level, teams, pet.units[0], pet.name))
+            {
+                std::cerr << "Unknown species in roster: " << entry << std::endl;
+                return false;
+            }
+            pet.units[1] = pet.units[0];
+            pets.push_back(pet);
+        }
+
+        if (!teams)
+        {
+            entrants = pets;
+        }
+        else
+        {
+            // 2v2 teams are consecutive roster entries
+            if (pets.size() % 2 != 0)
+            {
+                std::cerr << "A 2v2 roster needs an even number of pets" << std::endl;
+                return false;
+            }
+            for (size_t i = 0; i < pets.size(); i += 2)
+            {
+                Entrant team;
+                team.name = pets[i].name + " + " + pets[i + 1].name;
+                team.units[0] = pets[i].units[0];
+                team.units[1] = pets[i + 1].units[0];
+                entrants.push_back(team);
+            }
+        }
+
+        if (entrants.size() < 2)
+        {
+            std::cerr << "A tournament needs at least two entrants" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    GameResult playGame(const Pairing &pairing, int game, uint64_t gameSeed) const
+    {
+        sf::Clock clock;
+        MatchResult legs[2];
+        GameResult result;
+        result.outcome = playMirrored(entrants[pairing.first].units, entrants[pairing.second].units, teams, game, gameSeed, legs);
+        result.margin = mirroredMargin(legs);
+        result.ticks = legs[0].ticks + legs[1].ticks;
+        result.micros = clock.getElapsedTime().asMicroseconds();
+        return result;
+    }
+
+    // plays every game of every pairing in one batch, returns the winner of each pairing
+    std::vector<int> playRound(const std::vector<Pairing> &pairings, int round)
+    {
+        int jobs = static_cast<int>(pairings.size()) * gamesPerPairing;
+        std::vector<GameResult> results(jobs);
+        uint64_t roundSeed = seed + static_cast<uint64_t>(round) * 1000003;
+
+        sf::Clock clock;
+        JobSystem::shared().parallelFor(jobs, 1, [&](int begin, int end)
+                                        {
+            for (int job = begin; job < end; job++)
+            {
+                results[job] = playGame(pairings[job / gamesPerPairing], job % gamesPerPairing, roundSeed + job);
+            } });
+        wallSeconds += clock.getElapsedTime().asSeconds();
+
+        int count = static_cast<int>(entrants.size());
+        std::vector<int> winners;
+        for (size_t p = 0; p < pairings.size(); p++)
+        {
+            int a = pairings[p].first;
+            int b = pairings[p].second;
+            int firstWins = 0;
+            int secondWins = 0;
+            int margin = 0;
+            for (int g = 0; g < gamesPerPairing; g++)
+            {
+                const GameResult &result = results[p * gamesPerPairing + g];
+                firstWins += result.outcome > 0 ? 1 : 0;
+                secondWins += result.outcome < 0 ? 1 : 0;
+                margin += result.margin;
+                games.push_back(result);
+            }
+            int drawn = gamesPerPairing - firstWins - secondWins;
+            wins[a * count + b] += firstWins;
+            wins[b * count + a] += secondWins;
+            draws[a * count + b] += drawn;
+            draws[b * count + a] += drawn;
+            played[a * count + b] += gamesPerPairing;
+            played[b * count + a] += gamesPerPairing;
+
+            // a drawn series goes to the bigger damage margin, then to the higher seed
+            bool firstAdvances = firstWins != secondWins ? firstWins > secondWins : (margin != 0 ? margin > 0 : a < b);
+            winners.push_back(firstAdvances ? a : b);
+        }
+        return winners;
+    }
+
+    void runRoundRobin()
+    {
+        std::vector<Pairing> pairings;
+        int count = static_cast<int>(entrants.size());
+        for (int a = 0; a < count; a++)
+            for (int b = a + 1; b < count; b++)
+                pairings.push_back({a, b});
+        playRound(pairings, 0);
+    }
+
+    // single elimination seeded in roster order, the top seeds get the byes
+    void runBracket()
+    {
+        int count = static_cast<int>(entrants.size());
+        std::vector<int> slots(1, 0);
+        while (static_cast<int>(slots.size()) < count)
+        {
+            std::vector<int> next;
+            int size = static_cast<int>(slots.size()) * 2;
+            for (int seedIndex : slots)
+            {
+                next.push_back(seedIndex);
+                next.push_back(size - 1 - seedIndex);
+            }
+            slots = next;
+        }
+        for (int &slot : slots)
+        {
+            if (slot >= count)
+                slot = -1; // bye
+        }
+
+        for (int round = 1; slots.size() > 1; round++)
+        {
+            std::vector<Pairing> pairings;
+            std::vector<int> next(slots.size() / 2, -1);
+            for (size_t i = 0; i < next.size(); i++)
+            {
+                int a = slots[i * 2];
+                int b = slots[i * 2 + 1];
+                if (a < 0 || b < 0)
+                    next[i] = a < 0 ? b : a;
+                else
+                    pairings.push_back({a, b});
+            }
+
+            std::vector<int> winners = playRound(pairings, round);
+            std::cout << "Round " << round << ":" << std::endl;
+            for (size_t i = 0, p = 0; i < next.size(); i++)
+            {
+                if (next[i] >= 0)
+                {
+                    std::cout << "  " << entrants[next[i]].name << " has a bye" << std::endl;
+                    continue;
+                }
+                const Pairing &pairing = pairings[p];
+                int winner = winners[p++];
+                int loser = winner == pairing.first ? pairing.second : pairing.first;
+                int total = static_cast<int>(entrants.size());
+                next[i] = winner;
+                std::cout << "  " << entrants[winner].name << " beat " << entrants[loser].name << " "
+                          << wins[winner * total + loser] << "-" << wins[loser * total + winner] << std::endl;
+            }
+            slots = next;
+        }
+        std::cout << "Champion: " << entrants[slots[0]].name << std::endl;
+    }
+
+    void printWinMatrix() const
+    {
+        int count = static_cast<int>(entrants.size());
+        size_t width = 6;
+        for (const Entrant &entrant : entrants)
+            width = std::max(width, entrant.name.size());
+
+        std::cout << "=== Win matrix (row wins against column, " << gamesPerPairing << " games of two legs per pairing, a draw counts half) ===" << std::endl;
+        std::cout << std::string(width + 4, ' ');
+        for (int b = 0; b < count; b++)
+            std::cout << std::setw(6) << b;
+        std::cout << "   win %" << std::endl;
+
+        for (int a = 0; a < count; a++)
+        {
+            double totalWins = 0;
+            int totalPlayed = 0;
+            std::cout << std::setw(2) << a << "  " << entrants[a].name << std::string(width - entrants[a].name.size(), ' ');
+            for (int b = 0; b < count; b++)
+            {
+                if (played[a * count + b] == 0)
+                {
+                    std::cout << std::setw(6) << "-";
+                    continue;
+                }
+                std::cout << std::setw(6) << wins[a * count + b];
+                totalWins += wins[a * count + b] + 0.5 * draws[a * count + b];
+                totalPlayed += played[a * count + b];
+            }
+            std::cout << std::setw(8) << (totalPlayed > 0 ? 100.0 * totalWins / totalPlayed : 0.0) << std::endl;
+        }
+    }
+
+    void printTiming() const
+    {
+        if (games.empty())
+            return;
+
+        std::vector<long long> micros;
+        micros.reserve(games.size());
+        double simulatedTicks = 0;
+        double busySeconds = 0;
+        for (const GameResult &game : games)
+        {
+            micros.push_back(game.micros);
+            simulatedTicks += game.ticks;
+            busySeconds += game.micros / 1e6;
+        }
+        std::sort(micros.begin(), micros.end());
+        size_t n = micros.size();
+
+        std::cout << "=== Timing ===" << std::endl
+                  << "Played " << n << " games in " << wallSeconds * 1000 << " ms on " << JobSystem::shared().getThreadCount()
+                  << " threads (" << (wallSeconds > 0 ? n / wallSeconds : 0.0) << " games/s, "
+                  << (wallSeconds > 0 ? busySeconds / wallSeconds : 0.0) << "x parallel)" << std::endl
+                  << "Average leg " << (simulatedTicks / (2 * n) / TimerWheel::TICKS_PER_SECOND) << " s of battle, "
+                  << "simulated in p50/p90/max " << micros[n / 2] / 1000.0 << "/" << micros[n * 9 / 10] / 1000.0
+                  << "/" << micros[n - 1] / 1000.0 << " ms" << std::endl;
+    }
+
+public:
+    // one game is two legs on the same seed and script, each side takes the scripted seat against the other's AI once
+    // the sides are compared on the leg they played from the scripted seat, so what the seat is worth cancels out:
+    // winning it where the other lost decides, otherwise the bigger damage margin over both legs does
+    // legs[0] has the first side scripted, legs[1] the second, the script cycles through rush, kite and dodge game by game
+    // returns 1 when the first side won, -1 when the second did and 0 when both legs came out the same
+    static int playMirrored(const SimUnit *first, const SimUnit *second, bool teamBattle, int game, uint64_t gameSeed, MatchResult legs[2])
+    {
+        PlayerPolicy policy = static_cast<PlayerPolicy>(POLICY_RUSH + game % (POLICY_COUNT - POLICY_RUSH));
+        EnemyAIParams params;
+        for (int leg = 0; leg < 2; leg++)
+        {
+            const SimUnit *scripted = leg == 0 ? first : second;
+            const SimUnit *ai = leg == 0 ? second : first;
+            legs[leg] = teamBattle ? SelfPlay::playTeam(params, policy, scripted, 2, ai, 2, gameSeed)
+                                   : SelfPlay::playDuel(params, policy, scripted[0].speciesId, ai[0].speciesId, gameSeed);
+        }
+
+        if (legs[0].playerWon != legs[1].playerWon)
+            return legs[0].playerWon ? 1 : -1;
+        int margin = mirroredMargin(legs);
+        return margin > 0 ? 1 : (margin < 0 ? -1 : 0);
+    }
+
+    // damage the first side dealt minus damage it took over both legs of a playMirrored() game
+    static int mirroredMargin(const MatchResult legs[2])
+    {
+        return (legs[0].damageToEnemy - legs[0].damageToPlayer) - (legs[1].damageToEnemy - legs[1].damageToPlayer);
+    }
+
+    Tournament(bool teamBattles, int games, uint64_t firstSeed) // constructor
+        : teams(teamBattles), gamesPerPairing(games), seed(firstSeed), wallSeconds(0)
+    {
+    }
+
+    // --tournament <roster> [roundrobin|bracket] [1v1|2v2] [games per pairing] [seed], only a 2v2 roster may give levels
+    static int runCommand(int argc, char *argv[])
+    {
+        if (argc < 3)
+        {
+            std::cerr << "Usage: " << argv[0] << " --tournament <Species[:level],...> [roundrobin|bracket] [1v1|2v2] [games per pairing] [seed], levels are for 2v2" << std::endl;
+            return 1;
+        }
+        std::string format = argc >= 4 ? argv[3] : "roundrobin";
+        std::string mode = argc >= 5 ? argv[4] : "1v1";
+        int games = argc >= 6 ? std::max(1, atoi(argv[5])) : 10;
+        uint64_t seed = argc >= 7 ? strtoull(argv[6], nullptr, 10) : 1;
+        if ((format != "roundrobin" && format != "bracket") || (mode != "1v1" && mode != "2v2"))
+        {
+            std::cerr << "Unknown tournament format " << format << " " << mode << std::endl;
+            return 1;
+        }
+
+        Tournament tournament(mode == "2v2", games, seed);
+        if (!tournament.parseRoster(argv[2]))
+            return 1;
+        int count = static_cast<int>(tournament.entrants.size());
+        tournament.wins.assign(count * count, 0);
+        tournament.draws.assign(count * count, 0);
+        tournament.played.assign(count * count, 0);
+
+        std::cout.setf(std::ios::fixed);
+        std::cout.precision(1);
+        std::cout << "=== " << mode << " " << format << ", " << count << " entrants ===" << std::endl;
+        if (format == "bracket")
+            tournament.runBracket();
+        else
+            tournament.runRoundRobin();
+        tournament.printWinMatrix();
+        tournament.printTiming();
+        return 0;
+    }
+};
+
+// ==================== BALANCE SWEEP CLASS ==================== //
+
+// Varies one species' base HP, base attack and their growth over a grid and plays a batch of headless 2v2 games for every point.
+// It uses Abstraction and the JobSystem, a pair of the swept pet meets a pair of every other species at level 1 and at max level.
+class BalanceSweep
+{
+private:
+    static const int SPECIES = Species::COUNT;
+    static const int TOP_LEVEL = Species::MAX_LEVEL;
+    static const int LEVELS = 2;
+
+    struct Point
+    {
+        SpeciesStats stats;
+        SimUnit units[LEVELS]; // the swept pet at level 1 and TOP_LEVEL
+        float winRate[LEVELS];
+        float low[LEVELS];     // 95% Wilson interval around winRate
+        float high[LEVELS];
+        float averageSeconds;
+    };
+
+    // Wilson score interval at 95% for `score` points out of `games`, in percent, stays inside 0..100 even near the ends
+    static void wilson(double score, int games, float &low, float &high)
+    {
+        const double z = 1.96;
+        double p = score / games;
+        double denominator = 1 + z * z / games;
+        double center = (p + z * z / (2 * games)) / denominator;
+        double spread = z * std::sqrt(p * (1 - p) / games + z * z / (4.0 * games * games)) / denominator;
+        low = static_cast<float>(100 * std::max(0.0, center - spread));
+        high = static_cast<float>(100 * std::min(1.0, center + spread));
+    }
+
+    // builds a species at a level, optionally with a different stat line
+    static SimUnit unitFor(int kind, const SpeciesStats *stats, int level)
+    {
+        PetRecord pet = Species::record(kind, level);
+        return stats ? TeamBattle::unitFor(pet, *stats) : TeamBattle::unitFor(pet);
+    }
+
+    static int findSpecies(const std::string &name, SpeciesStats &baseline)
+    {
+        int kind = Species::find(name);
+        if (kind >= 0)
+            baseline = Species::info(kind).stats;
+        return kind;
+    }
+
+    static void writeRow(std::ostream &out, const Point &point, const char *separator)
+    {
+        out << point.stats.baseHP << separator << point.stats.baseAttack << separator
+            << point.stats.hpGrowth << separator << point.stats.attackGrowth << separator
+            << point.units[0].health << "/" << point.units[0].damage << separator
+            << point.units[1].health << "/" << point.units[1].damage << separator
+            << point.winRate[0] << separator << point.low[0] << "-" << point.high[0] << separator
+            << point.winRate[1] << separator << point.low[1] << "-" << point.high[1] << separator << point.averageSeconds;
+    }
+
+public:
+    // --sweep <species> [games per opponent] [seed] [results.tsv]
+    static int runCommand(int argc, char *argv[])
+    {
+        SpeciesStats baseline;
+        int kind = argc >= 3 ? findSpecies(argv[2], baseline) : -1;
+        if (kind < 0)
+        {
+            std::cerr << "Usage: " << argv[0] << " --sweep <Dragon|Phoenix|Griffin|Unicorn> [games per opponent] [seed] [results.tsv]" << std::endl;
+            return 1;
+        }
+        int games = argc >= 4 ? std::max(2, atoi(argv[3])) : 60; // 180 two-leg games per level, about +-7% at 95%
+        uint64_t seed = argc >= 5 ? strtoull(argv[4], nullptr, 10) : 1;
+
+        // grid around the shipped numbers
+        const float scale[] = {0.8f, 0.9f, 1.0f, 1.1f, 1.2f};
+        const float growthStep[] = {-0.05f, 0.0f, 0.05f};
+        std::vector<Point> points;
+        for (float hp : scale)
+            for (float attack : scale)
+                for (float hpStep : growthStep)
+                    for (float attackStep : growthStep)
+                    {
+                        Point point;
+                        point.stats = baseline;
+                        point.stats.baseHP = static_cast<int>(baseline.baseHP * hp + 0.5f);
+                        point.stats.baseAttack = static_cast<int>(baseline.baseAttack * attack + 0.5f);
+                        point.stats.hpGrowth = std::max(1.0f, baseline.hpGrowth + hpStep);
+                        point.stats.attackGrowth = std::max(1.0f, baseline.attackGrowth + attackStep);
+                        point.units[0] = unitFor(kind, &point.stats, 1);
+                        point.units[1] = unitFor(kind, &point.stats, TOP_LEVEL);
+                        points.push_back(point);
+                    }
+
+        // 2v2 teams of two of the same pet, the swept line against each other species at the same level
+        SimUnit opponents[LEVELS][SPECIES - 1][2];
+        for (int level = 0; level < LEVELS; level++)
+        {
+            for (int other = 0, slot = 0; other < SPECIES; other++)
+            {
+                if (other != kind)
+                {
+                    opponents[level][slot][0] = opponents[level][slot][1] = unitFor(other, nullptr, level == 0 ? 1 : TOP_LEVEL);
+                    slot++;
+                }
+            }
+        }
+
+        // one job per game, laid out point by level by opponent by game
+        const int gamesPerPoint = LEVELS * (SPECIES - 1) * games;
+        int jobs = static_cast<int>(points.size()) * gamesPerPoint;
+        std::vector<char> won(jobs);
+        std::vector<int> ticks(jobs);
+        sf::Clock clock;
+        JobSystem::shared().parallelFor(jobs, 16, [&](int begin, int end)
+                                        {
+            for (int job = begin; job < end; job++)
+            {
+                const Point &point = points[job / gamesPerPoint];
+                int level = (job / ((SPECIES - 1) * games)) % LEVELS;
+                int opponent = (job / games) % (SPECIES - 1);
+                SimUnit team[2] = {point.units[level], point.units[level]};
+                MatchResult legs[2];
+                int outcome = Tournament::playMirrored(team, opponents[level][opponent], true, job % games, seed + job, legs);
+                won[job] = static_cast<char>(outcome + 1); // half points, a draw scores 1 of 2
+                ticks[job] = legs[0].ticks + legs[1].ticks;
+            } });
+        float seconds = clock.getElapsedTime().asSeconds();
+
+        for (size_t p = 0; p < points.size(); p++)
+        {
+            double totalTicks = 0;
+            for (int level = 0; level < LEVELS; level++)
+            {
+                int wins = 0;
+                for (int g = 0; g < (SPECIES - 1) * games; g++)
+                {
+                    int job = static_cast<int>(p) * gamesPerPoint + level * (SPECIES - 1) * games + g;
+                    wins += won[job];
+                    totalTicks += ticks[job];
+                }
+                points[p].winRate[level] = 50.0f * wins / ((SPECIES - 1) * games);
+                wilson(wins / 2.0, (SPECIES - 1) * games, points[p].low[level], points[p].high[level]);
+            }
+            points[p].averageSeconds = static_cast<float>(totalTicks / (2 * gamesPerPoint) / TimerWheel::TICKS_PER_SECOND);
+        }
+
+        std::cout.setf(std::ios::fixed);
+        std::cout.precision(2);
+        std::cout << "=== " << argv[2] << " 2v2 balance sweep, " << games << " two-leg games against each species per level ===" << std::endl
+                  << "baseHP baseAtk hpGrow atkGrow L1 hp/dmg L" << TOP_LEVEL << " hp/dmg L1 win% 95% L" << TOP_LEVEL << " win% 95% avg s" << std::endl;
+        for (const Point &point : points)
+        {
+            writeRow(std::cout, point, " ");
+            bool shipped = point.stats.baseHP == baseline.baseHP && point.stats.baseAttack == baseline.baseAttack &&
+                           point.stats.hpGrowth == baseline.hpGrowth && point.stats.attackGrowth == baseline.attackGrowth;
+            std::cout << (shipped ? "  <- current" : "") << std::endl;
+        }
+
+        // the stat lines that land closest to an even matchup at both levels
+        std::vector<const Point *> closest;
+        for (const Point &point : points)
+            closest.push_back(&point);
+        std::sort(closest.begin(), closest.end(), [](const Point *a, const Point *b)
+                  { return std::abs(a->winRate[0] - 50) + std::abs(a->winRate[1] - 50) <
+                           std::abs(b->winRate[0] - 50) + std::abs(b->winRate[1] - 50); });
+        std::cout << "=== Closest to 50% ===" << std::endl;
+        for (size_t i = 0; i < closest.size() && i < 5; i++)
+        {
+            writeRow(std::cout, *closest[i], " ");
+            bool even = closest[i]->low[0] <= 50 && closest[i]->high[0] >= 50 && closest[i]->low[1] <= 50 && closest[i]->high[1] >= 50;
+            std::cout << (even ? "  <- even within the interval" : "") << std::endl;
+        }
+
+        if (argc >= 6)
+        {
+            std::ofstream file(argv[5]);
+            if (!file)
+            {
+                std::cerr << "Could not write " << argv[5] << std::endl;
+                return 1;
+            }
+            file.setf(std::ios::fixed);
+            file.precision(2);
+            file << "base_hp\tbase_attack\thp_growth\tattack_growth\tl1_hp/dmg\tl" << TOP_LEVEL << "_hp/dmg\tl1_win\tl1_win_95\tl" << TOP_LEVEL << "_win\tl" << TOP_LEVEL << "_win_95\tavg_seconds\n";
+            for (const Point &point : points)
+            {
+                writeRow(file, point, "\t");
+                file << "\n";
+            }
+        }
+
+        std::cout << "Played " << 2 * jobs << " team battles for " << points.size() << " stat lines in " << seconds << " s on "
+                  << JobSystem::shared().getThreadCount() << " threads" << std::endl;
+        return 0;
+    }
+};
+
+// ==================== SNAPSHOT CODEC CLASS ==================== //
+
+// Packs what a TeamBattle looks like into a small fixed-size frame, and writes a frame as the XOR against an older one with the zero runs squeezed out.
+// It uses Abstraction, the server and the clients only ever trade byte strings and tick numbers.
+struct BattleView
+{
+    static const int SHOT_SLOTS = 2 * TeamBattle::MAX_SHOTS;
+
+    uint32_t tick;
+    bool over;
+    bool playerWon;
+    int playerCount; // pets 0 .. playerCount-1 are the players, the rest up to petCount the enemies
+    int petCount;
+    int shotCount;
+    sf::Vector2f pets[TeamBattle::MAX_PETS]; // top left of the body
+    int health[TeamBattle::MAX_PETS];
+    int maxHealth[TeamBattle::MAX_PETS];
+    int species[TeamBattle::MAX_PETS];
+    sf::Vector2f shots[SHOT_SLOTS];
+    int shotOwner[SHOT_SLOTS]; // the pet that fired it, which also says its team and its look
+};
+
+class SnapshotCodec
+{
+private:
+    static const int HEADER_BYTES = 8;
+    static const int PET_BYTES = 9;
+    static const int SHOT_BYTES = 5;
+
+    // quarter pixels are plenty for drawing and keep a coordinate in 16 bits
+    static unsigned int quantize(float value)
+    {
+        return static_cast<unsigned int>(std::max(0.0f, std::min(value * 4.0f + 0.5f, 65535.0f)));
+    }
+
+public:
+    static const int FRAME_SIZE = HEADER_BYTES + TeamBattle::MAX_PETS * PET_BYTES + BattleView::SHOT_SLOTS * SHOT_BYTES;
+
+    static std::string pack(const TeamBattle &battle)
+    {
+        std::string frame;
+        frame.reserve(FRAME_SIZE);
+        int petCount = battle.getPetCount();
+        ByteCodec::put32(frame, battle.getTick());
+        frame += static_cast<char>((battle.isOver() ? 1 : 0) | (battle.hasPlayerWon() ? 2 : 0));
+        frame += static_cast<char>(battle.getWorld().countShots(TeamBattle::PLAYER_TEAM) + battle.getWorld().countShots(TeamBattle::ENEMY_TEAM));
+        frame += static_cast<char>(battle.getPlayerCount());
+        frame += static_cast<char>(petCount);
+        // unused slots stay zero so they cost nothing in a delta
+        for (int pet = 0; pet < TeamBattle::MAX_PETS; pet++)
+        {
+            bool used = pet < petCount;
+            sf::FloatRect box = used ? battle.getBox(pet) : sf::FloatRect();
+            ByteCodec::put16(frame, used ? quantize(box.left) : 0);
+            ByteCodec::put16(frame, used ? quantize(box.top) : 0);
+            ByteCodec::put16(frame, used ? static_cast<unsigned int>(battle.getHealth(pet)) : 0);
+            ByteCodec::put16(frame, used ? static_cast<unsigned int>(battle.getMaxHealth(pet)) : 0);
+            frame += static_cast<char>(used ? battle.getUnit(pet).speciesId : 0);
+        }
+        int shots = 0;
+        battle.getWorld().forEachBox(BattleWorld::SHOT, [&](const sf::FloatRect &box, int, int look)
+                                     {
+            if (shots++ >= BattleView::SHOT_SLOTS)
+                return;
+            ByteCodec::put16(frame, quantize(box.left));
+            ByteCodec::put16(frame, quantize(box.top));
+            frame += static_cast<char>(look - petCount); });
+        frame.resize(FRAME_SIZE, '\0');
+        return frame;
+    }
+
+    static bool unpack(const std::string &frame, BattleView &view)
+    {
+        if (frame.size() != static_cast<size_t>(FRAME_SIZE))
+            return false;
+
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(frame.data());
+        view.tick = ByteCodec::get32(p);
+        view.over = (p[4] & 1) != 0;
+        view.playerWon = (p[4] & 2) != 0;
+        view.shotCount = std::min<int>(p[5], BattleView::SHOT_SLOTS);
+        view.petCount = std::min<int>(p[7], TeamBattle::MAX_PETS);
+        view.playerCount = std::min<int>(p[6], view.petCount);
+        p += HEADER_BYTES;
+        for (int pet = 0; pet < TeamBattle::MAX_PETS; pet++, p += PET_BYTES)
+        {
+            view.pets[pet] = sf::Vector2f(ByteCodec::get16(p) / 4.0f, ByteCodec::get16(p + 2) / 4.0f);
+            view.health[pet] = ByteCodec::get16(p + 4);
+            view.maxHealth[pet] = ByteCodec::get16(p + 6);
+            view.species[pet] = p[8];
+        }
+        for (int shot = 0; shot < BattleView::SHOT_SLOTS; shot++, p += SHOT_BYTES)
+        {
+            view.shots[shot] = sf::Vector2f(ByteCodec::get16(p) / 4.0f, ByteCodec::get16(p + 2) / 4.0f);
+            view.shotOwner[shot] = std::min<int>(p[4], TeamBattle::MAX_PETS - 1);
+        }
+        return true;
+    }
+
+    // what a client would see of this battle, for peers that simulate locally and draw with the same code
+    static bool makeView(const TeamBattle &battle, BattleView &view)
+    {
+        return unpack(pack(battle), view);
+    }
+
+    // (zero run, literal run, literal bytes) triples of frame XOR base, an empty base sends the whole frame
+    static std::string diff(const std::string &base, const std::string &frame)
+    {
+        std::string delta;
+        size_t size = frame.size();
+        size_t i = 0;
+        while (i < size)
+        {
+            size_t zeros = 0;
+            while (i + zeros < size && zeros < 255 && (base.empty() ? 0 : base[i + zeros]) == frame[i + zeros])
+                zeros++;
+            size_t start = i + zeros;
+            size_t literals = 0;
+            while (start + literals < size && literals < 255 && (base.empty() ? 0 : base[start + literals]) != frame[start + literals])
+                literals++;
+
+            delta += static_cast<char>(zeros);
+            delta += static_cast<char>(literals);
+            for (size_t k = 0; k < literals; k++)
+                delta += static_cast<char>(frame[start + k] ^ (base.empty() ? 0 : base[start + k]));
+            i = start + literals;
+        }
+        return delta;
+    }
+
+    static bool patch(const std::string &base, const std::string &delta, std::string &frame)
+    {
+        frame = base.empty() ? std::string(FRAME_SIZE, '\0') : base;
+        size_t at = 0;
+        size_t i = 0;
+        while (i + 2 <= delta.size())
+        {
+            size_t zeros = static_cast<unsigned char>(delta[i]);
+            size_t literals = static_cast<unsigned char>(delta[i + 1]);
+            i += 2;
+            at += zeros;
+            if (at + literals > frame.size() || i + literals > delta.size())
+                return false;
+            for (size_t k = 0; k < literals; k++)
+                frame[at + k] ^= delta[i + k];
+            at += literals;
+            i += literals;
+        }
+        return i == delta.size() && at == frame.size();
+    }
+};
+
+// ==================== BATTLE REPLAY CLASS ==================== //
+
+// Records a 2v2, a 1v1 or a training round as its seed, who took part and the input of every tick, plus a checksum every ten seconds to check a re-run against.
+// It uses Encapsulation, recording, saving and playback go through this class and the file layout stays private to it.
+class BattleReplay
+{
+public:
+    // which rules the recording re-runs, each has its own starting line and input per tick
+    enum Mode
+    {
+        MODE_TEAM,    // TeamBattle, every player's buttons
+        MODE_DUEL,    // DuelBattle, the player's buttons
+        MODE_TRAINING // TrainingRound, the mouse height and the buttons
+    };
+
+private:
+    static const int VERSION = 3; // 2 was the 2v2 alone and still loads
+    static const int KEYFRAME_INTERVAL = 10 * TimerWheel::TICKS_PER_SECOND;
+    static const int TRAINING_FRAME = 3; // mouse Y as a signed u16, buttons
+
+    Mode mode;
+    uint64_t seed;
+    std::vector<SimUnit> units; // 2v2, players first like in the battle
+    int playerCount;
+    int duelSpecies[2];         // 1v1, per team
+    Trainee trainee;            // training
+    std::vector<uint8_t> frames; // frameSize() bytes of input per tick, in tick order
+
+    // keyframes[k] is the battle at the start of tick k * KEYFRAME_INTERVAL, rebuilt on demand, only the mode's own list is used
+    std::vector<TeamBattle> teamKeyframes;
+    std::vector<DuelBattle> duelKeyframes;
+    std::vector<TrainingRound> trainingKeyframes;
+    std::vector<uint32_t> checksums; // checksum() at each keyframe on the machine that recorded it
+
+    int frameSize() const { return mode == MODE_TEAM ? playerCount : (mode == MODE_DUEL ? 1 : TRAINING_FRAME); }
+    const uint8_t *frame(uint32_t tick) const { return frames.data() + static_cast<size_t>(tick) * frameSize(); }
+
+    void reset(Mode recorded, uint64_t matchSeed)
+    {
+        mode = recorded;
+        seed = matchSeed;
+        frames.clear();
+        teamKeyframes.clear();
+        duelKeyframes.clear();
+        trainingKeyframes.clear();
+        checksums.clear();
+    }
+
+    // one overload per kind of battle, the templates below stay the same for all three
+    static Mode modeOf(const TeamBattle &) { return MODE_TEAM; }
+    static Mode modeOf(const DuelBattle &) { return MODE_DUEL; }
+    static Mode modeOf(const TrainingRound &) { return MODE_TRAINING; }
+
+    std::vector<TeamBattle> &keyframesFor(const TeamBattle &) { return teamKeyframes; }
+    std::vector<DuelBattle> &keyframesFor(const DuelBattle &) { return duelKeyframes; }
+    std::vector<TrainingRound> &keyframesFor(const TrainingRound &) { return trainingKeyframes; }
+
+    void startBattle(TeamBattle &battle) const
+    {
+        battle.start(units.data(), playerCount, units.data() + playerCount, static_cast<int>(units.size()) - playerCount, seed);
+    }
+
+    void startBattle(DuelBattle &battle) const { battle.start(duelSpecies[0], duelSpecies[1], seed); }
+    void startBattle(TrainingRound &round) const { round.start(trainee, seed); }
+
+    void stepRecorded(TeamBattle &battle) const
+    {
+        uint8_t held[TeamBattle::MAX_PER_SIDE] = {0, 0, 0, 0};
+        memcpy(held, frame(battle.getTick()), playerCount);
+        battle.step(held);
+    }
+
+    void stepRecorded(DuelBattle &battle) const { battle.step(frame(battle.getTick())[0]); }
+
+    void stepRecorded(TrainingRound &round) const
+    {
+        const uint8_t *input = frame(round.getTick());
+        round.step(static_cast<int16_t>(ByteCodec::get16(input)), input[2]);
+    }
+
+    // plays the whole recording once and keeps a copy of the battle every KEYFRAME_INTERVAL ticks
+    // a fresh recording takes its checksums from here, a loaded one keeps the ones from the file
+    template <typename Battle>
+    void buildKeyframes(std::vector<Battle> &keyframes)
+    {
+        keyframes.clear();
+        bool record = checksums.empty();
+        Battle battle;
+        startBattle(battle);
+        while (true)
+        {
+            if (battle.getTick() % KEYFRAME_INTERVAL == 0)
+            {
+                keyframes.push_back(battle);
+                if (record)
+                    checksums.push_back(battle.checksum());
+            }
+            if (battle.isOver() || battle.getTick() >= getLength())
+                break;
+            stepRecorded(battle);
+        }
+    }
+
+    void buildKeyframes()
+    {
+        if (mode == MODE_TEAM)
+            buildKeyframes(teamKeyframes);
+        else if (mode == MODE_DUEL)
+            buildKeyframes(duelKeyframes);
+        else
+            buildKeyframes(trainingKeyframes);
+    }
+
+    // a line of what the battle looks like, for runCommand
+    static std::string describeEnd(const TeamBattle &battle)
+    {
+        return battle.isOver() ? (battle.hasPlayerWon() ? "players won" : "enemies won") : "unfinished";
+    }
+
+    static std::string describeEnd(const DuelBattle &battle)
+    {
+        return battle.isOver() ? (battle.hasPlayerWon() ? "player won" : "enemy won") : "unfinished";
+    }
+
+    static std::string describeEnd(const TrainingRound &round)
+    {
+        return std::string(round.isOver() ? "finished " : "unfinished ") + std::to_string(round.getPlayerScore()) + " to " +
+               std::to_string(round.getEnemyScore());
+    }
+
+    static std::string describeState(const TeamBattle &battle)
+    {
+        std::string state = "health";
+        for (int pet = 0; pet < battle.getPetCount(); pet++)
+            state += " " + std::to_string(battle.getHealth(pet));
+        return state;
+    }
+
+    static std::string describeState(const DuelBattle &battle)
+    {
+        return "health " + std::to_string(battle.getHealth(TeamBattle::PLAYER_TEAM)) + " " + std::to_string(battle.getHealth(TeamBattle::ENEMY_TEAM));
+    }
+
+    static std::string describeState(const TrainingRound &round)
+    {
+        return "score " + std::to_string(round.getPlayerScore()) + " to " + std::to_string(round.getEnemyScore());
+    }
+
+    // the timed re-run and the optional seek of runCommand, on the rules the file was recorded with
+    template <typename Battle>
+    int playBack(int argc, char *argv[], float minutes)
+    {
+        sf::Clock clock;
+        Battle final;
+        int mismatches = verify(final);
+        float seconds = clock.getElapsedTime().asSeconds();
+        std::cout << "Re-simulated in " << seconds * 1000 << " ms (" << (seconds > 0 ? minutes * 60 / seconds : 0.0f) << "x real time), "
+                  << describeEnd(final) << ", " << mismatches << " keyframes differ" << std::endl;
+
+        if (argc >= 4)
+        {
+            uint32_t tick = static_cast<uint32_t>(atof(argv[3]) * TimerWheel::TICKS_PER_SECOND);
+            Battle battle;
+            seek(0, battle); // builds the keyframes outside the timing
+            clock.restart();
+            bool found = seek(tick, battle);
+            float micros = static_cast<float>(clock.getElapsedTime().asMicroseconds());
+            std::cout << "Seek to tick " << tick << (found ? "" : " (past the end)") << " took " << micros << " us: " << describeState(battle)
+                      << ", " << battle.getWorld().countShots(TeamBattle::PLAYER_TEAM) + battle.getWorld().countShots(TeamBattle::ENEMY_TEAM)
+                      << " shots in flight" << std::endl;
+        }
+        return mismatches == 0 ? 0 : 2;
+    }
+
+public:
+    BattleReplay() : mode(MODE_TEAM), seed(0), playerCount(0), duelSpecies{Species::DRAGON, Species::DRAGON}, trainee{Species::DRAGON, 1, 0, 0} {} // constructor
+
+    // starts a recording of a battle that was just started, before its first step
+    void begin(const TeamBattle &battle)
+    {
+        reset(MODE_TEAM, battle.getSeed());
+        playerCount = battle.getPlayerCount();
+        units.clear();
+        for (int pet = 0; pet < battle.getPetCount(); pet++)
+            units.push_back(battle.getUnit(pet));
+    }
+
+    void begin(const DuelBattle &battle)
+    {
+        reset(MODE_DUEL, battle.getSeed());
+        duelSpecies[TeamBattle::PLAYER_TEAM] = battle.getSpecies(TeamBattle::PLAYER_TEAM);
+        duelSpecies[TeamBattle::ENEMY_TEAM] = battle.getSpecies(TeamBattle::ENEMY_TEAM);
+    }
+
+    void begin(const TrainingRound &round)
+    {
+        reset(MODE_TRAINING, round.getSeed());
+        trainee = round.getTrainee();
+    }
+
+    // the input of the next tick, in tick order: every 2v2 player's buttons, the 1v1 buttons, or the training mouse height and buttons
+    void record(const uint8_t *buttons) { frames.insert(frames.end(), buttons, buttons + playerCount); }
+    void record(uint8_t buttons) { frames.push_back(buttons); }
+
+    void record(int mouseY, uint8_t buttons)
+    {
+        unsigned int height = static_cast<uint16_t>(std::max(-32768, std::min(mouseY, 32767)));
+        frames.push_back(static_cast<uint8_t>(height & 0xFF));
+        frames.push_back(static_cast<uint8_t>(height >> 8));
+        frames.push_back(buttons);
+    }
+
+    // the battle the recorded input has led to, its checksum is kept at every keyframe tick while the game plays,
+    // so saving a live recording never re-runs it, call it after begin() and after each record()
+    template <typename Battle>
+    void checkpoint(const Battle &battle)
+    {
+        uint32_t tick = battle.getTick();
+        if (modeOf(battle) == mode && tick == getLength() && tick % KEYFRAME_INTERVAL == 0 && tick / KEYFRAME_INTERVAL == checksums.size())
+            checksums.push_back(battle.checksum());
+    }
+
+    uint32_t getLength() const { return static_cast<uint32_t>(frames.size() / frameSize()); }
+    uint64_t getSeed() const { return seed; }
+    Mode getMode() const { return mode; }
+
+    // the battle at the start of a tick, replayed from the nearest keyframe at or before it, false for the wrong kind of battle
+    template <typename Battle>
+    bool seek(uint32_t tick, Battle &battle)
+    {
+        if (modeOf(battle) != mode)
+            return false;
+        std::vector<Battle> &keyframes = keyframesFor(battle);
+        if (keyframes.empty())
+            buildKeyframes(keyframes);
+        size_t keyframe = std::min<size_t>(tick / KEYFRAME_INTERVAL, keyframes.size() - 1);
+        battle = keyframes[keyframe];
+        while (battle.getTick() < tick && battle.getTick() < getLength() && !battle.isOver())
+            stepRecorded(battle);
+        return battle.getTick() == tick;
+    }
+
+    // the whole match again from the seed, returns how many recorded checksums it disagreed with, -1 for the wrong kind of battle
+    template <typename Battle>
+    int verify(Battle &final)
+    {
+        if (modeOf(final) != mode)
+            return -1;
+        if (checksums.empty())
+            buildKeyframes();
+        int mismatches = 0;
+        startBattle(final);
+        while (true)
+        {
+            size_t keyframe = final.getTick() / KEYFRAME_INTERVAL;
+            if (final.getTick() % KEYFRAME_INTERVAL == 0 && keyframe < checksums.size() && final.checksum() != checksums[keyframe])
+                mismatches++;
+            if (final.isOver() || final.getTick() >= getLength())
+                break;
+            stepRecorded(final);
+        }
+        return mismatches;
+    }
+
+    // "MPKR", version, seed, mode, who took part, input runs, then the keyframe checksums
+    // a recording nobody checkpointed is re-run once here for its checksums
+    std::string encode()
+    {
+        if (checksums.empty())
+            buildKeyframes();
+
+        std::string bytes = "MPKR";
+        ByteCodec::put16(bytes, VERSION);
+        ByteCodec::put64(bytes, seed);
+        bytes += static_cast<char>(mode);
+        if (mode == MODE_TEAM)
+        {
+            bytes += static_cast<char>(playerCount);
+            bytes += static_cast<char>(units.size() - playerCount);
+            for (const SimUnit &unit : units)
+            {
+                bytes += static_cast<char>(unit.speciesId);
+                ByteCodec::put16(bytes, static_cast<unsigned int>(unit.health));
+                ByteCodec::put16(bytes, static_cast<unsigned int>(unit.damage));
+            }
+        }
+        else if (mode == MODE_DUEL)
+        {
+            bytes += static_cast<char>(duelSpecies[0]);
+            bytes += static_cast<char>(duelSpecies[1]);
+        }
+        else
+        {
+            bytes += static_cast<char>(trainee.speciesId);
+            bytes += static_cast<char>(trainee.level);
+            ByteCodec::put16(bytes, static_cast<unsigned int>(trainee.attack));
+            ByteCodec::put16(bytes, static_cast<unsigned int>(trainee.speed));
+        }
+        ByteCodec::put32(bytes, getLength());
+
+        // held keys change rarely and a resting mouse not at all, so the stream is (run length, one tick's input)
+        std::string runs;
+        uint32_t runCount = 0;
+        size_t size = frameSize();
+        for (uint32_t tick = 0; tick < getLength();)
+        {
+            uint32_t run = 1;
+            while (tick + run < getLength() && run < 0xFFFF && memcmp(frame(tick + run), frame(tick), size) == 0)
+                run++;
+            ByteCodec::put16(runs, run);
+            runs.append(reinterpret_cast<const char *>(frame(tick)), size);
+            runCount++;
+            tick += run;
+        }
+        ByteCodec::put32(bytes, runCount);
+        bytes += runs;
+
+        ByteCodec::put32(bytes, static_cast<uint32_t>(checksums.size()));
+        for (uint32_t sum : checksums)
+            ByteCodec::put32(bytes, sum);
+        return bytes;
+    }
+
+    bool save(const std::string &path)
+    {
+        return DurableFile::replace(path, encode());
+    }
+
+    bool load(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open())
+            return false;
+        std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(bytes.data());
+        size_t size = bytes.size();
+        if (size < 16 || memcmp(p, "MPKR", 4) != 0)
+            return false;
+        unsigned int version = ByteCodec::get16(p + 4);
+        if ((version != 2 && version != VERSION) || (version == VERSION && p[14] > MODE_TRAINING))
+            return false;
+
+        // version 2 had no mode byte, it only ever held a 2v2
+        size_t at = version == 2 ? 14 : 15;
+        Mode recorded = version == 2 ? MODE_TEAM : static_cast<Mode>(p[14]);
+        reset(recorded, ByteCodec::get64(p + 6));
+        if (mode == MODE_TEAM && size >= at + 2)
+        {
+            int players = p[at];
+            int enemies = p[at + 1];
+            if (players < 1 || players > TeamBattle::MAX_PER_SIDE || enemies < 1 || enemies > TeamBattle::MAX_PER_SIDE)
+                return false;
+            at += 2;
+            if (size < at + (players + enemies) * 5u)
+                return false;
+            playerCount = players;
+            units.assign(players + enemies, SimUnit());
+            for (SimUnit &unit : units)
+            {
+                unit.speciesId = p[at];
+                unit.health = ByteCodec::get16(p + at + 1);
+                unit.damage = ByteCodec::get16(p + at + 3);
+                at += 5;
+            }
+        }
+        else if (mode == MODE_DUEL && size >= at + 2)
+        {
+            duelSpecies[0] = p[at];
+            duelSpecies[1] = p[at + 1];
+            at += 2;
+        }
+        else if (mode == MODE_TRAINING && size >= at + 6)
+        {
+            trainee.speciesId = p[at];
+            trainee.level = p[at + 1];
+            trainee.attack = ByteCodec::get16(p + at + 2);
+            trainee.speed = ByteCodec::get16(p + at + 4);
+            at += 6;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (size < at + 8)
+            return false;
+        uint32_t length = ByteCodec::get32(p + at);
+        uint32_t runCount = ByteCodec::get32(p + at + 4);
+        at += 8;
+        size_t runBytes = 2 + frameSize();
+        if (size < at + runCount * runBytes)
+            return false;
+        for (uint32_t run = 0; run < runCount; run++, at += runBytes)
+        {
+            unsigned int count = ByteCodec::get16(p + at);
+            for (unsigned int tick = 0; tick < count; tick++)
+                frames.insert(frames.end(), p + at + 2, p + at + runBytes);
+        }
+        if (getLength() != length || size < at + 4)
+            return false;
+
+        uint32_t keyframeCount = ByteCodec::get32(p + at);
+        at += 4;
+        if (size < at + keyframeCount * 4ull)
+            return false;
+        for (uint32_t k = 0; k < keyframeCount; k++, at += 4)
+            checksums.push_back(ByteCodec::get32(p + at));
+        return true;
+    }
+
+    // --replay <file> [seek to second]
+    static int runCommand(int argc, char *argv[])
+    {
+        if (argc < 3)
+        {
+            std::cerr << "Usage: " << argv[0] << " --replay <file> [seek to second]" << std::endl;
+            return 1;
+        }
+        BattleReplay replay;
+        if (!replay.load(argv[2]))
+        {
+            std::cerr << "Could not read replay " << argv[2] << std::endl;
+            return 1;
+        }
+
+        static const char *modeNames[] = {"2v2 battle", "1v1 battle", "training round"};
+        std::ifstream file(argv[2], std::ios::binary | std::ios::ate);
+        float minutes = replay.getLength() / static_cast<float>(TimerWheel::TICKS_PER_SECOND) / 60.0f;
+        std::cout.setf(std::ios::fixed);
+        std::cout.precision(2);
+        std::cout << "Replay of a " << modeNames[replay.getMode()] << ", seed " << replay.getSeed() << ", " << replay.getLength() << " ticks ("
+                  << minutes * 60 << " s), " << file.tellg() << " bytes (" << (minutes > 0 ? file.tellg() / minutes : 0.0f)
+                  << " bytes per minute)" << std::endl;
+
+        if (replay.getMode() == MODE_TEAM)
+            return replay.playBack<TeamBattle>(argc, argv, minutes);
+        if (replay.getMode() == MODE_DUEL)
+            return replay.playBack<DuelBattle>(argc, argv, minutes);
+        return replay.playBack<TrainingRound>(argc, argv, minutes);
+    }
+};
+
+// ==================== REPLAY WRITER CLASS ==================== //
+
+// This class writes finished replays to disk on its own thread, so the tick a game ends on only pays for encoding the bytes.
+// It works like SaveWorker without the durability window, each replay is one synced atomic replace and a failed one is reported.
+class ReplayWriter
+{
+private:
+    struct Job
+    {
+        std::string path;
+        std::string bytes;
+    };
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<Job> queue;
+    bool stopping;
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [this]
+                      { return stopping || !queue.empty(); });
+            if (queue.empty() && stopping)
+                break;
+
+            std::vector<Job> batch;
+            batch.swap(queue);
+            lock.unlock();
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                if (!DurableFile::replace(batch[i].path, batch[i].bytes))
+                    std::cerr << "Could not save the replay to " << batch[i].path << std::endl;
+            }
+            lock.lock();
+        }
+    }
+
+public:
+    ReplayWriter() : stopping(false) {} // constructor
+
+    ~ReplayWriter() // destructor
+    {
+        stop();
+    }
+
+    ReplayWriter(const ReplayWriter &) = delete;
+    ReplayWriter &operator=(const ReplayWriter &) = delete;
+
+    // the thread starts with the first replay, a run that never records never starts it
+    void submit(const std::string &path, std::string bytes)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!worker.joinable())
+            {
+                stopping = false;
+                worker = std::thread(&ReplayWriter::run, this);
+            }
+            queue.push_back(Job{path, std::move(bytes)});
+        }
+        wake.notify_one();
+    }
+
+    // writes whatever is still queued, then ends the thread
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!worker.joinable())
+                return;
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+};
+
+// ==================== SPECTATOR FEED CLASS ==================== //
+
+// Shared outgoing stream for spectators, each snapshot is encoded once into a ring of ready-to-send packets.
+// It uses Encapsulation, a viewer is only a cursor into the ring, so one more viewer costs one send per snapshot and no encoding.
+enum NetMessage
+{
+    MSG_HELLO = 1,  // client -> server, asks for a seat, pet species u8, pet level u8
+    MSG_INPUT,      // client -> server, sequence u32, newest decoded snapshot tick u32, buttons u8
+    MSG_WELCOME,    // server -> client, seat u8 (0xFF for a spectator), seed u64
+    MSG_SNAPSHOT,   // server -> client, tick u32, base tick u32, delta bytes
+    MSG_FULL,       // server -> client, every seat is taken
+    MSG_PEER_INPUT, // rollback peer -> peer, heard-you u8, pet species u8, pet level u8, first tick u32, count u8, buttons, ack u32,
+                    // checksum tick u32, checksum u32
+    MSG_WATCH       // spectator -> server, asks to watch, repeated once a second to stay on the list
+};
+
+struct NetTraffic
+{
+    long long bytesSent;
+    long long bytesReceived;
+    int packetsSent;
+    int packetsReceived;
+    int fullSnapshots;
+    int deltaSnapshots;
+    long long snapshotBytes;
+};
+
+class SpectatorFeed
+{
+public:
+    static const int RING = 64;              // packets, about two seconds at 30 snapshots a second
+    static const int KEYFRAME_INTERVAL = 30; // packets between full frames, a viewer that lost one waits at most a second
+    static const uint32_t NO_BASE = 0xFFFFFFFF;
+
+private:
+    // spectators never ack, so every delta is against the newest keyframe, any packet decodes on its own once that arrived
+    std::string packets[RING];
+    uint64_t published;
+    uint64_t keyframeSequence;
+    uint32_t keyframeTick;
+    std::string keyframe;
+    int keyframes;
+    long long encodedBytes;
+
+public:
+    SpectatorFeed() : published(0), keyframeSequence(0), keyframeTick(NO_BASE), keyframes(0), encodedBytes(0) {} // constructor
+
+    // frame is the packed snapshot the players get too, so packing is shared as well
+    // the final frame goes out as keyframes so no viewer misses the result because of one lost keyframe
+    void publish(uint32_t tick, const std::string &frame, bool final)
+    {
+        bool full = keyframe.empty() || final || published - keyframeSequence >= static_cast<uint64_t>(KEYFRAME_INTERVAL);
+        if (full)
+        {
+            keyframe = frame;
+            keyframeTick = tick;
+            keyframeSequence = published;
+            keyframes++;
+        }
+
+        // the slot keeps its capacity, so a warm ring does not allocate
+        std::string &packet = packets[published % RING];
+        packet.assign(1, static_cast<char>(MSG_SNAPSHOT));
+        ByteCodec::put32(packet, tick);
+        ByteCodec::put32(packet, full ? NO_BASE : keyframeTick);
+        packet += SnapshotCodec::diff(full ? std::string() : keyframe, frame);
+        encodedBytes += static_cast<long long>(packet.size());
+        published++;
+    }
+
+    // a new viewer starts at the newest keyframe so the first packet it gets already decodes
+    uint64_t joinSequence() const { return keyframe.empty() ? published : keyframeSequence; }
+
+    // null once the sequence is not published yet or was overwritten
+    const std::string *packet(uint64_t sequence) const
+    {
+        if (sequence >= published || published - sequence > static_cast<uint64_t>(RING))
+            return nullptr;
+        return &packets[sequence % RING];
+    }
+
+    uint64_t getPublished() const { return published; } // getter
+    int getKeyframes() const { return keyframes; } // getter
+    long long getEncodedBytes() const { return encodedBytes; } // getter
+};
+
+// ==================== BATTLE SERVER CLASS ==================== //
+
+// Headless authoritative host for a networked 2v2 battle, each client sends its buttons and gets delta-compressed snapshots back over UDP.
+// It uses Encapsulation, the simulation, the snapshot history and the traffic counters all stay inside the server.
+class BattleServer
+{
+private:
+    static const int SNAPSHOT_INTERVAL = 2; // ticks between snapshots, 30 per second
+    static const int HISTORY = 64;          // snapshots kept as delta bases, about two seconds
+    static const uint32_t NO_BASE = 0xFFFFFFFF;
+    static const int SILENT_TICKS = 5 * TimerWheel::TICKS_PER_SECOND;
+    static const int MAX_SPECTATORS = 256;
+    static constexpr float SIM_STEP = 1.0f / TimerWheel::TICKS_PER_SECOND;
+
+    struct Spectator
+    {
+        sf::IpAddress address;
+        unsigned short port;
+        uint32_t lastHeardTick;
+        uint64_t cursor; // next feed packet to send
+    };
+
+    struct Client
+    {
+        bool joined;
+        sf::IpAddress address;
+        unsigned short port;
+        uint32_t lastSequence;
+        uint32_t ackTick;
+        uint8_t buttons;
+        uint32_t lastHeardTick;
+        PetRecord pet;
+        NetTraffic traffic;
+    };
+
+    sf::UdpSocket socket;
+    unsigned short port;
+    uint64_t seed;
+    int seatsToFill;
+    int lossPercent;
+    BattleRandom lossRandom;
+    Client clients[2];
+    TeamBattle battle;
+    BattleReplay replay;
+    std::string replayPath;
+    std::string history[HISTORY];
+    uint32_t historyTick[HISTORY];
+    SpectatorFeed feed;
+    std::vector<Spectator> spectators;
+    int peakSpectators;
+    long long encodeMicros;
+    long long fanOutMicros;
+    long long spectatorPackets;
+    long long spectatorBytes;
+
+    int findSeat(const sf::IpAddress &address, unsigned short senderPort) const
+    {
+        for (int seat = 0; seat < 2; seat++)
+        {
+            if (clients[seat].joined && clients[seat].address == address && clients[seat].port == senderPort)
+                return seat;
+        }
+        return -1;
+    }
+
+    int joinedCount() const
+    {
+        return (clients[0].joined ? 1 : 0) + (clients[1].joined ? 1 : 0);
+    }
+
+    int findSpectator(const sf::IpAddress &address, unsigned short senderPort) const
+    {
+        for (std::size_t i = 0; i < spectators.size(); i++)
+        {
+            if (spectators[i].address == address && spectators[i].port == senderPort)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    bool simulateLoss()
+    {
+        return lossPercent > 0 && lossRandom.nextInt(100) < lossPercent;
+    }
+
+    // counted before the simulated loss so the numbers show what the link would carry
+    void sendTo(Client &client, const std::string &message)
+    {
+        client.traffic.bytesSent += static_cast<long long>(message.size());
+        client.traffic.packetsSent++;
+        if (simulateLoss())
+            return;
+        socket.send(message.data(), message.size(), client.address, client.port);
+    }
+
+    void watch(const sf::IpAddress &address, unsigned short senderPort)
+    {
+        int index = findSpectator(address, senderPort);
+        if (index < 0 && spectators.size() < static_cast<std::size_t>(MAX_SPECTATORS))
+        {
+            Spectator spectator;
+            spectator.address = address;
+            spectator.port = senderPort;
+            spectator.cursor = feed.joinSequence();
+            spectators.push_back(spectator);
+            peakSpectators = std::max(peakSpectators, static_cast<int>(spectators.size()));
+            index = static_cast<int>(spectators.size()) - 1;
+            std::cout << "Spectator " << spectators.size() << " joined from " << address.toString() << ":" << senderPort << std::endl;
+        }
+
+        std::string reply(1, static_cast<char>(index >= 0 ? MSG_WELCOME : MSG_FULL));
+        if (index >= 0)
+        {
+            spectators[index].lastHeardTick = battle.getTick();
+            reply += static_cast<char>(0xFF);
+            ByteCodec::put64(reply, seed);
+        }
+        socket.send(reply.data(), reply.size(), address, senderPort);
+    }
+
+    // every viewer gets the same bytes, catching up from its cursor, a viewer that fell out of the ring restarts at a keyframe
+    void fanOut()
+    {
+        sf::Clock clock;
+        for (std::size_t i = 0; i < spectators.size();)
+        {
+            Spectator &spectator = spectators[i];
+            if (battle.getTick() - spectator.lastHeardTick > static_cast<uint32_t>(SILENT_TICKS))
+            {
+                spectators[i] = spectators.back();
+                spectators.pop_back();
+                continue;
+            }
+            while (spectator.cursor < feed.getPublished())
+            {
+                const std::string *packet = feed.packet(spectator.cursor);
+                if (!packet)
+                {
+                    spectator.cursor = feed.joinSequence();
+                    continue;
+                }
+                spectatorPackets++;
+                spectatorBytes += static_cast<long long>(packet->size());
+                if (!simulateLoss())
+                    socket.send(packet->data(), packet->size(), spectator.address, spectator.port);
+                spectator.cursor++;
+            }
+            i++;
+        }
+        fanOutMicros += clock.getElapsedTime().asMicroseconds();
+    }
+
+    void receiveAll()
+    {
+        char buffer[512];
+        std::size_t received = 0;
+        sf::IpAddress sender;
+        unsigned short senderPort = 0;
+        while (socket.receive(buffer, sizeof(buffer), received, sender, senderPort) == sf::Socket::Done)
+        {
+            if (received == 0)
+                continue;
+
+            const unsigned char *p = reinterpret_cast<const unsigned char *>(buffer);
+            int seat = findSeat(sender, senderPort);
+            if (p[0] == MSG_HELLO)
+            {
+                // a repeated hello gets the same seat back, its welcome may have been lost
+                for (int free = 0; free < 2 && seat < 0; free++)
+                {
+                    if (!clients[free].joined && free < seatsToFill)
+                    {
+                        Client &client = clients[free];
+                        client = Client();
+                        client.joined = true;
+                        client.address = sender;
+                        client.port = senderPort;
+                        client.ackTick = NO_BASE;
+                        client.lastHeardTick = battle.getTick();
+                        client.pet = received >= 3 ? Species::record(p[1], p[2]) : Species::record(Species::DRAGON);
+                        seat = free;
+                        std::cout << "Player " << seat + 1 << " joined from " << sender.toString() << ":" << senderPort << std::endl;
+                    }
+                }
+
+                std::string reply(1, static_cast<char>(seat >= 0 ? MSG_WELCOME : MSG_FULL));
+                if (seat >= 0)
+                {
+                    reply += static_cast<char>(seat);
+                    ByteCodec::put64(reply, seed);
+                    clients[seat].traffic.bytesReceived += static_cast<long long>(received);
+                    clients[seat].traffic.packetsReceived++;
+                    sendTo(clients[seat], reply);
+                }
+                else
+                {
+                    socket.send(reply.data(), reply.size(), sender, senderPort);
+                }
+            }
+            else if (p[0] == MSG_WATCH)
+            {
+                watch(sender, senderPort);
+            }
+            else if (p[0] == MSG_INPUT && seat >= 0 && received >= 10)
+            {
+                Client &client = clients[seat];
+                client.traffic.bytesReceived += static_cast<long long>(received);
+                client.traffic.packetsReceived++;
+                client.lastHeardTick = battle.getTick();
+
+                // inputs can arrive out of order, only the newest one counts
+                uint32_t sequence = ByteCodec::get32(p + 1);
+                if (sequence <= client.lastSequence)
+                    continue;
+                client.lastSequence = sequence;
+                client.ackTick = ByteCodec::get32(p + 5);
+                client.buttons = p[9];
+            }
+        }
+    }
+
+    // each client gets the newest frame as a delta against the last one it told us it has
+    void broadcastSnapshot()
+    {
+        std::string frame = SnapshotCodec::pack(battle);
+        int slot = static_cast<int>((battle.getTick() / SNAPSHOT_INTERVAL) % HISTORY);
+        history[slot] = frame;
+        historyTick[slot] = battle.getTick();
+
+        sf::Clock encodeClock;
+        feed.publish(battle.getTick(), frame, battle.isOver());
+        encodeMicros += encodeClock.getElapsedTime().asMicroseconds();
+        fanOut();
+
+        for (int seat = 0; seat < 2; seat++)
+        {
+            Client &client = clients[seat];
+            if (!client.joined)
+                continue;
+
+            uint32_t baseTick = NO_BASE;
+            if (client.ackTick != NO_BASE)
+            {
+                int baseSlot = static_cast<int>((client.ackTick / SNAPSHOT_INTERVAL) % HISTORY);
+                if (historyTick[baseSlot] == client.ackTick && !history[baseSlot].empty())
+                    baseTick = client.ackTick;
+            }
+            std::string delta = SnapshotCodec::diff(baseTick == NO_BASE ? std::string() : history[(baseTick / SNAPSHOT_INTERVAL) % HISTORY], frame);
+
+            std::string message(1, static_cast<char>(MSG_SNAPSHOT));
+            ByteCodec::put32(message, battle.getTick());
+            ByteCodec::put32(message, baseTick);
+            message += delta;
+            if (baseTick == NO_BASE)
+                client.traffic.fullSnapshots++;
+            else
+                client.traffic.deltaSnapshots++;
+            client.traffic.snapshotBytes += static_cast<long long>(message.size());
+            sendTo(client, message);
+        }
+    }
+
+    void printReport() const
+    {
+        float seconds = static_cast<float>(battle.getTick()) / TimerWheel::TICKS_PER_SECOND;
+        std::cout.setf(std::ios::fixed);
+        std::cout.precision(1);
+        std::cout << "=== Match over after " << seconds << " s, " << (battle.hasPlayerWon() ? "players" : "enemies") << " won ===" << std::endl;
+        for (int seat = 0; seat < 2; seat++)
+        {
+            const NetTraffic &traffic = clients[seat].traffic;
+            if (!clients[seat].joined)
+                continue;
+            int snapshots = traffic.fullSnapshots + traffic.deltaSnapshots;
+            std::cout << "Player " << seat + 1 << ": down " << traffic.bytesSent << " bytes in " << traffic.packetsSent << " packets ("
+                      << (seconds > 0 ? traffic.bytesSent * 8 / 1000.0 / seconds : 0.0) << " kbit/s), up "
+                      << traffic.bytesReceived << " bytes in " << traffic.packetsReceived << " packets ("
+                      << (seconds > 0 ? traffic.bytesReceived * 8 / 1000.0 / seconds : 0.0) << " kbit/s)" << std::endl
+                      << "          " << snapshots << " snapshots, " << traffic.fullSnapshots << " full, average "
+                      << (snapshots > 0 ? static_cast<double>(traffic.snapshotBytes) / snapshots : 0.0)
+                      << " bytes against a " << SnapshotCodec::FRAME_SIZE << " byte frame" << std::endl;
+        }
+
+        if (peakSpectators == 0)
+            return;
+        uint64_t published = feed.getPublished();
+        double perViewer = spectatorPackets > 0 ? static_cast<double>(fanOutMicros) / spectatorPackets : 0.0;
+        double perEncode = published > 0 ? static_cast<double>(encodeMicros) / published : 0.0;
+        std::cout.precision(2);
+        std::cout << "Spectators: " << peakSpectators << " at most, " << spectatorPackets << " packets, "
+                  << spectatorBytes << " bytes, " << (seconds > 0 ? spectatorBytes * 8 / 1000.0 / seconds / peakSpectators : 0.0)
+                  << " kbit/s per viewer" << std::endl
+                  << "            " << published << " snapshots encoded once (" << feed.getKeyframes() << " keyframes, average "
+                  << (published > 0 ? static_cast<double>(feed.getEncodedBytes()) / published : 0.0) << " bytes) at "
+                  << perEncode << " us each, fan-out " << perViewer << " us per viewer per snapshot" << std::endl;
+    }
+
+public:
+    BattleServer(unsigned short serverPort, uint64_t matchSeed, int seats, int loss, const std::string &replayFile) // constructor
+        : port(serverPort), seed(matchSeed), seatsToFill(std::max(1, std::min(seats, 2))), lossPercent(loss), lossRandom(matchSeed ^ 0x5EED),
+          replayPath(replayFile), peakSpectators(0), encodeMicros(0), fanOutMicros(0), spectatorPackets(0), spectatorBytes(0)
+    {
+        clients[0] = Client();
+        clients[1] = Client();
+        for (int i = 0; i < HISTORY; i++)
+            historyTick[i] = NO_BASE;
+    }
+
+    int run()
+    {
+        if (socket.bind(port) != sf::Socket::Done)
+        {
+            std::cerr << "Could not open UDP port " << port << std::endl;
+            return 1;
+        }
+        socket.setBlocking(false);
+        std::cout << "Waiting for " << seatsToFill << " player(s) on UDP port " << port << std::endl;
+        while (joinedCount() < seatsToFill)
+        {
+            receiveAll();
+            sf::sleep(sf::milliseconds(5));
+        }
+
+        // the players bring their own pets, an empty seat stands in with player 1's, the enemies are picked from the seed at the same levels
+        SimUnit players[2];
+        SimUnit enemies[2];
+        for (int seat = 0; seat < 2; seat++)
+        {
+            const PetRecord &pet = clients[clients[seat].joined ? seat : 0].pet;
+            players[seat] = TeamBattle::unitFor(pet);
+            enemies[seat] = TeamBattle::seededEnemy(seed, seat, pet.level);
+        }
+        battle.start(players, 2, enemies, 2, seed);
+        replay.begin(battle);
+        std::cout << "Match started, seed " << seed << ": " << Species::info(players[0].speciesId).name << " and "
+                  << Species::info(players[1].speciesId).name << " against " << Species::info(enemies[0].speciesId).name
+                  << " and " << Species::info(enemies[1].speciesId).name << std::endl;
+
+        // fixed 60 Hz steps like the game loop, a slow frame catches up by at most a quarter second
+        sf::Clock clock;
+        float accumulator = 0;
+        while (!battle.isOver())
+        {
+            accumulator = std::min(accumulator + clock.restart().asSeconds(), 0.25f);
+            while (accumulator >= SIM_STEP && !battle.isOver())
+            {
+                accumulator -= SIM_STEP;
+                receiveAll();
+                uint8_t buttons[2] = {0, 0};
+                for (int seat = 0; seat < 2; seat++)
+                {
+                    // a client that went quiet stops moving instead of holding its last keys forever
+                    if (clients[seat].joined && battle.getTick() - clients[seat].lastHeardTick < static_cast<uint32_t>(SILENT_TICKS))
+                        buttons[seat] = clients[seat].buttons;
+                }
+                replay.record(buttons);
+                battle.step(buttons);
+                if (battle.getTick() % SNAPSHOT_INTERVAL == 0 || battle.isOver())
+                    broadcastSnapshot();
+            }
+            sf::sleep(sf::milliseconds(1));
+        }
+
+        // the final snapshot goes out a few more times so one lost packet does not leave a client waiting
+        for (int i = 0; i < 5; i++)
+        {
+            sf::sleep(sf::milliseconds(20));
+            receiveAll();
+            broadcastSnapshot();
+        }
+        printReport();
+        if (replay.save(replayPath))
+            std::cout << "Replay saved to " << replayPath << std::endl;
+        else
+            std::cerr << "Could not save the replay to " << replayPath << std::endl;
+        return 0;
+    }
+
+    // --server [port] [seed] [players] [simulated loss %] [replay file]
+    static int runCommand(int argc, char *argv[])
+    {
+        unsigned short serverPort = static_cast<unsigned short>(argc >= 3 ? atoi(argv[2]) : 54000);
+        uint64_t matchSeed = argc >= 4 ? strtoull(argv[3], nullptr, 10) : BattleRandom::freshSeed();
+        int seats = argc >= 5 ? atoi(argv[4]) : 2;
+        int loss = argc >= 6 ? std::max(0, std::min(atoi(argv[5]), 90)) : 0;
+        std::string replayFile = argc >= 7 ? argv[6] : "battle_" + std::to_string(matchSeed) + ".replay";
+        BattleServer server(serverPort, matchSeed, seats, loss, replayFile);
+        return server.run();
+    }
+};
+
+// ==================== BATTLE CLIENT CLASS ==================== //
+
+// Joins a BattleServer, sends the local buttons every tick and draws whatever the latest snapshot says.
+// It uses Encapsulation, the client never simulates, it only keeps recent frames around as bases for the next delta.
+class BattleClient
+{
+private:
+    static const int HISTORY = 128; // by tick, the server sends every other tick
+    static const uint32_t NO_BASE = 0xFFFFFFFF;
+    static constexpr float SIM_STEP = 1.0f / TimerWheel::TICKS_PER_SECOND;
+
+    sf::UdpSocket socket;
+    sf::IpAddress serverAddress;
+    unsigned short serverPort;
+    bool bot;
+    bool spectator;
+    bool headless;
+    PetRecord pet;
+    bool welcomed;
+    int seat; // -1 while spectating
+    uint64_t seed;
+    uint32_t sequence;
+    bool haveSnapshot;
+    uint32_t newestTick;
+    std::string frames[HISTORY];
+    uint32_t frameTicks[HISTORY];
+    BattleView view;
+    NetTraffic traffic;
+    int undecodable;
+
+    void send(const std::string &message)
+    {
+        traffic.bytesSent += static_cast<long long>(message.size());
+        traffic.packetsSent++;
+        socket.send(message.data(), message.size(), serverAddress, serverPort);
+    }
+
+    // returns false if the server turned us away
+    bool receiveAll()
+    {
+        char buffer[2048];
+        std::size_t received = 0;
+        sf::IpAddress sender;
+        unsigned short senderPort = 0;
+        while (socket.receive(buffer, sizeof(buffer), received, sender, senderPort) == sf::Socket::Done)
+        {
+            if (received == 0 || sender != serverAddress || senderPort != serverPort)
+                continue;
+            traffic.bytesReceived += static_cast<long long>(received);
+            traffic.packetsReceived++;
+
+            const unsigned char *p = reinterpret_cast<const unsigned char *>(buffer);
+            if (p[0] == MSG_FULL)
+                return false;
+            if (p[0] == MSG_WELCOME && received >= 10)
+            {
+                welcomed = true;
+                seat = p[1] == 0xFF ? -1 : p[1];
+                seed = ByteCodec::get64(p + 2);
+            }
+            else if (p[0] == MSG_SNAPSHOT && received >= 9)
+            {
+                uint32_t tick = ByteCodec::get32(p + 1);
+                uint32_t baseTick = ByteCodec::get32(p + 5);
+                if (haveSnapshot && tick <= newestTick)
+                    continue;
+
+                std::string base;
+                if (baseTick != NO_BASE)
+                {
+                    if (frameTicks[baseTick % HISTORY] != baseTick)
+                    {
+                        undecodable++;
+                        continue;
+                    }
+                    base = frames[baseTick % HISTORY];
+                }
+
+                std::string frame;
+                BattleView decoded;
+                if (!SnapshotCodec::patch(base, std::string(buffer + 9, received - 9), frame) || !SnapshotCodec::unpack(frame, decoded))
+                {
+                    undecodable++;
+                    continue;
+                }
+                frames[tick % HISTORY] = frame;
+                frameTicks[tick % HISTORY] = tick;
+                newestTick = tick;
+                haveSnapshot = true;
+                view = decoded;
+            }
+        }
+        return true;
+    }
+
+public:
+    BattleClient(const std::string &host, unsigned short port, bool scripted, bool watching, bool noWindow, const PetRecord &ownPet) // constructor
+        : serverAddress(host), serverPort(port), bot(scripted), spectator(watching), headless(noWindow), pet(ownPet), welcomed(false), seat(-1), seed(0), sequence(0),
+          haveSnapshot(false), newestTick(0), traffic(), undecodable(0)
+    {
+        for (int i = 0; i < HISTORY; i++)
+            frameTicks[i] = NO_BASE;
+    }
+
+    // either key set works, so both players can keep the layout they know from the shared keyboard
+    static uint8_t keyboardButtons()
+    {
+        uint8_t buttons = 0;
+        if (sf::Keyboard::isKeyPressed(sf::Keyboard::W) || sf::Keyboard::isKeyPressed(sf::Keyboard::I))
+            buttons |= BUTTON_UP;
+        if (sf::Keyboard::isKeyPressed(sf::Keyboard::A) || sf::Keyboard::isKeyPressed(sf::Keyboard::J))
+            buttons |= BUTTON_LEFT;
+        if (sf::Keyboard::isKeyPressed(sf::Keyboard::S) || sf::Keyboard::isKeyPressed(sf::Keyboard::K))
+            buttons |= BUTTON_DOWN;
+        if (sf::Keyboard::isKeyPressed(sf::Keyboard::D) || sf::Keyboard::isKeyPressed(sf::Keyboard::L))
+            buttons |= BUTTON_RIGHT;
+        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Space) || sf::Keyboard::isKeyPressed(sf::Keyboard::M))
+            buttons |= BUTTON_FIRE;
+        return buttons;
+    }
+
+    // scripted player for headless tests, lines up with the nearest enemy at kiting range and keeps shooting
+    static uint8_t botButtons(const BattleView &view, int seat)
+    {
+        if (seat < 0 || seat >= view.playerCount)
+            return 0;
+
+        sf::Vector2f self = view.pets[seat];
+        int target = -1;
+        float best = 1e30f;
+        for (int enemy = view.playerCount; enemy < view.petCount; enemy++)
+        {
+            sf::Vector2f offset = view.pets[enemy] - self;
+            float distance = offset.x * offset.x + offset.y * offset.y;
+            if (view.health[enemy] > 0 && distance < best)
+            {
+                best = distance;
+                target = enemy;
+            }
+        }
+        if (target < 0)
+            return 0;
+
+        uint8_t buttons = BUTTON_FIRE;
+        float alignY = view.pets[target].y - self.y;
+        float gap = view.pets[target].x - self.x;
+        if (alignY > 5)
+            buttons |= BUTTON_DOWN;
+        else if (alignY < -5)
+            buttons |= BUTTON_UP;
+        if (gap > 500)
+            buttons |= BUTTON_RIGHT;
+        else if (gap < 300)
+            buttons |= BUTTON_LEFT;
+        return buttons;
+    }
+
+    // the arena with every pet's sprite and health bar and every shot in its owner's look, view may be null before the first snapshot
+    // sprites are stretched over the species' body and shot boxes, which are what the rules collide
+    static void drawView(sf::RenderWindow &window, const BattleView *view, int seat)
+    {
+        window.clear(sf::Color(20, 20, 30));
+        sf::RectangleShape arena(sf::Vector2f(TeamBattle::WIDTH, TeamBattle::HEIGHT));
+        arena.setPosition(TeamBattle::LEFT, TeamBattle::TOP);
+        arena.setFillColor(sf::Color(40, 40, 50));
+        arena.setOutlineThickness(4.f);
+        arena.setOutlineColor(sf::Color(255, 215, 0));
+        window.draw(arena);
+
+        if (view)
+        {
+            for (int pet = 0; pet < view->petCount; pet++)
+            {
+                const SpeciesInfo &species = Species::info(view->species[pet]);
+                const sf::Texture &texture = Species::texture(view->species[pet]);
+                sf::Sprite body(texture);
+                body.setScale(species.bodySize.x / texture.getSize().x, species.bodySize.y / texture.getSize().y);
+                body.setPosition(view->pets[pet]);
+                if (view->health[pet] <= 0)
+                    body.setColor(sf::Color(100, 100, 100));
+                window.draw(body);
+
+                if (pet == seat)
+                {
+                    sf::RectangleShape marker(species.bodySize);
+                    marker.setPosition(view->pets[pet]);
+                    marker.setFillColor(sf::Color::Transparent);
+                    marker.setOutlineThickness(2.f);
+                    marker.setOutlineColor(sf::Color::White);
+                    window.draw(marker);
+                }
+
+                float share = view->maxHealth[pet] > 0 ? static_cast<float>(view->health[pet]) / view->maxHealth[pet] : 0;
+                sf::RectangleShape bar(sf::Vector2f(species.bodySize.x * share, 6));
+                bar.setPosition(view->pets[pet].x, view->pets[pet].y - 10);
+                bar.setFillColor(pet < view->playerCount ? sf::Color(255, 50, 50) : sf::Color(50, 50, 255));
+                window.draw(bar);
+            }
+            for (int shot = 0; shot < view->shotCount; shot++)
+            {
+                int owner = view->species[view->shotOwner[shot]];
+                const sf::Texture &texture = Species::projectileTexture(owner);
+                sf::Sprite projectile(texture);
+                projectile.setScale(Species::info(owner).shotSize.x / texture.getSize().x, Species::info(owner).shotSize.y / texture.getSize().y);
+                projectile.setPosition(view->shots[shot]);
+                window.draw(projectile);
+            }
+        }
+        window.display();
+    }
+
+    int run()
+    {
+        if (socket.bind(sf::Socket::AnyPort) != sf::Socket::Done)
+        {
+            std::cerr << "Could not open a UDP socket" << std::endl;
+            return 1;
+        }
+        socket.setBlocking(false);
+
+        // hello until welcomed, the first packets may race the server starting up
+        std::string hello(1, static_cast<char>(spectator ? MSG_WATCH : MSG_HELLO));
+        if (!spectator)
+        {
+            hello += static_cast<char>(pet.speciesId);
+            hello += static_cast<char>(pet.level);
+        }
+        sf::Clock joinClock;
+        while (!welcomed)
+        {
+            if (joinClock.getElapsedTime().asSeconds() > 10)
+            {
+                std::cerr << "No answer from " << serverAddress.toString() << ":" << serverPort << std::endl;
+                return 1;
+            }
+            send(hello);
+            sf::sleep(sf::milliseconds(100));
+            if (!receiveAll())
+            {
+                std::cerr << "The server is full" << std::endl;
+                return 1;
+            }
+        }
+        if (spectator)
+            std::cout << "Watching, seed " << seed << std::endl;
+        else
+            std::cout << "Joined as player " << seat + 1 << ", seed " << seed << std::endl;
+
+        std::unique_ptr<sf::RenderWindow> window;
+        if (!headless)
+        {
+            std::string title = spectator ? std::string("Monster Pet Kingdom - Spectator") : "Monster Pet Kingdom - Player " + std::to_string(seat + 1);
+            window.reset(new sf::RenderWindow(sf::VideoMode(1200, 700), title, sf::Style::Close));
+            window->setFramerateLimit(60);
+        }
+
+        sf::Clock clock;
+        sf::Clock silence;
+        sf::Clock keepAlive;
+        float accumulator = 0;
+        while (!(haveSnapshot && view.over))
+        {
+            if (window)
+            {
+                sf::Event event;
+                while (window->pollEvent(event))
+                {
+                    if (event.type == sf::Event::Closed)
+                        return 0;
+                }
+            }
+
+            // the wait for the other players before the first snapshot does not count as silence
+            uint32_t before = newestTick;
+            receiveAll();
+            if (!haveSnapshot || newestTick != before)
+                silence.restart();
+            if (silence.getElapsedTime().asSeconds() > 5)
+            {
+                std::cerr << "Lost the server" << std::endl;
+                return 1;
+            }
+
+            // a spectator has no inputs to send, it only says it is still there
+            if (spectator && keepAlive.getElapsedTime().asSeconds() >= 1)
+            {
+                keepAlive.restart();
+                send(hello);
+            }
+
+            accumulator = std::min(accumulator + clock.restart().asSeconds(), 0.25f);
+            if (accumulator >= SIM_STEP && spectator)
+            {
+                accumulator = std::fmod(accumulator, SIM_STEP);
+                if (window)
+                    drawView(*window, haveSnapshot ? &view : nullptr, seat);
+            }
+            else if (accumulator >= SIM_STEP)
+            {
+                accumulator = std::fmod(accumulator, SIM_STEP);
+                uint8_t buttons = bot ? (haveSnapshot ? botButtons(view, seat) : 0) : ((window && window->hasFocus()) ? keyboardButtons() : 0);
+                std::string message(1, static_cast<char>(MSG_INPUT));
+                ByteCodec::put32(message, ++sequence);
+                ByteCodec::put32(message, haveSnapshot ? newestTick : static_cast<uint32_t>(NO_BASE));
+                message += static_cast<char>(buttons);
+                send(message);
+                if (window)
+                    drawView(*window, haveSnapshot ? &view : nullptr, seat);
+            }
+            sf::sleep(sf::milliseconds(1));
+        }
+
+        float seconds = static_cast<float>(view.tick) / TimerWheel::TICKS_PER_SECOND;
+        std::cout.setf(std::ios::fixed);
+        std::cout.precision(1);
+        if (spectator)
+            std::cout << (view.playerWon ? "Players" : "Enemies") << " won after " << seconds << " s" << std::endl;
+        else
+            std::cout << (view.playerWon ? "Victory" : "Defeat") << " after " << seconds << " s" << std::endl;
+        std::cout << "Received " << traffic.bytesReceived << " bytes in " << traffic.packetsReceived << " packets ("
+                  << (seconds > 0 ? traffic.bytesReceived * 8 / 1000.0 / seconds : 0.0) << " kbit/s), sent "
+                  << traffic.bytesSent << " bytes in " << traffic.packetsSent << " packets, "
+                  << undecodable << " snapshots without a base" << std::endl;
+        return 0;
+    }
+
+    // --client [host] [port] [play|bot|watch|watch-headless] [pet as Species:level]
+    static int runCommand(int argc, char *argv[])
+    {
+        std::string host = argc >= 3 ? argv[2] : "127.0.0.1";
+        unsigned short port = static_cast<unsigned short>(argc >= 4 ? atoi(argv[3]) : 54000);
+        std::string mode = argc >= 5 ? argv[4] : "play";
+        PetRecord pet = Species::record(Species::DRAGON);
+        if (argc >= 6 && !Species::parse(argv[5], pet))
+        {
+            std::cerr << "Unknown species: " << argv[5] << std::endl;
+            return 1;
+        }
+        bool scripted = mode == "bot";
+        bool watching = mode == "watch" || mode == "watch-headless";
+        BattleClient client(host, port, scripted, watching, scripted || mode == "watch-headless", pet);
+        return client.run();
+    }
+};
+
+// ==================== ROLLBACK SESSION CLASS ==================== //
+
+// Peer-to-peer 2v2 where both sides run TeamBattle themselves, guess the other player's buttons and rewind when the guess was wrong.
+// It uses Encapsulation, the saved states, the input rings and the prediction stay inside, the caller only feeds buttons in and reads the state.
+class RollbackSession
+{
+public:
+    static constexpr int MAX_ROLLBACK = 8; // ticks we run ahead of the other player before waiting, about 130 ms
+    static const uint32_t NONE = 0xFFFFFFFF;
+
+    struct Stats
+    {
+        int rollbacks;
+        long long resimulatedTicks;
+        int deepestRollback;
+        double saveMicros;    // total, one save per simulated tick
+        double restoreMicros; // total, one restore per rollback
+        double worstResimulateMicros;
+        long long savedTicks;
+    };
+
+private:
+    static const int STATE_RING = 16; // a power of two above MAX_ROLLBACK
+    static const int INPUT_RING = 64;
+
+    TeamBattle current;
+    TeamBattle saved[STATE_RING]; // the battle at the start of each recent tick, copies reuse their memory once the ring is warm
+    uint8_t buttons[2][INPUT_RING];
+    int localSeat;
+    int inputDelay;
+    uint32_t remoteNext; // first remote tick not heard yet, every tick before it is confirmed
+    uint32_t rewindTo;   // earliest tick simulated with a wrong guess, NONE when every guess held
+    uint32_t nextCheckTick;
+    Stats stats;
+
+    static double microsSince(const std::chrono::steady_clock::time_point &start)
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // the remote player is guessed to keep holding whatever it held last
+    void simulateTick()
+    {
+        uint32_t tick = current.getTick();
+        int remote = 1 - localSeat;
+        if (tick >= remoteNext)
+            buttons[remote][tick % INPUT_RING] = remoteNext > 0 ? buttons[remote][(remoteNext - 1) % INPUT_RING] : 0;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        saved[tick % STATE_RING] = current;
+        stats.saveMicros += microsSince(start);
+        stats.savedTicks++;
+
+        uint8_t held[2] = {buttons[0][tick % INPUT_RING], buttons[1][tick % INPUT_RING]};
+        current.step(held);
+    }
+
+    void rewindIfNeeded()
+    {
+        if (rewindTo == NONE)
+            return;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        uint32_t present = current.getTick();
+        current = saved[rewindTo % STATE_RING];
+        stats.restoreMicros += microsSince(start);
+
+        while (current.getTick() < present && !current.isOver())
+        {
+            simulateTick();
+            stats.resimulatedTicks++;
+        }
+        stats.rollbacks++;
+        stats.deepestRollback = std::max(stats.deepestRollback, static_cast<int>(present - rewindTo));
+        stats.worstResimulateMicros = std::max(stats.worstResimulateMicros, microsSince(start));
+        rewindTo = NONE;
+    }
+
+public:
+    RollbackSession(int seat, int delay) // constructor
+        : localSeat(seat), inputDelay(std::max(0, std::min(delay, MAX_ROLLBACK))), remoteNext(0), rewindTo(NONE),
+          nextCheckTick(0), stats()
+    {
+        memset(buttons, 0, sizeof(buttons));
+    }
+
+    void start(const SimUnit players[2], const SimUnit enemies[2], uint64_t seed)
+    {
+        current.start(players, 2, enemies, 2, seed);
+        memset(buttons, 0, sizeof(buttons));
+        remoteNext = 0;
+        rewindTo = NONE;
+        nextCheckTick = 0;
+        stats = Stats();
+    }
+
+    // false while we are MAX_ROLLBACK ticks ahead of the last input the other player sent
+    bool canAdvance() const
+    {
+        return !current.isOver() && current.getTick() < remoteNext + MAX_ROLLBACK;
+    }
+
+    // settles any late correction, then plays one tick, the local buttons land inputDelay ticks from now
+    void advance(uint8_t localButtons)
+    {
+        rewindIfNeeded();
+        if (!canAdvance())
+            return;
+        buttons[localSeat][(current.getTick() + inputDelay) % INPUT_RING] = localButtons;
+        simulateTick();
+    }
+
+    // remote inputs must arrive in tick order, anything else is a resend and is dropped
+    void addRemoteInput(uint32_t tick, uint8_t held)
+    {
+        if (tick != remoteNext || tick >= current.getTick() + INPUT_RING - MAX_ROLLBACK)
+            return;
+        uint8_t &slot = buttons[1 - localSeat][tick % INPUT_RING];
+        if (tick < current.getTick() && slot != held && rewindTo > tick)
+            rewindTo = tick;
+        slot = held;
+        remoteNext++;
+    }
+
+    // plays out any pending correction without moving forward, used while waiting at the end of a match
+    void settle()
+    {
+        rewindIfNeeded();
+    }
+
+    // a state both peers can no longer change, every CHECK_INTERVAL ticks, for desync detection
+    bool takeChecksum(uint32_t &tick, uint32_t &sum)
+    {
+        static const uint32_t CHECK_INTERVAL = 60;
+        if (rewindTo != NONE || nextCheckTick >= current.getTick() || nextCheckTick > remoteNext)
+            return false;
+        if (nextCheckTick + STATE_RING <= current.getTick())
+        {
+            nextCheckTick += CHECK_INTERVAL; // already out of the ring, skip it
+            return false;
+        }
+        tick = nextCheckTick;
+        sum = saved[tick % STATE_RING].checksum();
+        nextCheckTick += CHECK_INTERVAL;
+        return true;
+    }
+
+    // over, and every remote input up to the last tick is in, so no rewind can change the result
+    bool isFinished() const
+    {
+        return current.isOver() && rewindTo == NONE && remoteNext >= current.getTick();
+    }
+
+    // the local buttons for a tick, for sending, 0 before they were set
+    uint8_t getLocalInput(uint32_t tick) const { return buttons[localSeat][tick % INPUT_RING]; }
+    uint8_t getInput(int seat, uint32_t tick) const { return buttons[seat][tick % INPUT_RING]; }
+    uint32_t getLocalInputEnd() const { return current.getTick() + inputDelay; } // one past the newest local input
+    uint32_t getRemoteNext() const { return remoteNext; }
+    const TeamBattle &getBattle() const { return current; }
+    const Stats &getStats() const { return stats; }
+    int getSeat() const { return localSeat; }
+
+    static void printStats(const Stats &stats)
+    {
+        std::cout << "Rollbacks: " << stats.rollbacks << ", " << stats.resimulatedTicks << " ticks simulated again, deepest "
+                  << stats.deepestRollback << " ticks" << std::endl
+                  << "Save " << (stats.savedTicks > 0 ? stats.saveMicros / stats.savedTicks : 0.0) << " us, restore "
+                  << (stats.rollbacks > 0 ? stats.restoreMicros / stats.rollbacks : 0.0) << " us, worst rollback "
+                  << stats.worstResimulateMicros / 1000.0 << " ms of a " << 1000.0f / TimerWheel::TICKS_PER_SECOND
+                  << " ms frame" << std::endl;
+    }
+};
+
+// ==================== ROLLBACK PEER CLASS ==================== //
+
+// Runs one side of a rollback match over UDP, every packet carries all local inputs the other side has not acked yet.
+// It uses composition, a RollbackSession does the simulation and this class only moves inputs and checksums between the peers.
+class RollbackPeer
+{
+private:
+    static const int MAX_WINDOW = 64;
+    static constexpr float SIM_STEP = 1.0f / TimerWheel::TICKS_PER_SECOND;
+
+    sf::UdpSocket socket;
+    sf::IpAddress remoteAddress;
+    unsigned short localPort;
+    unsigned short remotePort;
+    bool bot;
+    uint64_t seed;
+    PetRecord pet;
+    PetRecord remotePet;
+    bool started; // remote inputs count from the start, which waits for the handshake and both pets
+    RollbackSession session;
+    BattleReplay replay;
+    uint32_t recordedTicks;
+    bool heardRemote;
+    bool remoteHeardUs;
+    uint32_t remoteAcked; // the other side has our inputs up to here
+    uint32_t checkTick;
+    uint32_t checkSum;
+    std::map<uint32_t, uint32_t> localChecks;
+    int desyncs;
+    int matchedChecks;
+    int stalledFrames;
+    NetTraffic traffic;
+
+    // inputs [remoteAcked, newest], our ack of theirs, and the newest settled checksum
+    void sendInputs()
+    {
+        uint32_t end = session.getLocalInputEnd();
+        uint32_t first = std::max(remoteAcked, end > MAX_WINDOW ? end - MAX_WINDOW : 0);
+        std::string message(1, static_cast<char>(MSG_PEER_INPUT));
+        message += static_cast<char>(heardRemote ? 1 : 0);
+        message += static_cast<char>(pet.speciesId);
+        message += static_cast<char>(pet.level);
+        ByteCodec::put32(message, first);
+        message += static_cast<char>(end - first);
+        for (uint32_t tick = first; tick < end; tick++)
+            message += static_cast<char>(session.getLocalInput(tick));
+        ByteCodec::put32(message, session.getRemoteNext());
+        ByteCodec::put32(message, checkTick);
+        ByteCodec::put32(message, checkSum);
+
+        traffic.bytesSent += static_cast<long long>(message.size());
+        traffic.packetsSent++;
+        socket.send(message.data(), message.size(), remoteAddress, remotePort);
+    }
+
+    // only ticks where both inputs are final go into the replay
+    void recordConfirmed()
+    {
+        uint32_t confirmed = std::min(session.getRemoteNext(), session.getBattle().getTick());
+        for (; recordedTicks < confirmed; recordedTicks++)
+        {
+            uint8_t held[2] = {session.getInput(0, recordedTicks), session.getInput(1, recordedTicks)};
+            replay.record(held);
+        }
+    }
+
+    void receiveAll()
+    {
+        char buffer[512];
+        std::size_t received = 0;
+        sf::IpAddress sender;
+        unsigned short senderPort = 0;
+        while (socket.receive(buffer, sizeof(buffer), received, sender, senderPort) == sf::Socket::Done)
+        {
+            const unsigned char *p = reinterpret_cast<const unsigned char *>(buffer);
+            if (received < 9 || sender != remoteAddress || senderPort != remotePort || p[0] != MSG_PEER_INPUT)
+                continue;
+            size_t count = p[8];
+            if (received < 9 + count + 12)
+                continue;
+            traffic.bytesReceived += static_cast<long long>(received);
+            traffic.packetsReceived++;
+
+            heardRemote = true;
+            remoteHeardUs = remoteHeardUs || p[1] != 0;
+            remotePet = Species::record(p[2], p[3]);
+            uint32_t first = ByteCodec::get32(p + 4);
+            for (size_t i = 0; started && i < count; i++)
+                session.addRemoteInput(first + static_cast<uint32_t>(i), p[9 + i]);
+
+            const unsigned char *tail = p + 9 + count;
+            remoteAcked = std::max(remoteAcked, ByteCodec::get32(tail));
+            uint32_t theirTick = ByteCodec::get32(tail + 4);
+            uint32_t theirSum = ByteCodec::get32(tail + 8);
+            std::map<uint32_t, uint32_t>::iterator mine = localChecks.find(theirTick);
+            if (theirTick != RollbackSession::NONE && mine != localChecks.end())
+            {
+                if (mine->second != theirSum)
+                {
+                    desyncs++;
+                    std::cerr << "Desync at tick " << theirTick << std::endl;
+                }
+                else
+                {
+                    matchedChecks++;
+                }
+                localChecks.erase(localChecks.begin(), ++mine);
+            }
+        }
+    }
+
+public:
+    RollbackPeer(unsigned short ownPort, const std::string &host, unsigned short otherPort, int seat, uint64_t matchSeed,
+                 bool scripted, int delay, const PetRecord &ownPet) // constructor
+        : remoteAddress(host), localPort(ownPort), remotePort(otherPort), bot(scripted), seed(matchSeed), pet(ownPet),
+          remotePet(ownPet), started(false), session(seat, delay),
+          recordedTicks(0), heardRemote(false), remoteHeardUs(false), remoteAcked(0), checkTick(RollbackSession::NONE), checkSum(0),
+          desyncs(0), matchedChecks(0), stalledFrames(0), traffic()
+    {
+    }
+
+    int run()
+    {
+        if (socket.bind(localPort) != sf::Socket::Done)
+        {
+            std::cerr << "Could not open UDP port " << localPort << std::endl;
+            return 1;
+        }
+        socket.setBlocking(false);
+
+        // both peers knock with their pet until each knows the other can hear it
+        sf::Clock waiting;
+        while (!(heardRemote && remoteHeardUs))
+        {
+            if (waiting.getElapsedTime().asSeconds() > 30)
+            {
+                std::cerr << "No answer from " << remoteAddress.toString() << ":" << remotePort << std::endl;
+                return 1;
+            }
+            sendInputs();
+            sf::sleep(sf::milliseconds(50));
+            receiveAll();
+        }
+        // seat 1's pet goes first on both sides, the enemies come from the seed at the players' levels
+        SimUnit players[2];
+        SimUnit enemies[2];
+        players[session.getSeat()] = TeamBattle::unitFor(pet);
+        players[1 - session.getSeat()] = TeamBattle::unitFor(remotePet);
+        for (int seat = 0; seat < 2; seat++)
+            enemies[seat] = TeamBattle::seededEnemy(seed, seat, seat == session.getSeat() ? pet.level : remotePet.level);
+        session.start(players, enemies, seed);
+        replay.begin(session.getBattle());
+        started = true;
+        sendInputs();
+        std::cout << "Playing as player " << session.getSeat() + 1 << ", seed " << seed << ": " << Species::info(players[0].speciesId).name
+                  << " and " << Species::info(players[1].speciesId).name << " against " << Species::info(enemies[0].speciesId).name
+                  << " and " << Species::info(enemies[1].speciesId).name << std::endl;
+
+        std::unique_ptr<sf::RenderWindow> window;
+        if (!bot)
+        {
+            window.reset(new sf::RenderWindow(sf::VideoMode(1200, 700), "Monster Pet Kingdom - Player " + std::to_string(session.getSeat() + 1), sf::Style::Close));
+            window->setFramerateLimit(60);
+        }
+
+        sf::Clock clock;
+        sf::Clock silence;
+        float accumulator = 0;
+        uint32_t heardBefore = 0;
+        while (!session.isFinished())
+        {
+            if (window)
+            {
+                sf::Event event;
+                while (window->pollEvent(event))
+                {
+                    if (event.type == sf::Event::Closed)
+                        return 0;
+                }
+            }
+
+            receiveAll();
+            if (session.getRemoteNext() != heardBefore)
+            {
+                heardBefore = session.getRemoteNext();
+                silence.restart();
+            }
+            if (silence.getElapsedTime().asSeconds() > 5)
+            {
+                std::cerr << "Lost the other player" << std::endl;
+                return 1;
+            }
+
+            accumulator = std::min(accumulator + clock.restart().asSeconds(), 0.25f);
+            if (accumulator >= SIM_STEP)
+            {
+                accumulator = std::fmod(accumulator, SIM_STEP);
+                BattleView view;
+                SnapshotCodec::makeView(session.getBattle(), view);
+                uint8_t held = bot ? BattleClient::botButtons(view, session.getSeat())
+                                   : ((window && window->hasFocus()) ? BattleClient::keyboardButtons() : 0);
+                if (session.canAdvance())
+                    session.advance(held);
+                else
+                {
+                    session.settle();
+                    if (!session.getBattle().isOver())
+                        stalledFrames++;
+                }
+
+                uint32_t tick;
+                uint32_t sum;
+                while (session.takeChecksum(tick, sum))
+                {
+                    localChecks[tick] = sum;
+                    checkTick = tick;
+                    checkSum = sum;
+                }
+                recordConfirmed();
+                sendInputs();
+                if (window)
+                    BattleClient::drawView(*window, &view, session.getSeat());
+            }
+            sf::sleep(sf::milliseconds(1));
+        }
+
+        // keep answering for a moment so the other side gets our last inputs too
+        for (int i = 0; i < 30; i++)
+        {
+            receiveAll();
+            sendInputs();
+            sf::sleep(sf::milliseconds(16));
+        }
+
+        const TeamBattle &battle = session.getBattle();
+        float seconds = static_cast<float>(battle.getTick()) / TimerWheel::TICKS_PER_SECOND;
+        std::cout.setf(std::ios::fixed);
+        std::cout.precision(2);
+        std::cout << (battle.hasPlayerWon() ? "Victory" : "Defeat") << " after " << seconds << " s, final checksum "
+                  << std::hex << battle.checksum() << std::dec << std::endl;
+        recordConfirmed();
+        std::string replayPath = "rollback_" + std::to_string(seed) + "_p" + std::to_string(session.getSeat() + 1) + ".replay";
+        if (replay.save(replayPath))
+            std::cout << "Replay saved to " << replayPath << std::endl;
+        RollbackSession::printStats(session.getStats());
+        std::cout << matchedChecks << " checksums matched, " << desyncs << " desyncs, " << stalledFrames << " frames waiting on the other player" << std::endl
+                  << "Sent " << traffic.bytesSent << " bytes, received " << traffic.bytesReceived << " bytes ("
+                  << (seconds > 0 ? traffic.bytesSent * 8 / 1000.0 / seconds : 0.0) << " kbit/s up)" << std::endl;
+        return desyncs == 0 ? 0 : 2;
+    }
+
+    // plays both peers in one process with a fixed delay on every input, then checks them against a plain run of the same inputs
+    static int runLoopback(int latencyTicks, uint64_t matchSeed, int delay)
+    {
+        struct InFlight
+        {
+            int arrival;
+            uint32_t tick;
+            uint8_t buttons;
+        };
+
+        SimUnit players[2] = {TeamBattle::unitFor(Species::record(Species::DRAGON)), TeamBattle::unitFor(Species::record(Species::PHOENIX))};
+        SimUnit enemies[2] = {TeamBattle::seededEnemy(matchSeed, 0, 1), TeamBattle::seededEnemy(matchSeed, 1, 1)};
+
+        RollbackSession peers[2] = {RollbackSession(0, delay), RollbackSession(1, delay)};
+        std::deque<InFlight> wire[2]; // wire[i] carries peer i's inputs to the other peer
+        std::vector<uint8_t> record[2];
+        uint32_t sent[2] = {0, 0};
+        for (int i = 0; i < 2; i++)
+            peers[i].start(players, enemies, matchSeed);
+
+        BattleRandom jitter(matchSeed);
+        int frame = 0;
+        for (; frame < TeamBattle::DURATION_TICKS * 2 && !(peers[0].isFinished() && peers[1].isFinished()); frame++)
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                while (!wire[1 - i].empty() && wire[1 - i].front().arrival <= frame)
+                {
+                    peers[i].addRemoteInput(wire[1 - i].front().tick, wire[1 - i].front().buttons);
+                    wire[1 - i].pop_front();
+                }
+
+                BattleView view;
+                SnapshotCodec::makeView(peers[i].getBattle(), view);
+                if (peers[i].canAdvance())
+                    peers[i].advance(BattleClient::botButtons(view, i));
+                else
+                    peers[i].settle();
+
+                // arrivals stay in order, like the resent window would make them
+                int arrival = std::max(frame + latencyTicks + jitter.nextInt(3), wire[i].empty() ? 0 : wire[i].back().arrival);
+                for (; sent[i] < peers[i].getLocalInputEnd(); sent[i]++)
+                {
+                    uint8_t held = peers[i].getLocalInput(sent[i]);
+                    wire[i].push_back({arrival, sent[i], held});
+                    record[i].push_back(held);
+                }
+            }
+        }
+
+        TeamBattle plain;
+        plain.start(players, 2, enemies, 2, matchSeed);
+        while (!plain.isOver() && plain.getTick() < record[0].size() && plain.getTick() < record[1].size())
+        {
+            uint8_t held[2] = {record[0][plain.getTick()], record[1][plain.getTick()]};
+            plain.step(held);
+        }
+
+        uint32_t sums[3] = {peers[0].getBattle().checksum(), peers[1].getBattle().checksum(), plain.checksum()};
+        std::cout.setf(std::ios::fixed);
+        std::cout.precision(2);
+        std::cout << "=== Rollback loopback, " << latencyTicks << " ticks latency, " << delay << " ticks input delay ===" << std::endl
+                  << "Match over at tick " << plain.getTick() << " after " << frame << " frames, final checksums " << std::hex
+                  << sums[0] << " " << sums[1] << " reference " << sums[2] << std::dec << std::endl;
+        for (int i = 0; i < 2; i++)
+        {
+            std::cout << "Player " << i + 1 << ": ";
+            RollbackSession::printStats(peers[i].getStats());
+        }
+        bool agree = sums[0] == sums[2] && sums[1] == sums[2];
+        std::cout << (agree ? "Both peers match the reference run" : "DESYNC") << std::endl;
+        return agree ? 0 : 2;
+    }
+
+    // --rollback <local port> <remote host> <remote port> <seat 1|2> <seed> [play|bot] [input delay] [pet as Species:level]
+    // --rollback loopback [latency ticks] [seed] [input delay]
+    static int runCommand(int argc, char *argv[])
+    {
+        if (argc >= 3 && std::string(argv[2]) == "loopback")
+        {
+            int latency = argc >= 4 ? std::max(0, atoi(argv[3])) : 6;
+            uint64_t matchSeed = argc >= 5 ? strtoull(argv[4], nullptr, 10) : 1;
+            int delay = argc >= 6 ? atoi(argv[5]) : 2;
+            return runLoopback(latency, matchSeed, delay);
+        }
+        if (argc < 7)
+        {
+            std::cerr << "Usage: " << argv[0] << " --rollback <local port> <remote host> <remote port> <seat 1|2> <seed> [play|bot] [input delay] [Species:level]\n"
+                      << "       " << argv[0] << " --rollback loopback [latency ticks] [seed] [input delay]" << std::endl;
+            return 1;
+        }
+        int seat = atoi(argv[5]) == 2 ? 1 : 0;
+        bool scripted = argc >= 8 && std::string(argv[7]) == "bot";
+        int delay = argc >= 9 ? atoi(argv[8]) : 2;
+        PetRecord pet = Species::record(seat == 0 ? Species::DRAGON : Species::PHOENIX);
+        if (argc >= 10 && !Species::parse(argv[9], pet))
+        {
+            std::cerr << "Unknown species: " << argv[9] << std::endl;
+            return 1;
+        }
+        RollbackPeer peer(static_cast<unsigned short>(atoi(argv[2])), argv[3], static_cast<unsigned short>(atoi(argv[4])),
+                          seat, strtoull(argv[6], nullptr, 10), scripted, delay, pet);
+        return peer.run();
+    }
+};
+
+// ==================== ARENA CLASS ==================== //
+
+// One self-contained match on a battle class the game itself plays, DuelBattle for the 1v1, TeamBattle for the 2v2 or TrainingRound, with scripted players on the inputs.
+// It uses Encapsulation and a template, the battle, its memory and its players live in the instance and nothing is static, so any number of arenas can run side by side on their own threads.
+struct ArenaResult
+{
+    uint64_t seed;
+    uint32_t ticks;
+    uint32_t checksum;
+    bool playerWon;
+};
+
+template <typename Battle>
+class Arena
+{
+private:
+    SessionArena memory; // the battle's world lives here, one per arena so threads never share an allocator
+    Battle battle{memory.resource()};
+    BattleView view;
+
+    // the lineup comes from the seed, a Dragon player against an enemy picked like the server picks them
+    void startMatch(DuelBattle &duel, uint64_t seed) { duel.start(Species::DRAGON, TeamBattle::seededEnemy(seed, 0, 1).speciesId, seed); }
+
+    void startMatch(TeamBattle &team, uint64_t seed)
+    {
+        SimUnit players[2] = {TeamBattle::unitFor(Species::record(Species::DRAGON)), TeamBattle::unitFor(Species::record(Species::PHOENIX))};
+        SimUnit enemies[2] = {TeamBattle::seededEnemy(seed, 0, 1), TeamBattle::seededEnemy(seed, 1, 1)};
+        team.start(players, 2, enemies, 2, seed);
+    }
+
+    void startMatch(TrainingRound &round, uint64_t seed)
+    {
+        const SpeciesStats &stats = Species::info(Species::GRIFFIN).stats;
+        round.start(Trainee{Species::GRIFFIN, 1, Species::attack(stats, 1), Species::speed(stats, 1)}, seed);
+    }
+
+    // one tick of the scripted players, the same ones the self-play and network tests use
+    void stepMatch(DuelBattle &duel)
+    {
+        duel.step(SelfPlay::scriptedButtons(POLICY_DODGE, duel.getBox(TeamBattle::PLAYER_TEAM), duel.getBox(TeamBattle::ENEMY_TEAM), duel.getWorld()));
+    }
+
+    void stepMatch(TeamBattle &team)
+    {
+        SnapshotCodec::makeView(team, view);
+        uint8_t buttons[2] = {BattleClient::botButtons(view, 0), BattleClient::botButtons(view, 1)};
+        team.step(buttons);
+    }
+
+    // the trainee keeps the mouse on its partner's height and holds fire
+    void stepMatch(TrainingRound &round)
+    {
+        sf::FloatRect target = round.getBox(TeamBattle::ENEMY_TEAM);
+        round.step(static_cast<int>(target.top + target.height / 2), BUTTON_FIRE);
+    }
+
+    static bool playerWon(const DuelBattle &duel) { return duel.hasPlayerWon(); }
+    static bool playerWon(const TeamBattle &team) { return team.hasPlayerWon(); }
+    static bool playerWon(const TrainingRound &round) { return round.getPlayerScore() > round.getEnemyScore(); }
+
+public:
+    void start(uint64_t seed) { startMatch(battle, seed); }
+
+    // one tick, false once the match is over
+    bool step()
+    {
+        stepMatch(battle);
+        return !battle.isOver();
+    }
+
+    ArenaResult play(uint64_t seed)
+    {
+        start(seed);
+        while (step())
+        {
+        }
+        ArenaResult result = {seed, battle.getTick(), battle.checksum(), playerWon(battle)};
+        battle.release();
+        memory.release();
+        return result;
+    }
+
+    const Battle &getBattle() const { return battle; } // getter
+};
+
+// ==================== ARENAS CLASS ==================== //
+
+// Runs many arenas at once, one thread each, taking turns between the 1v1, the 2v2 and training, then reruns every match on one thread to prove no state leaked between them.
+// It uses Abstraction, the command only knows arenas by kind and compares their results.
+class Arenas
+{
+private:
+    enum Kind
+    {
+        KIND_DUEL,
+        KIND_TEAM,
+        KIND_TRAINING,
+        KIND_COUNT
+    };
+
+    template <typename Battle>
+    static void playAll(uint64_t firstSeed, int matches, std::vector<ArenaResult> &results)
+    {
+        Arena<Battle> arena;
+        for (int match = 0; match < matches; match++)
+            results.push_back(arena.play(firstSeed + match));
+    }
+
+    static void playKind(int kind, uint64_t firstSeed, int matches, std::vector<ArenaResult> &results)
+    {
+        if (kind == KIND_DUEL)
+            playAll<DuelBattle>(firstSeed, matches, results);
+        else if (kind == KIND_TEAM)
+            playAll<TeamBattle>(firstSeed, matches, results);
+        else
+            playAll<TrainingRound>(firstSeed, matches, results);
+    }
+
+public:
+    // --arenas [count] [matches per arena] [seed]
+    static int runCommand(int argc, char *argv[])
+    {
+        int count = argc >= 3 ? std::max(1, std::min(atoi(argv[2]), 256)) : static_cast<int>(std::max(3u, std::thread::hardware_concurrency()));
+        int matches = argc >= 4 ? std::max(1, atoi(argv[3])) : 4;
+        uint64_t baseSeed = argc >= 5 ? strtoull(argv[4], nullptr, 10) : BattleRandom::freshSeed();
+
+        // each thread owns its arena and its row of results, nothing is locked
+        std::vector<std::vector<ArenaResult>> results(count);
+        sf::Clock clock;
+        std::vector<std::thread> threads;
+        for (int i = 0; i < count; i++)
+        {
+            threads.push_back(std::thread([&, i]()
+                                          { playKind(i % KIND_COUNT, baseSeed + static_cast<uint64_t>(i) * matches, matches, results[i]); }));
+        }
+        for (std::size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+        float parallelMs = clock.getElapsedTime().asMicroseconds() / 1000.0f;
+
+        // the same matches one after another on this thread, state leaking between arenas would change a result
+        clock.restart();
+        int mismatches = 0;
+        int wins[KIND_COUNT] = {0, 0, 0};
+        int played[KIND_COUNT] = {0, 0, 0};
+        long long ticks = 0;
+        for (int i = 0; i < count; i++)
+        {
+            std::vector<ArenaResult> serial;
+            playKind(i % KIND_COUNT, baseSeed + static_cast<uint64_t>(i) * matches, matches, serial);
+            for (int match = 0; match < matches; match++)
+            {
+                const ArenaResult &threaded = results[i][match];
+                if (serial[match].checksum != threaded.checksum || serial[match].ticks != threaded.ticks)
+                    mismatches++;
+                wins[i % KIND_COUNT] += threaded.playerWon ? 1 : 0;
+                played[i % KIND_COUNT]++;
+                ticks += threaded.ticks;
+            }
+        }
+        float serialMs = clock.getElapsedTime().asMicroseconds() / 1000.0f;
+
+        static const char *kindNames[KIND_COUNT] = {"1v1", "2v2", "training"};
+        int total = count * matches;
+        float simSeconds = static_cast<float>(ticks) / TimerWheel::TICKS_PER_SECOND;
+        std::cout.setf(std::ios::fixed);
+        std::cout.precision(1);
+        std::cout << count << " arenas on " << count << " threads, " << total << " matches, seed " << baseSeed << std::endl;
+        for (int kind = 0; kind < KIND_COUNT; kind++)
+        {
+            if (played[kind] > 0)
+                std::cout << kindNames[kind] << ": " << played[kind] << " matches, players won " << wins[kind] << std::endl;
+        }
+        std::cout << simSeconds << " s of battle" << std::endl
+                  << "Threaded: " << parallelMs << " ms (" << (parallelMs > 0 ? total * 1000.0f / parallelMs : 0.0f) << " matches/s, "
+                  << (parallelMs > 0 ? simSeconds * 1000.0f / parallelMs : 0.0f) << "x real time)" << std::endl
+                  << "Serial:   " << serialMs << " ms, " << (parallelMs > 0 ? serialMs / parallelMs : 0.0f) << "x speedup on "
+                  << std::thread::hardware_concurrency() << " hardware threads" << std::endl
+                  << (mismatches == 0 ? "Every arena matches its serial rerun" : "ARENAS DIFFER") << " (" << mismatches << " of " << total
+                  << " results differ)" << std::endl;
+        return mismatches == 0 ? 0 : 2;
+    }
+};
+
+// ==================== HUD NUMBER CLASS ==================== //
+
+// A number on a battle HUD such as the timer or a unit count, the text is only rebuilt when the value changes.
+// It uses Encapsulation, so update code can set it every tick without building a string and new glyphs each time.
+class HudNumber
+{
+private:
+    int shown;
+
+public:
+    HudNumber() : shown(-1) {} // constructor
+
+    // values are never negative, so the next set() always redraws
+    void reset() { shown = -1; }
+
+    void set(sf::Text &text, const char *prefix, int value)
+    {
+        if (value == shown)
+            return;
+        shown = value;
+        char line[48];
+        snprintf(line, sizeof(line), "%s%d", prefix, value);
+        text.setString(line);
+    }
+
+    // "Dragon: 30", a score next to a name
+    void set(sf::Text &text, const std::string &label, int value)
+    {
+        if (value == shown)
+            return;
+        shown = value;
+        char line[64];
+        snprintf(line, sizeof(line), "%s: %d", label.c_str(), value);
+        text.setString(line);
+    }
+
+    // "Dragon: 84/120", only the first number is watched since the total stays put for a battle
+    void set(sf::Text &text, const std::string &label, int value, int total)
+    {
+        if (value == shown)
+            return;
+        shown = value;
+        char line[64];
+        snprintf(line, sizeof(line), "%s: %d/%d", label.c_str(), value, total);
+        text.setString(line);
+    }
+};
+
+// ------------ 2V2 BATTLE GAME CLASS ---------------- //
+
+// This is a 2v2 pet battle game where players and enemies control pets that move, shoot abilities (fire/ice/lightning/magic), and have health bars.
+// It tracks game time, collisions, and win/lose conditions. It uses Encapsulation keeping  data  private and aggregation
+class Battle2v2Game
+{
+private:
+    bool isActive;
+    bool rewarded;
+
+    sf::RectangleShape window;
+    sf::RectangleShape backgroundDim;
+    sf::Text title;
+    Button closeButton;
+    sf::Font font;
+
+    // the rules own every position, health and shot, this class turns keys into buttons and draws what the battle holds
+    // pets are numbered players first like in the battle, looks[p] is pet p's sprite and looks[pets + p] its shots'
+    std::vector<Pet *> pets;
+    int playerCount;
+    SessionArena memory; // the battle's world and tables live here until close()
+    TeamBattle battle{memory.resource()};
+    std::vector<sf::Sprite> looks;
+    uint64_t nextSeed;
+
+    // W A S D for the first pet and I J K L for the second are held, Space and M fire once per press
+    bool keys[8];
+    bool fireTapped[2];
+    uint8_t lastButtons[2]; // what the last update() fed the battle, a replay records it
+
+    std::vector<sf::Text> healthText;
+    std::vector<HudNumber> shownHealth;
+    std::vector<sf::RectangleShape> healthBar;
+    std::vector<sf::RectangleShape> healthBarBackground;
+
+    sf::Text timerText;
+    HudNumber shownTime;
+
+    int petCount() const { return static_cast<int>(pets.size()); }
+    int enemyCount() const { return petCount() - playerCount; }
+
+    // sprites are stretched over the boxes the rules collide, so what you see is what gets hit
+    static void fitTo(sf::Sprite &sprite, const sf::Texture &texture, const sf::Vector2f &size)
+    {
+        sprite.setTexture(texture, true);
+        sprite.setScale(size.x / texture.getSize().x, size.y / texture.getSize().y);
+    }
+
+    // the HUD is a view of the battle, HudNumber only rebuilds a label when the number changed
+    void updateHealthBars()
+    {
+        for (int p = 0; p < petCount(); p++)
+        {
+            int health = battle.getHealth(p);
+            shownHealth[p].set(healthText[p], pets[p]->getName(), health, battle.getMaxHealth(p));
+            healthBar[p].setSize(sf::Vector2f(200 * (health / static_cast<float>(battle.getMaxHealth(p))), 20));
+            looks[p].setColor(health > 0 ? sf::Color::White : sf::Color(100, 100, 100));
+        }
+    }
+
+    uint8_t buttonsFor(int player) const
+    {
+        const bool *held = keys + 4 * player;
+        uint8_t buttons = 0;
+        if (held[0])
+            buttons |= BUTTON_UP;
+        if (held[1])
+            buttons |= BUTTON_LEFT;
+        if (held[2])
+            buttons |= BUTTON_DOWN;
+        if (held[3])
+            buttons |= BUTTON_RIGHT;
+        if (fireTapped[player])
+            buttons |= BUTTON_FIRE;
+        return buttons;
+    }
+
+public:
+    Battle2v2Game() : isActive(false), rewarded(false), playerCount(0), nextSeed(BattleRandom::freshSeed())
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            keys[i] = false;
+        }
+        fireTapped[0] = fireTapped[1] = false;
+        lastButtons[0] = lastButtons[1] = 0;
+    }
+
+    void setup(const sf::Font &gameFont, Pet *player1, Pet *player2, Pet *enemy1, Pet *enemy2)
+    {
+        font = gameFont;
+        pets = {player1, player2, enemy1, enemy2};
+        playerCount = 2;
+
+        backgroundDim.setFillColor(sf::Color(0, 0, 0, 180));
+        window.setSize(sf::Vector2f(1200, 700));
+        window.setFillColor(sf::Color(40, 40, 50, 240));
+        window.setOutlineThickness(4.f);
+        window.setOutlineColor(sf::Color(255, 215, 0));
+
+        title.setFont(font);
+        title.setString("2 vs 2 BATTLE ARENA");
+        title.setCharacterSize(42);
+        title.setFillColor(sf::Color(255, 215, 0));
+        title.setStyle(sf::Text::Bold);
+        title.setOutlineThickness(2.f);
+        title.setOutlineColor(sf::Color::Black);
+
+        closeButton = Button(font, "CLOSE", 28,
+                             sf::Color(255, 100, 100),
+                             sf::Color(255, 150, 150),
+                             sf::Color(200, 50, 50));
+
+        looks.assign(2 * petCount(), sf::Sprite());
+        healthText.assign(petCount(), sf::Text());
+        shownHealth.assign(petCount(), HudNumber());
+        healthBar.assign(petCount(), sf::RectangleShape());
+        healthBarBackground.assign(petCount(), sf::RectangleShape());
+        for (int p = 0; p < petCount(); p++)
+        {
+            bool enemy = p >= playerCount;
+            const SpeciesInfo &species = Species::info(pets[p]->getSpeciesId());
+            fitTo(looks[p], Species::texture(pets[p]->getSpeciesId()), species.bodySize);
+            fitTo(looks[petCount() + p], Species::projectileTexture(pets[p]->getSpeciesId()), species.shotSize);
+
+            healthText[p].setFont(font);
+            healthText[p].setCharacterSize(24);
+            healthText[p].setFillColor(enemy ? sf::Color(100, 150, 255) : sf::Color(255, 150, 100));
+            healthText[p].setOutlineThickness(1.f);
+            healthText[p].setOutlineColor(sf::Color::Black);
+
+            healthBarBackground[p].setSize(sf::Vector2f(200, 20));
+            healthBarBackground[p].setFillColor(sf::Color(50, 50, 50));
+            healthBarBackground[p].setOutlineThickness(2.f);
+            healthBarBackground[p].setOutlineColor(sf::Color::Black);
+
+            healthBar[p].setSize(sf::Vector2f(200, 20));
+            healthBar[p].setFillColor(enemy ? sf::Color(50, 50, 255) : sf::Color(255, 50, 50));
+        }
+
+        timerText.setFont(font);
+        timerText.setString("TIME: 180");
+        timerText.setCharacterSize(28);
+        timerText.setFillColor(sf::Color(255, 215, 0));
+        timerText.setOutlineThickness(1.f);
+        timerText.setOutlineColor(sf::Color::Black);
+    }
+
+    // the pets' current levels go into the battle, a pet that levelled up since setup() fights at its new strength
+    void open()
+    {
+        isActive = true;
+        rewarded = false;
+        shownTime.reset();
+        for (int i = 0; i < 8; i++)
+        {
+            keys[i] = false;
+        }
+        fireTapped[0] = fireTapped[1] = false;
+
+        std::vector<SimUnit> units;
+        for (int p = 0; p < petCount(); p++)
+        {
+            units.push_back(TeamBattle::unitFor(*pets[p]));
+            shownHealth[p].reset();
+        }
+        battle.start(units.data(), playerCount, units.data() + playerCount, enemyCount(), nextSeed);
+        nextSeed = BattleRandom::freshSeed();
+        updateHealthBars();
+    }
+
+    void handleInput(const sf::Event &event, const sf::Vector2f &mousePos)
+    {
+        if (event.type == sf::Event::KeyPressed)
+        {
+            switch (event.key.code)
+            {
+            case sf::Keyboard::W:
+                keys[0] = true;
+                break;
+            case sf::Keyboard::A:
+                keys[1] = true;
+                break;
+            case sf::Keyboard::S:
+                keys[2] = true;
+                break;
+            case sf::Keyboard::D:
+                keys[3] = true;
+                break;
+            case sf::Keyboard::Space:
+                fireTapped[0] = true;
+                break;
             }
-        }
 
-        // Enemy AI shooting
-        for (int i = 0; i < 2; i++)
-        {
-            if (enemyHealth[i] > 0)
+            switch (event.key.code)
             {
-                addEnemyProjectile(i);
+            case sf::Keyboard::I:
+                keys[4] = true;
+                break;
+            case sf::Keyboard::J:
+                keys[5] = true;
+                break;
+            case sf::Keyboard::K:
+                keys[6] = true;
+                break;
+            case sf::Keyboard::L:
+                keys[7] = true;
+                break;
+            case sf::Keyboard::M:
+                fireTapped[1] = true;
+                break;
             }
         }
-
-        for (int i = 0; i < playerAbilityCount; i++)
+        else if (event.type == sf::Event::KeyReleased)
         {
-            playerAbilities[i].projectile.move(playerAbilities[i].velocity);
+            switch (event.key.code)
+            {
+            case sf::Keyboard::W:
+                keys[0] = false;
+                break;
+            case sf::Keyboard::A:
+                keys[1] = false;
+                break;
+            case sf::Keyboard::S:
+                keys[2] = false;
+                break;
+            case sf::Keyboard::D:
+                keys[3] = false;
+                break;
+            }
 
-            if (playerAbilities[i].projectile.getPosition().x > arenaBounds.left + arenaBounds.width ||
-                playerAbilities[i].projectile.getPosition().y < arenaBounds.top ||
-                playerAbilities[i].projectile.getPosition().y > arenaBounds.top + arenaBounds.height)
+            switch (event.key.code)
             {
-                playerAbilities[i] = playerAbilities[playerAbilityCount - 1];
-                playerAbilityCount--;
-                i--;
+            case sf::Keyboard::I:
+                keys[4] = false;
+                break;
+            case sf::Keyboard::J:
+                keys[5] = false;
+                break;
+            case sf::Keyboard::K:
+                keys[6] = false;
+                break;
+            case sf::Keyboard::L:
+                keys[7] = false;
+                break;
             }
         }
-
-        for (int i = 0; i < enemyAbilityCount; i++)
+        else if (event.type == sf::Event::MouseButtonPressed &&
+                 event.mouseButton.button == sf::Mouse::Left)
         {
-            enemyAbilities[i].projectile.move(enemyAbilities[i].velocity);
-
-            if (enemyAbilities[i].projectile.getPosition().x + enemyAbilities[i].projectile.getGlobalBounds().width < arenaBounds.left ||
-                enemyAbilities[i].projectile.getPosition().y < arenaBounds.top ||
-                enemyAbilities[i].projectile.getPosition().y > arenaBounds.top + arenaBounds.height)
+            if (closeButton.contains(mousePos))
             {
-                enemyAbilities[i] = enemyAbilities[enemyAbilityCount - 1];
-                enemyAbilityCount--;
-                i--;
+                close();
             }
         }
+    }
 
-        handleCollisions();
+    // one battle tick from the keys, then the HUD, experience is handed out once when the battle says it is over
+    void update()
+    {
+        if (battle.isOver())
+            return;
 
-        int remainingTime = gameDuration - gameClock.getElapsedTime().asSeconds();
-        if (remainingTime < 0)
-            remainingTime = 0;
-        timerText.setString("TIME: " + std::to_string(remainingTime));
+        lastButtons[0] = buttonsFor(0);
+        lastButtons[1] = buttonsFor(1);
+        fireTapped[0] = fireTapped[1] = false;
+        battle.step(lastButtons);
+        updateHealthBars();
 
-        if (remainingTime <= 0)
-        {
-            gameOver = true;
-            int playerTotal = playerHealth[0] + playerHealth[1];
-            int enemyTotal = enemyHealth[0] + enemyHealth[1];
-            playerWon = (playerTotal > enemyTotal);
+        int remainingTime = (TeamBattle::DURATION_TICKS - static_cast<int>(battle.getTick())) / TimerWheel::TICKS_PER_SECOND;
+        shownTime.set(timerText, "TIME: ", std::max(0, remainingTime));
 
-            if (playerWon)
+        if (battle.isOver() && !rewarded)
+        {
+            rewarded = true;
+            for (int p = 0; p < playerCount; p++)
             {
-                for (int i = 0; i < 2; i++)
-                {
-                    if (playerHealth[i] > 0)
-                    {
-                        int xp = 30 + (rand() % 30) + enemyTotal / 20;
-                        playerPets[i]->gainExperience(xp);
-                    }
-                }
+                if (battle.getReward(p) > 0)
+                    pets[p]->gainExperience(battle.getReward(p));
             }
         }
     }
@@ -1978,80 +8849,45 @@ public:
             window.getPosition().x + windowBounds.width - closeButton.getBounds().width - 20,
             window.getPosition().y + 15);
 
-        for (int i = 0; i < 2; i++)
+        // each side's labels share the 500 px below the title, 250 px apart for two pets
+        for (int p = 0; p < petCount(); p++)
         {
-            playerHealthText[i].setPosition(
-                window.getPosition().x + 20,
-                window.getPosition().y + 120 + i * 250); 
-
-            enemyHealthText[i].setPosition(
-                window.getPosition().x + windowBounds.width - enemyHealthText[i].getLocalBounds().width - 20,
-                window.getPosition().y + 120 + i * 250); 
+            bool enemy = p >= playerCount;
+            int index = enemy ? p - playerCount : p;
+            float row = 500.0f / (enemy ? enemyCount() : playerCount) * index;
+            float left = enemy ? windowBounds.width - 220 : 20;
 
-            playerHealthBarBackground[i].setPosition(
-                window.getPosition().x + 20,
-                window.getPosition().y + 150 + i * 250); 
+            healthText[p].setPosition(
+                window.getPosition().x + (enemy ? windowBounds.width - healthText[p].getLocalBounds().width - 20 : 20),
+                window.getPosition().y + 120 + row);
 
-            playerHealthBar[i].setPosition(
-                window.getPosition().x + 20,
-                window.getPosition().y + 150 + i * 250); 
-
-            enemyHealthBarBackground[i].setPosition(
-                window.getPosition().x + windowBounds.width - 220,
-                window.getPosition().y + 150 + i * 250); 
-
-            enemyHealthBar[i].setPosition(
-                window.getPosition().x + windowBounds.width - 220,
-                window.getPosition().y + 150 + i * 250); 
+            healthBarBackground[p].setPosition(window.getPosition().x + left, window.getPosition().y + 150 + row);
+            healthBar[p].setPosition(window.getPosition().x + left, window.getPosition().y + 150 + row);
         }
 
         targetWindow.draw(window);
         targetWindow.draw(title);
         targetWindow.draw(timerText);
 
-        if (!gameOver)
+        if (!battle.isOver())
         {
-            for (int i = 0; i < 2; i++)
-            {
-                targetWindow.draw(playerHealthBarBackground[i]);
-                targetWindow.draw(enemyHealthBarBackground[i]);
-            }
-
-            for (int i = 0; i < 2; i++)
-            {
-                targetWindow.draw(playerHealthBar[i]);
-                targetWindow.draw(enemyHealthBar[i]);
-            }
-
-            for (int i = 0; i < 2; i++)
-            {
-                targetWindow.draw(playerHealthText[i]);
-                targetWindow.draw(enemyHealthText[i]);
-            }
-
-            for (int i = 0; i < 2; i++)
-            {
-                targetWindow.draw(playerSprites[i]);
-                targetWindow.draw(enemySprites[i]);
-            }
-
-            for (int i = 0; i < playerAbilityCount; i++)
-            {
-                targetWindow.draw(playerAbilities[i].projectile);
-            }
+            for (int p = 0; p < petCount(); p++)
+                targetWindow.draw(healthBarBackground[p]);
+            for (int p = 0; p < petCount(); p++)
+                targetWindow.draw(healthBar[p]);
+            for (int p = 0; p < petCount(); p++)
+                targetWindow.draw(healthText[p]);
 
-            for (int i = 0; i < enemyAbilityCount; i++)
-            {
-                targetWindow.draw(enemyAbilities[i].projectile);
-            }
+            // pets were spawned first so they sit in the lowest rows and shots draw over them
+            battle.getWorld().draw(targetWindow, sf::Vector2f(0, 0), looks.data(), static_cast<int>(looks.size()));
         }
         else
         {
             sf::Text gameOverText;
             gameOverText.setFont(font);
-            gameOverText.setString(playerWon ? "VICTORY!" : "DEFEAT!");
+            gameOverText.setString(battle.hasPlayerWon() ? "VICTORY!" : "DEFEAT!");
             gameOverText.setCharacterSize(72);
-            gameOverText.setFillColor(playerWon ? sf::Color(100, 255, 100) : sf::Color(255, 100, 100));
+            gameOverText.setFillColor(battle.hasPlayerWon() ? sf::Color(100, 255, 100) : sf::Color(255, 100, 100));
             gameOverText.setStyle(sf::Text::Bold);
             gameOverText.setOutlineThickness(2.f);
             gameOverText.setOutlineColor(sf::Color::Black);
@@ -2062,8 +8898,8 @@ public:
             sf::Text scoreText;
             scoreText.setFont(font);
 
-            int playerTotal = playerHealth[0] + playerHealth[1];
-            int enemyTotal = enemyHealth[0] + enemyHealth[1];
+            int playerTotal = battle.getSideHealth(TeamBattle::PLAYER_TEAM);
+            int enemyTotal = battle.getSideHealth(TeamBattle::ENEMY_TEAM);
 
             scoreText.setString("Your Pets: " + std::to_string(playerTotal) +
                                 "  |  Enemy Pets: " + std::to_string(enemyTotal));
@@ -2082,8 +8918,22 @@ public:
         closeButton.draw(targetWindow);
     }
 
+    // fixed seed for a reproducible match, call before open()
+    void setSeed(uint64_t seed) { nextSeed = seed; }
+    uint64_t getSeed() const { return battle.getSeed(); }
+    const TeamBattle &getBattle() const { return battle; } // getter
+    const uint8_t *getLastButtons() const { return lastButtons; } // getter
+
+    void setAIParams(const EnemyAIParams &params) { battle.setParams(params); }
+
     bool isOpen() const { return isActive; }
-    void close() { isActive = false; }
+    // the whole session's battle goes back to the arena in one release
+    void close()
+    {
+        isActive = false;
+        battle.release();
+        memory.release();
+    }
 };
 //---------------- 1V1 BATTLEGAME CLASS ----------------//
 
@@ -2093,8 +8943,7 @@ class BattleGame
 {
 private:
     bool isActive;
-    bool gameOver;
-    bool playerWon;
+    bool gameOver; // the end of the battle has been shown and cheered
 
     sf::RectangleShape window;
     sf::RectangleShape backgroundDim;
@@ -2104,401 +8953,115 @@ private:
 
     Pet *playerPet;
     Pet *enemyPet;
-    sf::Texture playerTexture;
-    sf::Sprite playerSprite;
-    sf::Texture enemyTexture;
-    sf::Sprite enemySprite;
-
-    float playerSpeed;
-    float enemySpeed;
-    sf::Vector2f playerVelocity;
-    sf::Vector2f enemyVelocity;
-    bool keys[4]; // W, A, S, D
-
-    struct Ability
-    {
-        sf::Sprite projectile;
-        sf::Vector2f velocity;
-        float cooldown;
-        float currentCooldown;
-        sf::Sound sound;
-    };
 
-    static const int MAX_ABILITIES = 50;
-    Ability playerAbilities[MAX_ABILITIES];
-    Ability enemyAbilities[MAX_ABILITIES];
-    int playerAbilityCount;
-    int enemyAbilityCount;
-    sf::Clock abilityClock;
+    // the rules own both pets, their shots and the obstacles, this class turns keys into buttons, draws the world and plays its cues
+    SessionArena memory; // the battle's world lives here until close()
+    DuelBattle battle{memory.resource()};
+    sf::Sprite looks[DuelBattle::LOOK_COUNT];
+    uint64_t nextSeed;
 
-    static const int MAX_OBSTACLES = 10;
-    sf::Sprite obstacles[MAX_OBSTACLES];
-    int obstacleCount;
-    sf::Texture obstacleTexture;
-    sf::Clock obstacleSpawnClock;
-    float obstacleSpawnInterval;
-    float obstacleSpeed;
+    bool keys[4]; // W, A, S, D
+    bool fireTapped; // Space fires once per press
+    uint8_t lastButtons; // what the last update() fed the battle, a replay records it
 
-    int playerHealth;
-    int enemyHealth;
     sf::Text playerHealthText;
     sf::Text enemyHealthText;
+    HudNumber shownPlayerHealth;
+    HudNumber shownEnemyHealth;
     sf::RectangleShape playerHealthBar;
     sf::RectangleShape enemyHealthBar;
     sf::RectangleShape playerHealthBarBack;
     sf::RectangleShape enemyHealthBarBack;
-    sf::Clock gameClock;
     sf::Text timerText;
-    int gameDuration;
+    HudNumber shownTime;
 
     sf::SoundBuffer hitSoundBuffer;
     sf::Sound hitSound;
     sf::SoundBuffer winSoundBuffer;
     sf::Sound winSound;
     sf::SoundBuffer fireSoundBuffer;
-    sf::Sound fireSound;
-
-    sf::Texture fireTexture;
-    sf::Texture iceTexture;
-
-    void setupAbilities()
-    {
-        playerAbilityCount = 0;
-        enemyAbilityCount = 0;
-
-        std::string playerProjTexture;
-        if (playerPet->getName() == "Dragon")
-        {
-            playerProjTexture = "fire1.png";
-        }
-        else if (playerPet->getName() == "Phoenix")
-        {
-            playerProjTexture = "ice1.png";
-        }
-        else if (playerPet->getName() == "Unicorn")
-        {
-            playerProjTexture = "magic.png";
-        }
-        else if (playerPet->getName() == "Griffin")
-        {
-            playerProjTexture = "lightning.png";
-        }
-        else
-        {
-            playerProjTexture = "default.png";
-        }
-
-        if (!fireTexture.loadFromFile(playerProjTexture))
-        {
-            sf::Image placeholder;
-            if (playerPet->getName() == "Dragon")
-            {
-                placeholder.create(50, 20, sf::Color(255, 150, 0)); // Orange for fire
-            }
-            else if (playerPet->getName() == "Phoenix")
-            {
-                placeholder.create(50, 20, sf::Color(100, 200, 255)); // Blue for ice
-            }
-            else if (playerPet->getName() == "Unicorn")
-            {
-                placeholder.create(50, 20, sf::Color(200, 100, 255)); // Purple for magic
-            }
-            else if (playerPet->getName() == "Griffin")
-            {
-                placeholder.create(50, 20, sf::Color(255, 255, 100)); // Yellow for lightning
-            }
-            else
-            {
-                placeholder.create(50, 20, sf::Color::White); // Default
-            }
-            fireTexture.loadFromImage(placeholder);
-        }
-
-        if (playerAbilityCount < MAX_ABILITIES)
-        {
-            playerAbilities[playerAbilityCount].projectile.setTexture(fireTexture);
-            playerAbilities[playerAbilityCount].projectile.setScale(0.4f, 0.4f);
-            playerAbilities[playerAbilityCount].velocity = sf::Vector2f(15.0f, 0);
-            playerAbilities[playerAbilityCount].cooldown = 0.5f;
-            if (fireSoundBuffer.loadFromFile("fire.wav"))
-            {
-                playerAbilities[playerAbilityCount].sound.setBuffer(fireSoundBuffer);
-            }
-            playerAbilityCount++;
-        }
-
-        std::string enemyProjTexture;
-        if (enemyPet->getName() == "Dragon")
-        {
-            enemyProjTexture = "fire1.png";
-        }
-        else if (enemyPet->getName() == "Phoenix")
-        {
-            enemyProjTexture = "ice1.png";
-        }
-        else if (enemyPet->getName() == "Unicorn")
-        {
-            enemyProjTexture = "magic.png";
-        }
-        else if (enemyPet->getName() == "Griffin")
-        {
-            enemyProjTexture = "lightning.png";
-        }
-        else
-        {
-            enemyProjTexture = "default.png";
-        }
-
-        if (!iceTexture.loadFromFile(enemyProjTexture))
-        {
-            sf::Image placeholder;
-            if (enemyPet->getName() == "Dragon")
-            {
-                placeholder.create(50, 20, sf::Color(255, 150, 0)); // Orange for fire
-            }
-            else if (enemyPet->getName() == "Phoenix")
-            {
-                placeholder.create(50, 20, sf::Color(100, 200, 255)); // Blue for ice
-            }
-            else if (enemyPet->getName() == "Unicorn")
-            {
-                placeholder.create(50, 20, sf::Color(200, 100, 255)); // Purple for magic
-            }
-            else if (enemyPet->getName() == "Griffin")
-            {
-                placeholder.create(50, 20, sf::Color(255, 255, 100)); // Yellow for lightning
-            }
-            else
-            {
-                placeholder.create(50, 20, sf::Color::White); // Default
-            }
-            iceTexture.loadFromImage(placeholder);
-        }
-
-        if (enemyAbilityCount < MAX_ABILITIES)
-        {
-            enemyAbilities[enemyAbilityCount].projectile.setTexture(iceTexture);
-            enemyAbilities[enemyAbilityCount].projectile.setScale(0.4f, 0.4f);
-            enemyAbilities[enemyAbilityCount].velocity = sf::Vector2f(-12.0f, 0);
-            enemyAbilities[enemyAbilityCount].cooldown = 1.0f;
-            if (hitSoundBuffer.loadFromFile("hit.wav"))
-            {
-                enemyAbilities[enemyAbilityCount].sound.setBuffer(hitSoundBuffer);
-            }
-            enemyAbilityCount++;
-        }
-    }
-
-    void setupObstacles()
-    {
-        obstacleCount = 0;
-        obstacleSpawnInterval = 2.5f;
-        obstacleSpeed = 3.5f;
-
-        if (!obstacleTexture.loadFromFile("obstacle1.png"))
-        {
-            sf::Image placeholder;
-            placeholder.create(60, 60, sf::Color(150, 75, 0));
-            obstacleTexture.loadFromImage(placeholder);
-        }
-    }
-
-    void spawnObstacle()
-    {
-        if (obstacleCount < MAX_OBSTACLES)
-        {
-            obstacles[obstacleCount].setTexture(obstacleTexture);
-            float x = rand() % static_cast<int>(window.getSize().x - 100) + 50;
-            obstacles[obstacleCount].setPosition(x, -50);
-            obstacleCount++;
-        }
-    }
-
-    void updateObstacles()
-    {
-        if (obstacleSpawnClock.getElapsedTime().asSeconds() > obstacleSpawnInterval)
-        {
-            spawnObstacle();
-            obstacleSpawnClock.restart();
-        }
-
-        for (int i = 0; i < obstacleCount; i++)
-        {
-            obstacles[i].move(0, obstacleSpeed);
-        }
-
-        for (int i = 0; i < obstacleCount;)
-        {
-            if (obstacles[i].getPosition().y > window.getSize().y)
-            {
-                obstacles[i] = obstacles[obstacleCount - 1];
-                obstacleCount--;
-            }
-            else
-            {
-                i++;
-            }
-        }
-    }
-
-    void resetPositions()
-    {
-        playerSprite.setPosition(150, 300);
-        enemySprite.setPosition(800, 300);
-        playerVelocity = sf::Vector2f(0, 0);
-        enemyVelocity = sf::Vector2f(0, 0);
-
-        playerAbilityCount = 0;
-        enemyAbilityCount = 0;
-        setupAbilities();
-
-        obstacleCount = 0;
-        obstacleSpawnClock.restart();
-    }
+    sf::Sound playerShotSound;
+    sf::Sound enemyShotSound;
 
-    bool checkCollision(const sf::Sprite &sprite1, const sf::Sprite &sprite2)
+    // sprites are stretched over the boxes the rules collide, so what you see is what gets hit
+    static void fitTo(sf::Sprite &sprite, const sf::Texture &texture, const sf::Vector2f &size)
     {
-        return sprite1.getGlobalBounds().intersects(sprite2.getGlobalBounds());
-    }
-
-    void handleCollisions()
-    {
-        if (gameOver)
-            return;
-
-        for (int i = 0; i < obstacleCount; i++)
-        {
-            if (checkCollision(playerSprite, obstacles[i]))
-            {
-                sf::Vector2f pushDirection = playerSprite.getPosition() - obstacles[i].getPosition();
-                float length = sqrt(pushDirection.x * pushDirection.x + pushDirection.y * pushDirection.y);
-                if (length > 0)
-                {
-                    pushDirection /= length;
-                    playerSprite.move(pushDirection * 5.0f);
-                }
-
-                playerHealth = std::max(0, playerHealth - 3);
-                playerHealthText.setString(std::to_string(playerHealth));
-                hitSound.play();
-
-                playerHealthBar.setSize(sf::Vector2f(200 * (playerHealth / 100.f), 20));
-
-                if (playerHealth <= 0)
-                {
-                    gameOver = true;
-                    playerWon = false;
-                    return;
-                }
-            }
-
-            if (checkCollision(enemySprite, obstacles[i]))
-            {
-                sf::Vector2f pushDirection = enemySprite.getPosition() - obstacles[i].getPosition();
-                float length = sqrt(pushDirection.x * pushDirection.x + pushDirection.y * pushDirection.y);
-                if (length > 0)
-                {
-                    pushDirection /= length;
-                    enemySprite.move(pushDirection * 5.0f);
-                }
-
-                enemyHealth = std::max(0, enemyHealth - 3);
-                enemyHealthText.setString(std::to_string(enemyHealth));
-                hitSound.play();
-
-                enemyHealthBar.setSize(sf::Vector2f(200 * (enemyHealth / 100.f), 20));
-
-                if (enemyHealth <= 0)
-                {
-                    gameOver = true;
-                    playerWon = true;
-                    winSound.play();
-                    return;
-                }
-            }
-        }
+        sprite.setTexture(texture, true);
+        sprite.setScale(size.x / texture.getSize().x, size.y / texture.getSize().y);
     }
 
-    void removeWhiteBackground(sf::Image &image)
+    // loaded by the first battle and shared by every battle after it, like the species textures
+    static const sf::Texture &obstacleTexture()
     {
-        for (unsigned int y = 0; y < image.getSize().y; ++y)
+        static sf::Texture texture;
+        static bool loaded = false;
+        if (!loaded)
         {
-            for (unsigned int x = 0; x < image.getSize().x; ++x)
+            if (!texture.loadFromFile("obstacle1.png"))
             {
-                sf::Color pixel = image.getPixel(x, y);
-                if (pixel.r > 200 && pixel.g > 200 && pixel.b > 200)
-                {
-                    pixel.a = 0;
-                    image.setPixel(x, y, pixel);
-                }
+                sf::Image placeholder;
+                placeholder.create(60, 60, sf::Color(150, 75, 0));
+                texture.loadFromImage(placeholder);
             }
+            loaded = true;
         }
+        return texture;
     }
 
-    void loadPetTexture(Pet *pet, sf::Texture &texture, sf::Sprite &sprite)
+    void setupLooks()
     {
-        sf::Image img;
-        if (img.loadFromFile(pet->getTexturePath()))
-        {
-            removeWhiteBackground(img);
-            if (pet->getName() == "Unicorn")
-            {
-                if (img.getSize().x < 64 || img.getSize().y < 64)
-                {
-                    sf::Image largerImg;
-                    unsigned int newSize = std::max(img.getSize().x, img.getSize().y) * 2; 
-                    largerImg.create(newSize, newSize, sf::Color::Transparent);
-
-                    unsigned int offsetX = (newSize - img.getSize().x) / 2;
-                    unsigned int offsetY = (newSize - img.getSize().y) / 2;
-
-                    for (unsigned int y = 0; y < img.getSize().y; ++y)
-                    {
-                        for (unsigned int x = 0; x < img.getSize().x; ++x)
-                        {
-                            largerImg.setPixel(x + offsetX, y + offsetY, img.getPixel(x, y));
-                        }
-                    }
-                    texture.loadFromImage(largerImg);
-                }
-                else
-                {
-                    texture.loadFromImage(img);
-                }
-            }
-            else
-            {
-                texture.loadFromImage(img);
-            }
-
-            sprite.setTexture(texture);
+        int playerSpecies = playerPet->getSpeciesId();
+        int enemySpecies = enemyPet->getSpeciesId();
+        sf::Vector2f petSize(DuelBattle::PET_SIZE, DuelBattle::PET_SIZE);
+        fitTo(looks[DuelBattle::LOOK_PLAYER], Species::texture(playerSpecies), petSize);
+        fitTo(looks[DuelBattle::LOOK_ENEMY], Species::texture(enemySpecies), petSize);
+        fitTo(looks[DuelBattle::LOOK_PLAYER_SHOT], Species::projectileTexture(playerSpecies), Species::info(playerSpecies).shotSize);
+        fitTo(looks[DuelBattle::LOOK_ENEMY_SHOT], Species::projectileTexture(enemySpecies), Species::info(enemySpecies).shotSize);
+        fitTo(looks[DuelBattle::LOOK_OBSTACLE], obstacleTexture(), sf::Vector2f(DuelBattle::OBSTACLE_WIDTH, DuelBattle::OBSTACLE_HEIGHT));
 
-            float baseSize = 100.0f; 
-            float scaleX = baseSize / texture.getSize().x;
-            float scaleY = baseSize / texture.getSize().y;
-            sprite.setScale(scaleX * 0.8f, scaleY * 0.8f);
+        if (fireSoundBuffer.loadFromFile("fire.wav"))
+        {
+            playerShotSound.setBuffer(fireSoundBuffer);
         }
-        else
+        if (hitSoundBuffer.loadFromFile("hit.wav"))
         {
-            sf::Image placeholder;
-            placeholder.create(100, 100,
-                               pet == playerPet ? sf::Color::Magenta : sf::Color::Cyan);
-            texture.loadFromImage(placeholder);
-            sprite.setTexture(texture);
-            sprite.setScale(0.8f, 0.8f);
+            enemyShotSound.setBuffer(hitSoundBuffer);
         }
     }
 
+    // the HUD is a view of the battle, HudNumber only rebuilds a label when the number changed
+    void updateHealthBars()
+    {
+        int playerHealth = battle.getHealth(TeamBattle::PLAYER_TEAM);
+        int enemyHealth = battle.getHealth(TeamBattle::ENEMY_TEAM);
+        shownPlayerHealth.set(playerHealthText, "", playerHealth);
+        shownEnemyHealth.set(enemyHealthText, "", enemyHealth);
+        playerHealthBar.setSize(sf::Vector2f(200 * (playerHealth / static_cast<float>(DuelBattle::MAX_HEALTH)), 20));
+        enemyHealthBar.setSize(sf::Vector2f(200 * (enemyHealth / static_cast<float>(DuelBattle::MAX_HEALTH)), 20));
+    }
+
+    uint8_t heldButtons() const
+    {
+        uint8_t buttons = 0;
+        if (keys[0])
+            buttons |= BUTTON_UP;
+        if (keys[1])
+            buttons |= BUTTON_LEFT;
+        if (keys[2])
+            buttons |= BUTTON_DOWN;
+        if (keys[3])
+            buttons |= BUTTON_RIGHT;
+        if (fireTapped)
+            buttons |= BUTTON_FIRE;
+        return buttons;
+    }
+
 public:
-    BattleGame() : isActive(false), gameOver(false), playerWon(false),               // constructor
-                   gameDuration(80), playerSpeed(5.0f), enemySpeed(3.5f),
-                   playerHealth(100), enemyHealth(100),
-                   playerAbilityCount(0), enemyAbilityCount(0),
-                   obstacleCount(0)
+    BattleGame() : isActive(false), gameOver(false), playerPet(nullptr), enemyPet(nullptr), // constructor
+                   nextSeed(BattleRandom::freshSeed()), fireTapped(false), lastButtons(0)
     {
         for (int i = 0; i < 4; i++)
             keys[i] = false;
-        playerVelocity = sf::Vector2f(0, 0);
     }
 
     void setup(const sf::Font &gameFont, Pet *player, Pet *enemy)
@@ -2526,9 +9089,6 @@ public:
                              sf::Color(255, 150, 150),
                              sf::Color(200, 50, 50));
 
-        loadPetTexture(playerPet, playerTexture, playerSprite);
-        loadPetTexture(enemyPet, enemyTexture, enemySprite);
-
         playerHealthText.setFont(font);
         playerHealthText.setString("100");
         playerHealthText.setCharacterSize(28);
@@ -2566,21 +9126,20 @@ public:
         timerText.setOutlineThickness(1.f);
         timerText.setOutlineColor(sf::Color::Black);
 
-        setupAbilities();
-        setupObstacles();
-        resetPositions();
+        setupLooks();
     }
 
     void open()
     {
         isActive = true;
+        shownTime.reset();
         gameOver = false;
-        playerWon = false;
-        playerHealth = 100;
-        enemyHealth = 100;
-        gameClock.restart();
-        obstacleSpawnClock.restart();
-        resetPositions();
+        fireTapped = false;
+        shownPlayerHealth.reset();
+        shownEnemyHealth.reset();
+        battle.start(playerPet->getSpeciesId(), enemyPet->getSpeciesId(), nextSeed);
+        nextSeed = BattleRandom::freshSeed();
+        updateHealthBars();
     }
 
     void handleInput(const sf::Event &event, const sf::Vector2f &mousePos)
@@ -2602,207 +9161,804 @@ public:
                 keys[3] = true;
                 break;
             case sf::Keyboard::Space:
-                if (playerAbilityCount > 0 && abilityClock.getElapsedTime().asSeconds() > playerAbilities[0].cooldown)
+                fireTapped = true;
+                break;
+            default:
+                break;
+            }
+        }
+        else if (event.type == sf::Event::KeyReleased)
+        {
+            switch (event.key.code)
+            {
+            case sf::Keyboard::W:
+                keys[0] = false;
+                break;
+            case sf::Keyboard::A:
+                keys[1] = false;
+                break;
+            case sf::Keyboard::S:
+                keys[2] = false;
+                break;
+            case sf::Keyboard::D:
+                keys[3] = false;
+                break;
+            default:
+                break;
+            }
+        }
+        else if (event.type == sf::Event::MouseButtonPressed &&
+                 event.mouseButton.button == sf::Mouse::Left)
+        {
+            if (closeButton.contains(mousePos))
+            {
+                close();
+            }
+        }
+    }
+
+    // one tick of the rules, then the HUD and the sounds catch up with what happened in it
+    void update()
+    {
+        if (gameOver)
+            return;
+
+        lastButtons = heldButtons();
+        fireTapped = false;
+        battle.step(lastButtons);
+
+        uint8_t cues = battle.getCues();
+        if (cues & DuelBattle::CUE_PLAYER_SHOT)
+            playerShotSound.play();
+        if (cues & DuelBattle::CUE_ENEMY_SHOT)
+            enemyShotSound.play();
+        if (cues & DuelBattle::CUE_HIT)
+            hitSound.play();
+        shownTime.set(timerText, "", battle.getRemainingSeconds());
+        updateHealthBars();
+
+        if (battle.isOver())
+        {
+            gameOver = true;
+            if (battle.hasPlayerWon())
+                winSound.play();
+        }
+    }
+
+    void draw(sf::RenderWindow &targetWindow)
+    {
+        if (!isActive)
+            return;
+
+        sf::Vector2u winSize = targetWindow.getSize();
+        backgroundDim.setSize(sf::Vector2f(winSize.x, winSize.y));
+        targetWindow.draw(backgroundDim);
+
+        sf::FloatRect windowBounds = window.getLocalBounds();
+        window.setPosition((winSize.x - windowBounds.width) / 2,
+                           (winSize.y - windowBounds.height) / 2);
+
+        title.setPosition(
+            window.getPosition().x + (windowBounds.width - title.getLocalBounds().width) / 2,
+            window.getPosition().y + 15);
+
+        closeButton.setPosition(
+            window.getPosition().x + windowBounds.width - closeButton.getBounds().width - 20,
+            window.getPosition().y + 15);
+
+        timerText.setPosition(
+            window.getPosition().x + (windowBounds.width - timerText.getLocalBounds().width) / 2,
+            window.getPosition().y + 70);
+
+        playerHealthBarBack.setPosition(
+            window.getPosition().x + 20,
+            window.getPosition().y + 70);
+
+        playerHealthBar.setPosition(
+            window.getPosition().x + 20,
+            window.getPosition().y + 70);
+
+        playerHealthText.setPosition(
+            window.getPosition().x + 20 + (200 - playerHealthText.getLocalBounds().width) / 2,
+            window.getPosition().y + 70);
+
+        enemyHealthBarBack.setPosition(
+            window.getPosition().x + windowBounds.width - 220,
+            window.getPosition().y + 70);
+
+        enemyHealthBar.setPosition(
+            window.getPosition().x + windowBounds.width - 220,
+            window.getPosition().y + 70);
+
+        enemyHealthText.setPosition(
+            window.getPosition().x + windowBounds.width - 220 + (200 - enemyHealthText.getLocalBounds().width) / 2,
+            window.getPosition().y + 70);
+
+        targetWindow.draw(window);
+        targetWindow.draw(title);
+
+        if (!gameOver)
+        {
+            battle.getWorld().draw(targetWindow, window.getPosition(), looks, DuelBattle::LOOK_COUNT);
+
+            targetWindow.draw(playerHealthBarBack);
+            targetWindow.draw(enemyHealthBarBack);
+            targetWindow.draw(playerHealthBar);
+            targetWindow.draw(enemyHealthBar);
+            targetWindow.draw(playerHealthText);
+            targetWindow.draw(enemyHealthText);
+            targetWindow.draw(timerText);
+        }
+        else
+        {
+            sf::Text gameOverText;
+            gameOverText.setFont(font);
+            gameOverText.setString(battle.hasPlayerWon() ? "VICTORY!" : "DEFEAT!");
+            gameOverText.setCharacterSize(72);
+            gameOverText.setFillColor(battle.hasPlayerWon() ? sf::Color(100, 255, 100) : sf::Color(255, 100, 100));
+            gameOverText.setStyle(sf::Text::Bold);
+            gameOverText.setOutlineThickness(2.f);
+            gameOverText.setOutlineColor(sf::Color::Black);
+            gameOverText.setPosition(
+                window.getPosition().x + (windowBounds.width - gameOverText.getLocalBounds().width) / 2,
+                window.getPosition().y + windowBounds.height / 2 - 50);
+
+            sf::Text scoreText;
+            scoreText.setFont(font);
+            scoreText.setString(playerPet->getName() + ": " + std::to_string(battle.getHealth(TeamBattle::PLAYER_TEAM)) +
+                                "  |  " + enemyPet->getName() + ": " + std::to_string(battle.getHealth(TeamBattle::ENEMY_TEAM)));
+            scoreText.setCharacterSize(36);
+            scoreText.setFillColor(sf::Color::White);
+            scoreText.setOutlineThickness(1.f);
+            scoreText.setOutlineColor(sf::Color::Black);
+            scoreText.setPosition(
+                window.getPosition().x + (windowBounds.width - scoreText.getLocalBounds().width) / 2,
+                window.getPosition().y + windowBounds.height / 2 + 20);
+
+            targetWindow.draw(gameOverText);
+            targetWindow.draw(scoreText);
+        }
+
+        closeButton.draw(targetWindow);
+    }
+
+    // fixed seed for a reproducible match, call before open()
+    void setSeed(uint64_t seed) { nextSeed = seed; }
+    uint64_t getSeed() const { return battle.getSeed(); }
+    const DuelBattle &getBattle() const { return battle; } // getter
+    uint8_t getLastButtons() const { return lastButtons; } // getter
+
+    void setAIParams(const EnemyAIParams &params) { battle.setParams(params); }
+                                                // getter
+    bool isOpen() const { return isActive; }
+    // the whole session's battle goes back to the arena in one release
+    void close()
+    {
+        isActive = false;
+        battle.release();
+        memory.release();
+    }
+};
+
+// ==================== GUILD WAR GAME CLASS ==================== //
+
+// Guild against guild, every pet species the player owns fields a whole squad and the fight runs until one guild is wiped out.
+// It uses Encapsulation, units and shots are entities of a BattleWorld and every unit is an agent of the guild brain, targeting, dodging
+// and positioning go through the same TargetingPass, ThreatField, TeamInfluence and AIScheduler as the 2v2 enemies.
+class GuildWarGame
+{
+private:
+    static const int PLAYER = 0;
+    static const int ENEMY = 1;
+    static const int SPECIES = 4;
+    static const int MAX_SQUAD = 100;
+    static const int MAX_SHOTS = 2 * SPECIES * MAX_SQUAD; // in flight, both guilds together
+
+    static constexpr float UNIT_SIZE = 10.0f;
+    static constexpr float SHOT_SIZE = 4.0f;
+    static constexpr float SIGHT_RADIUS = 220.0f;
+    static constexpr float SPACING = 12.0f;
+    static constexpr float CELL_SIZE = 40.0f;      // small enough that spacing checks only see a few squadmates
+    static constexpr float SHOT_SPEED = 7.0f;
+    static const int RETARGET_TICKS = 16;
+    static const int PLANS_PER_TICK = 32; // a full 480-unit war re-plans everyone about as often as it retargets
+    static constexpr float HIT_RADIUS = UNIT_SIZE / 2 + SHOT_SIZE;   // how close a rival shot has to pass to be worth a dodge
+    static const int JOB_GRAIN = 64; // units per task
+
+    // what the world does not keep about a unit, fixed when the guilds deploy
+    struct Unit
+    {
+        int body; // handle in the world, the body is tagged with the unit's index
+        int maxHealth;
+        float speed;
+        uint8_t guild;
+        uint8_t species;
+    };
+
+    bool isActive;
+    bool gameOver;
+    bool playerWon;
+
+    sf::RectangleShape window;
+    sf::RectangleShape backgroundDim;
+    sf::RectangleShape arenaBack;
+    sf::Text title;
+    sf::Text timerText;
+    HudNumber shownTime;
+    sf::Text countText[2];
+    HudNumber shownCount[2];
+    sf::Text hintText;
+    Button closeButton;
+    sf::Font font;
+
+    sf::FloatRect arenaBounds; // window-local, like every other battle
+    int gameDuration;
+    int squadSize;
+
+    Pet *playerPets[SPECIES];
+    int enemyLevel[SPECIES];
+
+    // the world moves every unit and shot, keeps health, weapons and targets, and resolves the hits
+    BattleWorld world;
+    std::vector<Unit> units;
+    std::vector<uint8_t> sighted; // whether a unit had a target when its plan was last checked
+    AIScheduler scheduler;        // every unit of both guilds is an agent of the guild brain
+    EnemyAIParams params;
+    std::vector<int> living[2];
+    SpatialGrid grids[2];
+    sf::Vector2f centroid[2];
+
+    // per guild, what its units see of the rivals: the nearest one, the rival shots and where to stand against them
+    // in its guild's influence map the rival guild plays the players' part and the ranged squads the enemies'
+    TargetingPass targeting[2];
+    std::vector<int> seekers[2];
+    ThreatField threats[2];
+    TeamInfluence influence[2];
+
+    // per-tick scratch, the parallel passes only read the world and write their own unit's slot, so the split across threads cannot change the result
+    struct Strike
+    {
+        int attacker;
+        int foe;
+        int damage;
+    };
+    std::vector<float> centerX, centerY; // unit centres when the tick began, what the grids index
+    std::vector<AIContext> contexts;
+    std::vector<sf::Vector2f> pushes;
+    std::vector<Strike> strikes;
+    JobSystem *jobs;
+
+    bool hasRally;
+    sf::Vector2f rallyPoint;
+
+    TimerWheel timers;
+    BattleRandom random;
+
+    sf::VertexArray unitQuads;
+    sf::VertexArray barQuads;
+    sf::VertexArray shotQuads;
+
+    // Dragon and Phoenix fight at range, Griffin and Unicorn close in
+    static float speciesRange(int kind) { return kind < 2 ? 140.0f : 22.0f; }
+    static int speciesReload(int kind) { return kind < 2 ? TimerWheel::TICKS_PER_SECOND : TimerWheel::TICKS_PER_SECOND * 2 / 3; }
+
+    static sf::Color speciesColor(int kind, int guild)
+    {
+        static const sf::Color player[SPECIES] = {sf::Color(255, 120, 60), sf::Color(120, 200, 255),
+                                                  sf::Color(230, 200, 90), sf::Color(240, 150, 240)};
+        static const sf::Color enemy[SPECIES] = {sf::Color(170, 40, 30), sf::Color(40, 90, 170),
+                                                 sf::Color(140, 110, 30), sf::Color(140, 60, 140)};
+        return guild == PLAYER ? player[kind] : enemy[kind];
+    }
+
+    sf::Vector2f centerOf(int unit) const { return sf::Vector2f(centerX[unit], centerY[unit]); }
+    bool isAlive(int unit) const { return world.getHealth(units[unit].body) > 0; }
+
+    void addUnit(int guild, const PetRecord &pet, float x, float y)
+    {
+        int kind = pet.speciesId;
+        const SpeciesStats &stats = Species::info(kind).stats;
+        Unit unit;
+        unit.maxHealth = Species::hp(stats, pet.level);
+        unit.speed = 0.4f * Species::speed(stats, pet.level);
+        unit.guild = static_cast<uint8_t>(guild);
+        unit.species = static_cast<uint8_t>(kind);
+        sf::FloatRect box(x - UNIT_SIZE / 2, y - UNIT_SIZE / 2, UNIT_SIZE, UNIT_SIZE);
+        unit.body = world.spawnBody(guild, box, unit.maxHealth, static_cast<int>(units.size()));
+        world.arm(unit.body, std::max(1, Species::attack(stats, pet.level)), speciesRange(kind), speciesReload(kind),
+                  random.nextInt(speciesReload(kind)) + 1);
+        units.push_back(unit);
+    }
+
+    // each guild lines its squads up in columns on its own half of the arena
+    void deployGuilds()
+    {
+        world.clear();
+        units.clear();
+        world.reserve(2 * SPECIES * squadSize + MAX_SHOTS);
+        float rowsPerColumn = std::max(1.0f, std::floor((arenaBounds.height - 20) / SPACING));
+
+        for (int guild = 0; guild < 2; guild++)
+        {
+            int placed = 0;
+            for (int kind = 0; kind < SPECIES; kind++)
+            {
+                // enemy squads only need the species and a level, not a whole Pet
+                if (guild == PLAYER && !playerPets[kind])
+                    continue;
+                PetRecord pet = guild == PLAYER ? playerPets[kind]->getProgress() : Species::record(kind, enemyLevel[kind]);
+
+                // ranged squads stand behind the melee ones
+                for (int i = 0; i < squadSize; i++, placed++)
                 {
-                    if (playerAbilityCount < MAX_ABILITIES)
-                    {
-                        playerAbilities[playerAbilityCount] = playerAbilities[0];
-                        playerAbilities[playerAbilityCount].projectile.setPosition(
-                            playerSprite.getPosition().x + playerSprite.getGlobalBounds().width,
-                            playerSprite.getPosition().y + playerSprite.getGlobalBounds().height / 2);
-                        playerAbilities[playerAbilityCount].sound.play();
-                        playerAbilityCount++;
-                        abilityClock.restart();
-                    }
+                    int column = placed / static_cast<int>(rowsPerColumn);
+                    int row = placed % static_cast<int>(rowsPerColumn);
+                    float depth = 30 + column * SPACING + (kind < 2 ? 0 : 4 * SPACING);
+                    float x = guild == PLAYER ? arenaBounds.left + depth : arenaBounds.left + arenaBounds.width - depth;
+                    float y = arenaBounds.top + 10 + row * SPACING + random.nextFloat() * 2;
+                    addUnit(guild, pet, x, y);
+                }
+            }
+        }
+        world.confine(arenaBounds);
+
+        sighted.assign(units.size(), 0);
+        scheduler.resize(static_cast<int>(units.size()));
+        scheduler.reset();
+        for (int guild = 0; guild < 2; guild++)
+        {
+            influence[guild].reset(arenaBounds, static_cast<int>(units.size()), static_cast<int>(units.size()), speciesRange(Species::DRAGON) * 0.9f);
+        }
+    }
+
+    void collectLiving()
+    {
+        int count = static_cast<int>(units.size());
+        centerX.resize(count);
+        centerY.resize(count);
+        for (int guild = 0; guild < 2; guild++)
+        {
+            living[guild].clear();
+            centroid[guild] = sf::Vector2f(0, 0);
+        }
+        for (int i = 0; i < count; i++)
+        {
+            sf::Vector2f center = world.getCenter(units[i].body);
+            centerX[i] = center.x;
+            centerY[i] = center.y;
+            if (isAlive(i))
+            {
+                living[units[i].guild].push_back(i);
+                centroid[units[i].guild] += center;
+            }
+        }
+        for (int guild = 0; guild < 2; guild++)
+        {
+            if (!living[guild].empty())
+                centroid[guild] /= static_cast<float>(living[guild].size());
+            grids[guild].build(arenaBounds, CELL_SIZE, centerX.data(), centerY.data(),
+                               living[guild].data(), static_cast<int>(living[guild].size()));
+        }
+    }
+
+    // the unit a body's weapon is set on, -1 for none
+    int targetOf(int unit) const
+    {
+        int foe = world.getTarget(units[unit].body);
+        return foe < 0 ? -1 : world.getTag(foe);
+    }
+
+    static bool isRanged(int kind) { return speciesRange(kind) >= SIGHT_RADIUS / 4; }
+
+    // staggered so only one unit in RETARGET_TICKS looks again each tick, unless its target just died,
+    // each guild's seekers then take the nearest living rival from one TargetingPass sweep, if it is in sight
+    void updateTargets()
+    {
+        uint64_t tick = timers.now();
+        for (int guild = 0; guild < 2; guild++)
+        {
+            TargetingPass &pass = targeting[guild];
+            pass.clear();
+            seekers[guild].clear();
+            for (int unit : living[guild])
+            {
+                int current = world.getTarget(units[unit].body);
+                bool lost = current < 0 || world.getHealth(current) <= 0;
+                if (lost || (tick + unit) % RETARGET_TICKS == 0)
+                {
+                    seekers[guild].push_back(unit);
+                    pass.addSeeker(centerOf(unit));
                 }
-                break;
-            default:
-                break;
             }
-        }
-        else if (event.type == sf::Event::KeyReleased)
-        {
-            switch (event.key.code)
+            for (int foe : living[1 - guild])
             {
-            case sf::Keyboard::W:
-                keys[0] = false;
-                break;
-            case sf::Keyboard::A:
-                keys[1] = false;
-                break;
-            case sf::Keyboard::S:
-                keys[2] = false;
-                break;
-            case sf::Keyboard::D:
-                keys[3] = false;
-                break;
-            default:
-                break;
+                pass.addTarget(centerOf(foe), true);
             }
         }
-        else if (event.type == sf::Event::MouseButtonPressed &&
-                 event.mouseButton.button == sf::Mouse::Left)
+
+        // the two sweeps share nothing
+        jobs->parallelFor(2, 1, [this](int begin, int end)
+                          {
+            for (int guild = begin; guild < end; guild++)
+                targeting[guild].run(); });
+
+        for (int guild = 0; guild < 2; guild++)
         {
-            if (closeButton.contains(mousePos))
+            const std::vector<int> &rivals = living[1 - guild];
+            for (size_t k = 0; k < seekers[guild].size(); k++)
             {
-                close();
+                int seeker = static_cast<int>(k);
+                int foe = targeting[guild].getTarget(seeker);
+                bool inSight = foe >= 0 && targeting[guild].getDistanceSquared(seeker) < SIGHT_RADIUS * SIGHT_RADIUS;
+                world.setTarget(units[seekers[guild][k]].body, inSight ? units[rivals[foe]].body : -1);
             }
         }
     }
 
-    void update()
+    // rival shots for the dodge, and the influence maps the ranged squads pick their spots from
+    void updateAwareness()
     {
-        if (gameOver)
-            return;
-
-        int remainingTime = gameDuration - gameClock.getElapsedTime().asSeconds();
-        if (remainingTime < 0)
-            remainingTime = 0;
-        timerText.setString(std::to_string(remainingTime));
+        for (int guild = 0; guild < 2; guild++)
+        {
+            ThreatField &field = threats[guild];
+            field.clear(arenaBounds);
+            world.forEachShot(1 - guild, [&field](const sf::Vector2f &center, const sf::Vector2f &velocity, int)
+                              { field.addProjectile(center, velocity); });
+            field.build();
+        }
 
-        if (remainingTime <= 0 || playerHealth <= 0 || enemyHealth <= 0)
+        for (int unit = 0; unit < static_cast<int>(units.size()); unit++)
         {
-            gameOver = true;
-            playerWon = (playerHealth > enemyHealth);
-            if (playerWon)
-                winSound.play();
-            return;
+            int guild = units[unit].guild;
+            bool alive = isAlive(unit);
+            influence[1 - guild].updatePlayer(unit, centerOf(unit), alive);
+            if (isRanged(units[unit].species))
+                influence[guild].updateEnemy(unit, centerOf(unit), alive);
         }
+    }
 
-        updateObstacles();
+    // contexts and spacing come from where everyone stood when the tick began, the scheduler re-plans a slice of the units,
+    // the guild brain steers them all and the world then moves and confines them
+    void moveUnits()
+    {
+        contexts.resize(units.size());
+        pushes.assign(units.size(), sf::Vector2f(0, 0));
+        for (int guild = 0; guild < 2; guild++)
+        {
+            const std::vector<int> &members = living[guild];
+            jobs->parallelFor(static_cast<int>(members.size()), JOB_GRAIN, [&](int begin, int end)
+                              {
+                for (int k = begin; k < end; k++)
+                {
+                    int unit = members[k];
+                    int body = units[unit].body;
+                    float x = centerX[unit], y = centerY[unit];
+                    int foe = targetOf(unit);
+                    sf::Vector2f toTarget = foe >= 0 ? centerOf(foe) - centerOf(unit) : sf::Vector2f(0, 0);
+                    float distance = sqrt(toTarget.x * toTarget.x + toTarget.y * toTarget.y);
+                    AIContext &context = contexts[unit];
+                    context = EnemyAI::makeContext(toTarget, distance, foe >= 0, world.getVelocity(body), units[unit].speed);
+                    context.reach = world.getRange(body) * 0.9f;
+
+                    // with a target a ranged unit's spot comes from the influence map and a melee unit's is within reach of the target,
+                    // without one every unit marches on the rally point or the rival guild
+                    if (foe < 0)
+                    {
+                        sf::Vector2f goal = guild == PLAYER && hasRally ? rallyPoint : centroid[1 - guild];
+                        context.toSpot = goal - centerOf(unit);
+                    }
+                    else if (isRanged(units[unit].species))
+                    {
+                        context.toSpot = influence[guild].toSpot(unit, centerOf(unit));
+                    }
+                    else if (distance > context.reach)
+                    {
+                        context.toSpot = toTarget * (1.0f - context.reach / distance);
+                    }
 
-        playerVelocity.x = keys[3] ? playerSpeed : (keys[1] ? -playerSpeed : 0);
-        playerVelocity.y = keys[2] ? playerSpeed : (keys[0] ? -playerSpeed : 0);
+                    // squadmates push apart so a squad spreads out instead of stacking on one pixel
+                    sf::Vector2f push(0, 0);
+                    grids[guild].forEachNear(x, y, SPACING, [&](int other)
+                                             {
+                        float dx = x - centerX[other], dy = y - centerY[other];
+                        float d2 = dx * dx + dy * dy;
+                        if (other != unit && d2 < SPACING * SPACING && d2 > 1e-4f)
+                        {
+                            float distance = sqrt(d2);
+                            float strength = (SPACING - distance) / SPACING * 0.5f;
+                            push += sf::Vector2f(dx, dy) * (strength / distance);
+                        } });
+                    pushes[unit] = push;
+                } });
+        }
 
-        if (playerVelocity.x != 0 && playerVelocity.y != 0)
+        // a unit that just found or lost its target re-plans this tick, whatever the budget,
+        // the threat fields reuse their scratch between calls, so the dodge checks stay on this thread
+        for (size_t unit = 0; unit < units.size(); unit++)
         {
-            playerVelocity *= 0.7071f;
+            if (!isAlive(unit))
+                continue;
+            int body = units[unit].body;
+            contexts[unit].threat = threats[units[unit].guild].assess(centerOf(unit), world.getVelocity(body), HIT_RADIUS,
+                                                                      params.dodgeHorizon, SHOT_SPEED);
+            if (contexts[unit].hasTarget != static_cast<bool>(sighted[unit]))
+            {
+                sighted[unit] = contexts[unit].hasTarget;
+                scheduler.invalidate(static_cast<int>(unit));
+            }
         }
+        scheduler.update(UtilityBrain::guildBrain(), params, [this](int agent, AIContext &context)
+                         {
+            context = contexts[agent];
+            return isAlive(agent); });
 
-        playerSprite.move(playerVelocity);
+        // the fallen stand still
+        for (size_t unit = 0; unit < units.size(); unit++)
+        {
+            sf::Vector2f velocity(0, 0);
+            if (isAlive(unit))
+                velocity = scheduler.steer(UtilityBrain::guildBrain(), static_cast<int>(unit), contexts[unit], params, random) + pushes[unit];
+            world.setVelocity(units[unit].body, velocity);
+        }
+    }
 
-        sf::FloatRect bounds = window.getGlobalBounds();
-        sf::FloatRect playerBounds = playerSprite.getGlobalBounds();
+    // the world decides who is ready and in range, melee lands at once and ranged units loose a shot where the foe is heading
+    void fireWeapons()
+    {
+        strikes.clear();
+        world.fireWeapons([this](int attacker, int foe, int damage)
+                          { strikes.push_back(Strike{world.getTag(attacker), world.getTag(foe), damage}); });
 
-        if (playerBounds.left < 0)
-            playerSprite.setPosition(0, playerBounds.top);
-        if (playerBounds.top < 50)
-            playerSprite.setPosition(playerBounds.left, 50);
-        if (playerBounds.left + playerBounds.width > bounds.width)
-            playerSprite.setPosition(bounds.width - playerBounds.width, playerBounds.top);
-        if (playerBounds.top + playerBounds.height > bounds.height - 50)
-            playerSprite.setPosition(playerBounds.left, bounds.height - playerBounds.height - 50);
+        for (size_t i = 0; i < strikes.size(); i++)
+        {
+            const Strike &strike = strikes[i];
+            const Unit &unit = units[strike.attacker];
+            if (!isRanged(unit.species))
+            {
+                world.hurt(units[strike.foe].body, strike.damage);
+                continue;
+            }
+            if (world.countShots(PLAYER) + world.countShots(ENEMY) >= MAX_SHOTS)
+                continue;
 
-        // Enemy AI movement
-        sf::Vector2f direction = playerSprite.getPosition() - enemySprite.getPosition();
-        float distance = sqrt(direction.x * direction.x + direction.y * direction.y);
+            // lead the foe by how far it moves while the shot flies
+            sf::Vector2f from = centerOf(strike.attacker);
+            sf::Vector2f to = centerOf(strike.foe);
+            sf::Vector2f offset = to - from;
+            float flight = sqrt(offset.x * offset.x + offset.y * offset.y) / SHOT_SPEED;
+            offset += world.getVelocity(units[strike.foe].body) * flight;
+            float length = sqrt(offset.x * offset.x + offset.y * offset.y);
+            sf::Vector2f velocity = length > 0 ? offset * (SHOT_SPEED / length) : sf::Vector2f(unit.guild == PLAYER ? SHOT_SPEED : -SHOT_SPEED, 0);
+            world.spawnShot(unit.guild, sf::FloatRect(from.x - SHOT_SIZE / 2, from.y - SHOT_SIZE / 2, SHOT_SIZE, SHOT_SIZE), velocity,
+                            strike.damage);
+        }
+    }
 
-        if (distance > 200)
+    void checkGameOver()
+    {
+        int alive[2] = {0, 0};
+        long long totalHealth[2] = {0, 0};
+        int count = static_cast<int>(units.size());
+        for (int i = 0; i < count; i++)
         {
-            if (distance > 0)
+            int health = world.getHealth(units[i].body);
+            if (health > 0)
             {
-                direction /= distance;
-                enemyVelocity = direction * enemySpeed;
+                alive[units[i].guild]++;
+                totalHealth[units[i].guild] += health;
             }
         }
-        else if (distance < 150)
+
+        int remainingTime = std::max(0, gameDuration - static_cast<int>(timers.seconds()));
+        shownTime.set(timerText, "TIME: ", remainingTime);
+        shownCount[PLAYER].set(countText[PLAYER], "GUILD: ", alive[PLAYER]);
+        shownCount[ENEMY].set(countText[ENEMY], "RIVALS: ", alive[ENEMY]);
+
+        if (alive[PLAYER] > 0 && alive[ENEMY] > 0 && remainingTime > 0)
+            return;
+
+        gameOver = true;
+        playerWon = alive[ENEMY] == 0 || (alive[PLAYER] > 0 && totalHealth[PLAYER] > totalHealth[ENEMY]);
+        if (!playerWon)
+            return;
+
+        // every species earns experience for the squadmates that are still standing
+        for (int kind = 0; kind < SPECIES; kind++)
         {
-            if (distance > 0)
+            if (!playerPets[kind])
+                continue;
+            int survivors = 0;
+            for (int i = 0; i < count; i++)
             {
-                direction /= distance;
-                enemyVelocity = -direction * enemySpeed * 0.7f;
+                survivors += units[i].guild == PLAYER && units[i].species == kind && isAlive(i);
             }
+            if (survivors > 0)
+                playerPets[kind]->gainExperience(20 + 40 * survivors / squadSize);
         }
-        else
+    }
+
+    static void setQuad(sf::Vertex *quad, float left, float top, float width, float height, const sf::Color &color)
+    {
+        quad[0] = sf::Vertex(sf::Vector2f(left, top), color);
+        quad[1] = sf::Vertex(sf::Vector2f(left + width, top), color);
+        quad[2] = sf::Vertex(sf::Vector2f(left + width, top + height), color);
+        quad[3] = sf::Vertex(sf::Vector2f(left, top + height), color);
+    }
+
+    // one vertex array per layer, so hundreds of units still cost three draw calls, every unit fills its own quads
+    void buildBatches(const sf::Vector2f &offset)
+    {
+        int count = static_cast<int>(living[PLAYER].size() + living[ENEMY].size());
+        unitQuads.resize(count * 4);
+        barQuads.resize(count * 4);
+        int first = 0;
+        for (int guild = 0; guild < 2; guild++)
+        {
+            const std::vector<int> &members = living[guild];
+            jobs->parallelFor(static_cast<int>(members.size()), JOB_GRAIN * 4, [&](int begin, int end)
+                              {
+                for (int k = begin; k < end; k++)
+                {
+                    const Unit &unit = units[members[k]];
+                    int q = first + k;
+                    sf::FloatRect box = world.getBox(unit.body);
+                    float left = offset.x + box.left;
+                    float top = offset.y + box.top;
+                    setQuad(&unitQuads[q * 4], left, top, box.width, box.height, speciesColor(unit.species, guild));
+                    float share = static_cast<float>(world.getHealth(unit.body)) / unit.maxHealth;
+                    setQuad(&barQuads[q * 4], left, top - 3, UNIT_SIZE * share, 2,
+                            share > 0.5f ? sf::Color(80, 220, 80) : sf::Color(230, 80, 60));
+                } });
+            first += static_cast<int>(members.size());
+        }
+
+        shotQuads.resize((world.countShots(PLAYER) + world.countShots(ENEMY)) * 4);
+        int shot = 0;
+        for (int guild = 0; guild < 2; guild++)
+        {
+            sf::Color color = guild == PLAYER ? sf::Color(255, 240, 150) : sf::Color(255, 90, 90);
+            world.forEachShot(guild, [&](const sf::Vector2f &center, const sf::Vector2f &, int)
+                              { setQuad(&shotQuads[4 * shot++], offset.x + center.x - SHOT_SIZE / 2, offset.y + center.y - SHOT_SIZE / 2,
+                                        SHOT_SIZE, SHOT_SIZE, color); });
+        }
+    }
+
+public:
+    GuildWarGame() : isActive(false), gameOver(false), playerWon(false), // constructor
+                     gameDuration(120), squadSize(60), scheduler(PLANS_PER_TICK * UtilityBrain::guildBrain().getActionCount()),
+                     jobs(&JobSystem::shared()), hasRally(false),
+                     unitQuads(sf::Quads), barQuads(sf::Quads), shotQuads(sf::Quads)
+    {
+        for (int i = 0; i < SPECIES; i++)
         {
-            enemyVelocity = sf::Vector2f(0, 0);
+            playerPets[i] = nullptr;
+            enemyLevel[i] = 1;
         }
+    }
 
-        enemyVelocity.x += (rand() % 100 - 50) / 100.0f;
-        enemyVelocity.y += (rand() % 100 - 50) / 100.0f;
+    // pets[i] is the player's pet of species i, its level sets the stats of the whole squad
+    void setup(const sf::Font &gameFont, Pet *pets[SPECIES])
+    {
+        font = gameFont;
+        for (int i = 0; i < SPECIES; i++)
+        {
+            playerPets[i] = pets[i];
+        }
 
-        enemySprite.move(enemyVelocity);
+        backgroundDim.setFillColor(sf::Color(0, 0, 0, 180));
+        window.setSize(sf::Vector2f(1000, 600));
+        window.setFillColor(sf::Color(40, 40, 50, 240));
+        window.setOutlineThickness(4.f);
+        window.setOutlineColor(sf::Color(255, 215, 0));
 
-        // Boundary checks
-        sf::FloatRect enemyBounds = enemySprite.getGlobalBounds();
+        arenaBounds = sf::FloatRect(20, 110, 960, 440);
+        arenaBack.setSize(sf::Vector2f(arenaBounds.width, arenaBounds.height));
+        arenaBack.setFillColor(sf::Color(30, 55, 35));
+        arenaBack.setOutlineThickness(2.f);
+        arenaBack.setOutlineColor(sf::Color(90, 90, 110));
 
-        if (enemyBounds.left < 0)
-            enemySprite.setPosition(0, enemyBounds.top);
-        if (enemyBounds.top < 50)
-            enemySprite.setPosition(enemyBounds.left, 50);
-        if (enemyBounds.left + enemyBounds.width > bounds.width)
-            enemySprite.setPosition(bounds.width - enemyBounds.width, enemyBounds.top);
-        if (enemyBounds.top + enemyBounds.height > bounds.height - 50)
-            enemySprite.setPosition(enemyBounds.left, bounds.height - enemyBounds.height - 50);
+        title.setFont(font);
+        title.setString("GUILD WAR");
+        title.setCharacterSize(42);
+        title.setFillColor(sf::Color(255, 215, 0));
+        title.setStyle(sf::Text::Bold);
+        title.setOutlineThickness(2.f);
+        title.setOutlineColor(sf::Color::Black);
 
-        handleCollisions();
+        timerText.setFont(font);
+        timerText.setCharacterSize(28);
+        timerText.setFillColor(sf::Color(255, 215, 0));
+        timerText.setOutlineThickness(1.f);
+        timerText.setOutlineColor(sf::Color::Black);
 
-        for (int i = 0; i < playerAbilityCount; i++)
+        for (int i = 0; i < 2; i++)
         {
-            playerAbilities[i].projectile.move(playerAbilities[i].velocity);
+            countText[i].setFont(font);
+            countText[i].setCharacterSize(26);
+            countText[i].setFillColor(i == PLAYER ? sf::Color(120, 220, 255) : sf::Color(255, 120, 120));
+            countText[i].setOutlineThickness(1.f);
+            countText[i].setOutlineColor(sf::Color::Black);
+        }
 
-            if (checkCollision(playerAbilities[i].projectile, enemySprite))
-            {
-                enemyHealth -= 8;
-                enemyHealthText.setString(std::to_string(enemyHealth));
-                hitSound.play();
+        hintText.setFont(font);
+        hintText.setString("Click the arena to rally your guild");
+        hintText.setCharacterSize(20);
+        hintText.setFillColor(sf::Color(200, 200, 200));
 
-                playerAbilities[i] = playerAbilities[playerAbilityCount - 1];
-                playerAbilityCount--;
-                i--;
+        closeButton = Button(font, "CLOSE", 28,
+                             sf::Color(255, 100, 100),
+                             sf::Color(255, 150, 150),
+                             sf::Color(200, 50, 50));
+    }
 
-                enemyHealthBar.setSize(sf::Vector2f(200 * (enemyHealth / 100.f), 20));
+    void open()
+    {
+        isActive = true;
+        shownTime.reset();
+        shownCount[0].reset();
+        shownCount[1].reset();
+        gameOver = false;
+        playerWon = false;
+        hasRally = false;
 
-                if (enemyHealth <= 0)
-                {
-                    enemyHealth = 0;
-                    enemyHealthText.setString("0");
-                    gameOver = true;
-                    playerWon = true;
-                    winSound.play();
-                    return;
-                }
-            }
+        // rival squads are matched to the player's pets, give or take a level
+        for (int kind = 0; kind < SPECIES; kind++)
+        {
+            int level = playerPets[kind] ? playerPets[kind]->getLevel() : 1;
+            enemyLevel[kind] = std::clamp(level + random.nextInt(3) - 1, 1, 3);
         }
 
-        // Enemy AI shooting
-        static sf::Clock enemyShootClock;
-        if (enemyShootClock.getElapsedTime().asSeconds() > 1.5f &&
-            enemyAbilityCount > 0 && enemyAbilityCount < MAX_ABILITIES)
+        timers.reset();
+        deployGuilds();
+        collectLiving();
+        checkGameOver();
+    }
+
+    void handleInput(const sf::Event &event, const sf::Vector2f &mousePos)
+    {
+        if (event.type == sf::Event::MouseMoved)
         {
-            enemyAbilities[enemyAbilityCount] = enemyAbilities[0];
-            enemyAbilities[enemyAbilityCount].projectile.setPosition(
-                enemySprite.getPosition().x,
-                enemySprite.getPosition().y + enemySprite.getGlobalBounds().height / 2);
-            enemyAbilities[enemyAbilityCount].sound.play();
-            enemyAbilityCount++;
-            enemyShootClock.restart();
+            closeButton.update(mousePos);
         }
-
-        for (int i = 0; i < enemyAbilityCount; i++)
+        else if (event.type == sf::Event::MouseButtonPressed &&
+                 event.mouseButton.button == sf::Mouse::Left)
         {
-            enemyAbilities[i].projectile.move(enemyAbilities[i].velocity);
-
-            if (checkCollision(enemyAbilities[i].projectile, playerSprite))
+            if (closeButton.contains(mousePos))
             {
-                playerHealth -= 8;
-                playerHealthText.setString(std::to_string(playerHealth));
-                hitSound.play();
-
-                enemyAbilities[i] = enemyAbilities[enemyAbilityCount - 1];
-                enemyAbilityCount--;
-                i--;
-
-                playerHealthBar.setSize(sf::Vector2f(200 * (playerHealth / 100.f), 20));
+                close();
+                return;
+            }
 
-                if (playerHealth <= 0)
-                {
-                    gameOver = true;
-                    playerWon = false;
-                    return;
-                }
+            sf::Vector2f local = mousePos - window.getPosition();
+            if (!gameOver && arenaBounds.contains(local))
+            {
+                rallyPoint = local;
+                hasRally = true;
             }
         }
+        else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape)
+        {
+            close();
+        }
+    }
+
+    // one simulation tick
+    void update()
+    {
+        if (gameOver)
+            return;
+
+        timers.advance([](int) {});
+        collectLiving();
+        updateTargets();
+        updateAwareness();
+        moveUnits();
+        fireWeapons();
+        world.integrate();
+        world.confine(arenaBounds);
+        world.cull(arenaBounds, [](int) {});
+        world.resolveHits([](int, int, int) {});
+        checkGameOver();
     }
 
     void draw(sf::RenderWindow &targetWindow)
@@ -2817,89 +9973,31 @@ public:
         sf::FloatRect windowBounds = window.getLocalBounds();
         window.setPosition((winSize.x - windowBounds.width) / 2,
                            (winSize.y - windowBounds.height) / 2);
+        sf::Vector2f origin = window.getPosition();
 
-        title.setPosition(
-            window.getPosition().x + (windowBounds.width - title.getLocalBounds().width) / 2,
-            window.getPosition().y + 15);
-
-        closeButton.setPosition(
-            window.getPosition().x + windowBounds.width - closeButton.getBounds().width - 20,
-            window.getPosition().y + 15);
-
-        timerText.setPosition(
-            window.getPosition().x + (windowBounds.width - timerText.getLocalBounds().width) / 2,
-            window.getPosition().y + 70);
-
-        playerHealthBarBack.setPosition(
-            window.getPosition().x + 20,
-            window.getPosition().y + 70);
-
-        playerHealthBar.setPosition(
-            window.getPosition().x + 20,
-            window.getPosition().y + 70);
-
-        playerHealthText.setPosition(
-            window.getPosition().x + 20 + (200 - playerHealthText.getLocalBounds().width) / 2,
-            window.getPosition().y + 70);
-
-        enemyHealthBarBack.setPosition(
-            window.getPosition().x + windowBounds.width - 220,
-            window.getPosition().y + 70);
-
-        enemyHealthBar.setPosition(
-            window.getPosition().x + windowBounds.width - 220,
-            window.getPosition().y + 70);
-
-        enemyHealthText.setPosition(
-            window.getPosition().x + windowBounds.width - 220 + (200 - enemyHealthText.getLocalBounds().width) / 2,
-            window.getPosition().y + 70);
+        title.setPosition(origin.x + (windowBounds.width - title.getLocalBounds().width) / 2, origin.y + 15);
+        closeButton.setPosition(origin.x + windowBounds.width - closeButton.getBounds().width - 20, origin.y + 15);
+        timerText.setPosition(origin.x + (windowBounds.width - timerText.getLocalBounds().width) / 2, origin.y + 70);
+        countText[PLAYER].setPosition(origin.x + 20, origin.y + 70);
+        countText[ENEMY].setPosition(origin.x + windowBounds.width - countText[ENEMY].getLocalBounds().width - 20,
+                                     origin.y + 70);
+        hintText.setPosition(origin.x + 20, origin.y + windowBounds.height - 40);
+        arenaBack.setPosition(origin.x + arenaBounds.left, origin.y + arenaBounds.top);
 
         targetWindow.draw(window);
         targetWindow.draw(title);
 
         if (!gameOver)
         {
-            for (int i = 0; i < obstacleCount; i++)
-            {
-                sf::Vector2f pos = obstacles[i].getPosition();
-                obstacles[i].setPosition(window.getPosition().x + pos.x, window.getPosition().y + pos.y);
-                targetWindow.draw(obstacles[i]);
-                obstacles[i].setPosition(pos);
-            }
-
-            sf::Vector2f playerPos = playerSprite.getPosition();
-            playerSprite.setPosition(window.getPosition().x + playerPos.x, window.getPosition().y + playerPos.y);
-            targetWindow.draw(playerSprite);
-            playerSprite.setPosition(playerPos);
-
-            sf::Vector2f enemyPos = enemySprite.getPosition();
-            enemySprite.setPosition(window.getPosition().x + enemyPos.x, window.getPosition().y + enemyPos.y);
-            targetWindow.draw(enemySprite);
-            enemySprite.setPosition(enemyPos);
-
-            for (int i = 0; i < playerAbilityCount; i++)
-            {
-                sf::Vector2f pos = playerAbilities[i].projectile.getPosition();
-                playerAbilities[i].projectile.setPosition(window.getPosition().x + pos.x, window.getPosition().y + pos.y);
-                targetWindow.draw(playerAbilities[i].projectile);
-                playerAbilities[i].projectile.setPosition(pos);
-            }
-
-            for (int i = 0; i < enemyAbilityCount; i++)
-            {
-                sf::Vector2f pos = enemyAbilities[i].projectile.getPosition();
-                enemyAbilities[i].projectile.setPosition(window.getPosition().x + pos.x, window.getPosition().y + pos.y);
-                targetWindow.draw(enemyAbilities[i].projectile);
-                enemyAbilities[i].projectile.setPosition(pos);
-            }
-
-            targetWindow.draw(playerHealthBarBack);
-            targetWindow.draw(enemyHealthBarBack);
-            targetWindow.draw(playerHealthBar);
-            targetWindow.draw(enemyHealthBar);
-            targetWindow.draw(playerHealthText);
-            targetWindow.draw(enemyHealthText);
+            targetWindow.draw(arenaBack);
+            buildBatches(origin);
+            targetWindow.draw(unitQuads);
+            targetWindow.draw(barQuads);
+            targetWindow.draw(shotQuads);
+            targetWindow.draw(countText[PLAYER]);
+            targetWindow.draw(countText[ENEMY]);
             targetWindow.draw(timerText);
+            targetWindow.draw(hintText);
         }
         else
         {
@@ -2912,28 +10010,31 @@ public:
             gameOverText.setOutlineThickness(2.f);
             gameOverText.setOutlineColor(sf::Color::Black);
             gameOverText.setPosition(
-                window.getPosition().x + (windowBounds.width - gameOverText.getLocalBounds().width) / 2,
-                window.getPosition().y + windowBounds.height / 2 - 50);
+                origin.x + (windowBounds.width - gameOverText.getLocalBounds().width) / 2,
+                origin.y + windowBounds.height / 2 - 50);
 
-            sf::Text scoreText;
-            scoreText.setFont(font);
-            scoreText.setString(playerPet->getName() + ": " + std::to_string(playerHealth) +
-                                "  |  " + enemyPet->getName() + ": " + std::to_string(enemyHealth));
-            scoreText.setCharacterSize(36);
-            scoreText.setFillColor(sf::Color::White);
-            scoreText.setOutlineThickness(1.f);
-            scoreText.setOutlineColor(sf::Color::Black);
-            scoreText.setPosition(
-                window.getPosition().x + (windowBounds.width - scoreText.getLocalBounds().width) / 2,
-                window.getPosition().y + windowBounds.height / 2 + 20);
+            countText[PLAYER].setPosition(origin.x + windowBounds.width / 2 - 220, origin.y + windowBounds.height / 2 + 40);
+            countText[ENEMY].setPosition(origin.x + windowBounds.width / 2 + 40, origin.y + windowBounds.height / 2 + 40);
 
             targetWindow.draw(gameOverText);
-            targetWindow.draw(scoreText);
+            targetWindow.draw(countText[PLAYER]);
+            targetWindow.draw(countText[ENEMY]);
         }
 
         closeButton.draw(targetWindow);
     }
+
+    // fixed seed for a reproducible match, call before open()
+    void setSeed(uint64_t seed) { random.setSeed(seed); }
+    uint64_t getSeed() const { return random.getSeed(); }
+
+    void setSquadSize(int size) { squadSize = std::clamp(size, 1, MAX_SQUAD); }
+    void setJobSystem(JobSystem *pool) { jobs = pool; }
                                                 // getter
+    int getUnitCount() const { return static_cast<int>(units.size()); }
+    int getLivingCount(int guild) const { return static_cast<int>(living[guild].size()); }
+    bool hasPlayerWon() const { return playerWon; }
+    bool isOver() const { return gameOver; }
     bool isOpen() const { return isActive; }
     void close() { isActive = false; }
 };
@@ -3095,8 +10196,6 @@ public:
 class TrainingGame
 {
 private:
-    static const int MAX_PROJECTILES = 50;
-
     sf::RectangleShape window;
     sf::RectangleShape backgroundDim;
     sf::Text title;
@@ -3104,35 +10203,25 @@ private:
     Button backButton;
     sf::Font font;
 
-    sf::Texture playerTexture;
-    sf::Sprite playerSprite;
-    sf::Texture enemyTexture;
-    sf::Sprite enemySprite;
+    // the rules own both pets and their shots, this class turns the mouse and Space into input, draws the world and pays out
+    SessionArena memory; // the round's world lives here until close()
+    TrainingRound round{memory.resource()};
+    sf::Sprite looks[TrainingRound::LOOK_COUNT];
+    uint64_t nextSeed;
+    int lastMouseY; // what the last update() fed the round, a replay records it
+    uint8_t lastButtons;
 
-    sf::Texture playerProjectileTexture;
-    sf::Sprite playerProjectiles[MAX_PROJECTILES];
-    int playerProjectileCount;
-
-    sf::Texture enemyProjectileTexture;
-    sf::Sprite enemyProjectiles[MAX_PROJECTILES];
-    int enemyProjectileCount;
-
-    int playerScore;
-    int enemyScore;
     sf::Text playerScoreText;
     sf::Text enemyScoreText;
+    HudNumber shownPlayerScore;
+    HudNumber shownEnemyScore;
     sf::Text timerText;
+    HudNumber shownTime;
     sf::Text gameOverText;
     sf::Text resultText;
     Button continueButton;
 
-    sf::Clock projectileClock;
-    sf::Clock enemyMoveClock;
-    sf::Clock gameTimer;
     bool isActive;
-    float playerSpeed;
-    float enemySpeed;
-    int gameDuration;
     bool gameOver;
     Pet *trainedPet;
 
@@ -3143,66 +10232,22 @@ private:
     sf::SoundBuffer hitSoundBuffer;
     sf::Sound hitSound;
 
-    void removeBackground(sf::Image &image, const std::string &filename)
-    {
-        if (filename.find("unicorn") != std::string::npos)
-        {
-            return;
-        }
-
-        sf::Color backgroundColor = image.getPixel(0, 0);
-
-        for (unsigned int y = 0; y < image.getSize().y; ++y)
-        {
-            for (unsigned int x = 0; x < image.getSize().x; ++x)
-            {
-                sf::Color pixel = image.getPixel(x, y);
-                if (abs(pixel.r - backgroundColor.r) < 30 &&
-                    abs(pixel.g - backgroundColor.g) < 30 &&
-                    abs(pixel.b - backgroundColor.b) < 30)
-                {
-                    pixel.a = 0;
-                    image.setPixel(x, y, pixel);
-                }
-            }
-        }
-    }
-
-    void resetPositions()
-    {
-        float playerX = window.getPosition().x + window.getSize().x * 0.21f;
-        float playerY = window.getPosition().y + (window.getSize().y - playerSprite.getGlobalBounds().height) / 2;
-        playerSprite.setPosition(playerX, playerY);
-
-        float enemyX = window.getPosition().x + window.getSize().x * 1.2f;
-        float enemyY = window.getPosition().y + (window.getSize().y - enemySprite.getGlobalBounds().height) / 2;
-        enemySprite.setPosition(enemyX, enemyY);
-    }
-
-    void addPlayerProjectile()
-    {
-        if (playerProjectileCount < MAX_PROJECTILES)
-        {
-            playerProjectiles[playerProjectileCount] = sf::Sprite(playerProjectileTexture);
-            playerProjectiles[playerProjectileCount].setPosition(
-                playerSprite.getPosition().x + playerSprite.getGlobalBounds().width,
-                playerSprite.getPosition().y + playerSprite.getGlobalBounds().height / 2 - 15);
-            playerProjectiles[playerProjectileCount].setScale(0.4f, 0.4f);
-            playerProjectileCount++;
-        }
+    // sprites are stretched over the boxes the rules collide, so what you see is what gets hit
+    static void fitTo(sf::Sprite &sprite, const sf::Texture &texture, const sf::Vector2f &size)
+    {
+        sprite.setTexture(texture, true);
+        sprite.setScale(size.x / texture.getSize().x, size.y / texture.getSize().y);
     }
 
-    void addEnemyProjectile()
+    // the round picks the sparring partner when it starts, so the pictures are chosen after that, from the species' shared textures
+    void setupLooks()
     {
-        if (enemyProjectileCount < MAX_PROJECTILES)
-        {
-            enemyProjectiles[enemyProjectileCount] = sf::Sprite(enemyProjectileTexture);
-            enemyProjectiles[enemyProjectileCount].setPosition(
-                enemySprite.getPosition().x,
-                enemySprite.getPosition().y + enemySprite.getGlobalBounds().height / 2 - 15);
-            enemyProjectiles[enemyProjectileCount].setScale(0.4f, 0.4f);
-            enemyProjectileCount++;
-        }
+        int playerSpecies = round.getTrainee().speciesId;
+        int enemySpecies = round.getEnemySpecies();
+        fitTo(looks[TrainingRound::LOOK_PLAYER], Species::texture(playerSpecies), TrainingRound::petSize(playerSpecies));
+        fitTo(looks[TrainingRound::LOOK_ENEMY], Species::texture(enemySpecies), TrainingRound::petSize(enemySpecies));
+        fitTo(looks[TrainingRound::LOOK_PLAYER_SHOT], Species::projectileTexture(playerSpecies), Species::info(playerSpecies).shotSize);
+        fitTo(looks[TrainingRound::LOOK_ENEMY_SHOT], Species::projectileTexture(Species::GRIFFIN), Species::info(Species::GRIFFIN).shotSize);
     }
 
     void setupTextElements()
@@ -3222,7 +10267,7 @@ private:
         enemyScoreText.setOutlineColor(sf::Color::Black);
 
         timerText.setFont(font);
-        timerText.setString("TIME: " + std::to_string(gameDuration));
+        timerText.setString("TIME: " + std::to_string(TrainingRound::DURATION_SECONDS));
         timerText.setCharacterSize(28);
         timerText.setFillColor(sf::Color(255, 215, 0));
         timerText.setOutlineThickness(1.f);
@@ -3253,26 +10298,15 @@ private:
     }
 
 public:
-    TrainingGame() : isActive(false), playerScore(0), enemyScore(0),                // constructor
-                     playerSpeed(0), enemySpeed(1.5f), gameDuration(60),
-                     gameOver(false), trainedPet(nullptr),
-                     playerProjectileCount(0), enemyProjectileCount(0),
-                     oldLevel(1)
+    TrainingGame() : nextSeed(BattleRandom::freshSeed()), lastMouseY(0), lastButtons(0), isActive(false), // constructor
+                     gameOver(false), trainedPet(nullptr), oldLevel(1)
     {
     }
 
-    std::string getRandomEnemyTexture(Pet *playerPet)
+    // what the round needs to know about a pet
+    static Trainee traineeOf(const Pet *pet)
     {
-        std::string playerType = playerPet->getType();
-        int count = 0;
-        std::string enemies[4];
-
-        if (playerType != "Fire")
-            enemies[count++] = "dragon1.png";
-        if (playerType != "Ice")
-            enemies[count++] = "phoneix1.png";
-
-        return (count == 0) ? "dragon1.png" : enemies[rand() % count];
+        return Trainee{pet->getSpeciesId(), pet->getLevel(), pet->getAttack(), pet->getSpeed()};
     }
 
     void setup(const sf::Font &gameFont, Pet *petToTrain)
@@ -3281,7 +10315,7 @@ public:
         trainedPet = petToTrain;
 
         backgroundDim.setFillColor(sf::Color(0, 0, 0, 180));
-        window.setSize(sf::Vector2f(900, 600));
+        window.setSize(sf::Vector2f(TrainingRound::WIDTH, TrainingRound::HEIGHT));
         window.setFillColor(sf::Color(40, 40, 50, 240));
         window.setOutlineThickness(4.f);
         window.setOutlineColor(sf::Color(255, 215, 0));
@@ -3299,76 +10333,6 @@ public:
                              sf::Color(255, 150, 150),
                              sf::Color(200, 50, 50));
 
-        std::string playerTexFile, projectileTexFile;
-
-        if (trainedPet->getType() == "Fire")
-        {
-            playerTexFile = "dragon1.png";
-            projectileTexFile = "fire1.png";
-        }
-        else if (trainedPet->getType() == "Ice")
-        {
-            playerTexFile = "phoneix1.png";
-            projectileTexFile = "ice1.png";
-        }
-        else if (trainedPet->getType() == "Electric")
-        {
-            playerTexFile = "griffin1.png";
-            projectileTexFile = "lightning.png";
-        }
-        else
-        {
-            playerTexFile = "unicorn1.png";
-            projectileTexFile = "magic.png";
-        }
-
-        if (!playerTexture.loadFromFile(playerTexFile))
-        {
-            sf::Image placeholder;
-            placeholder.create(150, 150, sf::Color::Magenta);
-            playerTexture.loadFromImage(placeholder);
-        }
-        else
-        {
-            sf::Image playerImg = playerTexture.copyToImage();
-            removeBackground(playerImg, playerTexFile); 
-            playerTexture.loadFromImage(playerImg);
-        }
-
-        playerSprite.setTexture(playerTexture);
-        float scale = (window.getSize().y * 0.12f) / playerSprite.getLocalBounds().height;
-        playerSprite.setScale(scale, scale);
-
-        std::string enemyTexFile = getRandomEnemyTexture(trainedPet);
-        if (!enemyTexture.loadFromFile(enemyTexFile))
-        {
-            sf::Image placeholder;
-            placeholder.create(150, 150, sf::Color::Cyan);
-            enemyTexture.loadFromImage(placeholder);
-        }
-        else
-        {
-            sf::Image enemyImg = enemyTexture.copyToImage();
-            removeBackground(enemyImg, enemyTexFile); 
-            enemyTexture.loadFromImage(enemyImg);
-        }
-        enemySprite.setTexture(enemyTexture);
-        enemySprite.setScale(scale, scale);
-
-        if (!playerProjectileTexture.loadFromFile(projectileTexFile))
-        {
-            sf::Image placeholder;
-            placeholder.create(50, 20, sf::Color::Yellow);
-            playerProjectileTexture.loadFromImage(placeholder);
-        }
-
-        if (!enemyProjectileTexture.loadFromFile("lightning.png"))
-        {
-            sf::Image placeholder;
-            placeholder.create(50, 20, sf::Color::Blue);
-            enemyProjectileTexture.loadFromImage(placeholder);
-        }
-
         if (!fireSoundBuffer.loadFromFile("fire.wav"))
         {
             std::cerr << "Error loading fire sound!" << std::endl;
@@ -3382,7 +10346,6 @@ public:
         hitSound.setBuffer(hitSoundBuffer);
 
         setupTextElements();
-        resetPositions();
     }
 
     void update(const sf::Vector2f &mousePos)
@@ -3408,141 +10371,17 @@ public:
             return;
         }
 
-        int remainingTime = gameDuration - gameTimer.getElapsedTime().asSeconds();
-        remainingTime = std::max(0, remainingTime);
-        timerText.setString("TIME: " + std::to_string(remainingTime));
+        // the round works in window coordinates, Space fires when the cooldown allows
+        lastMouseY = static_cast<int>(mousePos.y - window.getPosition().y);
+        lastButtons = sf::Keyboard::isKeyPressed(sf::Keyboard::Space) ? BUTTON_FIRE : 0;
+        round.step(lastMouseY, lastButtons);
 
-        if (remainingTime <= 0 && !gameOver)
+        shownTime.set(timerText, "TIME: ", round.getRemainingSeconds());
+        shownPlayerScore.set(playerScoreText, trainedPet->getName(), round.getPlayerScore());
+        shownEnemyScore.set(enemyScoreText, "ENEMY: ", round.getEnemyScore());
+        if (round.isOver())
         {
             endGame();
-            return;
-        }
-
-        float newY = mousePos.y - playerSprite.getGlobalBounds().height / 2;
-        float minY = window.getPosition().y + 80;
-        float maxY = window.getPosition().y + window.getSize().y - playerSprite.getGlobalBounds().height - 80;
-        playerSprite.setPosition(playerSprite.getPosition().x, std::clamp(newY, minY, maxY));
-
-        // Enemy AI movement
-        if (enemyMoveClock.getElapsedTime().asSeconds() > 0.5f)
-        {
-            int aiChoice = rand() % 100;
-            if (aiChoice < 40)
-            {
-                enemySpeed = (playerSprite.getPosition().y - enemySprite.getPosition().y) * 0.05f;
-            }
-            else if (aiChoice < 70)
-            {
-                enemySpeed = ((rand() % 100) / 50.0f) - 1.0f;
-            }
-            else
-            {
-                enemySpeed = 0;
-            }
-            enemyMoveClock.restart();
-        }
-
-        enemySprite.move(0, enemySpeed * 3.0f);
-        float enemyMinY = window.getPosition().y + 80;
-        float enemyMaxY = window.getPosition().y + window.getSize().y - enemySprite.getGlobalBounds().height - 80;
-        enemySprite.setPosition(enemySprite.getPosition().x,
-                                std::clamp(enemySprite.getPosition().y, enemyMinY, enemyMaxY));
-
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Space) && projectileClock.getElapsedTime().asSeconds() > 0.2f)
-        {
-            addPlayerProjectile();
-            projectileClock.restart();
-        }
-
-        // Enemy shooting
-        if (rand() % 100 < 2 + trainedPet->getLevel() / 5)
-        {
-            addEnemyProjectile();
-        }
-
-        updateProjectiles();
-    }
-
-    void updateProjectiles()
-    {
-        float playerProjectileSpeed = 15.0f + trainedPet->getSpeed() * 0.5f;
-        for (int i = 0; i < playerProjectileCount; i++)
-        {
-            playerProjectiles[i].move(playerProjectileSpeed, 0);
-        }
-
-        float enemyProjectileSpeed = 12.0f;
-        for (int i = 0; i < enemyProjectileCount; i++)
-        {
-            enemyProjectiles[i].move(-enemyProjectileSpeed, 0);
-        }
-
-        auto removeIf = [](auto &array, int &count, auto predicate)
-        {
-            for (int i = 0; i < count;)
-            {
-                if (predicate(array[i]))
-                {
-                    for (int j = i; j < count - 1; j++)
-                        array[j] = array[j + 1];
-                    count--;
-                }
-                else
-                {
-                    i++;
-                }
-            }
-        };
-
-        removeIf(playerProjectiles, playerProjectileCount, [this](const auto &proj)
-                 { return proj.getPosition().x > window.getPosition().x + window.getSize().x; });
-
-        removeIf(enemyProjectiles, enemyProjectileCount, [this](const auto &proj)
-                 { return proj.getPosition().x + proj.getGlobalBounds().width < window.getPosition().x; });
-
-        checkCollisions(); // check for collisions
-    }
-
-    void checkCollisions()
-    {
-        sf::FloatRect enemyRect = enemySprite.getGlobalBounds();
-        for (int i = 0; i < playerProjectileCount;)
-        {
-            if (enemyRect.intersects(playerProjectiles[i].getGlobalBounds()))
-            {
-                playerScore += 10 + trainedPet->getAttack() / 2;
-                playerScoreText.setString(trainedPet->getName() + ": " + std::to_string(playerScore));
-
-                for (int j = i; j < playerProjectileCount - 1; j++)
-                {
-                    playerProjectiles[j] = playerProjectiles[j + 1];
-                }
-                playerProjectileCount--;
-            }
-            else
-            {
-                i++;
-            }
-        }
-
-        sf::FloatRect playerRect = playerSprite.getGlobalBounds();
-        for (int i = 0; i < enemyProjectileCount;)
-        {
-            if (playerRect.intersects(enemyProjectiles[i].getGlobalBounds()))
-            {
-                enemyScore += 10;
-                enemyScoreText.setString("ENEMY: " + std::to_string(enemyScore));
-
-                for (int j = i; j < enemyProjectileCount - 1; j++)
-                {
-                    enemyProjectiles[j] = enemyProjectiles[j + 1];
-                }
-                enemyProjectileCount--;
-            }
-            else
-            {
-                i++;
-            }
         }
     }
 
@@ -3550,8 +10389,8 @@ public:
     {
         gameOver = true;
 
-        int baseExp = std::min(playerScore, 50);
-        int timeBonus = (gameDuration - gameTimer.getElapsedTime().asSeconds()) / 2;
+        int baseExp = std::min(round.getPlayerScore(), 50);
+        int timeBonus = (TrainingRound::DURATION_SECONDS - round.getElapsedSeconds()) / 2;
         int totalExp = baseExp + timeBonus;
 
         totalExp = std::min(totalExp, 80);
@@ -3566,7 +10405,6 @@ public:
             window.getPosition().x + window.getSize().x / 2 - continueButton.getBounds().width / 2,
             window.getPosition().y + window.getSize().y - 100);
 
-        trainedPet->updateStats();
     }
 
     void draw(sf::RenderWindow &targetWindow)
@@ -3604,13 +10442,7 @@ public:
             targetWindow.draw(enemyScoreText);
             targetWindow.draw(timerText);
 
-            targetWindow.draw(playerSprite);
-            targetWindow.draw(enemySprite);
-
-            for (int i = 0; i < playerProjectileCount; i++)
-                targetWindow.draw(playerProjectiles[i]);
-            for (int i = 0; i < enemyProjectileCount; i++)
-                targetWindow.draw(enemyProjectiles[i]);
+            round.getWorld().draw(targetWindow, window.getPosition(), looks, TrainingRound::LOOK_COUNT);
         }
         else
         {
@@ -3640,20 +10472,19 @@ public:
     void open(Pet *petToTrain)
     {
         isActive = true;
-        playerScore = 0;
-        enemyScore = 0;
-        playerProjectileCount = 0;
-        enemyProjectileCount = 0;
+        shownTime.reset();
+        shownPlayerScore.reset();
+        shownEnemyScore.reset();
         gameOver = false;
         trainedPet = petToTrain;
         oldLevel = trainedPet->getLevel();
+        lastMouseY = 0;
+        lastButtons = 0;
 
-        projectileClock.restart();
-        enemyMoveClock.restart();
-        gameTimer.restart();
-
-        setup(font, petToTrain);
-        resetPositions();
+        round.start(traineeOf(trainedPet), nextSeed);
+        nextSeed = BattleRandom::freshSeed();
+        setupLooks();
+        setupTextElements();
 
         window.setPosition((800 - window.getSize().x) / 2, (600 - window.getSize().y) / 2);
     }
@@ -3680,12 +10511,20 @@ public:
         }
     }
 
+    // fixed seed for the next open(), which also picks the sparring partner from it
+    void setSeed(uint64_t seed) { nextSeed = seed; }
+    uint64_t getSeed() const { return round.getSeed(); }
+    const TrainingRound &getRound() const { return round; } // getter
+    int getLastMouseY() const { return lastMouseY; } // getter
+    uint8_t getLastButtons() const { return lastButtons; } // getter
+
     bool isOpen() const { return isActive; }
+    // the whole session's world goes back to the arena in one release
     void close()
     {
         isActive = false;
-        playerProjectileCount = 0;
-        enemyProjectileCount = 0;
+        round.release();
+        memory.release();
     }
 };
 
@@ -4121,8 +10960,8 @@ public:
 
 // ==================== SCOREBOARD CLASS ==================== //
 
-// This class manages a leaderboard of top 5 players by diamonds, using file I/O to persist data
-// It uses encapsulation to hide file operations and operator overloading for comparisons
+// This class shows the top 5 players by diamonds, read straight from the live Leaderboard so opening it needs no file I/O.
+// It uses encapsulation to hide the drawing details and operator overloading for comparisons
 class Scoreboard
 {
 private:
@@ -4140,98 +10979,33 @@ private:
 
     Entry entries[MAX_ENTRIES];
     sf::Font font;
-    std::string currentPlayer;
-    int currentDiamonds;
+    Leaderboard *leaderboard;
+    int shownVersion; // leaderboard version the entries were copied from
 
-    void loadAndSortEntries()
+    void refreshEntries()
     {
+        shownVersion = leaderboard ? leaderboard->getVersion() : -1;
         for (int i = 0; i < MAX_ENTRIES; i++)
         {
             entries[i] = {"-----", 0};
-        }
-
-        std::ifstream file("user_data.txt");
-        if (!file.is_open())
-            return;
-
-        std::string line;
-        int entryCount = 0;
-        Entry allEntries[100];
-        int totalUsers = 0;
-
-        while (std::getline(file, line))
-        {
-            if (line.find("Username: ") == 0)
-            {
-                std::string username = line.substr(10);
-
-                                            // Get diamonds
-                std::getline(file, line);
-                int diamonds = 0;
-                if (line.find("Diamonds: ") == 0)
-                {
-                    diamonds = std::stoi(line.substr(10));
-                }
-
-                for (int i = 0; i < 9 && std::getline(file, line); i++)
-                    ;
-
-                allEntries[totalUsers++] = {username, diamonds};
-            }
-        }
-        file.close();
-
-        bool currentPlayerExists = false;
-        for (int i = 0; i < totalUsers; i++)
-        {
-            if (allEntries[i].username == currentPlayer)
-            {
-                currentPlayerExists = true;
-                if (currentDiamonds > allEntries[i].diamonds)
-                {
-                    allEntries[i].diamonds = currentDiamonds;
-                }
-                break;
-            }
-        }
-        if (!currentPlayerExists && totalUsers < 100)
-        {
-            allEntries[totalUsers++] = {currentPlayer, currentDiamonds};
-        }
-
-        for (int i = 0; i < totalUsers - 1; i++)
-        {                                                                   // sorting
-            for (int j = 0; j < totalUsers - i - 1; j++)
+            if (leaderboard)
             {
-                if (allEntries[j + 1] < allEntries[j])
-                {
-                    Entry temp = allEntries[j];
-                    allEntries[j] = allEntries[j + 1];
-                    allEntries[j + 1] = temp;
-                }
+                leaderboard->getEntry(i + 1, entries[i].username, entries[i].diamonds);
             }
         }
-
-        for (int i = 0; i < MAX_ENTRIES && i < totalUsers; i++)
-        {                                                                       // only 5
-            entries[i] = allEntries[i];
-        }
     }
 
 public:
-    Scoreboard()
+    Scoreboard() : leaderboard(nullptr), shownVersion(-1)
     {
-        currentPlayer = "";
-        currentDiamonds = 0;
-        loadAndSortEntries();
+        refreshEntries();
     }
 
-    void setup(const sf::Font &gameFont, const std::string &playerName, int diamonds)
+    void setup(const sf::Font &gameFont, Leaderboard *board)
     {
         font = gameFont;
-        currentPlayer = playerName;
-        currentDiamonds = diamonds;
-        loadAndSortEntries();
+        leaderboard = board;
+        refreshEntries();
     }
 
     void draw(sf::RenderWindow &window)
@@ -4243,6 +11017,10 @@ public:
         background.setPosition(window.getSize().x / 2 - 300, window.getSize().y / 2 - 200);
         window.draw(background);
 
+        // only copy the top entries again after a score actually changed
+        if (leaderboard && leaderboard->getVersion() != shownVersion)
+            refreshEntries();
+
         sf::Text title("TOP PLAYERS", font, 48);
         title.setFillColor(sf::Color(255, 215, 0));
         title.setPosition(window.getSize().x / 2 - title.getLocalBounds().width / 2,
@@ -4326,6 +11104,14 @@ private:
     bool isMainMenu;
     bool isTrainingSelected = false;
 
+    EnemyPool enemyPool;
+    // the player's pets, one per species and indexed by species id, the pet windows only show copies of their records
+    std::unique_ptr<Pet> playerPets[Species::COUNT];
+
+    // the 2v2 team picked so far, per kingdom instead of in function statics
+    int teamPicks;
+    Pet *teamPets[2];
+
     float transitionTimer;
 
     std::string playerName;
@@ -4334,9 +11120,18 @@ private:
     sf::Text namePrompt;
     sf::Text nameDisplay;
     sf::RectangleShape nameInputBox;
-    sf::Clock cursorBlinkClock;
     bool showCursor;
 
+    enum UITimerEvent
+    {
+        EVENT_CURSOR_BLINK
+    };
+
+    static constexpr float SIM_STEP = 1.0f / TimerWheel::TICKS_PER_SECOND;
+    float simAccumulator;
+    TimerWheel uiTimers;
+    int cursorBlinkTimer;
+
     sf::RectangleShape mainMenuWindow;
     sf::Text mainMenuTitle;
     sf::Text welcomeText;
@@ -4347,11 +11142,20 @@ private:
 
     PetDisplay petDisplay;
     PetSelectionWindow petSelectionWindow;
-    TrainingGame trainingGame;
     BattleSelectionWindow battleSelectionWindow;
-    BattleGame battleGame;
-    Battle2v2Game battle2v2Game;
-
+    // a game is made when it starts and dropped once closed, nothing in it is shared, so any number could run at once like the arenas do
+    std::unique_ptr<TrainingGame> trainingGame;
+    std::unique_ptr<BattleGame> battleGame;
+    std::unique_ptr<Battle2v2Game> battle2v2Game;
+    GuildWarGame guildWarGame;
+
+    // the game being played is recorded as its seed and inputs, written out as <kind>_<seed>.replay when it ends or its window closes
+    BattleReplay replay;
+    std::string replayName; // empty while nothing records
+    ReplayWriter replayWriter;
+
+    Leaderboard leaderboard;
+    SaveWorker saveWorker;
     UserData userData;
     Inventory inventory;
 
@@ -4418,7 +11222,7 @@ private:
             centerButton(options[i], 0.4f + i * 0.15f);
         }
 
-        scoreboard.setup(font, playerName, userData.getDiamonds());
+        scoreboard.setup(font, &leaderboard);
     }
 
     void setupNameInput()
@@ -4536,16 +11340,6 @@ private:
         petSelectionWindow.setup(font);
         inventory.setup(font, &userData);
         battleSelectionWindow.setup(font);
-
-        Pet *pets[4] = {
-            new Dragon(),
-            new Phoenix(),
-            new Griffin(),
-            new Unicorn()};
-        for (int i = 0; i < 4; i++)
-        {
-            pets[i]->setup(font);
-        }
     }
 
     void centerButton(Button &button, float verticalRatio)
@@ -4612,8 +11406,7 @@ private:
             {
                 playerName += static_cast<char>(event.text.unicode);
             }
-            cursorBlinkClock.restart();
-            showCursor = true;
+            restartCursorBlink();
         }
         else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Enter)
         {
@@ -4623,6 +11416,7 @@ private:
                 isMainMenu = true;
                 userData.loadUserData(playerName);
                 setupMainMenu();
+                applyPetProgress();
             }
         }
     }
@@ -4643,14 +11437,10 @@ private:
                 }
             }
 
-            if (battle2v2Game.isOpen())
-            {
-                battle2v2Game.update();
-            }
-            else if (trainingGame.isOpen())
+            if (playing(trainingGame))
             {
-                trainingGame.handleInput(event, mousePos);
-                if (!trainingGame.isOpen())
+                trainingGame->handleInput(event, mousePos);
+                if (!playing(trainingGame))
                 {
                     isMainMenu = true;
                     userData.updateUserData();
@@ -4667,7 +11457,6 @@ private:
                 if (!inventory.isOpen())
                 {
                     updateDiamondDisplay();
-                    scoreboard.setup(font, playerName, userData.getDiamonds());
                 }
             }
             else if (petDisplay.isOpen())
@@ -4687,18 +11476,18 @@ private:
                  event.mouseButton.button == sf::Mouse::Left)
         {
 
-            if (battle2v2Game.isOpen())
+            if (playing(battle2v2Game))
             {
-                battle2v2Game.handleInput(event, mousePos);
-                if (!battle2v2Game.isOpen())
+                battle2v2Game->handleInput(event, mousePos);
+                if (!playing(battle2v2Game))
                 {
                     isMainMenu = true;
                 }
             }
-            else if (trainingGame.isOpen())
+            else if (playing(trainingGame))
             {
-                trainingGame.handleInput(event, mousePos);
-                if (!trainingGame.isOpen())
+                trainingGame->handleInput(event, mousePos);
+                if (!playing(trainingGame))
                 {
                     isMainMenu = true;
                 }
@@ -4724,13 +11513,10 @@ private:
                     }
                     else if (selected == 1)
                     {
-                        static int petsSelected = 0;
-                        static Pet *selectedPets[2] = {nullptr, nullptr};
-
-                        if (petsSelected < 2)
-                        {
-                            petSelectionWindow.open();
-                        }
+                        // a team left half picked from an earlier visit starts over
+                        teamPicks = 0;
+                        teamPets[0] = teamPets[1] = nullptr;
+                        petSelectionWindow.open();
                     }
                 }
             }
@@ -4738,102 +11524,50 @@ private:
             {
                 petSelectionWindow.handleInput(event, mousePos);
 
-                if (!petSelectionWindow.isOpen() && petSelectionWindow.getSelectedPet())
+                Pet *picked = selectedPet();
+                if (!petSelectionWindow.isOpen() && picked)
                 {
                     if (isTrainingSelected)
                     {
-                        trainingGame.setup(font, petSelectionWindow.getSelectedPet());
-                        trainingGame.open(petSelectionWindow.getSelectedPet());
+                        trainingGame.reset(new TrainingGame());
+                        trainingGame->setup(font, picked);
+                        trainingGame->open(picked);
                         isTrainingSelected = false;
                     }
                     if (battleSelectionWindow.getSelectedBattle() == 0)
                     {
-                        Pet *enemy;
-                        int enemyType = rand() % 4;
-                        switch (enemyType)
-                        {
-                        case 0:
-                            enemy = new Dragon();
-                            break;
-                        case 1:
-                            enemy = new Phoenix();
-                            break;
-                        case 2:
-                            enemy = new Griffin();
-                            break;
-                        case 3:
-                            enemy = new Unicorn();
-                            break;
-                        }
-                        enemy->setup(font);
-
-                        battleGame.setup(font, petSelectionWindow.getSelectedPet(), enemy);
-                        battleGame.open();
+                        Pet *enemy = enemyPool.acquire(rand() % Species::COUNT, 0);
+                        battleGame.reset(new BattleGame());
+                        battleGame->setup(font, picked, enemy);
+                        battleGame->open();
                     }
                     else if (battleSelectionWindow.getSelectedBattle() == 1)
                     {
-                        static int petsSelected = 0;
-                        static Pet *selectedPets[2] = {nullptr, nullptr};
+                        teamPets[teamPicks] = picked;
+                        teamPicks++;
 
-                        selectedPets[petsSelected] = petSelectionWindow.getSelectedPet();
-                        petsSelected++;
-
-                        if (petsSelected < 2)
+                        if (teamPicks < 2)
                         {
                             petSelectionWindow.open();
                         }
                         else
                         {
-                            Pet *enemy1;
-                            Pet *enemy2;
-                            int enemyType1 = rand() % 4;
-                            int enemyType2 = rand() % 4;
-
-                            switch (enemyType1)
-                            {
-                            case 0:
-                                enemy1 = new Dragon();
-                                break;
-                            case 1:
-                                enemy1 = new Phoenix();
-                                break;
-                            case 2:
-                                enemy1 = new Griffin();
-                                break;
-                            case 3:
-                                enemy1 = new Unicorn();
-                                break;
-                            }
-                            enemy1->setup(font);
-
-                            switch (enemyType2)
-                            {
-                            case 0:
-                                enemy2 = new Dragon();
-                                break;
-                            case 1:
-                                enemy2 = new Phoenix();
-                                break;
-                            case 2:
-                                enemy2 = new Griffin();
-                                break;
-                            case 3:
-                                enemy2 = new Unicorn();
-                                break;
-                            }
-                            enemy2->setup(font);
-
-                            battle2v2Game.setup(font, selectedPets[0], selectedPets[1], enemy1, enemy2);
-                            battle2v2Game.open();
-
-                            petsSelected = 0;
-                            selectedPets[0] = selectedPets[1] = nullptr;
+                            Pet *enemy1 = enemyPool.acquire(rand() % Species::COUNT, 0);
+                            Pet *enemy2 = enemyPool.acquire(rand() % Species::COUNT, 1);
+
+                            battle2v2Game.reset(new Battle2v2Game());
+                            battle2v2Game->setup(font, teamPets[0], teamPets[1], enemy1, enemy2);
+                            battle2v2Game->open();
+
+                            teamPicks = 0;
+                            teamPets[0] = teamPets[1] = nullptr;
                         }
                     }
                     else
                     {
-                        trainingGame.setup(font, petSelectionWindow.getSelectedPet());
-                        trainingGame.open(petSelectionWindow.getSelectedPet());
+                        trainingGame.reset(new TrainingGame());
+                        trainingGame->setup(font, picked);
+                        trainingGame->open(picked);
                     }
                 }
             }
@@ -4852,7 +11586,7 @@ private:
             isOptionsPage = false;
             isNameInput = true;
             playerName.clear();
-            cursorBlinkClock.restart();
+            restartCursorBlink();
             setupNameInput();
         }
         else if (selectedOption == 1) // continue
@@ -4860,7 +11594,7 @@ private:
             isOptionsPage = false;
             isNameInput = true;
             playerName.clear();
-            cursorBlinkClock.restart();
+            restartCursorBlink();
             setupNameInput();
         }
         else if (selectedOption == 2) // scoreboard
@@ -4882,11 +11616,18 @@ private:
             userData.addDiamonds(50);
             diamondText.setString(std::to_string(userData.getDiamonds()));
             userData.updateUserData();
-            diamondText.setString(std::to_string(userData.getDiamonds()));
-            scoreboard.setup(font, playerName, userData.getDiamonds());
             break;
         case 1: // guildwar
+        {
+            Pet *guildPets[Species::COUNT];
+            for (int i = 0; i < Species::COUNT; i++)
+            {
+                guildPets[i] = playerPets[i].get();
+            }
+            guildWarGame.setup(font, guildPets);
+            guildWarGame.open();
             break;
+        }
         case 2: // Training
             isTrainingSelected = true;
             petSelectionWindow.open();
@@ -4908,6 +11649,38 @@ private:
         diamondText.setString(std::to_string(userData.getDiamonds()));
     }
 
+    // the pet picked in the selection window, or nullptr
+    Pet *selectedPet()
+    {
+        int id = petSelectionWindow.getSelectedPet();
+        return (id >= 0 && id < Species::COUNT) ? playerPets[id].get() : nullptr;
+    }
+
+    // loads the saved progress into the player's pets and shows it in both pet windows
+    void applyPetProgress()
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            PetRecord state = userData.getPetState(i);
+            Pet *pet = playerPets[Species::record(state.speciesId).speciesId].get();
+            pet->setProgress(state.level, state.trainingPoints);
+            petSelectionWindow.setPet(pet->getProgress());
+            petDisplay.setPet(pet->getProgress());
+        }
+    }
+
+    // battles and training level up the player's pets, copy that back and save it
+    void savePetProgress()
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            Pet *pet = playerPets[Species::record(userData.getPetState(i).speciesId).speciesId].get();
+            userData.setPetState(i, pet->getLevel(), pet->getTrainingPoints());
+        }
+        applyPetProgress();
+        userData.updateUserData();
+    }
+
 public:
     MonsterPetKingdom() : window(sf::VideoMode(1280, 720), "Monster Pet Kingdom", sf::Style::Close),
                           isHomePage(true),
@@ -4915,11 +11688,22 @@ public:
                           isTransition(false),
                           isNameInput(false),
                           isMainMenu(false),
+                          teamPicks(0),
+                          teamPets{nullptr, nullptr},
                           transitionTimer(0.0f),
                           selectedOption(-1),
                           mainMenuSelected(-1),
-                          showCursor(true)
-    {
+                          showCursor(true),
+                          simAccumulator(0.0f),
+                          cursorBlinkTimer(-1)
+    {
+        for (int id = 0; id < Species::COUNT; id++)
+            playerPets[id].reset(EnemyPool::create(id));
+        leaderboard.load("user_data.txt");
+        userData.setLeaderboard(&leaderboard);
+        saveWorker.setDurabilityWindow(0.5f);
+        saveWorker.start("user_data.txt", "pet_data.dat");
+        userData.setSaveWorker(&saveWorker);
         loadResources();
         setupHomePage();
     }
@@ -4934,6 +11718,7 @@ public:
             update(deltaTime);
             render();
         }
+        shutdown();
     }
 
     void showScoreboard()
@@ -4965,6 +11750,13 @@ public:
     }
 
 private:
+    // every queued save must reach the disk before the process exits
+    void shutdown()
+    {
+        saveWorker.flush();
+        saveWorker.stop();
+    }
+
     void handleEvents()
     {
         sf::Event event;
@@ -4977,20 +11769,33 @@ private:
 
             mousePos = window.mapPixelToCoords(sf::Mouse::getPosition(window));
 
-            if (battle2v2Game.isOpen())
+            if (playing(battle2v2Game))
+            {
+                battle2v2Game->handleInput(event, mousePos);
+                if (!playing(battle2v2Game))
+                    savePetProgress();
+                continue;
+            }
+            else if (playing(battleGame))
             {
-                battle2v2Game.handleInput(event, mousePos);
+                battleGame->handleInput(event, mousePos);
+                if (!playing(battleGame))
+                    savePetProgress();
                 continue;
             }
-            else if (battleGame.isOpen())
+            else if (guildWarGame.isOpen())
             {
-                battleGame.handleInput(event, mousePos);
+                guildWarGame.handleInput(event, mousePos);
+                if (!guildWarGame.isOpen())
+                    savePetProgress();
                 continue;
             }
 
-            if (trainingGame.isOpen())
+            if (playing(trainingGame))
             {
-                trainingGame.handleInput(event, mousePos);
+                trainingGame->handleInput(event, mousePos);
+                if (!playing(trainingGame))
+                    savePetProgress();
                 continue;
             }
             if (inventory.isOpen())
@@ -5021,26 +11826,128 @@ private:
         }
     }
 
-    void update(float deltaTime)
+    void restartCursorBlink()
     {
-        mousePos = window.mapPixelToCoords(sf::Mouse::getPosition(window));
+        uiTimers.cancel(cursorBlinkTimer);
+        cursorBlinkTimer = uiTimers.schedule(TimerWheel::ticks(0.5f), EVENT_CURSOR_BLINK, TimerWheel::ticks(0.5f));
+        showCursor = true;
+    }
 
-        if (trainingGame.isOpen())
+    void onUITimer(int event)
+    {
+        if (event == EVENT_CURSOR_BLINK && isNameInput)
         {
-            trainingGame.update(mousePos);
+            showCursor = !showCursor;
         }
+    }
 
-        if (battle2v2Game.isOpen())
-        {
-            battle2v2Game.update();
+    template <typename Game>
+    static bool playing(const std::unique_ptr<Game> &game) { return game && game->isOpen(); }
+
+    // a closed game has handed out its rewards and been saved, its battle and pictures go with it
+    void dropClosedGames()
+    {
+        if (trainingGame && !trainingGame->isOpen())
+            trainingGame.reset();
+        if (battleGame && !battleGame->isOpen())
+            battleGame.reset();
+        if (battle2v2Game && !battle2v2Game->isOpen())
+            battle2v2Game.reset();
+    }
+
+    // a battle about to play its first tick starts a new recording
+    template <typename Battle>
+    void beginRecording(const Battle &battle, const char *kind)
+    {
+        if (battle.getTick() != 0)
+            return;
+        endRecording();
+        replay.begin(battle);
+        replay.checkpoint(battle);
+        replayName = kind + std::to_string(battle.getSeed()) + ".replay";
+    }
+
+    // the checksums were taken while the game played, so this only packs the input and hands the file to the writer thread
+    void endRecording()
+    {
+        if (replayName.empty())
             return;
+        replayWriter.submit(replayName, replay.encode());
+        replayName.clear();
+    }
+
+    // games advance in fixed ticks so their timers mean the same thing at any frame rate
+    // every tick a game plays is recorded with the input it was fed
+    void tick()
+    {
+        uiTimers.advance([this](int event) { onUITimer(event); });
+        dropClosedGames();
+
+        bool inPlay = false;
+        if (playing(trainingGame))
+        {
+            const TrainingRound &round = trainingGame->getRound();
+            beginRecording(round, "training_");
+            uint32_t played = round.getTick();
+            trainingGame->update(mousePos);
+            if (round.getTick() != played)
+            {
+                replay.record(trainingGame->getLastMouseY(), trainingGame->getLastButtons());
+                replay.checkpoint(round);
+            }
+            inPlay = !round.isOver();
         }
-        else if (battleGame.isOpen())
+
+        if (playing(battle2v2Game))
         {
-            battleGame.update();
-            return;
+            const TeamBattle &battle = battle2v2Game->getBattle();
+            beginRecording(battle, "team_");
+            uint32_t played = battle.getTick();
+            battle2v2Game->update();
+            if (battle.getTick() != played)
+            {
+                replay.record(battle2v2Game->getLastButtons());
+                replay.checkpoint(battle);
+            }
+            inPlay = !battle.isOver();
+        }
+        else if (playing(battleGame))
+        {
+            const DuelBattle &battle = battleGame->getBattle();
+            beginRecording(battle, "duel_");
+            uint32_t played = battle.getTick();
+            battleGame->update();
+            if (battle.getTick() != played)
+            {
+                replay.record(battleGame->getLastButtons());
+                replay.checkpoint(battle);
+            }
+            inPlay = !battle.isOver();
+        }
+        else if (guildWarGame.isOpen())
+        {
+            guildWarGame.update();
+        }
+
+        if (!inPlay)
+            endRecording();
+    }
+
+    void update(float deltaTime)
+    {
+        mousePos = window.mapPixelToCoords(sf::Mouse::getPosition(window));
+
+        simAccumulator += std::min(deltaTime, 0.25f); // a long stall is not replayed tick by tick
+        while (simAccumulator >= SIM_STEP)
+        {
+            simAccumulator -= SIM_STEP;
+            tick();
         }
 
+        if (playing(battle2v2Game) || playing(battleGame) || guildWarGame.isOpen())
+        {
+            return;
+        }
         else if (inventory.isOpen())
         {
             inventory.update(mousePos);
@@ -5066,14 +11973,6 @@ private:
                 options[i].update(mousePos);
             }
         }
-        else if (isNameInput)
-        {
-            if (cursorBlinkClock.getElapsedTime().asSeconds() > 0.5f)
-            {
-                showCursor = !showCursor;
-                cursorBlinkClock.restart();
-            }
-        }
         else if (isMainMenu)
         {
             for (int i = 0; i < 6; i++)
@@ -5108,17 +12007,21 @@ private:
             }
         }
 
-        if (battle2v2Game.isOpen())
+        if (playing(battle2v2Game))
         {
-            battle2v2Game.draw(window);
+            battle2v2Game->draw(window);
         }
-        else if (battleGame.isOpen())
+        else if (playing(battleGame))
         {
-            battleGame.draw(window);
+            battleGame->draw(window);
         }
-        else if (trainingGame.isOpen())
+        else if (guildWarGame.isOpen())
         {
-            trainingGame.draw(window);
+            guildWarGame.draw(window);
+        }
+        else if (playing(trainingGame))
+        {
+            trainingGame->draw(window);
         }
         else if (petDisplay.isOpen())
         {
@@ -5205,8 +12108,29 @@ private:
 
 // ----------- Main fxn -------------//
 
-int main()
+int main(int argc, char *argv[])
 {
+    if (argc > 1)
+    {
+        if (std::string(argv[1]) == "--selfplay")
+            return SelfPlay::runCommand(argc, argv);
+        if (std::string(argv[1]) == "--tournament")
+            return Tournament::runCommand(argc, argv);
+        if (std::string(argv[1]) == "--sweep")
+            return BalanceSweep::runCommand(argc, argv);
+        if (std::string(argv[1]) == "--server")
+            return BattleServer::runCommand(argc, argv);
+        if (std::string(argv[1]) == "--client")
+            return BattleClient::runCommand(argc, argv);
+        if (std::string(argv[1]) == "--rollback")
+            return RollbackPeer::runCommand(argc, argv);
+        if (std::string(argv[1]) == "--replay")
+            return BattleReplay::runCommand(argc, argv);
+        if (std::string(argv[1]) == "--arenas")
+            return Arenas::runCommand(argc, argv);
+        return UserStore::runCommand(argc, argv);
+    }
+
     MonsterPetKingdom game;
     game.run();
     return 0;